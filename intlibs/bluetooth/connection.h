@@ -38,6 +38,7 @@ Software Foundation, 59 Temple Place - Suite 330, Boston, MA
 #include "btinit.h"
 
 class HttpConnection;
+class InetConnection;
 
 class Closable {
 public:
@@ -80,6 +81,9 @@ public:
 
 	virtual HttpConnection* http() { return NULL; }
 
+	//Returns non-NULL if reads and writes can be done directly on a socket.
+	virtual InetConnection* inet() { return NULL; }
+
 	//Reads exactly <len> bytes into <dst>.
 	//Returns >0 or CONNERR code.
 	int readFully(void* dst, int len);
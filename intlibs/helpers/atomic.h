@@ -0,0 +1,123 @@
+/* Copyright (C) 2009 Mobile Sorcery AB
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License, version 2, as published by
+the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING.  If not, write to the Free
+Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.
+*/
+
+#ifndef ATOMIC_H
+#define ATOMIC_H
+
+// Atomic operations on aligned 32-bit integers.
+// All of them are full memory barriers, except the Acquire and Release variants.
+
+#if defined(WIN32) || defined(_WIN32_WCE)
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+// Returns the new value.
+inline int atomicAdd(volatile int* p, int v) {
+	return InterlockedExchangeAdd((volatile LONG*)p, v) + v;
+}
+
+// Stores newVal in *p if *p == oldVal. Returns true if it did.
+inline bool atomicCompareAndSwap(volatile int* p, int oldVal, int newVal) {
+	return InterlockedCompareExchange((volatile LONG*)p, newVal, oldVal) == oldVal;
+}
+
+inline int atomicLoad(volatile int* p) {
+	return InterlockedCompareExchange((volatile LONG*)p, 0, 0);
+}
+
+inline void atomicStore(volatile int* p, int v) {
+	InterlockedExchange((volatile LONG*)p, v);
+}
+
+inline int atomicLoadAcquire(volatile int* p) {
+	return atomicLoad(p);
+}
+
+inline void atomicStoreRelease(volatile int* p, int v) {
+	atomicStore(p, v);
+}
+
+#elif defined(__GNUC__)
+
+inline int atomicAdd(volatile int* p, int v) {
+	return __sync_add_and_fetch(p, v);
+}
+
+inline bool atomicCompareAndSwap(volatile int* p, int oldVal, int newVal) {
+	return __sync_bool_compare_and_swap(p, oldVal, newVal);
+}
+
+#ifdef __ATOMIC_SEQ_CST
+inline int atomicLoad(volatile int* p) {
+	return __atomic_load_n(p, __ATOMIC_SEQ_CST);
+}
+
+inline void atomicStore(volatile int* p, int v) {
+	__atomic_store_n(p, v, __ATOMIC_SEQ_CST);
+}
+
+// Later loads and stores can't move before this load.
+inline int atomicLoadAcquire(volatile int* p) {
+	return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+// Earlier loads and stores can't move after this store.
+inline void atomicStoreRelease(volatile int* p, int v) {
+	__atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+#else	//older GCC
+inline int atomicLoad(volatile int* p) {
+	__sync_synchronize();
+	int v = *p;
+	__sync_synchronize();
+	return v;
+}
+
+inline void atomicStore(volatile int* p, int v) {
+	__sync_synchronize();
+	*p = v;
+	__sync_synchronize();
+}
+
+inline int atomicLoadAcquire(volatile int* p) {
+	int v = *p;
+	__sync_synchronize();
+	return v;
+}
+
+inline void atomicStoreRelease(volatile int* p, int v) {
+	__sync_synchronize();
+	*p = v;
+}
+#endif
+
+#else
+#error Unsupported platform
+#endif
+
+// Raises *p to v, if v is greater.
+inline void atomicMax(volatile int* p, int v) {
+	int old;
+	do {
+		old = atomicLoad(p);
+		if(old >= v)
+			return;
+	} while(!atomicCompareAndSwap(p, old, v));
+}
+
+#endif	//ATOMIC_H
@@ -20,6 +20,7 @@ Software Foundation, 59 Temple Place - Suite 330, Boston, MA
 
 #include <helpers/helpers.h>
 #include <helpers/CriticalSection.h>
+#include <helpers/atomic.h>
 
 using namespace MoSyncError;
 
@@ -69,4 +70,148 @@ private:
 	size_t mReadPos, mWritePos;
 };
 
+//A lock-free FIFO queue for one producer thread and one consumer thread,
+//implemented using a non-resizable circular buffer. Same interface as CircularFifo,
+//but put() drops the item instead of panicking when the queue is full.
+//The producer calls put(). The consumer calls get(), getMany() and clear().
+//Anyone may call count() and dropped(); the answer is approximate while the others work.
+template<class T, int size> class SpscFifo {
+public:
+	SpscFifo() : mReadPos(0), mWritePos(0), mDropped(0) {}
+
+	//returns false, and loses the item being put, but not the rest, if the queue is full.
+	//max count is capacity - 1.
+	bool put(const T& t) {
+		int pos = mWritePos;	//only the producer changes it
+		int next = pos + 1 == size ? 0 : pos + 1;
+		if(next == atomicLoadAcquire(&mReadPos)) {
+			atomicAdd(&mDropped, 1);
+			return false;
+		}
+		mBuf[pos] = t;
+		atomicStoreRelease(&mWritePos, next);
+		return true;
+	}
+	T get() {
+		int pos = mReadPos;	//only the consumer changes it
+		DEBUG_ASSERT(pos != atomicLoadAcquire(&mWritePos));
+		T t = mBuf[pos];
+		atomicStoreRelease(&mReadPos, pos + 1 == size ? 0 : pos + 1);
+		return t;
+	}
+	//Gets up to max items at once. Returns the number of items got.
+	int getMany(T* dst, int max) {
+		int pos = mReadPos;
+		int end = atomicLoadAcquire(&mWritePos);
+		int n = 0;
+		while(pos != end && n < max) {
+			dst[n++] = mBuf[pos];
+			pos = pos + 1 == size ? 0 : pos + 1;
+		}
+		atomicStoreRelease(&mReadPos, pos);
+		return n;
+	}
+	size_t count() {
+		int dif = atomicLoadAcquire(&mWritePos) - atomicLoadAcquire(&mReadPos);
+		return dif >= 0 ? dif : size + dif;
+	}
+	//throws away everything put so far.
+	void clear() {
+		atomicStoreRelease(&mReadPos, atomicLoadAcquire(&mWritePos));
+	}
+	//the number of items that put() has lost.
+	int dropped() {
+		return atomicLoad(&mDropped);
+	}
+private:
+	T mBuf[size];
+	//keep the producer's and the consumer's positions on separate cache lines.
+	volatile int mReadPos;
+	char mPad[64];
+	volatile int mWritePos;
+	volatile int mDropped;
+};
+
+//A lock-free FIFO queue for any number of producers and consumers,
+//implemented using a non-resizable circular buffer.
+//size must be a power of two.
+//Each slot has a sequence number that tells whether it is free, full or in use.
+template<class T, int size> class MpmcFifo {
+public:
+	MpmcFifo() : mWritePos(0), mReadPos(0) {
+		DEBUG_ASSERT((size & (size - 1)) == 0);
+		for(int i=0; i<size; i++) {
+			mSlots[i].seq = i;
+		}
+	}
+
+	//returns false if the queue is full.
+	bool put(const T& t) {
+		Slot* slot;
+		int pos = atomicLoad(&mWritePos);
+		while(true) {
+			slot = &mSlots[pos & (size - 1)];
+			int dif = diff(atomicLoad(&slot->seq), pos);
+			if(dif == 0) {
+				if(atomicCompareAndSwap(&mWritePos, pos, add(pos, 1)))
+					break;
+				pos = atomicLoad(&mWritePos);
+			} else if(dif < 0) {
+				return false;
+			} else {	//another thread took this slot.
+				pos = atomicLoad(&mWritePos);
+			}
+		}
+		slot->data = t;
+		atomicStore(&slot->seq, add(pos, 1));
+		return true;
+	}
+
+	//returns false if the queue is empty, or if the next item is still being put.
+	bool get(T& t) {
+		Slot* slot;
+		int pos = atomicLoad(&mReadPos);
+		while(true) {
+			slot = &mSlots[pos & (size - 1)];
+			int dif = diff(atomicLoad(&slot->seq), add(pos, 1));
+			if(dif == 0) {
+				if(atomicCompareAndSwap(&mReadPos, pos, add(pos, 1)))
+					break;
+				pos = atomicLoad(&mReadPos);
+			} else if(dif < 0) {
+				return false;
+			} else {
+				pos = atomicLoad(&mReadPos);
+			}
+		}
+		t = slot->data;
+		atomicStore(&slot->seq, add(pos, size));
+		return true;
+	}
+
+	//approximate, if other threads are using the queue.
+	size_t count() {
+		return diff(atomicLoad(&mWritePos), atomicLoad(&mReadPos));
+	}
+private:
+	struct Slot {
+		volatile int seq;
+		T data;
+	};
+
+	//the positions wrap around, so do their arithmetic unsigned.
+	static int add(int a, int b) {
+		return (int)((unsigned)a + (unsigned)b);
+	}
+	static int diff(int a, int b) {
+		return (int)((unsigned)a - (unsigned)b);
+	}
+
+	Slot mSlots[size];
+	//keep the two positions on separate cache lines.
+	volatile int mWritePos;
+	char mPad[64];
+	volatile int mReadPos;
+};
+
 #endif
@@ -25,6 +25,7 @@ Software Foundation, 59 Temple Place - Suite 330, Boston, MA
 #include "net_errors.h"
 #if defined(LINUX) || defined(DARWIN)
 #include <unistd.h>
+#include <sys/select.h>
 #endif
 
 using namespace MoSyncError;
@@ -50,7 +51,7 @@ int atoiLen(const char* str, int len);
 int readProtocolResponseCode(const char* protocolSlash, const char* line, int len) {
 	//check protocol
 	int responseCode = CONNERR_PROTOCOL;
-	if(len >= (int)sizeof("HTTP/x.x xxx") - 1) if(sstrcmp(line, protocolSlash) == 0) {
+	if(len >= (int)sizeof("HTTP/x.x xxx") - 1) if(strncmp(line, protocolSlash, strlen(protocolSlash)) == 0) {
 		//const char* line = baseLine + sizeof("HTTP/") - 1;
 		int pos = sizeof("HTTP/") - 1;
 		if(isdigit(line[pos++])) if(line[pos++] == '.') if(isdigit(line[pos++]))	if(line[pos++] == ' ')
@@ -485,8 +486,8 @@ ProtocolUrlParseResult parseProtocolURL(const char *parturl, u16 *port,
 //******************************************************************************
 
 ProtocolConnection::ProtocolConnection(Connection* transport, const std::string& path) :
-mState(SETUP), mTransport(transport), mPath(path), mPos(0), mSize(0),
-mHeadersSent(false)
+mState(SETUP), mTransport(transport), mHeadersSent(false), mReused(false),
+mPath(path), mPos(0), mSize(0)
 {
 	//spaces are not allowed in URLs.
 	MYASSERT(mPath.find(' ') == mPath.npos, ERR_URL_SPACE);
@@ -497,14 +498,46 @@ ProtocolConnection::~ProtocolConnection() {
 }
 
 void ProtocolConnection::close() {
-	if(mTransport)
+	if(mTransport) {
 		delete mTransport;
+		mTransport = NULL;
+	}
 }
 
 int ProtocolConnection::getAddr(MAConnAddr& addr) {
+	if(!mTransport)
+		return CONNERR_GENERIC;
 	return mTransport->getAddr(addr);
 }
 
+Connection* ProtocolConnection::releaseTransport(std::string& unread) {
+	unread.assign(mBuffer + mPos, mSize - mPos);
+	mPos = mSize = 0;
+	Connection* transport = mTransport;
+	mTransport = NULL;
+	return transport;
+}
+
+void ProtocolConnection::adoptTransport(Connection* transport, const std::string& unread) {
+	DEBUG_ASSERT(unread.size() < sizeof(mBuffer));
+	if(mTransport != transport)
+		delete mTransport;
+	mTransport = transport;
+	memcpy(mBuffer, unread.data(), unread.size());
+	mPos = 0;
+	mSize = unread.size();
+	mBuffer[mSize] = 0;
+	mReused = true;
+}
+
+int ProtocolConnection::reconnect() {
+	mTransport->close();
+	mPos = mSize = 0;
+	mHeadersSent = false;
+	mReused = false;
+	return mTransport->connect();
+}
+
 int ProtocolConnection::connect() {
 	TLTZ_PASS(mTransport->connect());
 	TLTZ_PASS(sendHeaders());
@@ -512,7 +545,7 @@ int ProtocolConnection::connect() {
 }
 
 bool ProtocolConnection::isConnected() {
-	return mTransport->isConnected();
+	return mTransport != NULL && mTransport->isConnected();
 }
 
 int ProtocolConnection::finish() {
@@ -596,10 +629,17 @@ int ProtocolConnection::readHeaders() {
 	return responseCode;
 }
 
+void ProtocolConnection::clearResponseHeaders() {
+	mResponseHeaders.clear();
+}
+
 //puts a pointer to a line in lineP.
 //a line is a zero-terminated string with no CR('\0xA', '\r') or LF('\0xD', '\n') bytes.
 //returns strlen or CONNERR.
 int ProtocolConnection::readLine(const char*& lineP) {
+	if(mPos == mSize) {	//everything read has been used; start over.
+		mPos = mSize = 0;
+	}
 	int startPos = mPos;
 	while(true) {
 		//either a CR, an LF, or a CRLF pair will terminate a line.
@@ -607,6 +647,10 @@ int ProtocolConnection::readLine(const char*& lineP) {
 			int oldPos = mPos;
 			switch(mBuffer[mPos]) {
 			case '\r':
+				if(mPos + 1 == mSize) {
+					//we need the next byte to tell if it's a CRLF pair.
+					goto readMore;
+				}
 				if(mBuffer[mPos+1] == '\n') {
 					//we got ourselves a good line
 					mPos++;
@@ -620,21 +664,23 @@ int ProtocolConnection::readLine(const char*& lineP) {
 				mPos++;
 			}
 		}
+readMore:
 
 		//something clever could be done here when we want to support arbitrarily large headers.
-		if(mPos == sizeof(mBuffer)) {
+		//one byte is kept for the terminating zero.
+		if(mSize == (int)sizeof(mBuffer) - 1) {
 			if(startPos == 0) {
 				LOG("header buffer full!\n");
 				return CONNERR_INTERNAL;
 			}
-			int size = mPos - startPos;
-			memcpy(mBuffer, mBuffer + startPos, size);
-			mPos = size;
+			memmove(mBuffer, mBuffer + startPos, mSize - startPos);
+			mPos -= startPos;
+			mSize -= startPos;
 			startPos = 0;
 		}
 
 		int res;
-		TLTZ_PASS(res = mTransport->read(mBuffer + mPos, sizeof(mBuffer) - mPos));
+		TLTZ_PASS(res = mTransport->read(mBuffer + mSize, sizeof(mBuffer) - 1 - mSize));
 		mSize += res;
 		mBuffer[mSize] = 0;	//for string functions
 	}
@@ -646,8 +692,10 @@ int ProtocolConnection::read(void* dst, int max) {
 		memcpy(dst, mBuffer + mPos, len);
 		mPos += len;
 		return len;
-	} else {	//we gotta read from outside
+	} else if(mTransport) {	//we gotta read from outside
 		return mTransport->read(dst, max);
+	} else {
+		return CONNERR_CLOSED;
 	}
 }
 
@@ -682,10 +730,11 @@ const std::string* ProtocolConnection::GetResponseHeader(std::string key) const
 
 HttpConnection::HttpConnection(Connection* transport, const std::string& hostname,
 	const std::string& path, int method) :
-ProtocolConnection(transport, path), mMethod(method)
+ProtocolConnection(transport, path), mMethod(method), mFraming(BODY_UNTIL_CLOSE),
+mBodyLeft(0), mBodyDone(false), mChunkEnd(false), mKeepAlive(false),
+mVersion11(false), mBodySent(false)
 {
 	SetRequestHeader("Host", hostname);
-	SetRequestHeader("Connection", "close");
 }
 
 std::string HttpConnection::methodString() {
@@ -706,17 +755,176 @@ std::string HttpConnection::methodString() {
 }
 
 std::string HttpConnection::protocolVersion() {
-	return "HTTP/1.0";
+	return "HTTP/1.1";
 }
 
 int HttpConnection::readResponseCode(const char* line, int len) {
 	int responseCode;
 	TLTZ_PASS(responseCode = readProtocolResponseCode("HTTP/", line, len));
+	mVersion11 = line[5] > '1' || (line[5] == '1' && line[7] >= '1');
+	return responseCode;
+}
+
+//true if the comma-separated header value contains the token.
+static bool headerHasToken(const std::string* value, const char* token) {
+	if(value == NULL)
+		return false;
+	std::string v(*value);
+	lower(v);
+	return v.find(token) != std::string::npos;
+}
+
+int HttpConnection::readHeaders() {
+	int responseCode;
+	while(true) {
+		TLTZ_PASS(responseCode = ProtocolConnection::readHeaders());
+		//skip interim responses, like 100 Continue.
+		if(responseCode >= 200 || responseCode == 101)
+			break;
+		clearResponseHeaders();
+		mState = FINISHING;
+	}
+
+	//find the end of the body.
+	const std::string* connection = GetResponseHeader("connection");
+	const std::string* contentLength = GetResponseHeader("content-length");
+	mKeepAlive = mVersion11 ? !headerHasToken(connection, "close") :
+		headerHasToken(connection, "keep-alive");
+	mBodyLeft = 0;
+	mBodyDone = false;
+	mChunkEnd = false;
+	if(mMethod == HTTP_HEAD || responseCode == 204 || responseCode == 304) {
+		mFraming = BODY_LENGTH;
+		mBodyDone = true;
+	} else if(responseCode == 101) {
+		mFraming = BODY_UNTIL_CLOSE;
+		mKeepAlive = false;
+	} else if(headerHasToken(GetResponseHeader("transfer-encoding"), "chunked")) {
+		mFraming = BODY_CHUNKED;
+	} else if(contentLength != NULL && isdigit((*contentLength)[0])) {
+		mFraming = BODY_LENGTH;
+		mBodyLeft = atoi(contentLength->c_str());
+		mBodyDone = (mBodyLeft == 0);
+	} else {
+		mFraming = BODY_UNTIL_CLOSE;
+		mKeepAlive = false;
+	}
 	return responseCode;
 }
 
+//reads the line before a chunk, and the trailer after the last chunk.
+int HttpConnection::readChunkSize() {
+	const char* line;
+	if(mChunkEnd) {
+		TLTZ_PASS(readLine(line));
+		if(line[0] != 0) {
+			LOG("bad chunk end: \"%s\"\n", line);
+			return CONNERR_PROTOCOL;
+		}
+		mChunkEnd = false;
+	}
+
+	//format: hex-size (';' extension)*
+	TLTZ_PASS(readLine(line));
+	char* end;
+	long size = strtol(line, &end, 16);
+	if(end == line || size < 0 || size > 0x7fffffff) {
+		LOG("bad chunk size: \"%s\"\n", line);
+		return CONNERR_PROTOCOL;
+	}
+	if(size == 0) {
+		//the trailer ends with an empty line.
+		do {
+			TLTZ_PASS(readLine(line));
+		} while(line[0] != 0);
+		mBodyDone = true;
+	}
+	mBodyLeft = (int)size;
+	return 1;
+}
+
+int HttpConnection::read(void* dst, int max) {
+	if(mFraming == BODY_UNTIL_CLOSE)
+		return ProtocolConnection::read(dst, max);
+	if(mBodyDone)
+		return CONNERR_CLOSED;
+	if(mFraming == BODY_CHUNKED && mBodyLeft == 0) {
+		TLTZ_PASS(readChunkSize());
+		if(mBodyDone)
+			return CONNERR_CLOSED;
+	}
+
+	int res;
+	TLTZ_PASS(res = ProtocolConnection::read(dst, MIN(max, mBodyLeft)));
+	mBodyLeft -= res;
+	if(mBodyLeft == 0) {
+		if(mFraming == BODY_LENGTH)
+			mBodyDone = true;
+		else
+			mChunkEnd = true;
+	}
+	return res;
+}
+
+int HttpConnection::connect() {
+	return finish();
+}
+
+int HttpConnection::sendRequest() {
+	if(!mHeadersSent) {
+		TLTZ_PASS(sendHeaders());
+	}
+	return 1;
+}
+
+int HttpConnection::readResponse() {
+	mState = FINISHING;
+	return readHeaders();
+}
+
+int HttpConnection::finish() {
+	int res = sendRequest();
+	if(res > 0)
+		res = readResponse();
+
+	//a transport that has been idle may have been closed by the server just as
+	//the request was sent. if there was nothing but headers, send them again
+	//on a new socket.
+	if(mReused && !mBodySent && (res == CONNERR_CLOSED || res == CONNERR_GENERIC)) {
+		LOG("HttpConnection: reused transport failed; reconnecting.\n");
+		clearResponseHeaders();
+		TLTZ_PASS(reconnect());
+		TLTZ_PASS(sendRequest());
+		res = readResponse();
+	}
+	return res;
+}
+
+int HttpConnection::sendRequestOn(Connection* transport) {
+	Connection* own = mTransport;
+	mTransport = transport;
+	int res = sendRequest();
+	mTransport = own;
+	return res;
+}
+
+int HttpConnection::finishOn(Connection* transport, const std::string& unread) {
+	if(transport) {
+		adoptTransport(transport, unread);
+	} else {
+		TLTZ_PASS(reconnect());
+	}
+	return finish();
+}
+
+bool HttpConnection::isReusable() const {
+	return mState == FINISHED && mBodyDone && mKeepAlive && mTransport != NULL &&
+		mTransport->isConnected();
+}
+
 int HttpConnection::write(const void* src, int len) {
 	MYASSERT(mMethod == HTTP_POST || mMethod == HTTP_PUT, ERR_HTTP_READONLY_WRITE);
+	mBodySent = true;
 	return ProtocolConnection::write(src, len);
 }
 
@@ -724,6 +932,81 @@ HttpConnection* HttpConnection::http() {
 	return this;
 }
 
+//******************************************************************************
+// HttpConnectionPool
+//******************************************************************************
+
+HttpConnectionPool::HttpConnectionPool(int maxIdle, int maxIdleSeconds)
+: mMaxIdle(maxIdle), mMaxIdleSeconds(maxIdleSeconds)
+{
+}
+
+HttpConnectionPool::~HttpConnectionPool() {
+	clear();
+}
+
+std::string HttpConnectionPool::key(const std::string& hostname, u16 port, bool ssl) {
+	char portString[16];
+	sprintf(portString, ":%i", port);
+	std::string k((ssl ? https_string : http_string) + hostname + portString);
+	lower(k);
+	return k;
+}
+
+//true if nothing has arrived on the socket, not even its end.
+static bool socketIsQuiet(MoSyncSocket sock) {
+	if(sock == INVALID_SOCKET)
+		return false;
+	fd_set fds;
+	FD_ZERO(&fds);
+	FD_SET(sock, &fds);
+	timeval timeout = { 0, 0 };
+	return select((int)sock + 1, &fds, NULL, NULL, &timeout) == 0;
+}
+
+TcpConnection* HttpConnectionPool::take(const std::string& key) {
+	time_t now = time(NULL);
+	for(int i = (int)mIdle.size() - 1; i >= 0; i--) {
+		if(mIdle[i].key != key)
+			continue;
+		Idle idle = mIdle[i];
+		mIdle.erase(mIdle.begin() + i);
+		if(now - idle.since <= mMaxIdleSeconds && socketIsQuiet(idle.transport->getSocket()))
+			return idle.transport;
+		delete idle.transport;
+	}
+	return NULL;
+}
+
+void HttpConnectionPool::give(const std::string& key, TcpConnection* transport) {
+	time_t now = time(NULL);
+	for(size_t i = 0; i < mIdle.size(); ) {
+		if(now - mIdle[i].since > mMaxIdleSeconds) {
+			delete mIdle[i].transport;
+			mIdle.erase(mIdle.begin() + i);
+		} else {
+			i++;
+		}
+	}
+	if(mMaxIdle <= 0) {
+		delete transport;
+		return;
+	}
+	if((int)mIdle.size() >= mMaxIdle) {
+		delete mIdle[0].transport;
+		mIdle.erase(mIdle.begin());
+	}
+	Idle idle = { key, transport, now };
+	mIdle.push_back(idle);
+}
+
+void HttpConnectionPool::clear() {
+	for(size_t i = 0; i < mIdle.size(); i++) {
+		delete mIdle[i].transport;
+	}
+	mIdle.clear();
+}
+
 //******************************************************************************
 // TcpServer
 //******************************************************************************
@@ -761,7 +1044,7 @@ int TcpServer::open(int port) {
 		return 0;
 	}
 
-	if(listen(mSock, 5)<0) {
+	if(listen(mSock, SOMAXCONN)<0) {
 		close();
 		return 0;
 	}
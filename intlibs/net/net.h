@@ -23,6 +23,8 @@ int readProtocolResponseCode(const char* protocolSlash, const char* line, int le
 #ifndef __SYMBIAN32__
 
 #include <string>
+#include <vector>
+#include <time.h>
 
 #include "helpers/types.h"
 #include "bluetooth/connection.h"
@@ -74,6 +76,8 @@ public:
 	virtual int write(const void* src, int len);
 	virtual void close();
 	int getAddr(MAConnAddr& addr);
+	InetConnection* inet() { return this; }
+	MoSyncSocket getSocket() const { return mSock; }
 protected:
 	MoSyncSocket mSock;
 	const std::string mHostname;
@@ -125,7 +129,16 @@ public:
 	//returns NULL if value doesn't exist. The returned pointer should be discarded ASAP.
 	const std::string* GetResponseHeader(std::string key) const;
 
-	int finish();	//calls sendHeaders if necessary. always calls readHeaders.
+	virtual int finish();	//calls sendHeaders if necessary. always calls readHeaders.
+
+	//Hands over the transport, and the bytes read from it that this connection
+	//hasn't used. After this, the connection has no transport.
+	Connection* releaseTransport(std::string& unread);
+	Connection* getTransport() const { return mTransport; }
+
+	//Replaces the transport with one that has been used before, and whose
+	//next bytes are \a unread. The old transport is deleted.
+	void adoptTransport(Connection* transport, const std::string& unread);
 
 	enum State {
 		SETUP=1, WRITING, FINISHING, FINISHED
@@ -137,22 +150,28 @@ protected:
 	virtual std::string pathString();
 	virtual int readResponseCode(const char* line, int len) = 0;
 
+	int readLine(const char*& lineP);
+	int sendHeaders();
+	virtual int readHeaders();
+	void clearResponseHeaders();
+
+	//Closes the transport and connects it again, to send the request anew.
+	int reconnect();
+
+	Connection* mTransport;
+	bool mHeadersSent;
+	bool mReused;	//the transport has carried a request before
+
 private:
 	typedef std::pair<std::string, std::string> HeaderPair;
 	typedef hash_map<std::string, std::string> HeaderMap;
 	typedef HeaderMap::iterator HeaderItr;
 	typedef HeaderMap::const_iterator HeaderItrC;
 
-	Connection* mTransport;
 	const std::string mPath;
 	char mBuffer[1024];
 	int mPos, mSize;
 	HeaderMap mRequestHeaders, mResponseHeaders;
-	bool mHeadersSent;
-
-	int readLine(const char*& lineP);
-	int sendHeaders();
-	int readHeaders();
 };
 
 enum ProtocolUrlParseResult {
@@ -163,10 +182,42 @@ enum ProtocolUrlParseResult {
 ProtocolUrlParseResult parseProtocolURL(const char *parturl, u16 *port,
 	u16 defaultPort, const char **path, std::string &address);
 
+//Speaks HTTP/1.1. The end of each response body is found from its
+//Content-Length or its chunks, so the transport can carry the next request
+//when the server keeps the connection open; reads past the end of the body
+//return CONNERR_CLOSED, just like the end of an HTTP/1.0 response.
 class HttpConnection : public ProtocolConnection {
 public:
 	HttpConnection(Connection* transport, const std::string& hostname,
 		const std::string& path, int method);
+
+	virtual int connect();
+	virtual int read(void* dst, int max);
+	virtual int finish();
+
+	//finish() in two steps, for pipelining: the request can be sent on a
+	//transport before the response to the request before it has been read.
+	int sendRequest();
+	int readResponse();
+
+	//Pipelining: sends the request on the transport of the connection before
+	//this one, while that connection's response is still being read.
+	//The transport is only borrowed.
+	int sendRequestOn(Connection* transport);
+	//Takes over the transport when the response before has been read, and
+	//reads this one. With a NULL transport, the request is sent again on a
+	//new one.
+	int finishOn(Connection* transport, const std::string& unread);
+
+	int getMethod() const { return mMethod; }
+
+	//True when the whole response body has been read.
+	bool isResponseDone() const { return mBodyDone; }
+
+	//True when the whole response body has been read and the server keeps the
+	//connection open, so the transport can carry another request.
+	bool isReusable() const;
+
 protected:
 	//ProtocolConnection
 	std::string methodString();
@@ -175,10 +226,60 @@ protected:
 	HttpConnection* http();
 
 	int readResponseCode(const char* line, int len);
+	int readHeaders();
 
 	virtual int write(const void* src, int len);
 
 	const int mMethod;
+
+private:
+	enum Framing {
+		BODY_LENGTH,	//mBodyLeft bytes
+		BODY_CHUNKED,	//mBodyLeft bytes left of the current chunk
+		BODY_UNTIL_CLOSE
+	};
+
+	int readChunkSize();
+
+	Framing mFraming;
+	int mBodyLeft;
+	bool mBodyDone;
+	bool mChunkEnd;	//the CRLF after a chunk hasn't been read yet
+	bool mKeepAlive;
+	bool mVersion11;
+	bool mBodySent;
+};
+
+//Idle HTTP transports, kept open for the next request to the same server.
+//It isn't thread safe; the runtime uses it under its connection mutex.
+class HttpConnectionPool {
+public:
+	HttpConnectionPool(int maxIdle = 8, int maxIdleSeconds = 15);
+	~HttpConnectionPool();
+
+	//The key of a server's transports.
+	static std::string key(const std::string& hostname, u16 port, bool ssl);
+
+	//Returns an idle transport for the key, or NULL. Transports the server
+	//has closed, or has sent anything on, are deleted instead.
+	TcpConnection* take(const std::string& key);
+
+	//Keeps the transport for the next request with the same key. If the pool
+	//is full, the transport that has been idle the longest is deleted.
+	void give(const std::string& key, TcpConnection* transport);
+
+	//Deletes all transports.
+	void clear();
+
+private:
+	struct Idle {
+		std::string key;
+		TcpConnection* transport;
+		time_t since;
+	};
+	std::vector<Idle> mIdle;	//oldest first
+	const int mMaxIdle;
+	const int mMaxIdleSeconds;
 };
 
 #define ANY_PORT (-1)
@@ -197,6 +298,8 @@ public:
 
 	int getAddr(MAConnAddr& addr);
 
+	MoSyncSocket getSocket() const { return mSock; }
+
 	TcpServer();
 	virtual ~TcpServer() { close(); }
 
@@ -19,6 +19,7 @@ Software Foundation, 59 Temple Place - Suite 330, Boston, MA
 #include "MemoryMgr.h"
 #include "MapCache.h"
 #include "MapTile.h"
+#include "MapTileStore.h"
 #include "MapSource.h"
 #include "LonLat.h"
 #include "MapTileCoordinate.h"
@@ -29,54 +30,6 @@ namespace MAP
 {
 	MapCache* MapCache::sSingleton = NULL;
 
-	//=========================================================================
-	class MapTileKey
-	//=========================================================================
-	{
-	public:
-		MapTileKey( ) { }
-
-		//---------------------------------------------------------------------
-		MapTileKey( MapSource* source, int gridX, int gridY, int magnification )
-		//---------------------------------------------------------------------
-		:	mSource( source ),
-			mGridX( gridX ),
-			mGridY( gridY ),
-			mMagnification( magnification )
-		{
-		}
-
-		MapSource* mSource;
-		int mGridX;
-		int mGridY;
-		int mMagnification;
-
-		bool operator==(const MapTileKey& c) const 
-		{
-			return mSource == c.mSource && mGridX == c.mGridX && mGridY == c.mGridY && mMagnification == c.mMagnification;
-		}
-
-		bool operator<(const MapTileKey& c) const 
-		{
-			return mSource < c.mSource && mGridX < c.mGridX && mGridY < c.mGridY && mMagnification < c.mMagnification;
-		}
-					
-	};
-}
-
-namespace MAUtil 
-{
-	//-------------------------------------------------------------------------
-	template<> 
-	hash_val_t THashFunction<MAP::MapTileKey>( const MAP::MapTileKey& data ) 
-	//-------------------------------------------------------------------------
-	{
-		return ((int)data.mSource) ^ data.mGridX ^ data.mGridY ^ data.mMagnification;
-	} 
-}
-
-namespace MAP
-{
 	//-------------------------------------------------------------------------
 	MapCache* MapCache::get( ) 
 	//-------------------------------------------------------------------------
@@ -100,9 +53,15 @@ namespace MAP
 	MapCache::MapCache( ) :
 	//-------------------------------------------------------------------------
 		mList( ),
+		mMostRecent( NULL ),
+		mLeastRecent( NULL ),
 		mHits( 0 ),
 		mMisses( 0 ),
-		mCapacity( MapCacheDefaultCapacity )
+		mStoreHits( 0 ),
+		mCapacity( MapCacheDefaultCapacity ),
+		mByteCapacity( MapCacheDefaultByteCapacity ),
+		mByteSize( 0 ),
+		mStore( NULL )
 	{
 	}
 
@@ -129,6 +88,7 @@ namespace MAP
 	//-------------------------------------------------------------------------
 	{ 
 		mCapacity = capacity;
+		trim( );
 	}
 
 	//-------------------------------------------------------------------------
@@ -138,6 +98,184 @@ namespace MAP
 		return mList.size( );
 	}
 
+	//-------------------------------------------------------------------------
+	int MapCache::getByteCapacity( ) const
+	//-------------------------------------------------------------------------
+	{
+		return mByteCapacity;
+	}
+
+	//-------------------------------------------------------------------------
+	void MapCache::setByteCapacity( int byteCapacity )
+	//-------------------------------------------------------------------------
+	{
+		mByteCapacity = byteCapacity;
+		trim( );
+	}
+
+	//-------------------------------------------------------------------------
+	int MapCache::getByteSize( ) const
+	//-------------------------------------------------------------------------
+	{
+		return mByteSize;
+	}
+
+	//-------------------------------------------------------------------------
+	MapTileStore* MapCache::getTileStore( ) const
+	//-------------------------------------------------------------------------
+	{
+		return mStore;
+	}
+
+	//-------------------------------------------------------------------------
+	void MapCache::setTileStore( MapTileStore* store )
+	//-------------------------------------------------------------------------
+	{
+		mStore = store;
+	}
+
+	//-------------------------------------------------------------------------
+	//
+	// Bytes of image data held by a tile
+	//
+	static int tileByteSize( MapTile* tile )
+	//-------------------------------------------------------------------------
+	{
+		#ifdef StoreCompressedTilesInCache
+		return tile->getContentLength( );
+		#else
+		MAExtent size = maGetImageSize( tile->getImage( ) );
+		return EXTENT_X( size ) * EXTENT_Y( size ) * 4;
+		#endif
+	}
+
+	//-------------------------------------------------------------------------
+	void MapCache::pushFront( MapTile* tile )
+	//-------------------------------------------------------------------------
+	{
+		tile->mPrev = NULL;
+		tile->mNext = mMostRecent;
+		if ( mMostRecent != NULL )
+			mMostRecent->mPrev = tile;
+		else
+			mLeastRecent = tile;
+		mMostRecent = tile;
+	}
+
+	//-------------------------------------------------------------------------
+	void MapCache::unlink( MapTile* tile )
+	//-------------------------------------------------------------------------
+	{
+		if ( tile->mPrev != NULL )
+			tile->mPrev->mNext = tile->mNext;
+		else
+			mMostRecent = tile->mNext;
+		if ( tile->mNext != NULL )
+			tile->mNext->mPrev = tile->mPrev;
+		else
+			mLeastRecent = tile->mPrev;
+		tile->mPrev = NULL;
+		tile->mNext = NULL;
+	}
+
+	//-------------------------------------------------------------------------
+	//
+	// Finds a tile in memory, and moves it first in the LRU list
+	//
+	MapTile* MapCache::find( const MapTileKey& key )
+	//-------------------------------------------------------------------------
+	{
+		HashMap<MapTileKey, MapTile*>::Iterator found = mList.find( key );
+		if ( found == mList.end( ) )
+			return NULL;
+
+		MapTile* t = found->second;
+		t->stamp( );
+		if ( t != mMostRecent )
+		{
+			unlink( t );
+			pushFront( t );
+		}
+		return t;
+	}
+
+	//-------------------------------------------------------------------------
+	//
+	// Adds a tile to memory, then drops tiles until within capacity
+	//
+	void MapCache::add( MapTile* tile )
+	//-------------------------------------------------------------------------
+	{
+		MapTileKey newKey = MapTileKey( tile->getMapSource( ), tile->getGridX( ), tile->getGridY( ), tile->getMagnification( ) );
+		//
+		// A tile can be downloaded twice if it was requested again while on its way.
+		// Keep the new one.
+		//
+		HashMap<MapTileKey, MapTile*>::Iterator found = mList.find( newKey );
+		if ( found != mList.end( ) )
+			remove( found->second );
+
+		tile->stamp( );
+		tile->mByteSize = tileByteSize( tile );
+		mList.insert( newKey, tile );
+		pushFront( tile );
+		mByteSize += tile->mByteSize;
+		trim( );
+	}
+
+	//-------------------------------------------------------------------------
+	//
+	// Drops least recently used tiles until within capacity.
+	// The most recently used tile is always kept.
+	//
+	void MapCache::trim( )
+	//-------------------------------------------------------------------------
+	{
+		while ( mLeastRecent != NULL && mLeastRecent != mMostRecent &&
+			( mByteSize > mByteCapacity || ( mCapacity > 0 && mList.size( ) > (unsigned int)mCapacity ) ) )
+		{
+			MapTile* oldest = mLeastRecent;
+			if ( mStore != NULL )
+				mStore->put( oldest );
+			remove( oldest );
+		}
+	}
+
+	//-------------------------------------------------------------------------
+	void MapCache::remove( MapTile* tile )
+	//-------------------------------------------------------------------------
+	{
+		unlink( tile );
+		mByteSize -= tile->mByteSize;
+		mList.erase( MapTileKey( tile->getMapSource( ), tile->getGridX( ), tile->getGridY( ), tile->getMagnification( ) ) );
+		deleteobject( tile );
+	}
+
+	//-------------------------------------------------------------------------
+	MapTile* MapCache::getTile( MapSource* source, int gridX, int gridY, int magnification )
+	//-------------------------------------------------------------------------
+	{
+		MapTileKey key = MapTileKey( source, gridX, gridY, magnification );
+		MapTile* t = find( key );
+		if ( t != NULL )
+		{
+			mHits++;
+			return t;
+		}
+		if ( mStore != NULL )
+		{
+			t = mStore->get( source, gridX, gridY, magnification );
+			if ( t != NULL )
+			{
+				mStoreHits++;
+				add( t );
+				return t;
+			}
+		}
+		mMisses++;
+		return NULL;
+	}
+
 	//
 	// Min, Max
 	//
@@ -211,87 +349,29 @@ namespace MAP
 				//
 				// In cache? Then immediately return tile in cache
 				//
-				MapTileKey key = MapTileKey( source, x, y, magnification );
-				HashMap<MapTileKey, MapTile*>::Iterator found = mList.find( key );
-
-				if ( found != mList.end( ) )
+				MapTile* t = getTile( source, x, y, (int)magnification );
+				if ( t != NULL )
 				{
-					HashMap<MapTileKey, MapTile*>::PairKV kv = *found;
-					mHits++;
-					MapTile* t = kv.second;
-					t->stamp( );
 					onTileReceived( t, true );
 					continue;
 				}
 				//
 				// Not in cache: request from map source.
 				//
-				mMisses++;
 				source->requestTile( this, MapTileCoordinate( x, y, (int)magnification ) );
 			}
 		}
 		source->requestJobComplete( this );
 	}
 
-	//-------------------------------------------------------------------------
-	MapTileKey MapCache::findLRU( )
-	//-------------------------------------------------------------------------
-	{
-		DateTime oldest = DateTime::maxValue( );
-		MapTileKey ret;
-		for ( HashMap<MapTileKey, MapTile*>::ConstIterator i = mList.begin( ); i != mList.end( ); i++ )
-		{
-			MapTile* t = i->second;
-			if ( t->getLastAccessTime( ) < oldest )
-			{
-				oldest = t->getLastAccessTime( );
-				ret = i->first;
-			}
-		}
-		return ret;
-	}
-
 	//-------------------------------------------------------------------------
 	void MapCache::tileReceived( MapSource* sender, MapTile* tile )
 	//-------------------------------------------------------------------------
 	{
-#if 0 // this block tries to test if memory is available
-
-		//
-		// try to alloc something bigger than a tile
-		//
-		MAHandle placeholder = maCreatePlaceholder( );
-		int res = maCreateData( placeholder, 1 << 20 );
 		//
-		// Cleanup after test
+		// Add to cache, dropping the least recently used tiles if it is full
 		//
-		maDestroyObject( placeholder );
-		//
-		// failed?
-		//
-		if ( res == RES_OUT_OF_MEMORY )
-
-#else // this block just limits cache size
-
-		if ( mList.size( ) >= (unsigned int)mCapacity )
-
-#endif
-
-		{
-			//
-			// find and remove oldest in cache
-			//
-			MapTileKey oldestKey = findLRU( );
-			MapTile* oldestTile = mList[oldestKey];
-			deleteobject( oldestTile );
-			mList.erase( oldestKey );
-		}
-		//
-		// Finally add to cache
-		//
-		tile->stamp( );
-		MapTileKey newKey = MapTileKey( sender, tile->getGridX( ), tile->getGridY(), tile->getMagnification( ) );
-		mList.insert( newKey, tile );
+		add( tile );
 
 		onTileReceived( tile, false );
 	}
@@ -333,6 +413,9 @@ namespace MAP
 			deleteobject( t );
 		}
 		mList.clear( );
+		mMostRecent = NULL;
+		mLeastRecent = NULL;
+		mByteSize = 0;
 	}
 
 	//-------------------------------------------------------------------------
@@ -28,12 +28,14 @@ Software Foundation, 59 Temple Place - Suite 330, Boston, MA
 #include "DateTime.h"
 
 #include "MapSource.h"
+#include "MapTileKey.h"
 
 namespace MAP
 {
 	class MapTile;
 	class MapCache;
 	class MapSource;
+	class MapTileStore;
 
 	//=========================================================================
 	/**
@@ -57,12 +59,15 @@ namespace MAP
 		virtual void error( MapCache* sender, int code ) = 0;
 	};
 
-	class MapTileKey;
-
 	//=========================================================================
 	/**
 	 * \brief Manages map caches for clients to access.
 	 * Implemented as singleton.
+	 *
+	 * Tiles are kept in a list ordered by last use, so finding and
+	 * dropping the least recently used tile takes constant time.
+	 * The cache is limited by the bytes of image data it holds, and
+	 * optionally by the number of tiles.
 	 */
 	class MapCache : IMapSourceListener,
 		public Broadcaster<IMapCacheListener>
@@ -99,28 +104,59 @@ namespace MAP
 		void downloadCancelled( MapSource* sender );
 		void error( MapSource* source, int code );
 		void jobComplete( MapSource* source );
+		/**
+		 * Returns a tile if it is in memory or in the tile store,
+		 * otherwise NULL. The tile counts as used.
+		 */
+		MapTile* getTile( MapSource* source, int gridX, int gridY, int magnification );
 		//
-		// Capacity property
+		// Capacity property, in tiles. 0 means no limit.
 		//
 		int getCapacity( ) const;
 		void setCapacity( int capacity );
 		int size( );
+		//
+		// Capacity property, in bytes of image data.
+		//
+		int getByteCapacity( ) const;
+		void setByteCapacity( int byteCapacity );
+		int getByteSize( ) const;
+		//
+		// Tile store property.
+		// Tiles dropped from memory are put in the store, and tiles not in
+		// memory are looked for there before they are requested from the
+		// map source. The cache does not own the store. NULL for none.
+		//
+		MapTileStore* getTileStore( ) const;
+		void setTileStore( MapTileStore* store );
 
 	private:
 		static MapCache* sSingleton;
-		/**
-		 * returns location of least recently used tile
-		 */
-		MapTileKey findLRU( );
+
+		MapTile* find( const MapTileKey& key );
+		void add( MapTile* tile );
+		void remove( MapTile* tile );
+		void trim( );
+		//
+		// Least recently used list
+		//
+		void pushFront( MapTile* tile );
+		void unlink( MapTile* tile );
 
 		void onTileReceived( MapTile* tile, bool foundInCache );
 		void onJobComplete( );
 		void onError( int code );
 
 		HashMap<MapTileKey, MapTile*> mList;
+		MapTile* mMostRecent;
+		MapTile* mLeastRecent;
 		int mHits;
 		int mMisses;
+		int mStoreHits;
 		int mCapacity;
+		int mByteCapacity;
+		int mByteSize;
+		MapTileStore* mStore;
 	};
 }
 
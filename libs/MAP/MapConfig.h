@@ -37,9 +37,14 @@ Software Foundation, 59 Temple Place - Suite 330, Boston, MA
 //
 static const int			MapSourceDownloaders = 5;
 //
-// Default capacity in MapCache.
+// Default capacity in MapCache, in tiles. 0 means no limit.
 //
-static const int MapCacheDefaultCapacity = 40;
+static const int MapCacheDefaultCapacity = 0;
+//
+// Default capacity in MapCache, in bytes of image data.
+// The same as 40 unpacked 256x256 tiles.
+//
+static const int MapCacheDefaultByteCapacity = 40 * 256 * 256 * 4;
 
 #endif // MAPCONFIG_H
 
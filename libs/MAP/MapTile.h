@@ -64,10 +64,13 @@ namespace MAP
 			mCenter( center ),
 			mImage( image ),
 			mLastAccessTime( DateTime::minValue( ) ),
-			mCreationTime( maGetMilliSecondCount() )
+			mCreationTime( maGetMilliSecondCount() ),
 			#ifdef StoreCompressedTilesInCache
-			, mContentLength( contentLength )
+			mContentLength( contentLength ),
 			#endif
+			mPrev( NULL ),
+			mNext( NULL ),
+			mByteSize( 0 )
 		{
 		}
 		/**
@@ -152,6 +155,8 @@ namespace MAP
 		#endif
 
 	private:
+		friend class MapCache;
+
 		MapSource* mSource;
 		int mGridX;
 		int mGridY;
@@ -161,6 +166,12 @@ namespace MAP
 		DateTime mLastAccessTime;
 		int mCreationTime;
 		int mContentLength;
+		//
+		// Least recently used list of MapCache, and the bytes counted for the tile there.
+		//
+		MapTile* mPrev;
+		MapTile* mNext;
+		int mByteSize;
 	};
 }
 #endif // MAPTILE_H_
@@ -0,0 +1,82 @@
+/* Copyright (C) 2010 Mobile Sorcery AB
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License, version 2, as published by
+the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING.  If not, write to the Free
+Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.
+*/
+
+/** 
+* \file MapTileKey.h
+* \brief Key of a tile in MapCache and MapTileStore
+* \author Lars-Åke Vinberg
+*/
+
+#ifndef MAPTILEKEY_H_
+#define MAPTILEKEY_H_
+
+#include <MAUtil/HashMap.h>
+
+namespace MAP
+{
+	class MapSource;
+
+	//=========================================================================
+	class MapTileKey
+	//=========================================================================
+	{
+	public:
+		MapTileKey( ) { }
+
+		//---------------------------------------------------------------------
+		MapTileKey( MapSource* source, int gridX, int gridY, int magnification )
+		//---------------------------------------------------------------------
+		:	mSource( source ),
+			mGridX( gridX ),
+			mGridY( gridY ),
+			mMagnification( magnification )
+		{
+		}
+
+		MapSource* mSource;
+		int mGridX;
+		int mGridY;
+		int mMagnification;
+
+		bool operator==(const MapTileKey& c) const 
+		{
+			return mSource == c.mSource && mGridX == c.mGridX && mGridY == c.mGridY && mMagnification == c.mMagnification;
+		}
+
+		bool operator<(const MapTileKey& c) const 
+		{
+			return mSource < c.mSource && mGridX < c.mGridX && mGridY < c.mGridY && mMagnification < c.mMagnification;
+		}
+					
+	};
+}
+
+namespace MAUtil 
+{
+	//-------------------------------------------------------------------------
+	template<> 
+	inline hash_val_t THashFunction<MAP::MapTileKey>( const MAP::MapTileKey& data ) 
+	//-------------------------------------------------------------------------
+	{
+		//
+		// Neighbouring tiles differ in few bits, so spread them before mixing.
+		//
+		return ((int)data.mSource) ^ ( data.mGridX * 73856093 ) ^ ( data.mGridY * 19349663 ) ^ ( data.mMagnification * 83492791 );
+	} 
+}
+
+#endif // MAPTILEKEY_H_
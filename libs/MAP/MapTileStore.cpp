@@ -0,0 +1,308 @@
+/* Copyright (C) 2010 Mobile Sorcery AB
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License, version 2, as published by
+the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING.  If not, write to the Free
+Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.
+*/
+
+#include <mavsprintf.h>
+#include "MapConfig.h"
+#include "MemoryMgr.h"
+#include "MapTileStore.h"
+#include "MapTile.h"
+#include "MapSource.h"
+#include "MapTileCoordinate.h"
+#include "DebugPrintf.h"
+
+namespace MAP
+{
+	//=========================================================================
+	class MapTileStore::Entry
+	//=========================================================================
+	{
+	public:
+		Entry( const MapTileKey& key, int byteSize )
+		:	mKey( key ),
+			mByteSize( byteSize ),
+			mPrev( NULL ),
+			mNext( NULL )
+		{
+		}
+
+		MapTileKey mKey;
+		int mByteSize;
+		Entry* mPrev;
+		Entry* mNext;
+	};
+
+	//-------------------------------------------------------------------------
+	MapTileStore::MapTileStore( const char* directory, int byteCapacity )
+	//-------------------------------------------------------------------------
+	:	mDirectory( directory ),
+		mEntries( ),
+		mMostRecent( NULL ),
+		mLeastRecent( NULL ),
+		mByteCapacity( byteCapacity ),
+		mByteSize( 0 )
+	{
+		MAHandle dir = maFileOpen( directory, MA_ACCESS_READ_WRITE );
+		if ( dir < 0 )
+		{
+			DebugPrintf( "MapTileStore: can't open %s: %d\n", directory, dir );
+			return;
+		}
+		if ( maFileExists( dir ) == 0 )
+			maFileCreate( dir );
+		maFileClose( dir );
+	}
+
+	//-------------------------------------------------------------------------
+	MapTileStore::~MapTileStore( )
+	//-------------------------------------------------------------------------
+	{
+		clear( );
+	}
+
+	//-------------------------------------------------------------------------
+	void MapTileStore::getFileName( char* buffer, const MapTileKey& key ) const
+	//-------------------------------------------------------------------------
+	{
+		sprintf( buffer, "%s%x_%d_%d_%d.tile", mDirectory.c_str( ), (int)key.mSource, key.mMagnification, key.mGridX, key.mGridY );
+	}
+
+	//-------------------------------------------------------------------------
+	void MapTileStore::pushFront( Entry* entry )
+	//-------------------------------------------------------------------------
+	{
+		entry->mPrev = NULL;
+		entry->mNext = mMostRecent;
+		if ( mMostRecent != NULL )
+			mMostRecent->mPrev = entry;
+		else
+			mLeastRecent = entry;
+		mMostRecent = entry;
+	}
+
+	//-------------------------------------------------------------------------
+	void MapTileStore::unlink( Entry* entry )
+	//-------------------------------------------------------------------------
+	{
+		if ( entry->mPrev != NULL )
+			entry->mPrev->mNext = entry->mNext;
+		else
+			mMostRecent = entry->mNext;
+		if ( entry->mNext != NULL )
+			entry->mNext->mPrev = entry->mPrev;
+		else
+			mLeastRecent = entry->mPrev;
+	}
+
+	//-------------------------------------------------------------------------
+	//
+	// Deletes the file of an entry, and the entry
+	//
+	void MapTileStore::remove( Entry* entry )
+	//-------------------------------------------------------------------------
+	{
+		char name[256];
+		getFileName( name, entry->mKey );
+		MAHandle file = maFileOpen( name, MA_ACCESS_READ_WRITE );
+		if ( file >= 0 )
+		{
+			maFileDelete( file );
+			maFileClose( file );
+		}
+		unlink( entry );
+		mByteSize -= entry->mByteSize;
+		mEntries.erase( entry->mKey );
+		deleteobject( entry );
+	}
+
+	//-------------------------------------------------------------------------
+	void MapTileStore::trim( )
+	//-------------------------------------------------------------------------
+	{
+		while ( mLeastRecent != NULL && mByteSize > mByteCapacity )
+			remove( mLeastRecent );
+	}
+
+	//-------------------------------------------------------------------------
+	bool MapTileStore::put( MapTile* tile )
+	//-------------------------------------------------------------------------
+	{
+		MapTileKey key = MapTileKey( tile->getMapSource( ), tile->getGridX( ), tile->getGridY( ), tile->getMagnification( ) );
+		HashMap<MapTileKey, Entry*>::Iterator found = mEntries.find( key );
+		if ( found != mEntries.end( ) )
+		{
+			//
+			// Tiles don't change, the file is still good
+			//
+			Entry* entry = found->second;
+			unlink( entry );
+			pushFront( entry );
+			return true;
+		}
+
+		char name[256];
+		getFileName( name, key );
+		MAHandle file = maFileOpen( name, MA_ACCESS_READ_WRITE );
+		if ( file < 0 )
+			return false;
+		if ( maFileExists( file ) )
+			maFileTruncate( file, 0 );
+		else
+			maFileCreate( file );
+
+		int byteSize;
+		int res;
+
+		#ifdef StoreCompressedTilesInCache
+		//
+		// The tile is the downloaded file
+		//
+		byteSize = tile->getContentLength( );
+		res = maFileWriteFromData( file, tile->getImage( ), 0, byteSize );
+		#else
+		//
+		// Width, height and the pixels
+		//
+		MAExtent extent = maGetImageSize( tile->getImage( ) );
+		int size[2] = { EXTENT_X( extent ), EXTENT_Y( extent ) };
+		int* pixels = new int[size[0] * size[1]];
+		MARect rect = { 0, 0, size[0], size[1] };
+		maGetImageData( tile->getImage( ), pixels, &rect, size[0] );
+		byteSize = sizeof( size ) + size[0] * size[1] * 4;
+		res = maFileWrite( file, size, sizeof( size ) );
+		if ( res >= 0 )
+			res = maFileWrite( file, pixels, size[0] * size[1] * 4 );
+		delete[] pixels;
+		#endif
+
+		if ( res < 0 )
+		{
+			DebugPrintf( "MapTileStore: can't write %s: %d\n", name, res );
+			maFileDelete( file );
+			maFileClose( file );
+			return false;
+		}
+		maFileClose( file );
+
+		Entry* entry = newobject( Entry, new Entry( key, byteSize ) );
+		mEntries.insert( key, entry );
+		pushFront( entry );
+		mByteSize += byteSize;
+		trim( );
+		return true;
+	}
+
+	//-------------------------------------------------------------------------
+	MapTile* MapTileStore::get( MapSource* source, int gridX, int gridY, int magnification )
+	//-------------------------------------------------------------------------
+	{
+		MapTileKey key = MapTileKey( source, gridX, gridY, magnification );
+		HashMap<MapTileKey, Entry*>::Iterator found = mEntries.find( key );
+		if ( found == mEntries.end( ) )
+			return NULL;
+		Entry* entry = found->second;
+
+		char name[256];
+		getFileName( name, key );
+		MAHandle file = maFileOpen( name, MA_ACCESS_READ );
+		if ( file < 0 )
+		{
+			remove( entry );
+			return NULL;
+		}
+
+		MAHandle data = maCreatePlaceholder( );
+		int res;
+
+		#ifdef StoreCompressedTilesInCache
+		res = maCreateData( data, entry->mByteSize );
+		if ( res == RES_OK )
+			res = maFileReadToData( file, data, 0, entry->mByteSize );
+		#else
+		int size[2];
+		res = maFileRead( file, size, sizeof( size ) );
+		if ( res >= 0 && sizeof( size ) + size[0] * size[1] * 4 == (unsigned int)entry->mByteSize )
+		{
+			int* pixels = new int[size[0] * size[1]];
+			res = maFileRead( file, pixels, size[0] * size[1] * 4 );
+			if ( res >= 0 )
+				res = maCreateImageRaw( data, pixels, EXTENT( size[0], size[1] ), 1 );
+			delete[] pixels;
+		}
+		else if ( res >= 0 )
+		{
+			res = RES_BAD_INPUT;
+		}
+		#endif
+
+		maFileClose( file );
+
+		if ( res < 0 )
+		{
+			DebugPrintf( "MapTileStore: can't read %s: %d\n", name, res );
+			maDestroyPlaceholder( data );
+			remove( entry );
+			return NULL;
+		}
+
+		unlink( entry );
+		pushFront( entry );
+
+		LonLat center = source->tileCenterToLonLat( source->getTileSize( ), MapTileCoordinate( gridX, gridY, magnification ), 0, 0 );
+		#ifdef StoreCompressedTilesInCache
+		return newobject( MapTile, new MapTile( source, gridX, gridY, magnification, center, data, entry->mByteSize ) );
+		#else
+		return newobject( MapTile, new MapTile( source, gridX, gridY, magnification, center, data ) );
+		#endif
+	}
+
+	//-------------------------------------------------------------------------
+	void MapTileStore::clear( )
+	//-------------------------------------------------------------------------
+	{
+		while ( mMostRecent != NULL )
+			remove( mMostRecent );
+	}
+
+	//-------------------------------------------------------------------------
+	int MapTileStore::size( ) const
+	//-------------------------------------------------------------------------
+	{
+		return mEntries.size( );
+	}
+
+	//-------------------------------------------------------------------------
+	int MapTileStore::getByteCapacity( ) const
+	//-------------------------------------------------------------------------
+	{
+		return mByteCapacity;
+	}
+
+	//-------------------------------------------------------------------------
+	void MapTileStore::setByteCapacity( int byteCapacity )
+	//-------------------------------------------------------------------------
+	{
+		mByteCapacity = byteCapacity;
+		trim( );
+	}
+
+	//-------------------------------------------------------------------------
+	int MapTileStore::getByteSize( ) const
+	//-------------------------------------------------------------------------
+	{
+		return mByteSize;
+	}
+}
@@ -0,0 +1,103 @@
+/* Copyright (C) 2010 Mobile Sorcery AB
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License, version 2, as published by
+the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING.  If not, write to the Free
+Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.
+*/
+
+/** 
+* \file MapTileStore.h
+* \brief Second level of MapCache, in files
+*/
+
+#ifndef MAPTILESTORE_H_
+#define MAPTILESTORE_H_
+
+#include <MAUtil/HashMap.h>
+#include <MAUtil/String.h>
+#include "MapTileKey.h"
+
+namespace MAP
+{
+	using namespace MAUtil;
+
+	class MapTile;
+	class MapSource;
+
+	//=========================================================================
+	/**
+	 * \brief Second level of MapCache, in files.
+	 *
+	 * MapCache puts tiles here when it drops them from memory, and looks here
+	 * before it requests a tile from the map source, so panning back over an
+	 * area doesn't download it again.
+	 * The store is limited by the bytes in its files, and deletes the least
+	 * recently used. The files only live as long as the store.
+	 */
+	class MapTileStore
+	//=========================================================================
+	{
+	public:
+		/**
+		 * Creates a store that keeps its files in a directory.
+		 * The path must end with a slash. The directory is created if needed.
+		 */
+		MapTileStore( const char* directory, int byteCapacity );
+		/**
+		 * Deletes the files of the store.
+		 */
+		virtual ~MapTileStore( );
+		/**
+		 * Writes a tile to a file, unless it is already in the store.
+		 * Returns false if the file could not be written.
+		 */
+		bool put( MapTile* tile );
+		/**
+		 * Reads a tile from its file, or returns NULL if it is not in the store.
+		 * The caller owns the tile.
+		 */
+		MapTile* get( MapSource* source, int gridX, int gridY, int magnification );
+		/**
+		 * Deletes all files of the store.
+		 */
+		void clear( );
+		/**
+		 * Returns number of tiles in the store.
+		 */
+		int size( ) const;
+		//
+		// Capacity property, in bytes of files.
+		//
+		int getByteCapacity( ) const;
+		void setByteCapacity( int byteCapacity );
+		int getByteSize( ) const;
+
+	private:
+		class Entry;
+
+		void getFileName( char* buffer, const MapTileKey& key ) const;
+		void pushFront( Entry* entry );
+		void unlink( Entry* entry );
+		void remove( Entry* entry );
+		void trim( );
+
+		String mDirectory;
+		HashMap<MapTileKey, Entry*> mEntries;
+		Entry* mMostRecent;
+		Entry* mLeastRecent;
+		int mByteCapacity;
+		int mByteSize;
+	};
+}
+
+#endif // MAPTILESTORE_H_
@@ -119,7 +119,7 @@ Create, read, write binary objects, destroy objects, create resource handles.
 </td>
 <td>
 maCreateData(), maCreatePlaceholder(), maDestroyObject(), maGetDataSize(), maReadData(),<br>
-maWriteData(), maDestroyPlaceholder()
+maWriteData(), maConcatData(), maDestroyPlaceholder()
 </td>
 <td>
 MAUtil::DataHandler
@@ -308,6 +308,8 @@ MAUtil::DataHandler
 </td>
 <td>maDBOpen(),
 maDBClose(),
+maDBBeginTransaction(),
+maDBCommitTransaction(),
 maDBExecSQL(),
 maDBExecSQLParams(),
 maDBCursorDestroy(),
@@ -36,6 +36,8 @@ namespace MAUI {
 		defaultFont = NULL;
 		defaultSkin = NULL;
 		overlay = NULL;
+		numDirtyRects = 0;
+		fullUpdate = false;
 		singletonPtr = this;
 		//clipStackPtr = -1;
 		Environment::getEnvironment().addFocusListener(this);
@@ -176,8 +178,84 @@ namespace MAUI {
 	}
 
 	void Engine::requestUIUpdate() {
+		fullUpdate = true;
 		Environment::getEnvironment().addIdleListener(this);
 	}
+
+	void Engine::requestUIUpdate(Widget* root, const Rect& area) {
+		Rect r = area;
+		if(root == NULL) {
+			return;
+		} else if(root == overlay) {
+			r.x += overlayPosition.x;
+			r.y += overlayPosition.y;
+		} else if(root != main) {
+			requestUIUpdate();
+			return;
+		}
+		if(r.width <= 0 || r.height <= 0)
+			return;
+		addDirtyRect(r);
+		Environment::getEnvironment().addIdleListener(this);
+	}
+
+	void Engine::addDirtyRect(const Rect& area) {
+		for(int i = 0; i < numDirtyRects; i++) {
+			Rect r = dirtyRects[i];
+			if(r.intersect(area)) {
+				dirtyRects[i].unite(area);
+				return;
+			}
+		}
+		if(numDirtyRects < MAX_DIRTY_RECTS) {
+			dirtyRects[numDirtyRects++] = area;
+			return;
+		}
+
+		// merge with the one that grows the least.
+		int best = 0, bestGrowth = 0;
+		for(int i = 0; i < numDirtyRects; i++) {
+			Rect r = dirtyRects[i];
+			r.unite(area);
+			int growth = r.area() - dirtyRects[i].area();
+			if(i == 0 || growth < bestGrowth) {
+				best = i;
+				bestGrowth = growth;
+			}
+		}
+		dirtyRects[best].unite(area);
+	}
+
+	void Engine::markDirty(Widget* w, const Rect& area, int x, int y) {
+		Rect r = w->bounds;
+		r.x += x;
+		r.y += y;
+		if(!r.intersect(area))
+			return;
+		w->dirty = true;
+		Point offset = w->getChildOffset();
+		Vector_each(Widget*, it, w->children)
+			markDirty(*it, area, x + offset.x, y + offset.y);
+	}
+
+	void Engine::drawArea(const Rect& area) {
+		markDirty(main, area, 0, 0);
+		Gfx_clearClipRect();
+		Gfx_clearMatrix();
+		Gfx_pushClipRect(area.x, area.y, area.width, area.height);
+		main->draw();
+		Gfx_popClipRect();
+
+		if(overlay) {
+			markDirty(overlay, area, overlayPosition.x, overlayPosition.y);
+			Gfx_clearClipRect();
+			Gfx_clearMatrix();
+			Gfx_pushClipRect(area.x, area.y, area.width, area.height);
+			Gfx_translate(overlayPosition.x, overlayPosition.y);
+			overlay->draw();
+			Gfx_popClipRect();
+		}
+	}
 	
 	void Engine::repaint() {
 		//lprintfln("repaint @ (%i ms)", maGetMilliSecondCount());
@@ -185,33 +263,58 @@ namespace MAUI {
 		//printf("doing repaint!");
 		
 		Gfx_beginRendering();
-		
-		//clearClipRect();
-		Gfx_clearClipRect();
-		Gfx_clearMatrix();
 
-		
 		int scrW = EXTENT_X(maGetScrSize());
 		int scrH = EXTENT_Y(maGetScrSize());
-		//printf("screenSize: (%d, %d)\n", scrW, scrH);
-		Gfx_pushClipRect(0, 0, scrW, scrH);
+
+		// may move widgets, and request more areas.
 		main->update();
-		main->draw();
-		Gfx_popClipRect();
+		if(overlay)
+			overlay->update();
 
-		if(overlay) {
+		// a driver that clears the screen has to have all of it redrawn.
+		bool keepsScreen = Gfx_keepsScreen() ? true : false;
+		bool drawn = false;
+
+		if(fullUpdate || !keepsScreen) {
+			//clearClipRect();
 			Gfx_clearClipRect();
 			Gfx_clearMatrix();
+
+			//printf("screenSize: (%d, %d)\n", scrW, scrH);
 			Gfx_pushClipRect(0, 0, scrW, scrH);
+			main->draw();
+			Gfx_popClipRect();
+
+			if(overlay) {
+				Gfx_clearClipRect();
+				Gfx_clearMatrix();
+				Gfx_pushClipRect(0, 0, scrW, scrH);
+
+				overlay->setDirty();
+				Gfx_translate(overlayPosition.x, overlayPosition.y);
+				overlay->draw();
+				Gfx_popClipRect();
+			}
+			drawn = true;
+		}
 
-			overlay->requestRepaint();
-			Gfx_translate(overlayPosition.x, overlayPosition.y);
-			overlay->update();
-			overlay->draw();
+		if(keepsScreen) {
+			Rect screen(0, 0, scrW, scrH);
+			for(int i = 0; i < numDirtyRects; i++) {
+				Rect area = dirtyRects[i];
+				if(area.intersect(screen)) {
+					drawArea(area);
+					drawn = true;
+				}
+			}
 		}
+		numDirtyRects = 0;
+		fullUpdate = false;
 
 		//maUpdateScreen();
-		Gfx_updateScreen();
+		if(drawn)
+			Gfx_updateScreen();
 	}
 	
 	void Engine::idle() {
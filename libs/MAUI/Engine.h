@@ -41,7 +41,8 @@ namespace MAUI {
 	class Engine : public IdleListener, public FocusListener {
 	public:
 		enum {
-			MAX_WIDGET_DEPTH = 16
+			MAX_WIDGET_DEPTH = 16,
+			MAX_DIRTY_RECTS = 8
 		};
 
 		/** Sets the widget that is main to the application, constituting the root of the UI tree **/
@@ -71,12 +72,24 @@ namespace MAUI {
 		  * any dirty widgets to be redrawn in the next iteration of the event loop.
 		  **/
 		void requestUIUpdate();
+
+		/** Causes every widget in \a area to be redrawn in the next iteration
+		  * of the event loop, dirty or not. \a area is in the coordinates of
+		  * the tree under \a root. If that is neither the main widget nor the
+		  * overlay, this is the same as requestUIUpdate().
+		  * Areas are gathered until the repaint; if there are too many, the
+		  * closest ones are merged.
+		  **/
+		void requestUIUpdate(Widget* root, const Rect& area);
 		
 		// added this because graphics can be invalidated on some devices when the focus is lost...
 		void focusLost();
 		void focusGained();
 
-		/** Actually performs repainting **/ 
+		/** Actually performs repainting. If only areas were requested, and the
+		  * graphics driver keeps the screen between frames, nothing outside them
+		  * is drawn.
+		  **/ 
 		void repaint();
 		
 		/** Returns a reference to the single instance of this class, using lazy
@@ -106,8 +119,16 @@ namespace MAUI {
 
 		bool characterInputActive;
 
+		// screen areas to redraw; fullUpdate means all dirty widgets
+		Rect dirtyRects[MAX_DIRTY_RECTS];
+		int numDirtyRects;
+		bool fullUpdate;
+
 	private:
 		Engine();
+		void addDirtyRect(const Rect& area);
+		void drawArea(const Rect& area);
+		static void markDirty(Widget* w, const Rect& area, int x, int y);
 	};
 }
 
@@ -224,6 +224,13 @@ namespace MAUI {
 		return yOffset>>16;
 	}
 
+	Point ListBox::getChildOffset() const {
+		if(orientation == LBO_VERTICAL)
+			return Point(0, yOffset>>16);
+		else
+			return Point(yOffset>>16, 0);
+	}
+
 	void ListBox::update() {
 		Widget::update();	
 		if(mustRebuild) rebuild();
@@ -156,6 +156,8 @@ namespace MAUI {
 
 		void drawWidget();
 
+		Point getChildOffset() const;
+
 		bool mustRebuild;
 		void rebuild();
 
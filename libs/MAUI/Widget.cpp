@@ -184,6 +184,9 @@ namespace MAUI {
 
 	void Widget::setPosition(int x, int y) {
 		bool changed = relX != x || relY != y;
+		// the area it leaves
+		if(changed)
+			requestRepaint();
 		relX = x;
 		relY = y;
 		updateAbsolutePosition();
@@ -208,6 +211,8 @@ namespace MAUI {
 
 	void Widget::setWidth(int width) {
 		bool changed = width != bounds.width;
+		if(changed && width < bounds.width)
+			requestRepaint();
 		bounds.width = width;
 		updatePaddedBounds();
 		requestRepaint();
@@ -222,6 +227,8 @@ namespace MAUI {
 
 	void Widget::setHeight(int height) {
 		bool changed = height != bounds.height;
+		if(changed && height < bounds.height)
+			requestRepaint();
 		bounds.height = height;
 		updatePaddedBounds();
 		requestRepaint();
@@ -267,14 +274,54 @@ namespace MAUI {
 	}
 
 	void Widget::requestRepaint() {
-		Engine::getSingleton().requestUIUpdate();
+		Engine& engine = Engine::getSingleton();
 		setDirty();
 
-		if(isTransparent()) {
-			if(parent) {
-				parent->requestRepaint();
-			}
+		// the parents are only marked; the area below is all that needs redrawing.
+		Widget* w = this;
+		while(w->isTransparent() && w->parent) {
+			w = w->parent;
+			w->setDirty();
+		}
+
+		Rect area;
+		Widget* root = getScreenArea(area);
+		engine.requestUIUpdate(root, area);
+	}
+
+	Point Widget::getChildOffset() const {
+		return Point(0, 0);
+	}
+
+	Widget* Widget::getScreenArea(Rect& area) {
+		// bounds don't include scrolling, so add the offsets of all ancestors,
+		// the way draw() translates by them on the way down.
+		Point scroll(0, 0);
+		Widget* w = this;
+		while(w->parent) {
+			w = w->parent;
+			Point offset = w->getChildOffset();
+			scroll.x += offset.x;
+			scroll.y += offset.y;
+		}
+		area = bounds;
+		area.x += scroll.x;
+		area.y += scroll.y;
+
+		// each ancestor clips to its padded bounds, moved by the offsets of
+		// the ancestors above it.
+		w = this;
+		while(w->parent) {
+			w = w->parent;
+			Point offset = w->getChildOffset();
+			scroll.x -= offset.x;
+			scroll.y -= offset.y;
+			Rect clip = w->paddedBounds;
+			clip.x += scroll.x;
+			clip.y += scroll.y;
+			area.intersect(clip);
 		}
+		return w;
 	}
 
 	bool Widget::isDirty() const {
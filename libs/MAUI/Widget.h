@@ -108,6 +108,7 @@ namespace MAUI {
 	class Widget {
 		friend class Screen;
 		friend class Layout;
+		friend class Engine;
 	
 	public:
 
@@ -176,6 +177,7 @@ namespace MAUI {
 		 * redraw the widget and anything else that may be made dirty by
 		 * doing so. For instance, if the widget is transparent its parent
 		 * also has to be repainted, and so on recursively.
+		 * Only the part of the screen covered by the widget is redrawn.
 		 */
 		void requestRepaint();
 
@@ -390,6 +392,19 @@ namespace MAUI {
 		 */
 		void setDirty(bool d=true);
 
+		/**
+		 * Returns the offset by which the widget draws its children, on top of
+		 * their positions. The default is none; a ListBox moves them by its
+		 * scroll offset.
+		 */
+		virtual Point getChildOffset() const;
+
+		/**
+		 * Sets \a area to the part of the screen the widget is drawn on, clipped
+		 * by its parents, and returns the root of its tree.
+		 */
+		Widget* getScreenArea(Rect& area);
+
 		// a list of pointers to the children of the widget
 		Vector<Widget*> children;
 
@@ -32,6 +32,13 @@ using namespace MAUtil;
 // Redirection attemps limit
 #define MAX_REDIRECTIONS_COUNT 8
 
+// A download of unknown length is read into chunks of a quarter of what
+// has been read so far, between the first and the max size, so that a
+// big download needs few data objects and few reads, and the space left
+// unused in the last chunk is small.
+#define FIRST_CHUNK_SIZE 2048
+#define MAX_CHUNK_SIZE (256 * 1024)
+
 // *************** Class DownloadListener *************** //
 
 void DownloadListener::notifyProgress(Downloader* dl, int downloadedBytes, int totalBytes)
@@ -595,24 +602,64 @@ void DownloaderReaderWithKnownContentLength::connRecvFinished(
 
 DownloaderReaderThatReadsChunks::DownloaderReaderThatReadsChunks(Downloader* downloader)
 : DownloaderReader(downloader),
-  mDataChunkSize(2048),
+  mDataChunkSize(0),
   mDataChunkOffset(0)
 {
 }
 
 DownloaderReaderThatReadsChunks::~DownloaderReaderThatReadsChunks()
 {
-	while (0 < mDataChunks.size())
+	destroyChunks();
+}
+
+void DownloaderReaderThatReadsChunks::destroyChunks()
+{
+	// Return chunks to pool.
+	for (int i = 0; i < mDataChunks.size(); ++i)
 	{
-		// Remove first remaining chunk.
-		MAHandle chunk = mDataChunks[0];
+		maDestroyPlaceholder(mDataChunks[i]);
+	}
+	mDataChunks.clear();
+}
 
-		// Return chunk to pool.
-		maDestroyPlaceholder(chunk);
+int DownloaderReaderThatReadsChunks::copyChunks()
+{
+	// Allocate big handle and copy the chunks to it, for runtimes
+	// that don't have maConcatData.
+	int errorCode = maCreateData(
+		mDownloader->getDataPlaceholder(),
+		mContentLength);
 
-		// Remove chunk from list.
-		mDataChunks.remove(0);
+	if (RES_OUT_OF_MEMORY == errorCode)
+	{
+		return errorCode;
 	}
+
+	// Copy the chunks to the data object, handle to handle, so there is
+	// no bounce buffer, and free each chunk as soon as it is copied.
+	MACopyData copy;
+	copy.dst = mDownloader->getDataPlaceholder();
+	copy.dstOffset = 0;
+	copy.srcOffset = 0;
+	for (int i = 0; i < mDataChunks.size(); ++i)
+	{
+		copy.src = mDataChunks[i];
+
+		// Last chunk should only be partially written.
+		copy.size = maGetDataSize(copy.src);
+		if (copy.size > mContentLength - copy.dstOffset)
+		{
+			copy.size = mContentLength - copy.dstOffset;
+		}
+		if (copy.size > 0)
+		{
+			maCopyData(&copy);
+		}
+		copy.dstOffset += copy.size;
+
+		maDestroyObject(copy.src);
+	}
+	return RES_OK;
 }
 
 void DownloaderReaderThatReadsChunks::startRecvToData(Connection* conn)
@@ -671,63 +718,64 @@ void DownloaderReaderThatReadsChunks::connRecvFinished(Connection* conn, int res
 
 bool DownloaderReaderThatReadsChunks::readNextChunk(Connection* conn)
 {
-	// Allocate new a chunk of data.
-	MAHandle chunk = maCreatePlaceholder();
-	int result = maCreateData(chunk, mDataChunkSize);
-	if (RES_OUT_OF_MEMORY == result)
+	// Each chunk is a quarter of the data read so far, between
+	// FIRST_CHUNK_SIZE and MAX_CHUNK_SIZE. If there is no memory
+	// for that, try smaller chunks down to the first size.
+	int size = mContentLength / 4;
+	if (size < FIRST_CHUNK_SIZE)
 	{
-		return false;
+		size = FIRST_CHUNK_SIZE;
 	}
-	else
+	else if (size > MAX_CHUNK_SIZE)
+	{
+		size = MAX_CHUNK_SIZE;
+	}
+
+	// Allocate new a chunk of data.
+	MAHandle chunk = maCreatePlaceholder();
+	while (RES_OUT_OF_MEMORY == maCreateData(chunk, size))
 	{
-		// Start reading into the new chunk.
-		mDataChunks.add(chunk);
-		mDataChunkOffset = 0;
-		conn->recvToData(chunk, mDataChunkOffset, mDataChunkSize);
-		return true;
+		if (size <= FIRST_CHUNK_SIZE)
+		{
+			maDestroyPlaceholder(chunk);
+			return false;
+		}
+		size /= 2;
 	}
+
+	// Start reading into the new chunk.
+	mDataChunks.add(chunk);
+	mDataChunkSize = size;
+	mDataChunkOffset = 0;
+	conn->recvToData(chunk, mDataChunkOffset, mDataChunkSize);
+	return true;
 }
 
 void DownloaderReaderThatReadsChunks::finishedDownloadingChunkedData()
 {
-	// Allocate big handle and copy the chunks to it.
+	// Join the chunks into a data object of the exact size.
 	// mContentLength holds the accumulated size of read data.
-	int errorCode = maCreateData(
+	// The runtime frees each chunk as soon as it is copied,
+	// so the download is never in memory twice.
+	int errorCode = maConcatData(
 		mDownloader->getDataPlaceholder(),
+		mDataChunks.pointer(),
+		mDataChunks.size(),
 		mContentLength);
 
-	if (RES_OUT_OF_MEMORY == errorCode)
+	if (IOCTL_UNAVAILABLE == errorCode)
 	{
-		mDownloader->fireError(CONNERR_DOWNLOADER_OOM);
-		return;
+		errorCode = copyChunks();
 	}
 
-	// Copy the chunks to the data object.
-	int offset = 0;
-	char *buf = new char[mDataChunkSize];
-	while (0 < mDataChunks.size())
-	{
-		// Last chunk should only be partially written.
-		int dataLeftToWrite = mContentLength - offset;
-		// Set size to min(dataLeftToWrite, mDataChunkSize)
-		int size = (dataLeftToWrite < mDataChunkSize
-			? dataLeftToWrite : mDataChunkSize);
-
-		// Copy first remaining chunk.
-		MAHandle chunk = mDataChunks[0];
-		maReadData(chunk, buf, 0, size);
-		maWriteData(mDownloader->getDataPlaceholder(), buf, offset, size);
-
-		// Return chunk to pool.
-		maDestroyPlaceholder(chunk);
+	// Return chunks to pool.
+	destroyChunks();
 
-		// Remove chunk from list.
-		mDataChunks.remove(0);
-
-		// Increment offset.
-		offset += mDataChunkSize;
+	if (RES_OUT_OF_MEMORY == errorCode)
+	{
+		mDownloader->fireError(CONNERR_DOWNLOADER_OOM);
+		return;
 	}
-	delete[] buf;
 
 	MAHandle handle = mDownloader->getHandle();
 	if (handle)
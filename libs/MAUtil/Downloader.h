@@ -417,7 +417,8 @@ namespace MAUtil {
 	/**
 	 * \brief Class that handles download when content-length is NOT known.
 	 * Here we read in chunks until we get result CONNERR_CLOSED in
-	 * connRecvFinished.
+	 * connRecvFinished. Chunks grow with the download, up to 256 KB each,
+	 * and are joined with maConcatData at the end.
 	 */
 	class DownloaderReaderThatReadsChunks : public DownloaderReader
 	{
@@ -429,9 +430,11 @@ namespace MAUtil {
 	protected:
 		bool readNextChunk(Connection* conn);
 		void finishedDownloadingChunkedData();
+		int copyChunks();
+		void destroyChunks();
 	protected:
 		MAUtil::Vector<MAHandle> mDataChunks;
-		int mDataChunkSize;
+		int mDataChunkSize; // Size of the last chunk.
 		int mDataChunkOffset;
 	};
 }
@@ -17,6 +17,9 @@ Software Foundation, 59 Temple Place - Suite 330, Boston, MA
 
 #include "Geometry.h"
 
+#define MIN(a,b) ((a)<(b)?(a):(b))
+#define MAX(a,b) ((a)>(b)?(a):(b))
+
 namespace MAUtil {
 	Rect::Rect() : x(0), y(0), width(0), height(0) {
 	}
@@ -66,6 +69,25 @@ namespace MAUtil {
 			return (xInside && yInside);
 	}
 
+	bool Rect::intersect(const Rect &r) {
+		int x2 = MIN(x + width, r.x + r.width);
+		int y2 = MIN(y + height, r.y + r.height);
+		x = MAX(x, r.x);
+		y = MAX(y, r.y);
+		width = MAX(x2 - x, 0);
+		height = MAX(y2 - y, 0);
+		return width > 0 && height > 0;
+	}
+
+	void Rect::unite(const Rect &r) {
+		int x2 = MAX(x + width, r.x + r.width);
+		int y2 = MAX(y + height, r.y + r.height);
+		x = MIN(x, r.x);
+		y = MIN(y, r.y);
+		width = x2 - x;
+		height = y2 - y;
+	}
+
 	bool Rect::contains(int xx, int yy) const
 	{
 		if(xx < x)	return false;
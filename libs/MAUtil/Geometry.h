@@ -63,6 +63,19 @@ namespace MAUtil {
 		*/
 		//virtual bool intersects(const Rect &r) const;
 
+		/**
+		* Shrinks \a this to the area it shares with \a r.
+		* Returns false if that is empty.
+		*/
+		bool intersect(const Rect &r);
+
+		/**
+		* Grows \a this to the smallest rect that covers both it and \a r.
+		*/
+		void unite(const Rect &r);
+
+		int area() const { return width * height; }
+
 		void setPosition(int x, int y);
 		virtual void set(int x, int y, int w, int h);
 
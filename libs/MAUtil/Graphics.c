@@ -78,7 +78,8 @@ static MAGraphicsDriver sDummy = {
 	&dummy_updateScreen,
 	&dummy_setClearColor,
 	&dummy_setColor,
-	&dummy_setAlpha
+	&dummy_setAlpha,
+	false
 };
 
 static MAGraphicsDriver* graphicsDriver = &sDummy;
@@ -552,6 +553,10 @@ void Gfx_updateScreen(void) {
 	graphicsDriver->updateScreen();
 }
 
+BOOL Gfx_keepsScreen(void) {
+	return graphicsDriver->keepsScreen;
+}
+
 void Gfx_setClearColor(int r, int g, int b) {
 	graphicsDriver->setClearColor(r, g, b);
 }
@@ -100,6 +100,7 @@ typedef struct MAGraphicsDriver_t {
 	SetClearColor setClearColor;	
 	SetColor setColor;
 	SetAlpha setAlpha;
+	int keepsScreen; // true if what was drawn stays on the screen between frames, so a frame may redraw only part of it
 } MAGraphicsDriver;
 
 
@@ -176,6 +177,12 @@ void Gfx_notifyImageUpdated(MAHandle image);
 // software do nothing.
 void Gfx_beginRendering(void);
 void Gfx_updateScreen(void);
+
+/** Returns true if the current driver leaves the previous frame on the screen
+  * when a new one begins, so that only the parts that changed need redrawing.
+  * The software driver does; the OpenGL driver clears the screen.
+  **/
+BOOL Gfx_keepsScreen(void);
 void Gfx_setClearColor(int r, int g, int b);
 void Gfx_setColor(int r, int g, int b);
 void Gfx_setAlpha(int a);
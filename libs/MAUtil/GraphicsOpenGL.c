@@ -69,7 +69,8 @@ static MAGraphicsDriver sGLGraphicsDriver = {
 	&ogl_updateScreen,
 	&ogl_setClearColor,
 	&ogl_setColor,
-	&ogl_setAlpha
+	&ogl_setAlpha,
+	0
 };
 
 static int sNativeUIOpenGLView = -1;
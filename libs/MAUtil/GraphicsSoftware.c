@@ -77,8 +77,8 @@ static MAGraphicsDriver sSoftwareGraphicsDriver = {
 	&soft_updateScreen,
 	&soft_setClearColor,
 	&soft_setColor,
-	&soft_setAlpha
-
+	&soft_setAlpha,
+	1
 };
 
 //MAGraphicsDriver* Gfx_getDriverSoftware(void) {
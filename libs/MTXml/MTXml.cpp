@@ -658,14 +658,163 @@ static void parseComment() {
 	}
 }
 
-static int find(char c) {
-	int i=0;
-	while(sCurPtr[i] != 0) {
-		if(sCurPtr[i] == c)
-			return i;
-		i++;
+//******************************************************************************
+// Scanning
+//******************************************************************************
+
+//The scanners look at a block of bytes at a time: 16 with SSE2, 4 otherwise.
+//Blocks are aligned, so they may be read past the terminating zero,
+//but never past the memory page it's in.
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MTX_SSE2
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#ifdef __SANITIZE_ADDRESS__
+#define MTX_NO_ASAN __attribute__((no_sanitize_address))
+#else
+#define MTX_NO_ASAN
+#endif
+
+#define ONES 0x01010101u
+#define HIGHS 0x80808080u
+//nonzero if a byte of x is less than n, which must be <= 0x80.
+#define HAS_LESS(x, n) (((x) - ONES * (n)) & ~(x) & HIGHS)
+#define HAS_ZERO(x) HAS_LESS(x, 1)
+#define HAS_BYTE(x, c) HAS_ZERO((x) ^ (ONES * (byte)(c)))
+
+static inline bool isSpace(byte c) {
+	return c == ' ' || (byte)(c - '\t') <= '\r' - '\t';
+}
+
+//A Stop says where a scan ends. It always ends on a zero.
+//match() is exact. block() and word() may find candidates that match() rejects,
+//but must find every byte it would accept.
+
+//the character, or zero.
+struct StopAtChar {
+	const char c;
+	StopAtChar(char ch) : c(ch) {}
+	bool match(char b) const { return b == 0 || b == c; }
+	unsigned int word(unsigned int x) const { return HAS_ZERO(x) | HAS_BYTE(x, c); }
+#ifdef MTX_SSE2
+	int block(__m128i v) const {
+		return _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_setzero_si128()),
+			_mm_cmpeq_epi8(v, _mm_set1_epi8(c))));
 	}
-	sCurPtr += i;
+#endif
+};
+
+//the first byte that _proc() can't copy as it is.
+struct StopAtText {
+	const bool ent, utf8;
+	StopAtText(bool e, bool u) : ent(e), utf8(u) {}
+	bool match(char b) const { return b == 0 || (ent && b == '&') || (utf8 && (b & 0x80)); }
+	unsigned int word(unsigned int x) const {
+		return HAS_ZERO(x) | (ent ? HAS_BYTE(x, '&') : 0) | (utf8 ? x & HIGHS : 0);
+	}
+#ifdef MTX_SSE2
+	int block(__m128i v) const {
+		__m128i m = _mm_cmpeq_epi8(v, _mm_setzero_si128());
+		if(ent)
+			m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('&')));
+		return _mm_movemask_epi8(m) | (utf8 ? _mm_movemask_epi8(v) : 0);
+	}
+#endif
+};
+
+//whitespace or one of the characters that end a Name.
+struct StopAtNameEnd {
+	bool match(char b) const {
+		return b == 0 || isSpace(b) || b == '>' || b == '/' || b == '=' || b == '[';
+	}
+	unsigned int word(unsigned int x) const {
+		return HAS_LESS(x, ' ' + 1) | HAS_BYTE(x, '>') | HAS_BYTE(x, '/') |
+			HAS_BYTE(x, '=') | HAS_BYTE(x, '[');
+	}
+#ifdef MTX_SSE2
+	int block(__m128i v) const {
+		__m128i low = _mm_cmpeq_epi8(_mm_min_epu8(v, _mm_set1_epi8(' ')), v);
+		__m128i m = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('>')),
+			_mm_cmpeq_epi8(v, _mm_set1_epi8('/')));
+		m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('=')));
+		m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('[')));
+		return _mm_movemask_epi8(_mm_or_si128(m, low));
+	}
+#endif
+};
+
+//anything but whitespace.
+struct StopAtNonSpace {
+	bool match(char b) const { return !isSpace(b); }
+	unsigned int word(unsigned int x) const { return x != ONES * ' '; }
+#ifdef MTX_SSE2
+	int block(__m128i v) const {
+		__m128i tab = _mm_sub_epi8(v, _mm_set1_epi8('\t'));
+		__m128i space = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+			_mm_cmpeq_epi8(_mm_min_epu8(tab, _mm_set1_epi8('\r' - '\t')), tab));
+		return ~_mm_movemask_epi8(space) & 0xFFFF;
+	}
+#endif
+};
+
+#ifdef MTX_SSE2
+static inline int firstBit(int mask) {
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return (int)index;
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+#endif
+
+//returns a pointer to the first byte, at or after p, where stop.match() is true.
+template<class Stop> MTX_NO_ASAN static char* scan(char* p, const Stop& stop) {
+#ifdef MTX_SSE2
+	//many scans end right away, like those for the space before an attribute.
+	if(stop.match(*p))
+		return p;
+	char* block = (char*)((size_t)p & ~(size_t)15);
+	int mask = stop.block(_mm_load_si128((const __m128i*)block)) & (0xFFFF << (p - block));
+	while(true) {
+		while(mask != 0) {
+			int i = firstBit(mask);
+			if(stop.match(block[i]))
+				return block + i;
+			mask &= mask - 1;
+		}
+		block += 16;
+		mask = stop.block(_mm_load_si128((const __m128i*)block));
+	}
+#else
+	while((size_t)p & 3) {
+		if(stop.match(*p))
+			return p;
+		p++;
+	}
+	while(true) {
+		if(stop.word(*(unsigned int*)p)) {
+			for(int i=0; i<4; i++) {
+				if(stop.match(p[i]))
+					return p + i;
+			}
+		}
+		p += 4;
+	}
+#endif
+}
+
+static int find(char c) {
+	char* p = scan(sCurPtr, StopAtChar(c));
+	if(*p != 0)
+		return p - sCurPtr;
+	sCurPtr = p;
 	return -1;
 }
 
@@ -694,71 +843,46 @@ static int matchString(const char* str) {
 }
 
 static int findString(const char* str) {
-	int i = 0;
-	int lastPartialStart = -1;
-	int index = 0;
-	while(sCurPtr[index] != 0) {
+	StopAtChar first(str[0]);
+	char* p = sCurPtr;
+	while(true) {
+		p = scan(p, first);
+		if(*p == 0) {
+			sCurPtr = p;
+			return -1;
+		}
+		int i = 1;
+		while(str[i] != 0 && p[i] == str[i])
+			i++;
+		if(p[i] == 0) {	//partial match, then end-of-buffer
+			sCurPtr = p;
+			return i;
+		}
 		if(str[i] == 0) {
-			sCurPtr += index;
+			sCurPtr = p + i;
 			return 0;
 		}
-		if(sCurPtr[index] != str[i]) {
-			if(lastPartialStart >= 0) {
-				i = 0;
-				//go back to character directly after start of last partial match.
-				index = lastPartialStart + 1;
-				lastPartialStart = -1;
-			} else {
-				index++;
-			}
-			continue;
-		}
-		if(i == 0)
-			lastPartialStart = index;
-		index++;
-		i++;
-	}
-	if(lastPartialStart > 0)
-		sCurPtr += lastPartialStart;
-	if(lastPartialStart < 0) {
-		sCurPtr += index;
-		return lastPartialStart;
+		p++;
 	}
-	return index - lastPartialStart;
 }
 
 static int findNameEnd() {
-	int index = -1;
-	int i=0;
-	while(sCurPtr[i] != 0) {
-		byte c = sCurPtr[i];
-		if(isspace(c) || c == '>' || c == '/' || c == '=' || c == '[') {
-			index = i;
-			break;
-		}
-		i++;
-	}
-
-	if(index < 0) {
-		if(i == 0) {
-			if(sCurPtr[i] != 0)
-				fireParseError();
-			else
-				sThereIsData = false;
-		} else {
-			sCurPtr += i;
-			return 0;
-		}
+	char* p = scan(sCurPtr, StopAtNameEnd());
+	int i = p - sCurPtr;
+	if(*p != 0)
+		return i;
+	if(i == 0) {
+		sThereIsData = false;
+		return -1;
 	}
-	return index;
+	sCurPtr = p;
+	return 0;
 }
 
 static bool skipWhiteSpace() {
-	while(*sCurPtr != 0) {
-		if(!isspace((byte)*sCurPtr))
-			return true;
-		sCurPtr++;
-	}
+	sCurPtr = scan(sCurPtr, StopAtNonSpace());
+	if(*sCurPtr != 0)
+		return true;
 	sThereIsData = false;
 	return false;
 }
@@ -791,6 +915,21 @@ static int _proc(char* data, int* remainsLen, bool ent) {
 	char* src = data;
 	*remainsLen = 0;
 	while(*src != 0) {
+		//copy a run of ASCII at once; only '&' and UTF-8 need more work.
+		char* end = scan(src, StopAtText(ent, sUtf8 != 0));
+		if(end != src) {
+			if(sWideBuf) {
+				while(src != end) {
+					*(wdst++) = *(src++);
+				}
+			} else {
+				if(dst != src)
+					memmove(dst, src, end - src);
+				dst += end - src;
+				src = end;
+			}
+			continue;
+		}
 		int res = 0;
 		if(ent && *src == '&') {	//reference
 			src++;
@@ -878,7 +1017,7 @@ static int parseRef(char* ref, int* pnBytes) {
 
 //todo: optimize. maybe use mbtowc().
 static int convertUtf8ToUnicode(const char* utf8, int* pnBytes) {
-	char b = utf8[0];
+	byte b = utf8[0];
 	if(b & 0x80) {
 		int nBytes = 0, unicode, i;
 		do {
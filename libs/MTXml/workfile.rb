@@ -32,7 +32,7 @@ mod.class_eval do
 		@IGNORED_FILES = ['entities.c']
 		@IGNORED_HEADERS = ['entities.h']
 		@EXTRA_SOURCETASKS = [entities]
-		@SPECIFIC_CFLAGS = {"MTXml.cpp" => " -Wno-unreachable-code",
+		@SPECIFIC_CFLAGS = {"MTXml.cpp" => " -Wno-unreachable-code -fno-strict-aliasing",
 			"entities.c" => " -Wno-extra",
 		}
 		@INSTALL_INCDIR = "MTXml"
@@ -60,13 +60,13 @@ namespace Wormhole
 
 	MAUtil::String JSONMessage::getArgsField(const MAUtil::String& fieldName)
 	{
-		YAJLDom::Value* argsNode = getParamNode("args");
-		if (NULL != argsNode && YAJLDom::Value::MAP == argsNode->getType())
+		YAJLDom::Node argsNode = getMessage().getValueForKey("args");
+		if (YAJLDom::Value::MAP == argsNode.getType())
 		{
-			YAJLDom::Value* value = argsNode->getValueForKey(fieldName.c_str());
-			if (NULL != value && YAJLDom::Value::STRING == value->getType())
+			YAJLDom::Node value = argsNode.getValueForKey(fieldName.c_str());
+			if (YAJLDom::Value::STRING == value.getType())
 			{
-				return value->toString();
+				return value.toString();
 			}
 		}
 		return "";
@@ -74,13 +74,13 @@ namespace Wormhole
 
 	int JSONMessage::getArgsFieldInt(const MAUtil::String& fieldName)
 	{
-		YAJLDom::Value* argsNode = getParamNode("args");
-		if (NULL != argsNode && YAJLDom::Value::MAP == argsNode->getType())
+		YAJLDom::Node argsNode = getMessage().getValueForKey("args");
+		if (YAJLDom::Value::MAP == argsNode.getType())
 		{
-			YAJLDom::Value* value = argsNode->getValueForKey(fieldName.c_str());
-			if (NULL != value && YAJLDom::Value::NUMBER == value->getType())
+			YAJLDom::Node value = argsNode.getValueForKey(fieldName.c_str());
+			if (YAJLDom::Value::NUMBER == value.getType())
 			{
-				return value->toInt();
+				return value.toInt();
 			}
 		}
 		return 0;
@@ -88,13 +88,13 @@ namespace Wormhole
 
 	MAUtil::String JSONMessage::getArgsField(int index)
 	{
-		YAJLDom::Value* argsNode = getParamNode("args");
-		if (NULL != argsNode && YAJLDom::Value::ARRAY == argsNode->getType())
+		YAJLDom::Node argsNode = getMessage().getValueForKey("args");
+		if (YAJLDom::Value::ARRAY == argsNode.getType())
 		{
-			YAJLDom::Value* value = argsNode->getValueByIndex(index);
-			if (NULL != value && YAJLDom::Value::STRING == value->getType())
+			YAJLDom::Node value = argsNode.getValueByIndex(index);
+			if (YAJLDom::Value::STRING == value.getType())
 			{
-				return value->toString();
+				return value.toString();
 			}
 		}
 		return "";
@@ -102,13 +102,13 @@ namespace Wormhole
 
 	int JSONMessage::getArgsFieldInt(int index)
 	{
-		YAJLDom::Value* argsNode = getParamNode("args");
-		if (NULL != argsNode && YAJLDom::Value::ARRAY == argsNode->getType())
+		YAJLDom::Node argsNode = getMessage().getValueForKey("args");
+		if (YAJLDom::Value::ARRAY == argsNode.getType())
 		{
-			YAJLDom::Value* value = argsNode->getValueByIndex(index);
-			if (NULL != value && YAJLDom::Value::NUMBER == value->getType())
+			YAJLDom::Node value = argsNode.getValueByIndex(index);
+			if (YAJLDom::Value::NUMBER == value.getType())
 			{
-				return value->toInt();
+				return value.toInt();
 			}
 		}
 		return 0;
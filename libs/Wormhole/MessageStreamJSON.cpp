@@ -29,13 +29,62 @@ MA 02110-1301, USA.
 #include <mavsprintf.h>		// C string functions
 #include <mastdlib.h>		// C string conversion functions
 #include <conprint.h>
+#include <MAP/MemoryMgr.h>
 
 #include "MessageStreamJSON.h"
 
 using namespace MAUtil;
+using namespace MAPUtil;
 
 namespace Wormhole
 {
+	/**
+	 * Make a Value tree that is a copy of a node.
+	 * Delete it with YAJLDom::deleteValue.
+	 */
+	static YAJLDom::Value* makeValue(const YAJLDom::Node& node)
+	{
+		switch (node.getType())
+		{
+			case YAJLDom::Value::BOOLEAN:
+				return newobject(YAJLDom::BooleanValue,
+					new YAJLDom::BooleanValue(node.toBoolean()));
+			case YAJLDom::Value::NUMBER:
+				return newobject(YAJLDom::NumberValue,
+					new YAJLDom::NumberValue(node.toDouble()));
+			case YAJLDom::Value::STRING:
+				return newobject(YAJLDom::StringValue,
+					new YAJLDom::StringValue(
+						node.getString(),
+						node.getStringLength()));
+			case YAJLDom::Value::ARRAY:
+			{
+				YAJLDom::ArrayValue* array = newobject(
+					YAJLDom::ArrayValue, new YAJLDom::ArrayValue());
+				for (int i = 0; i < node.getNumChildValues(); ++i)
+				{
+					array->addValue(makeValue(node.getValueByIndex(i)));
+				}
+				return array;
+			}
+			case YAJLDom::Value::MAP:
+			{
+				YAJLDom::MapValue* map = newobject(
+					YAJLDom::MapValue, new YAJLDom::MapValue());
+				for (int i = 0; i < node.getNumChildValues(); ++i)
+				{
+					map->setValueForKey(
+						node.getKey(i),
+						makeValue(node.getValueByIndex(i)));
+				}
+				return map;
+			}
+			default:
+				return newobject(YAJLDom::NullValue,
+					new YAJLDom::NullValue());
+		}
+	}
+
 	/**
 	 * Constructor. Here we parse the message.
 	 */
@@ -45,7 +94,10 @@ namespace Wormhole
 	{
 		mWebViewHandle = webViewHandle;
 		mWebView = NULL;
+		mJSONRoot = NULL;
 		mCurrentMessageIndex = -1;
+		mStringData = NULL;
+		mDataSize = 0;
 		parse(dataHandle);
 	}
 
@@ -59,12 +111,15 @@ namespace Wormhole
 	{
 		mWebViewHandle = webView->getWidgetHandle();
 		mWebView = webView;
+		mJSONRoot = NULL;
 		mCurrentMessageIndex = -1;
+		mStringData = NULL;
+		mDataSize = 0;
 		parse(dataHandle);
 	}
 
 	/**
-	 * Destructor. Here we delete the JSON tree.
+	 * Destructor. Here we delete the JSON trees and the message data.
 	 */
 	MessageStreamJSON::~MessageStreamJSON()
 	{
@@ -75,6 +130,13 @@ namespace Wormhole
 			YAJLDom::deleteValue(mJSONRoot);
 			mJSONRoot = NULL;
 		}
+
+		for (int i = 0; i < mParamNodes.size(); ++i)
+		{
+			YAJLDom::deleteValue(mParamNodes[i].mValue);
+		}
+
+		free(mStringData);
 	}
 
 	/**
@@ -119,10 +181,10 @@ namespace Wormhole
 	 */
 	bool MessageStreamJSON::next()
 	{
-		if (NULL != mJSONRoot && YAJLDom::Value::ARRAY == mJSONRoot->getType())
+		if (mReader.next())
 		{
-			++mCurrentMessageIndex;
-			return mCurrentMessageIndex < mJSONRoot->getNumChildValues();
+			mCurrentMessageIndex = mReader.getIndex();
+			return true;
 		}
 		return false;
 	}
@@ -132,25 +194,7 @@ namespace Wormhole
 	 */
 	bool MessageStreamJSON::is(const char* paramName)
 	{
-		YAJLDom::Value* value = getParamNode("messageName");
-		if (NULL != value && YAJLDom::Value::STRING == value->getType())
-		{
-		// Commented out code that was intended to be used with
-		// pointers into the unparsed JSON data. This was made as
-		// part of a project to remove creation of String objects
-		// from YAJLDom. But this was never finished. A problem
-		// with the raw string data is that it needs to be unstringified,
-		// and therefore one of the benefits of using raw data gets lost,
-		// you still need to create a new string. Code left here as a
-		// reference.
-//			YAJLDom::StringValue* stringValue = (YAJLDom::StringValue*) value;
-//			return 0 == strncmp(
-//				paramName,
-//				stringValue->getCharPointer(),
-//				stringValue->getLength());
-			return value->toString() == paramName;
-		}
-		return false;
+		return getMessage().getValueForKey("messageName").equals(paramName);
 	}
 
 	/**
@@ -159,10 +203,10 @@ namespace Wormhole
 	 */
 	String MessageStreamJSON::getParam(const char* paramName)
 	{
-		YAJLDom::Value* value = getParamNode(paramName);
-		if (NULL != value && YAJLDom::Value::STRING == value->getType())
+		YAJLDom::Node value = getMessage().getValueForKey(paramName);
+		if (YAJLDom::Value::STRING == value.getType())
 		{
-			return value->toString();
+			return value.toString();
 		}
 		return "";
 	}
@@ -173,10 +217,10 @@ namespace Wormhole
 	 */
 	int MessageStreamJSON::getParamInt(const char* paramName)
 	{
-		YAJLDom::Value* value = getParamNode(paramName);
-		if (NULL != value && YAJLDom::Value::NUMBER == value->getType())
+		YAJLDom::Node value = getMessage().getValueForKey(paramName);
+		if (YAJLDom::Value::NUMBER == value.getType())
 		{
-			return value->toInt();
+			return value.toInt();
 		}
 		return 0;
 	}
@@ -186,8 +230,7 @@ namespace Wormhole
 	 */
 	bool MessageStreamJSON::hasParam(const char* paramName)
 	{
-		YAJLDom::Value* value = getParamNode(paramName);
-		return (NULL != value && YAJLDom::Value::NUL != value->getType());
+		return !getMessage().getValueForKey(paramName).isNull();
 	}
 
 	/**
@@ -195,15 +238,37 @@ namespace Wormhole
 	 */
 	YAJLDom::Value* MessageStreamJSON::getParamNode(const char* paramName)
 	{
-		if (NULL != mJSONRoot && YAJLDom::Value::ARRAY == mJSONRoot->getType())
+		YAJLDom::Node message = getMessage();
+		if (YAJLDom::Value::MAP != message.getType())
+		{
+			return NULL;
+		}
+
+		// Callers ask for the same parameter many times, make it once.
+		for (int i = 0; i < mParamNodes.size(); ++i)
 		{
-			YAJLDom::Value* message = mJSONRoot->getValueByIndex(mCurrentMessageIndex);
-			if (YAJLDom::Value::MAP == message->getType())
+			if (mParamNodes[i].mMessageIndex == mCurrentMessageIndex
+				&& mParamNodes[i].mParamName == paramName)
 			{
-				return message->getValueForKey(paramName);
+				return mParamNodes[i].mValue;
 			}
 		}
-		return NULL;
+
+		ParamNode node;
+		node.mMessageIndex = mCurrentMessageIndex;
+		node.mParamName = paramName;
+		node.mValue = makeValue(message.getValueForKey(paramName));
+		mParamNodes.add(node);
+		return node.mValue;
+	}
+
+	/**
+	 * Get the current message. The node is valid until
+	 * the next call to next().
+	 */
+	YAJLDom::Node MessageStreamJSON::getMessage()
+	{
+		return mReader.current();
 	}
 
 	/**
@@ -211,12 +276,20 @@ namespace Wormhole
 	 */
 	MAUtil::YAJLDom::Value* MessageStreamJSON::getJSONRoot()
 	{
+		if (NULL == mJSONRoot && NULL != mStringData
+			&& 0 == strncmp(mStringData, "ma:[", 4))
+		{
+			mJSONRoot = YAJLDom::parse(
+				(const unsigned char*)mStringData + 3,
+				mDataSize - 3);
+		}
 		return mJSONRoot;
 	}
 
 	/**
-	 * Parse the message. This finds the message name and
-	 * creates a dictionary with the message parameters.
+	 * Parse the message. This reads the message data and checks
+	 * that it is a message array. The messages themselves are
+	 * parsed one by one in next().
 	 */
 	void MessageStreamJSON::parse(MAHandle dataHandle)
 	{
@@ -231,8 +304,16 @@ namespace Wormhole
 		// Get length of the data, it is not zero terminated.
 		int dataSize = maGetDataSize(dataHandle);
 
-		// Allocate buffer for string data.
-		char* stringData = (char*) malloc(dataSize + 1);
+		// Allocate buffer for string data. It is kept until the
+		// destructor, the parsed messages point into it.
+		free(mStringData);
+		mStringData = (char*) malloc(dataSize + 1);
+		if (NULL == mStringData)
+		{
+			return;
+		}
+		mDataSize = dataSize;
+		char* stringData = mStringData;
 
 		// Get the data.
 		maReadData(dataHandle, stringData, 0, dataSize);
@@ -253,11 +334,7 @@ namespace Wormhole
 		// opening '[' character.
 		char* jsonData = stringData + 3;
 
-		mJSONRoot = YAJLDom::parse(
-			(const unsigned char*)jsonData,
-			dataSize - 3);
-
-		free(stringData);
+		mReader.open(jsonData, dataSize - 3);
 	}
 
 } // namespace
@@ -37,8 +37,10 @@ MA 02110-1301, USA.
 #include <ma.h>
 #include <MAUtil/String.h>
 #include <MAUtil/HashMap.h>
+#include <MAUtil/Vector.h>
 #include <NativeUI/WebView.h>
 #include <yajl/YAJLDom.h>
+#include <yajl/YAJLDocument.h>
 
 namespace Wormhole
 {
@@ -53,6 +55,8 @@ namespace Wormhole
  *
  *   ma:[{"messageName":"message1",...},{"messageName":"message2",...},...]
  *
+ * Messages are parsed one at a time, when next() moves to them.
+ *
  * TODO: Add copy constructor and assignment operator.
  */
 class MessageStreamJSON
@@ -131,17 +135,27 @@ public:
 
 	/**
 	 * Get the node of a top-level parameter in the current message.
+	 * The node is built on demand from the parsed message and is
+	 * owned by the stream. Prefer getMessage(), which needs no copy.
 	 */
 	MAUtil::YAJLDom::Value* getParamNode(const char* paramName);
 
 	/**
-	 * @return The JSON root node.
+	 * Get the current message. The node is valid until
+	 * the next call to next().
+	 */
+	MAUtil::YAJLDom::Node getMessage();
+
+	/**
+	 * @return The JSON root node. This parses the whole
+	 * message array into a Value tree on first use.
 	 */
 	MAUtil::YAJLDom::Value* getJSONRoot();
 
 	/**
-	 * Parse the message. This finds the message name and
-	 * creates a dictionary with the message parameters.
+	 * Parse the message. This reads the message data and checks
+	 * that it is a message array. The messages themselves are
+	 * parsed one by one in next().
 	 */
 	void parse(MAHandle dataHandle);
 
@@ -158,7 +172,7 @@ protected:
 	NativeUI::WebView* mWebView;
 
 	/**
-	 * Table for message parameters.
+	 * Value tree of the whole message array, made by getJSONRoot().
 	 */
 	MAUtil::YAJLDom::Value* mJSONRoot;
 
@@ -166,6 +180,37 @@ protected:
 	 * Index of current message.
 	 */
 	int mCurrentMessageIndex;
+
+	/**
+	 * The message data. The parsed messages point into it.
+	 */
+	char* mStringData;
+
+	/**
+	 * Size of the message data.
+	 */
+	int mDataSize;
+
+	/**
+	 * Parses the messages one at a time.
+	 */
+	MAUtil::YAJLDom::ArrayReader mReader;
+
+	/**
+	 * A Value tree made by getParamNode().
+	 */
+	struct ParamNode
+	{
+		int mMessageIndex;
+		MAUtil::String mParamName;
+		MAUtil::YAJLDom::Value* mValue;
+	};
+
+	/**
+	 * Value trees made by getParamNode(). They are kept
+	 * until the stream is destroyed.
+	 */
+	MAUtil::Vector<ParamNode> mParamNodes;
 };
 
 } // namespace
@@ -0,0 +1,727 @@
+/* Copyright (C) 2011 Mobile Sorcery AB
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License, version 2, as published by
+the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING.  If not, write to the Free
+Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.
+*/
+
+/*
+ * YAJLDocument.cpp
+ *
+ * Node storage is two plain structs. A DocumentItem is a value: numbers
+ * and booleans are stored inline, strings as pointer and length, and
+ * containers as pointer and count of their children. Array children are
+ * a contiguous DocumentItem array; map children are a contiguous
+ * DocumentMember array, sorted by key, with duplicate keys removed.
+ *
+ * While a container is open its children are collected on a scratch
+ * stack shared by all open containers. When it closes, they are copied
+ * into the arena as one array and popped. Nothing is ever freed
+ * individually.
+ */
+
+#include "YAJLDocument.h"
+#include <MAUtil/util.h>
+#include <maheap.h>
+#include <mastring.h>
+#include <mastdlib.h>
+#include <madmath.h>
+#include "src/api/yajl_parse.h"
+
+namespace MAUtil {
+namespace YAJLDom {
+
+struct DocumentItem {
+	int type;
+	// Bytes of a string, or number of children of a container.
+	int length;
+	union {
+		double number;
+		int boolean;
+		const char* string;
+		const DocumentItem* elements;
+		const DocumentMember* members;
+	} u;
+};
+
+struct DocumentMember {
+	const char* key;
+	int keyLength;
+	DocumentItem value;
+};
+
+struct Document::Block {
+	Block* next;
+	int size;
+	int used;
+	double data[1];
+};
+
+struct Document::Frame {
+	int type;
+	// Index of the first child on the scratch stack.
+	int start;
+	// Key of the next member, for maps.
+	const char* key;
+	int keyLength;
+};
+
+#define FIRST_BLOCK_SIZE 2048
+#define MAX_BLOCK_SIZE (64 * 1024)
+
+// Longest number that is converted from a stack copy.
+#define MAX_NUMBER_LENGTH 63
+
+static int compareKeys(const DocumentMember& a, const DocumentMember& b) {
+	int n = a.keyLength < b.keyLength ? a.keyLength : b.keyLength;
+	int c = memcmp(a.key, b.key, n);
+	if (c != 0)
+		return c;
+	return a.keyLength - b.keyLength;
+}
+
+// Stable merge sort, so that members with equal keys stay in text order.
+// tmp must have room for n members.
+static void sortMembers(DocumentMember* a, DocumentMember* tmp, int n) {
+	if (n <= 8) {
+		for (int i = 1; i < n; i++) {
+			DocumentMember m = a[i];
+			int j = i;
+			while (j > 0 && compareKeys(m, a[j - 1]) < 0) {
+				a[j] = a[j - 1];
+				j--;
+			}
+			a[j] = m;
+		}
+		return;
+	}
+
+	int half = n / 2;
+	sortMembers(a, tmp, half);
+	sortMembers(a + half, tmp, n - half);
+
+	int i = 0, j = half, k = 0;
+	while (i < half && j < n) {
+		if (compareKeys(a[j], a[i]) < 0)
+			tmp[k++] = a[j++];
+		else
+			tmp[k++] = a[i++];
+	}
+	while (i < half)
+		tmp[k++] = a[i++];
+	while (j < n)
+		tmp[k++] = a[j++];
+	memcpy(a, tmp, n * sizeof(DocumentMember));
+}
+
+// Removes all but the last of each run of equal keys in a sorted array.
+// Returns the new count.
+static int removeDuplicateKeys(DocumentMember* a, int n) {
+	int count = 0;
+	for (int i = 0; i < n; i++) {
+		if (i + 1 < n && compareKeys(a[i], a[i + 1]) == 0)
+			continue;
+		a[count++] = a[i];
+	}
+	return count;
+}
+
+//******************************************************************************
+// Node
+//******************************************************************************
+
+Node::Node() : mItem(NULL) {
+}
+
+Node::Node(const DocumentItem* item) : mItem(item) {
+}
+
+Value::Type Node::getType() const {
+	if (mItem == NULL)
+		return Value::NUL;
+	return (Value::Type) mItem->type;
+}
+
+bool Node::isNull() const {
+	return getType() == Value::NUL;
+}
+
+bool Node::toBoolean() const {
+	if (getType() == Value::BOOLEAN)
+		return mItem->u.boolean != 0;
+	return toString() == "true";
+}
+
+int Node::toInt() const {
+	if (getType() == Value::NUMBER)
+		return (int) mItem->u.number;
+	return stringToInteger(toString());
+}
+
+double Node::toDouble() const {
+	if (getType() == Value::NUMBER)
+		return mItem->u.number;
+	return stringToDouble(toString());
+}
+
+const char* Node::getString() const {
+	if (getType() != Value::STRING)
+		return NULL;
+	return mItem->u.string;
+}
+
+int Node::getStringLength() const {
+	if (getType() != Value::STRING)
+		return 0;
+	return mItem->length;
+}
+
+bool Node::equals(const char* str) const {
+	if (getType() != Value::STRING)
+		return false;
+	int length = strlen(str);
+	return length == mItem->length &&
+		memcmp(str, mItem->u.string, length) == 0;
+}
+
+static void appendItem(String& out, const DocumentItem* item, bool nullText);
+
+static void appendQuoted(String& out, const DocumentItem* item, bool nullText) {
+	if (item->type == Value::STRING) {
+		out += "\"";
+		out.append(item->u.string, item->length);
+		out += "\"";
+	} else {
+		appendItem(out, item, nullText);
+	}
+}
+
+// Same text as the Value::toString() overrides, including their quirk
+// that null prints as "null" inside maps but as nothing inside arrays.
+static void appendItem(String& out, const DocumentItem* item, bool nullText) {
+	switch (item->type) {
+	case Value::NUL:
+		if (nullText)
+			out += "null";
+		break;
+	case Value::BOOLEAN:
+		out += item->u.boolean ? "true" : "false";
+		break;
+	case Value::NUMBER:
+		out += doubleToString(item->u.number);
+		break;
+	case Value::STRING:
+		out.append(item->u.string, item->length);
+		break;
+	case Value::ARRAY:
+		out += "[";
+		for (int i = 0; i < item->length; i++) {
+			if (i > 0)
+				out += ", ";
+			appendQuoted(out, &item->u.elements[i], false);
+		}
+		out += "]";
+		break;
+	case Value::MAP:
+		out += "{";
+		for (int i = 0; i < item->length; i++) {
+			const DocumentMember& m = item->u.members[i];
+			if (i > 0)
+				out += ", ";
+			out += "\"";
+			out.append(m.key, m.keyLength);
+			out += "\": ";
+			appendQuoted(out, &m.value, true);
+		}
+		out += "}";
+		break;
+	}
+}
+
+String Node::toString() const {
+	String ret;
+	if (mItem != NULL)
+		appendItem(ret, mItem, false);
+	return ret;
+}
+
+int Node::getNumChildValues() const {
+	Value::Type type = getType();
+	if (type == Value::ARRAY || type == Value::MAP)
+		return mItem->length;
+	return 0;
+}
+
+Node Node::getValueByIndex(int i) const {
+	if (i < 0 || i >= getNumChildValues())
+		return Node();
+	if (mItem->type == Value::ARRAY)
+		return Node(&mItem->u.elements[i]);
+	return Node(&mItem->u.members[i].value);
+}
+
+Node Node::getValueForKey(const char* key) const {
+	return getValueForKey(key, strlen(key));
+}
+
+Node Node::getValueForKey(const char* key, int keyLength) const {
+	if (getType() != Value::MAP)
+		return Node();
+
+	DocumentMember probe;
+	probe.key = key;
+	probe.keyLength = keyLength;
+
+	const DocumentMember* members = mItem->u.members;
+	int low = 0;
+	int high = mItem->length;
+	while (low < high) {
+		int mid = (low + high) / 2;
+		int c = compareKeys(members[mid], probe);
+		if (c == 0)
+			return Node(&members[mid].value);
+		if (c < 0)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	return Node();
+}
+
+String Node::getKey(int i) const {
+	if (getType() != Value::MAP || i < 0 || i >= mItem->length)
+		return "";
+	const DocumentMember& m = mItem->u.members[i];
+	return String(m.key, m.keyLength);
+}
+
+//******************************************************************************
+// Document
+//******************************************************************************
+
+Document::Document() :
+	mBlocks(NULL), mRoot(NULL), mText(NULL), mTextEnd(NULL),
+	mFrames(NULL), mFrameCount(0), mFrameCapacity(0),
+	mScratch(NULL), mScratchCount(0), mScratchCapacity(0) {
+}
+
+Document::~Document() {
+	freeBlocks(mBlocks);
+	free(mFrames);
+	free(mScratch);
+}
+
+void Document::freeBlocks(Block* block) {
+	while (block != NULL) {
+		Block* next = block->next;
+		free(block);
+		block = next;
+	}
+}
+
+void Document::clear() {
+	if (mBlocks != NULL) {
+		// The newest block is also the biggest, keep it.
+		freeBlocks(mBlocks->next);
+		mBlocks->next = NULL;
+		mBlocks->used = 0;
+	}
+	mRoot = NULL;
+}
+
+int Document::getByteSize() const {
+	int size = 0;
+	for (Block* block = mBlocks; block != NULL; block = block->next)
+		size += block->used;
+	return size;
+}
+
+void* Document::allocate(int size) {
+	// Keep everything 8-aligned, for the doubles.
+	size = (size + 7) & ~7;
+	if (size == 0)
+		size = 8;
+
+	if (mBlocks == NULL || mBlocks->size - mBlocks->used < size) {
+		int blockSize = FIRST_BLOCK_SIZE;
+		if (mBlocks != NULL && mBlocks->size < MAX_BLOCK_SIZE)
+			blockSize = mBlocks->size * 2;
+		else if (mBlocks != NULL)
+			blockSize = mBlocks->size;
+		if (blockSize < size)
+			blockSize = size;
+
+		Block* block = (Block*) malloc(sizeof(Block) - sizeof(double) + blockSize);
+		if (block == NULL)
+			return NULL;
+		block->next = mBlocks;
+		block->size = blockSize;
+		block->used = 0;
+		mBlocks = block;
+	}
+
+	void* p = (char*) mBlocks->data + mBlocks->used;
+	mBlocks->used += size;
+	return p;
+}
+
+// Strings that lie in the text are used where they are. Others, the ones
+// yajl had to unescape into its own buffer, are copied.
+const char* Document::keep(const char* str, int length) {
+	if (str >= mText && str < mTextEnd)
+		return str;
+	char* copy = (char*) allocate(length);
+	if (copy != NULL)
+		memcpy(copy, str, length);
+	return copy;
+}
+
+DocumentMember* Document::pushMember() {
+	if (mScratchCount == mScratchCapacity) {
+		int capacity = mScratchCapacity ? mScratchCapacity * 2 : 32;
+		DocumentMember* scratch = (DocumentMember*)
+			realloc(mScratch, capacity * sizeof(DocumentMember));
+		if (scratch == NULL)
+			return NULL;
+		mScratch = scratch;
+		mScratchCapacity = capacity;
+	}
+	return &mScratch[mScratchCount++];
+}
+
+bool Document::addValue(const DocumentItem& item) {
+	if (mFrameCount == 0) {
+		if (mRoot != NULL)
+			return false;
+		mRoot = (DocumentItem*) allocate(sizeof(DocumentItem));
+		if (mRoot == NULL)
+			return false;
+		*mRoot = item;
+		return true;
+	}
+
+	DocumentMember* member = pushMember();
+	if (member == NULL)
+		return false;
+	const Frame& frame = mFrames[mFrameCount - 1];
+	member->key = frame.key;
+	member->keyLength = frame.keyLength;
+	member->value = item;
+	return true;
+}
+
+bool Document::openContainer(Value::Type type) {
+	if (mFrameCount == mFrameCapacity) {
+		int capacity = mFrameCapacity ? mFrameCapacity * 2 : 16;
+		Frame* frames = (Frame*) realloc(mFrames, capacity * sizeof(Frame));
+		if (frames == NULL)
+			return false;
+		mFrames = frames;
+		mFrameCapacity = capacity;
+	}
+	Frame& frame = mFrames[mFrameCount++];
+	frame.type = type;
+	frame.start = mScratchCount;
+	frame.key = NULL;
+	frame.keyLength = 0;
+	return true;
+}
+
+bool Document::closeContainer() {
+	const Frame& frame = mFrames[--mFrameCount];
+	int start = frame.start;
+	int count = mScratchCount - start;
+
+	DocumentItem item;
+	item.type = frame.type;
+
+	if (frame.type == Value::ARRAY) {
+		DocumentItem* elements =
+			(DocumentItem*) allocate(count * sizeof(DocumentItem));
+		if (elements == NULL)
+			return false;
+		for (int i = 0; i < count; i++)
+			elements[i] = mScratch[start + i].value;
+		item.length = count;
+		item.u.elements = elements;
+	} else {
+		// Sort in place, using the free end of the scratch stack.
+		int needed = start + 2 * count;
+		if (needed > mScratchCapacity) {
+			DocumentMember* scratch = (DocumentMember*)
+				realloc(mScratch, needed * sizeof(DocumentMember));
+			if (scratch == NULL)
+				return false;
+			mScratch = scratch;
+			mScratchCapacity = needed;
+		}
+		DocumentMember* members = mScratch + start;
+		sortMembers(members, members + count, count);
+		count = removeDuplicateKeys(members, count);
+
+		DocumentMember* copy =
+			(DocumentMember*) allocate(count * sizeof(DocumentMember));
+		if (copy == NULL)
+			return false;
+		if (count > 0)
+			memcpy(copy, members, count * sizeof(DocumentMember));
+		item.length = count;
+		item.u.members = copy;
+	}
+
+	mScratchCount = start;
+	return addValue(item);
+}
+
+int Document::onNull(void* ctx) {
+	DocumentItem item;
+	item.type = Value::NUL;
+	item.length = 0;
+	return ((Document*) ctx)->addValue(item);
+}
+
+int Document::onBoolean(void* ctx, int boolean) {
+	DocumentItem item;
+	item.type = Value::BOOLEAN;
+	item.length = 0;
+	item.u.boolean = boolean;
+	return ((Document*) ctx)->addValue(item);
+}
+
+int Document::onNumber(void* ctx, const char* s, unsigned int l) {
+	// The number is not zero terminated.
+	char buffer[MAX_NUMBER_LENGTH + 1];
+	char* str = buffer;
+	if (l > MAX_NUMBER_LENGTH) {
+		str = (char*) ((Document*) ctx)->allocate(l + 1);
+		if (str == NULL)
+			return 0;
+	}
+	memcpy(str, s, l);
+	str[l] = 0;
+
+	DocumentItem item;
+	item.type = Value::NUMBER;
+	item.length = 0;
+	item.u.number = atof(str);
+	return ((Document*) ctx)->addValue(item);
+}
+
+int Document::onString(void* ctx, const unsigned char* s, unsigned int l) {
+	Document* doc = (Document*) ctx;
+	DocumentItem item;
+	item.type = Value::STRING;
+	item.length = l;
+	item.u.string = doc->keep((const char*) s, l);
+	if (item.u.string == NULL)
+		return 0;
+	return doc->addValue(item);
+}
+
+int Document::onMapKey(void* ctx, const unsigned char* s, unsigned int l) {
+	Document* doc = (Document*) ctx;
+	Frame& frame = doc->mFrames[doc->mFrameCount - 1];
+	frame.key = doc->keep((const char*) s, l);
+	frame.keyLength = l;
+	return frame.key != NULL;
+}
+
+int Document::onStartMap(void* ctx) {
+	return ((Document*) ctx)->openContainer(Value::MAP);
+}
+
+int Document::onEndMap(void* ctx) {
+	return ((Document*) ctx)->closeContainer();
+}
+
+int Document::onStartArray(void* ctx) {
+	return ((Document*) ctx)->openContainer(Value::ARRAY);
+}
+
+int Document::onEndArray(void* ctx) {
+	return ((Document*) ctx)->closeContainer();
+}
+
+bool Document::parse(const char* jsonText, int jsonTextLength) {
+	static const yajl_callbacks callbacks = { onNull, onBoolean, NULL, NULL,
+		onNumber, onString, onStartMap, onMapKey,
+		onEndMap, onStartArray, onEndArray };
+	yajl_parser_config cfg = { 1, 1 };
+
+	clear();
+	mText = jsonText;
+	mTextEnd = jsonText + jsonTextLength;
+	mFrameCount = 0;
+	mScratchCount = 0;
+
+	yajl_handle hand = yajl_alloc(&callbacks, &cfg, NULL, this);
+	if (hand == NULL)
+		return false;
+
+	yajl_status stat = yajl_parse(hand,
+		(const unsigned char*) jsonText, jsonTextLength);
+	if (stat == yajl_status_ok || stat == yajl_status_insufficient_data)
+		stat = yajl_parse_complete(hand);
+	yajl_free(hand);
+
+	if (stat != yajl_status_ok || mFrameCount != 0 || mRoot == NULL) {
+		clear();
+		return false;
+	}
+	return true;
+}
+
+Node Document::getRoot() const {
+	return Node(mRoot);
+}
+
+//******************************************************************************
+// ArrayReader
+//******************************************************************************
+
+// Skips whitespace and comments, which yajl allows as configured above.
+static const char* skipSpace(const char* p, const char* end) {
+	while (p < end) {
+		char c = *p;
+		if (c == ' ' || c == '\t' || c == '\n' || c == '\r' ||
+			c == '\f' || c == '\v')
+		{
+			p++;
+		} else if (c == '/' && p + 1 < end && p[1] == '/') {
+			p += 2;
+			while (p < end && *p != '\n')
+				p++;
+		} else if (c == '/' && p + 1 < end && p[1] == '*') {
+			p += 2;
+			while (p + 1 < end && !(p[0] == '*' && p[1] == '/'))
+				p++;
+			p += 2;
+		} else {
+			break;
+		}
+	}
+	return p < end ? p : end;
+}
+
+// p points after the opening quote. Returns the position after the
+// closing quote, or NULL.
+static const char* skipString(const char* p, const char* end) {
+	while (p < end) {
+		char c = *p++;
+		if (c == '\\')
+			p++;
+		else if (c == '"')
+			return p;
+	}
+	return NULL;
+}
+
+ArrayReader::ArrayReader() :
+	mPos(NULL), mEnd(NULL), mIndex(-1), mError(false), mDone(true) {
+}
+
+bool ArrayReader::open(const char* jsonText, int jsonTextLength) {
+	mDocument.clear();
+	mEnd = jsonText + jsonTextLength;
+	mPos = skipSpace(jsonText, mEnd);
+	mIndex = -1;
+	mError = false;
+	mDone = false;
+	if (mPos == mEnd || *mPos != '[') {
+		mError = true;
+		return false;
+	}
+	mPos++;
+	return true;
+}
+
+// Finds the end of the element that starts at p. This only has to get the
+// extent right for valid JSON; the element itself is checked by yajl.
+const char* ArrayReader::findElementEnd(const char* p) const {
+	if (*p == '"')
+		return skipString(p + 1, mEnd);
+
+	if (*p == '{' || *p == '[') {
+		int depth = 0;
+		while (p < mEnd) {
+			char c = *p++;
+			if (c == '"') {
+				p = skipString(p, mEnd);
+				if (p == NULL)
+					return NULL;
+			} else if (c == '{' || c == '[') {
+				depth++;
+			} else if (c == '}' || c == ']') {
+				if (--depth == 0)
+					return p;
+			} else if (c == '/' && p < mEnd && (*p == '/' || *p == '*')) {
+				p = skipSpace(p - 1, mEnd);
+			}
+		}
+		return NULL;
+	}
+
+	const char* start = p;
+	while (p < mEnd && *p != ',' && *p != ']' && *p != '}' && *p != '/' &&
+		*p != ' ' && *p != '\t' && *p != '\n' && *p != '\r')
+	{
+		p++;
+	}
+	return p > start ? p : NULL;
+}
+
+bool ArrayReader::next() {
+	if (mDone || mError)
+		return false;
+
+	const char* p = skipSpace(mPos, mEnd);
+	if (p < mEnd && *p == ']') {
+		mDone = true;
+		mDocument.clear();
+		return false;
+	}
+	if (mIndex >= 0) {
+		if (p == mEnd || *p != ',') {
+			mError = true;
+			mDocument.clear();
+			return false;
+		}
+		p = skipSpace(p + 1, mEnd);
+	}
+
+	const char* end = p < mEnd ? findElementEnd(p) : NULL;
+	if (end == NULL || !mDocument.parse(p, end - p)) {
+		mError = true;
+		mDocument.clear();
+		return false;
+	}
+
+	mPos = end;
+	mIndex++;
+	return true;
+}
+
+Node ArrayReader::current() const {
+	return mDocument.getRoot();
+}
+
+int ArrayReader::getIndex() const {
+	return mIndex;
+}
+
+bool ArrayReader::hasError() const {
+	return mError;
+}
+
+} // namespace YAJLDom
+} // namespace MAUtil
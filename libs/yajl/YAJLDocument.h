@@ -0,0 +1,231 @@
+/* Copyright (C) 2011 Mobile Sorcery AB
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License, version 2, as published by
+the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING.  If not, write to the Free
+Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.
+*/
+
+/*
+ * YAJLDocument.h
+ *
+ * A flat, arena-allocated alternative to the Value tree in YAJLDom.h.
+ *
+ * A Document owns one arena. Parsing puts every node, every child array
+ * and every decoded string in it, and clear() or the destructor gives it
+ * all back in one go. Strings without escapes are not copied at all; they
+ * point straight into the parsed text, so the text must outlive the
+ * Document. Map members are kept sorted by key, so lookups are a binary
+ * search over a flat array.
+ *
+ * ArrayReader is the lazy mode: it walks a JSON array and parses one
+ * element at a time, reusing the same arena for each.
+ */
+
+#ifndef _YAJL_DOCUMENT_H_
+#define _YAJL_DOCUMENT_H_
+
+#include <MAUtil/String.h>
+#include "YAJLDom.h"
+
+namespace MAUtil {
+namespace YAJLDom {
+
+struct DocumentItem;
+struct DocumentMember;
+
+/**
+ * A read-only handle to a value in a Document. It is a single pointer and
+ * is meant to be passed by value. A Node for a missing key or index has
+ * type Value::NUL, just like the sNullValue returned by the Value tree.
+ * A Node is valid until its Document is cleared, reparsed or destroyed.
+ */
+class Node {
+public:
+	Node();
+
+	Value::Type getType() const;
+	bool isNull() const;
+
+	bool toBoolean() const;
+	int toInt() const;
+	double toDouble() const;
+
+	/**
+	 * The bytes of a STRING value. Not zero terminated; use
+	 * getStringLength(). Returns NULL for other types.
+	 */
+	const char* getString() const;
+	int getStringLength() const;
+
+	/**
+	 * Compare a STRING value to a zero terminated string
+	 * without making a copy.
+	 */
+	bool equals(const char* str) const;
+
+	/**
+	 * Copy of the value as text, formatted as Value::toString() does.
+	 */
+	MAUtil::String toString() const;
+
+	/**
+	 * Number of elements of an ARRAY or members of a MAP, 0 otherwise.
+	 */
+	int getNumChildValues() const;
+
+	Node getValueByIndex(int i) const;
+
+	/**
+	 * Member lookup in a MAP. If the key occurs more than once,
+	 * the last one in the text wins, as it does in MapValue.
+	 */
+	Node getValueForKey(const char* key) const;
+	Node getValueForKey(const char* key, int keyLength) const;
+
+	/**
+	 * Key of member i of a MAP. Members are in key order.
+	 */
+	MAUtil::String getKey(int i) const;
+
+private:
+	friend class Document;
+	Node(const DocumentItem* item);
+
+	const DocumentItem* mItem;
+};
+
+/**
+ * Owner of a parsed JSON text.
+ */
+class Document {
+public:
+	Document();
+	~Document();
+
+	/**
+	 * Parse JSON text, replacing anything parsed before.
+	 * The text is referenced, not copied, and must stay alive and
+	 * unchanged for as long as the Document is used.
+	 * \param jsonText UTF8 or ASCII.
+	 * \param jsonTextLength Length of Json text.
+	 * \return true if successful. On error the root is NUL.
+	 */
+	bool parse(const char* jsonText, int jsonTextLength);
+
+	Node getRoot() const;
+
+	/**
+	 * Free everything parsed so far. The newest arena block is
+	 * kept for reuse by the next parse.
+	 */
+	void clear();
+
+	/**
+	 * Number of arena bytes in use.
+	 */
+	int getByteSize() const;
+
+private:
+	struct Block;
+	struct Frame;
+
+	// Not copyable.
+	Document(const Document&);
+	Document& operator=(const Document&);
+
+	void* allocate(int size);
+	void freeBlocks(Block* first);
+
+	const char* keep(const char* str, int length);
+	bool addValue(const DocumentItem& item);
+	bool openContainer(Value::Type type);
+	bool closeContainer();
+	DocumentMember* pushMember();
+
+	static int onNull(void* ctx);
+	static int onBoolean(void* ctx, int boolean);
+	static int onNumber(void* ctx, const char* s, unsigned int l);
+	static int onString(void* ctx, const unsigned char* s, unsigned int l);
+	static int onMapKey(void* ctx, const unsigned char* s, unsigned int l);
+	static int onStartMap(void* ctx);
+	static int onEndMap(void* ctx);
+	static int onStartArray(void* ctx);
+	static int onEndArray(void* ctx);
+
+	Block* mBlocks;
+	DocumentItem* mRoot;
+
+	// Parse state. The text being parsed, the open containers, and the
+	// children of the open containers waiting to be copied into the arena
+	// when their container closes.
+	const char* mText;
+	const char* mTextEnd;
+	Frame* mFrames;
+	int mFrameCount;
+	int mFrameCapacity;
+	DocumentMember* mScratch;
+	int mScratchCount;
+	int mScratchCapacity;
+};
+
+/**
+ * Lazy reader for a JSON array. Each call to next() finds the extent of
+ * the next element with a quick scan and parses only that element.
+ * Elements after the current one are not looked at, so a syntax error
+ * there is only reported when the reader gets to it.
+ */
+class ArrayReader {
+public:
+	ArrayReader();
+
+	/**
+	 * Start reading an array. The text must start with '[' (leading
+	 * whitespace is allowed) and must stay alive while it is read.
+	 * \return false if the text does not start an array.
+	 */
+	bool open(const char* jsonText, int jsonTextLength);
+
+	/**
+	 * Parse the next element. The previous element is freed.
+	 * \return true if there is a new current element, false at the end
+	 * of the array or on error.
+	 */
+	bool next();
+
+	/**
+	 * The element parsed by the last successful next().
+	 */
+	Node current() const;
+
+	/**
+	 * Index of the current element, -1 before the first next().
+	 */
+	int getIndex() const;
+
+	bool hasError() const;
+
+private:
+	const char* findElementEnd(const char* p) const;
+
+	Document mDocument;
+	const char* mPos;
+	const char* mEnd;
+	int mIndex;
+	bool mError;
+	bool mDone;
+};
+
+} // namespace YAJLDom
+} // namespace MAUtil
+
+#endif // _YAJL_DOCUMENT_H_
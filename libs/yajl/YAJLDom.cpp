@@ -270,15 +270,9 @@ const Value* ArrayValue::getValueByIndex(int i) const {
 Value *sRoot = NULL;
 Stack<Value*> sValueStack;
 
-struct KeyString {
-	KeyString() {}
-	KeyString(const char* s, int len) : str(s), length(len) {
-	}
-	const char* str;
-	int length;
-};
-
-Stack<KeyString> sKeyStack;
+// The key of the map member being parsed. It's copied, because yajl
+// decodes escaped strings into a buffer that the next one overwrites.
+String sKey;
 
 Value* validateValue(Value* value, Value::Type type) {
 	if (value->getType() != type)
@@ -340,8 +334,7 @@ void pushValue(Value *value) {
 		case Value::MAP:
 		{
 			MapValue* map = (MapValue*) validateValue(parent, Value::MAP);
-			const KeyString& key = sKeyStack.peek();
-			map->setValueForKey(String(key.str, key.length), value);
+			map->setValueForKey(sKey, value);
 		}
 		break;
 
@@ -404,7 +397,7 @@ static int parse_map_key(void * ctx, const unsigned char * stringVal,
 		unsigned int stringLen) {
 	yajl_gen g = (yajl_gen) ctx;
 	yajl_gen_string(g, stringVal, stringLen);
-	sKeyStack.push(KeyString((const char*) stringVal, stringLen));
+	sKey = String((const char*) stringVal, stringLen);
 	return 1;
 }
 
@@ -469,7 +462,7 @@ Value* parse(const unsigned char* jsonText, size_t jsonTextLength) {
 	hand = yajl_alloc(&callbacks, &cfg, NULL, (void *) g);
 
 	sValueStack.clear();
-	sKeyStack.clear();
+	sKey.clear();
 	sRoot = NULL;
 
 	/* read file data, pass to parser */
@@ -16,8 +16,17 @@ Software Foundation, 59 Temple Place - Suite 330, Boston, MA
 */
 
 #include <cstdlib>
+#include <cstring>
 #include "AudioChannel.h"
 #include "AudioSource.h"
+#include "AudioKernels.h"
+
+// Source frames are converted to 16 bit stereo this many at a time.
+#define AUDIO_CHUNK_FRAMES 1024
+
+// Channels are mixed this many output frames at a time, so the 32 bit
+// mix stays in the cache until it's saturated.
+#define AUDIO_MIX_FRAMES 256
 
 
 
@@ -30,11 +39,14 @@ Software Foundation, 59 Temple Place - Suite 330, Boston, MA
 AudioChannel::AudioChannel ( int s, AudioSource* audioSource )
 : mActive( false ),
   mVolume( 0xffff ),
+  mResampler( RESAMPLE_LINEAR ),
   mOutputSampleRate( s ),
   mAudioSource( audioSource ),
   mBufferedSamples( 0 ),
-  mBufferedSamplePos( 0 )
+  mBufferOffset( 0 ),
+  mPosition( 0 )
 {
+    mLastFrame[0] = mLastFrame[1] = 0;
 }
 
 /**
@@ -45,6 +57,10 @@ AudioChannel::AudioChannel ( int s, AudioSource* audioSource )
 void AudioChannel::setAudioSource ( AudioSource* as )
 {
     mAudioSource = as;
+    mBufferedSamples = 0;
+    mBufferOffset = 0;
+    mPosition = 0;
+    mLastFrame[0] = mLastFrame[1] = 0;
 }
 
 /**
@@ -103,45 +119,24 @@ int AudioChannel::getVolume ( void )
 
 
 /**
- * This is a template for on the fly converting and mixing from
- * any source (8/16/mono/stereo) format to 32 bit signed stereo
+ * Sets how the channel is resampled. The default is linear on every
+ * CPU; nearest costs about half as much without SIMD kernels.
  *
- * @param dst           Pointer to the destination buffer
- * @param numSamples    Number of samples to mix
- * @param src           Pointer to the source buffer
- * @param pos           The position in the source buffer to start (24.8 FIXP)
- * @param delta         The increment delta (24.8 FIXP)
- * @param vol           The source volume [0-1) (16.16 FIXP)
+ * @param r     The resampler
  */
-template< typename SrcT, int srcBitDepth, int srcNumChannels, bool sign >
-void convert_audio ( int *dst, int numSamples, const SrcT *src,
-                     int pos, int delta, int vol )
+void AudioChannel::setResampler ( Resampler r )
 {
-    int sample;
-
-    for( int i = 0; i < numSamples; i++ )
-    {
-        sample = (int)src[((pos>>8)<<(srcNumChannels>>1))];
-        if ( sign == false )
-            sample -= ((1<<srcBitDepth)>>1);
-        sample <<= 16-srcBitDepth;
-        sample = (sample*vol)>>16;
-        dst[i*2+0] += sample;
-
-        if ( srcNumChannels == 2 )
-        {
-            sample = (int)src[((pos>>8)<<1)+1];
-            if ( sign == false)
-                sample -= ((1<<srcBitDepth)>>1);
-            sample <<= 16-srcBitDepth;
-            sample = (sample*vol)>>16;
-            dst[i*2+1] += sample;
-        }
-        else
-            dst[i*2+1] += sample;
+    mResampler = r;
+}
 
-        pos+=delta;
-    }
+/**
+ * Returns how the channel is resampled.
+ *
+ * @return The resampler
+ */
+AudioChannel::Resampler AudioChannel::getResampler ( void ) const
+{
+    return mResampler;
 }
 
 
@@ -149,81 +144,148 @@ void convert_audio ( int *dst, int numSamples, const SrcT *src,
 /**
  * Converts and mixes the audio source to the internal buffer
  *
+ * The source is converted to 16 bit stereo a chunk at a time, and
+ * resampled from there, unless the kernels can mix the nearest frames
+ * straight from the source. Positions are 16.16 fixed point source frames;
+ * linear resampling between two buffers uses the last frame of the first,
+ * which is why the position can be down to -1.
+ *
  * @param dst           Pointer to the internal buffer to mix in to.
  * @param numSamples    The number of samples to mix.
  *
  */
 void AudioChannel::mix ( int *dst, int numSamples )
 {
+    // only the audio thread mixes
+    static s16 chunk[(AUDIO_CHUNK_FRAMES + 1) * 2];
+
     if ( mAudioSource == NULL || mActive == false )
         return;
 
-    int samplesWritten = 0;
-    int srate   = mAudioSource->getInfo().sampleRate;
-    int delta   = (srate<<8)/mOutputSampleRate; // amount of src samples per dst sample (in 24:8 fixed point)
-    int snc     = mAudioSource->getInfo().numChannels;
-    //int numSourceSamples = srate*numSamples/mOutputSampleRate; //
+    const AudioSource::Info& info = mAudioSource->getInfo();
+    if ( info.sampleRate <= 0 || mOutputSampleRate <= 0 )
+        return;
 
-    AudioSource::Format sfmt = mAudioSource->getInfo().fmt;
-    
+    // amount of src frames per dst frame (in 16.16 fixed point)
+    int delta = (int)(((s64)info.sampleRate<<16)/mOutputSampleRate);
+    if ( delta <= 0 )
+        return;
 
-    const void *src = mAudioSource->getBuffer();
+    AudioSampleFormat format = (AudioSampleFormat)info.fmt;
+    int frameBytes = info.bytesPerSample*info.numChannels;
+    int vol = mVolume < 0 ? 0 : (mVolume > 0xffff ? 0xffff : mVolume);
+    bool linear = mResampler == RESAMPLE_LINEAR;
+    const AudioKernels& k = audioKernels();
 
+    int samplesWritten = 0;
     while ( samplesWritten < numSamples )
     {
-        if ( mBufferedSamples == false )
+        if ( mBufferedSamples == 0 )
         {
-            if ( (mBufferedSamples=mAudioSource->fillBuffer( )) == false )
+            if ( (mBufferedSamples=mAudioSource->fillBuffer( )) <= 0 )
             {
+                mBufferedSamples = 0;
                 mActive = false;
                 break;
             }
-            mBufferedSamplePos = 0;
         }
 
-        int copySize = numSamples - samplesWritten;
-        int scaledBufferedSamples = (mBufferedSamples*mOutputSampleRate)/srate;
+        // the frames from mBufferOffset on, as much as fits in a chunk
+        int available = mBufferedSamples - mBufferOffset;
+        int frames = available < AUDIO_CHUNK_FRAMES ? available : AUDIO_CHUNK_FRAMES;
+
+        // the dst frames whose src frames (two of them, if linear) are there
+        int last = frames - (linear ? 2 : 1);
+        int count = 0;
+        if ( mPosition < ((last+1)*0x10000) )
+            count = (((last+1)*0x10000) - mPosition + delta - 1)/delta;
 
-        if ( copySize > scaledBufferedSamples )
-            copySize = scaledBufferedSamples;
+        const char *src = (const char *)mAudioSource->getBuffer( );
 
-        if ( copySize > 0 )
+        if ( count <= 0 )
         {
-            switch ( sfmt )
+            // the rest of the buffer is behind us, carry on in the next one
+            if ( mBufferedSamples > 0 )
+                k.convert( mLastFrame, src + (mBufferedSamples-1)*frameBytes, 1, format, info.numChannels );
+            mPosition -= available*0x10000;
+            mBufferOffset = 0;
+            mBufferedSamples = 0;
+            continue;
+        }
+
+        if ( count > numSamples - samplesWritten )
+            count = numSamples - samplesWritten;
+
+        if ( !linear && k.mixNearestFrom != NULL && mPosition >= 0 )
+        {
+            k.mixNearestFrom( &dst[samplesWritten<<1], src + mBufferOffset*frameBytes, format,
+                info.numChannels, mPosition, delta, count, vol );
+        }
+        else
+        {
+            // the src frames [first, end) are needed; frame -1 is mLastFrame
+            int first = mPosition>>16;
+            int end = ((mPosition + (count-1)*delta)>>16) + (linear ? 2 : 1);
+            s16 *to = chunk;
+            if ( first < 0 )
             {
-                case AudioSource::FMT_S8:
-                    if ( snc == 1 )
-                        convert_audio<char, sizeof(char)<<3, 1, true>( &dst[samplesWritten<<1], copySize, (char*)src, mBufferedSamplePos<<8, delta, mVolume );
-                    else
-                        convert_audio<char, sizeof(char)<<3, 2, true>( &dst[samplesWritten<<1], copySize, (char*)src, mBufferedSamplePos<<8, delta, mVolume );
-                    break;
-                case AudioSource::FMT_S16:
-                    if( snc == 1 )
-                        convert_audio<short, sizeof(short)<<3, 1, true>( &dst[samplesWritten<<1], copySize, (short*)src, mBufferedSamplePos<<8, delta, mVolume );
-                    else
-                        convert_audio<short, sizeof(short)<<3, 2, true>( &dst[samplesWritten<<1], copySize, (short*)src, mBufferedSamplePos<<8, delta, mVolume );
-                    break;
-                case AudioSource::FMT_U8:
-                    if ( snc == 1 )
-                        convert_audio<unsigned char, sizeof(char)<<3, 1, false>( &dst[samplesWritten<<1], copySize, (unsigned char*)src, mBufferedSamplePos<<8, delta, mVolume);
-                    else
-                        convert_audio<unsigned char, sizeof(char)<<3, 2, false>( &dst[samplesWritten<<1], copySize, (unsigned char*)src, mBufferedSamplePos<<8, delta, mVolume);
-                    break;
-                case AudioSource::FMT_U16:
-                    if ( snc == 1 )
-                        convert_audio<unsigned short, sizeof(short)<<3, 1, false>( &dst[samplesWritten<<1], copySize, (unsigned short*)src, mBufferedSamplePos<<8, delta, mVolume );
-                    else
-                        convert_audio<unsigned short, sizeof(short)<<3, 2, false>( &dst[samplesWritten<<1], copySize, (unsigned short*)src, mBufferedSamplePos<<8, delta, mVolume );
-                    break;
+                chunk[0] = mLastFrame[0];
+                chunk[1] = mLastFrame[1];
+                to += 2;
+                first = 0;
             }
+            k.convert( to, src + (mBufferOffset+first)*frameBytes, end-first, format, info.numChannels );
+
+            int pos = mPosition & 0xffff;
+            if ( linear )
+                k.mixLinear( &dst[samplesWritten<<1], chunk, pos, delta, count, vol );
+            else
+                k.mixNearest( &dst[samplesWritten<<1], chunk, pos, delta, count, vol );
+        }
+
+        samplesWritten += count;
+        mPosition += count*delta;
+
+        // keep the position small; mBufferOffset may pass the end of the
+        // buffer, which skips frames of the next one.
+        if ( mPosition >= 0x10000 )
+        {
+            mBufferOffset += mPosition>>16;
+            mPosition &= 0xffff;
+        }
+    }
+}
+
 
-            int scaledCopySize = (copySize*delta)>>8;
-            if ( scaledCopySize == 0 )
-                scaledCopySize = 1;
 
-            samplesWritten      += copySize;
-            mBufferedSamplePos  += scaledCopySize;
-            mBufferedSamples    -= scaledCopySize;
+/**
+ * Mixes all active channels to 16 bit signed stereo, a block at a
+ * time, and saturates each block once when all channels are in.
+ *
+ * @param out           The output buffer, numSamples stereo frames.
+ * @param channels      The channels, NULL entries are skipped.
+ * @param numChannels   The number of channels.
+ * @param numSamples    The number of stereo frames to mix.
+ */
+void mixAudioChannels ( s16 *out, AudioChannel* const* channels,
+                        int numChannels, int numSamples )
+{
+    int mix[AUDIO_MIX_FRAMES*2];
+    const AudioKernels& k = audioKernels();
+
+    while ( numSamples > 0 )
+    {
+        int n = numSamples < AUDIO_MIX_FRAMES ? numSamples : AUDIO_MIX_FRAMES;
+
+        memset( mix, 0, n*2*sizeof( int ) );
+        for ( int i = 0; i < numChannels; i++ )
+        {
+            if ( channels[i] != NULL && channels[i]->isActive( ) )
+                channels[i]->mix( mix, n );
         }
+        k.saturate16( out, mix, n*2 );
+
+        out += n*2;
+        numSamples -= n;
     }
 }
@@ -19,6 +19,7 @@ Software Foundation, 59 Temple Place - Suite 330, Boston, MA
 #define _AUDIO_CHANNEL_H_
 
 #include <cstdlib>
+#include "helpers/types.h"
 
 class AudioSource;
 
@@ -30,15 +31,28 @@ class AudioSource;
  */
 class AudioChannel
 {
+public:
+    /**
+     * How the source is resampled to the output sample rate.
+     */
+    enum Resampler
+    {
+        RESAMPLE_NEAREST,   // the closest source frame; aliases audibly
+        RESAMPLE_LINEAR     // interpolated between the two closest frames
+    };
+
 protected:
     bool            mActive;
     int             mVolume;
+    Resampler       mResampler;
 
     int             mOutputSampleRate;
 
     AudioSource*    mAudioSource;
-    int             mBufferedSamples;
-    int             mBufferedSamplePos;
+    int             mBufferedSamples;   // frames in the source buffer
+    int             mBufferOffset;      // the frame mPosition is relative to
+    int             mPosition;          // 16.16, in [-1, 1) between mixes
+    s16             mLastFrame[2];      // the last frame of the previous buffer
 
 public:
     /**
@@ -96,6 +110,21 @@ public:
      */
     int getVolume ( void );
 
+    /**
+     * Sets how the channel is resampled. The default is linear on every
+     * CPU; nearest costs about half as much without SIMD kernels.
+     *
+     * @param r     The resampler
+     */
+    void setResampler ( Resampler r );
+
+    /**
+     * Returns how the channel is resampled.
+     *
+     * @return The resampler
+     */
+    Resampler getResampler ( void ) const;
+
     /**
      * Converts and mixes the audio source to the internal buffer
      *
@@ -106,4 +135,16 @@ public:
     virtual void mix ( int *buffer, int numSamples );
 };
 
+/**
+ * Mixes all active channels to 16 bit signed stereo, a block at a
+ * time, and saturates each block once when all channels are in.
+ *
+ * @param out           The output buffer, numSamples stereo frames.
+ * @param channels      The channels, NULL entries are skipped.
+ * @param numChannels   The number of channels.
+ * @param numSamples    The number of stereo frames to mix.
+ */
+void mixAudioChannels ( s16 *out, AudioChannel* const* channels,
+                        int numChannels, int numSamples );
+
 #endif /* _AUDIO_CHANNEL_H_ */
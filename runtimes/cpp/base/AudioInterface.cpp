@@ -265,6 +265,15 @@ void AudioInterface::outputCallback ( void *b, size_t len )
     Lock    lck( m_mutex );
     size_t numSamples = len/((m_outputSampleBits/8)*m_outputChannels);
 
+#ifndef __SOUND_OUTPUT_USE_CONVERSION__
+    // Mix all active channels straight to the output
+    m_mixChanList.assign( m_activeChanList.begin( ), m_activeChanList.end( ) );
+    if ( m_mixChanList.empty( ) )
+        memset( b, 0, numSamples*2*sizeof( s16 ) );
+    else
+        mixAudioChannels( static_cast<s16 *>( b ), &m_mixChanList[0],
+                          (int)m_mixChanList.size( ), (int)numSamples );
+#else
     // Reset audio buffer
     memset( m_audioBuffer, 0, AUDIO_BUF_SAMPLES*2*sizeof( int ) );
 
@@ -274,14 +283,6 @@ void AudioInterface::outputCallback ( void *b, size_t len )
         (*it)->mix( m_audioBuffer, numSamples );
 
     // Convert to output format
-#ifndef __SOUND_OUTPUT_USE_CONVERSION__
-    s16 *out = static_cast<s16 *>( b );
-    for ( size_t i = 0; i < numSamples; i++ )
-    {
-        out[i*2+0] = (s16)mostd::clamp<int>( -32768, m_audioBuffer[i*2+0], 32767 );
-        out[i*2+1] = (s16)mostd::clamp<int>( -32768, m_audioBuffer[i*2+1], 32767 );
-    }
-#else
     switch ( m_outputSampleBits )
     {
         case 8:
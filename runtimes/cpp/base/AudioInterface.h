@@ -26,6 +26,7 @@ Software Foundation, 59 Temple Place - Suite 330, Boston, MA
 #define	__AUDIOINTERFACE_H__
 
 #include <list>
+#include <vector>
 #include <thread/mutex.hpp>
 #include "Stream.h"
 
@@ -50,6 +51,7 @@ protected:
     static AudioInterface*      m_instance;
     Base::Thread::Mutex*        m_mutex;
     std::list<AudioChannel *>   m_activeChanList;
+    std::vector<AudioChannel *> m_mixChanList;     // m_activeChanList, for mixAudioChannels
     std::list<AudioSource *>    m_activeSourceList;
     bool			m_outputSigned;
     int                         m_outputSampleRate;
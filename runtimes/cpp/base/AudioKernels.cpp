@@ -0,0 +1,463 @@
+/* Copyright (C) 2009 Mobile Sorcery AB
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License, version 2, as published by
+the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING.  If not, write to the Free
+Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.
+*/
+
+#include "AudioKernels.h"
+#include "CpuFeatures.h"
+#include <string.h>
+
+//******************************************************************************
+// Scalar
+//******************************************************************************
+
+template<AudioSampleFormat format> static inline int sampleAt(const void* src, int i);
+
+template<> inline int sampleAt<AUDIO_SAMPLE_S8>(const void* src, int i) {
+	return ((const s8*)src)[i] * 256;
+}
+template<> inline int sampleAt<AUDIO_SAMPLE_U8>(const void* src, int i) {
+	return (((const u8*)src)[i] - 128) * 256;
+}
+template<> inline int sampleAt<AUDIO_SAMPLE_S16>(const void* src, int i) {
+	return ((const s16*)src)[i];
+}
+template<> inline int sampleAt<AUDIO_SAMPLE_U16>(const void* src, int i) {
+	return ((const u16*)src)[i] - 32768;
+}
+
+template<AudioSampleFormat format> static void convertFrames(s16* dst, const void* src, int n, int channels) {
+	if(channels == 1) {
+		for(int i = 0; i < n; i++) {
+			dst[i*2+0] = dst[i*2+1] = (s16)sampleAt<format>(src, i);
+		}
+	} else {
+		for(int i = 0; i < n; i++) {
+			dst[i*2+0] = (s16)sampleAt<format>(src, i*2+0);
+			dst[i*2+1] = (s16)sampleAt<format>(src, i*2+1);
+		}
+	}
+}
+
+static void convertScalar(s16* dst, const void* src, int n, AudioSampleFormat format, int channels) {
+	switch(format) {
+	case AUDIO_SAMPLE_S8: convertFrames<AUDIO_SAMPLE_S8>(dst, src, n, channels); break;
+	case AUDIO_SAMPLE_U8: convertFrames<AUDIO_SAMPLE_U8>(dst, src, n, channels); break;
+	case AUDIO_SAMPLE_S16: convertFrames<AUDIO_SAMPLE_S16>(dst, src, n, channels); break;
+	case AUDIO_SAMPLE_U16: convertFrames<AUDIO_SAMPLE_U16>(dst, src, n, channels); break;
+	}
+}
+
+static void mixNearestScalar(int* dst, const s16* src, int pos, int delta, int n, int vol) {
+	for(int i = 0; i < n; i++) {
+		const s16* f = src + (pos >> 16) * 2;
+		dst[i*2+0] += (f[0] * vol) >> 16;
+		dst[i*2+1] += (f[1] * vol) >> 16;
+		pos += delta;
+	}
+}
+
+// like the loop AudioChannel used to have, a mono sample is scaled once.
+template<AudioSampleFormat format, int channels>
+static void mixNearestFrames(int* dst, const void* src, int pos, int delta, int n, int vol) {
+	for(int i = 0; i < n; i++) {
+		int at = (pos >> 16) * channels;
+		int l = (sampleAt<format>(src, at) * vol) >> 16;
+		dst[i*2+0] += l;
+		dst[i*2+1] += channels == 2 ? (sampleAt<format>(src, at + 1) * vol) >> 16 : l;
+		pos += delta;
+	}
+}
+
+static void mixNearestFromScalar(int* dst, const void* src, AudioSampleFormat format, int channels,
+	int pos, int delta, int n, int vol)
+{
+	switch(format) {
+	case AUDIO_SAMPLE_S8:
+		if(channels == 1) mixNearestFrames<AUDIO_SAMPLE_S8, 1>(dst, src, pos, delta, n, vol);
+		else mixNearestFrames<AUDIO_SAMPLE_S8, 2>(dst, src, pos, delta, n, vol);
+		break;
+	case AUDIO_SAMPLE_U8:
+		if(channels == 1) mixNearestFrames<AUDIO_SAMPLE_U8, 1>(dst, src, pos, delta, n, vol);
+		else mixNearestFrames<AUDIO_SAMPLE_U8, 2>(dst, src, pos, delta, n, vol);
+		break;
+	case AUDIO_SAMPLE_S16:
+		if(channels == 1) mixNearestFrames<AUDIO_SAMPLE_S16, 1>(dst, src, pos, delta, n, vol);
+		else mixNearestFrames<AUDIO_SAMPLE_S16, 2>(dst, src, pos, delta, n, vol);
+		break;
+	case AUDIO_SAMPLE_U16:
+		if(channels == 1) mixNearestFrames<AUDIO_SAMPLE_U16, 1>(dst, src, pos, delta, n, vol);
+		else mixNearestFrames<AUDIO_SAMPLE_U16, 2>(dst, src, pos, delta, n, vol);
+		break;
+	}
+}
+
+// two frames per iteration, so the loads of the second frame overlap the
+// multiplies of the first.
+static void mixLinearScalar(int* dst, const s16* src, int pos, int delta, int n, int vol) {
+	int i = 0;
+	for(; i + 2 <= n; i += 2) {
+		const s16* f = src + (pos >> 16) * 2;
+		const s16* g = src + ((pos + delta) >> 16) * 2;
+		int a1 = (pos & 0xffff) >> 2;
+		int b1 = ((pos + delta) & 0xffff) >> 2;
+		int a0 = 16384 - a1;
+		int b0 = 16384 - b1;
+		int l0 = (f[0] * a0 + f[2] * a1) >> 14;
+		int r0 = (f[1] * a0 + f[3] * a1) >> 14;
+		int l1 = (g[0] * b0 + g[2] * b1) >> 14;
+		int r1 = (g[1] * b0 + g[3] * b1) >> 14;
+		dst[i*2+0] += (l0 * vol) >> 16;
+		dst[i*2+1] += (r0 * vol) >> 16;
+		dst[i*2+2] += (l1 * vol) >> 16;
+		dst[i*2+3] += (r1 * vol) >> 16;
+		pos += delta * 2;
+	}
+	if(i < n) {
+		const s16* f = src + (pos >> 16) * 2;
+		int w1 = (pos & 0xffff) >> 2;
+		int w0 = 16384 - w1;
+		int l = (f[0] * w0 + f[2] * w1) >> 14;
+		int r = (f[1] * w0 + f[3] * w1) >> 14;
+		dst[i*2+0] += (l * vol) >> 16;
+		dst[i*2+1] += (r * vol) >> 16;
+	}
+}
+
+static void saturate16Scalar(s16* dst, const int* src, int n) {
+	for(int i = 0; i < n; i++) {
+		int s = src[i];
+		if(s < -32768)
+			s = -32768;
+		else if(s > 32767)
+			s = 32767;
+		dst[i] = (s16)s;
+	}
+}
+
+static const AudioKernels sScalar = {
+	"scalar",
+	convertScalar,
+	mixNearestScalar, mixNearestFromScalar, mixLinearScalar,
+	saturate16Scalar,
+};
+
+#ifdef KERNELS_X86
+
+// a stereo frame as one int.
+static inline int frameAt(const s16* src, int i) {
+	int f;
+	memcpy(&f, src + i * 2, 4);
+	return f;
+}
+
+// the two 16 bit weights of mixLinear for pos.
+static inline int weightsAt(int pos) {
+	int w1 = (pos & 0xffff) >> 2;
+	return (16384 - w1) | (w1 << 16);
+}
+
+//******************************************************************************
+// SSE2
+//******************************************************************************
+
+// (s*vol)>>16 is the high half of the product. mulhi_epu16 takes s as
+// unsigned, which adds vol to the high half when s is negative.
+KERNEL_SSE2 static inline __m128i scaleSSE2(__m128i s, __m128i vol) {
+	return _mm_sub_epi16(_mm_mulhi_epu16(s, vol), _mm_and_si128(_mm_srai_epi16(s, 15), vol));
+}
+
+// adds 8 samples to dst.
+KERNEL_SSE2 static inline void addSSE2(int* dst, __m128i s) {
+	__m128i sign = _mm_srai_epi16(s, 15);
+	__m128i* d = (__m128i*)dst;
+	_mm_storeu_si128(d, _mm_add_epi32(_mm_loadu_si128(d), _mm_unpacklo_epi16(s, sign)));
+	_mm_storeu_si128(d + 1, _mm_add_epi32(_mm_loadu_si128(d + 1), _mm_unpackhi_epi16(s, sign)));
+}
+
+// 4 frames, interpolated with weights w, as 8 samples.
+KERNEL_SSE2 static inline __m128i lerpSSE2(__m128i a, __m128i b, __m128i w) {
+	__m128i lo = _mm_madd_epi16(_mm_unpacklo_epi16(a, b), _mm_shuffle_epi32(w, _MM_SHUFFLE(1, 1, 0, 0)));
+	__m128i hi = _mm_madd_epi16(_mm_unpackhi_epi16(a, b), _mm_shuffle_epi32(w, _MM_SHUFFLE(3, 3, 2, 2)));
+	return _mm_packs_epi32(_mm_srai_epi32(lo, 14), _mm_srai_epi32(hi, 14));
+}
+
+KERNEL_SSE2 static void convertSSE2(s16* dst, const void* src, int n, AudioSampleFormat format, int channels) {
+	int samples = n * channels;
+	int i = 0;
+	if(format == AUDIO_SAMPLE_S16 || format == AUDIO_SAMPLE_U16) {
+		const s16* s = (const s16*)src;
+		__m128i flip = _mm_set1_epi16(format == AUDIO_SAMPLE_U16 ? (short)0x8000 : 0);
+		if(channels == 2) {
+			for(; i + 8 <= samples; i += 8) {
+				__m128i x = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(s + i)), flip);
+				_mm_storeu_si128((__m128i*)(dst + i), x);
+			}
+		} else {
+			for(; i + 8 <= samples; i += 8) {
+				__m128i x = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(s + i)), flip);
+				_mm_storeu_si128((__m128i*)(dst + i*2), _mm_unpacklo_epi16(x, x));
+				_mm_storeu_si128((__m128i*)(dst + i*2 + 8), _mm_unpackhi_epi16(x, x));
+			}
+		}
+		src = s + i;
+	} else {
+		// a byte in the high half of a short is the byte times 256.
+		const u8* s = (const u8*)src;
+		__m128i flip = _mm_set1_epi8(format == AUDIO_SAMPLE_U8 ? (char)0x80 : 0);
+		__m128i zero = _mm_setzero_si128();
+		if(channels == 2) {
+			for(; i + 16 <= samples; i += 16) {
+				__m128i x = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(s + i)), flip);
+				_mm_storeu_si128((__m128i*)(dst + i), _mm_unpacklo_epi8(zero, x));
+				_mm_storeu_si128((__m128i*)(dst + i + 8), _mm_unpackhi_epi8(zero, x));
+			}
+		} else {
+			for(; i + 16 <= samples; i += 16) {
+				__m128i x = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(s + i)), flip);
+				__m128i lo = _mm_unpacklo_epi8(zero, x);
+				__m128i hi = _mm_unpackhi_epi8(zero, x);
+				_mm_storeu_si128((__m128i*)(dst + i*2), _mm_unpacklo_epi16(lo, lo));
+				_mm_storeu_si128((__m128i*)(dst + i*2 + 8), _mm_unpackhi_epi16(lo, lo));
+				_mm_storeu_si128((__m128i*)(dst + i*2 + 16), _mm_unpacklo_epi16(hi, hi));
+				_mm_storeu_si128((__m128i*)(dst + i*2 + 24), _mm_unpackhi_epi16(hi, hi));
+			}
+		}
+		src = s + i;
+	}
+	convertScalar(dst + (i / channels) * 2, src, n - i / channels, format, channels);
+}
+
+KERNEL_SSE2 static void mixNearestSSE2(int* dst, const s16* src, int pos, int delta, int n, int vol) {
+	__m128i v = _mm_set1_epi16((short)vol);
+	if(delta == 0x10000) {
+		const s16* s = src + (pos >> 16) * 2;
+		while(n >= 4) {
+			addSSE2(dst, scaleSSE2(_mm_loadu_si128((const __m128i*)s), v));
+			s += 8;
+			pos += 4 << 16;
+			dst += 8;
+			n -= 4;
+		}
+	} else {
+		while(n >= 4) {
+			__m128i f = _mm_setr_epi32(frameAt(src, pos >> 16), frameAt(src, (pos + delta) >> 16),
+				frameAt(src, (pos + delta*2) >> 16), frameAt(src, (pos + delta*3) >> 16));
+			addSSE2(dst, scaleSSE2(f, v));
+			pos += delta * 4;
+			dst += 8;
+			n -= 4;
+		}
+	}
+	mixNearestScalar(dst, src, pos, delta, n, vol);
+}
+
+KERNEL_SSE2 static void mixLinearSSE2(int* dst, const s16* src, int pos, int delta, int n, int vol) {
+	__m128i v = _mm_set1_epi16((short)vol);
+	if(delta == 0x10000) {
+		const s16* s = src + (pos >> 16) * 2;
+		__m128i w = _mm_set1_epi32(weightsAt(pos));
+		while(n >= 4) {
+			__m128i a = _mm_loadu_si128((const __m128i*)s);
+			__m128i b = _mm_loadu_si128((const __m128i*)(s + 2));
+			addSSE2(dst, scaleSSE2(lerpSSE2(a, b, w), v));
+			s += 8;
+			pos += 4 << 16;
+			dst += 8;
+			n -= 4;
+		}
+	} else {
+		while(n >= 4) {
+			int p0 = pos, p1 = pos + delta, p2 = pos + delta*2, p3 = pos + delta*3;
+			__m128i a = _mm_setr_epi32(frameAt(src, p0 >> 16), frameAt(src, p1 >> 16),
+				frameAt(src, p2 >> 16), frameAt(src, p3 >> 16));
+			__m128i b = _mm_setr_epi32(frameAt(src, (p0 >> 16) + 1), frameAt(src, (p1 >> 16) + 1),
+				frameAt(src, (p2 >> 16) + 1), frameAt(src, (p3 >> 16) + 1));
+			__m128i w = _mm_setr_epi32(weightsAt(p0), weightsAt(p1), weightsAt(p2), weightsAt(p3));
+			addSSE2(dst, scaleSSE2(lerpSSE2(a, b, w), v));
+			pos += delta * 4;
+			dst += 8;
+			n -= 4;
+		}
+	}
+	mixLinearScalar(dst, src, pos, delta, n, vol);
+}
+
+KERNEL_SSE2 static void saturate16SSE2(s16* dst, const int* src, int n) {
+	int i = 0;
+	for(; i + 8 <= n; i += 8) {
+		__m128i a = _mm_loadu_si128((const __m128i*)(src + i));
+		__m128i b = _mm_loadu_si128((const __m128i*)(src + i + 4));
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_packs_epi32(a, b));
+	}
+	saturate16Scalar(dst + i, src + i, n - i);
+}
+
+static const AudioKernels sSSE2 = {
+	"sse2",
+	convertSSE2,
+	mixNearestSSE2, NULL, mixLinearSSE2,
+	saturate16SSE2,
+};
+
+//******************************************************************************
+// AVX2
+//******************************************************************************
+
+#ifdef KERNELS_AVX2
+
+KERNEL_AVX2 static inline __m256i scaleAVX2(__m256i s, __m256i vol) {
+	return _mm256_sub_epi16(_mm256_mulhi_epu16(s, vol), _mm256_and_si256(_mm256_srai_epi16(s, 15), vol));
+}
+
+// adds 16 samples to dst.
+KERNEL_AVX2 static inline void addAVX2(int* dst, __m256i s) {
+	__m256i* d = (__m256i*)dst;
+	__m256i lo = _mm256_cvtepi16_epi32(_mm256_castsi256_si128(s));
+	__m256i hi = _mm256_cvtepi16_epi32(_mm256_extracti128_si256(s, 1));
+	_mm256_storeu_si256(d, _mm256_add_epi32(_mm256_loadu_si256(d), lo));
+	_mm256_storeu_si256(d + 1, _mm256_add_epi32(_mm256_loadu_si256(d + 1), hi));
+}
+
+// 8 frames, interpolated with weights w, as 16 samples. The unpacks and the
+// pack work within each 128 bit lane, so the frames come out in order.
+KERNEL_AVX2 static inline __m256i lerpAVX2(__m256i a, __m256i b, __m256i w) {
+	__m256i lo = _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), _mm256_shuffle_epi32(w, _MM_SHUFFLE(1, 1, 0, 0)));
+	__m256i hi = _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), _mm256_shuffle_epi32(w, _MM_SHUFFLE(3, 3, 2, 2)));
+	return _mm256_packs_epi32(_mm256_srai_epi32(lo, 14), _mm256_srai_epi32(hi, 14));
+}
+
+KERNEL_AVX2 static inline __m256i stepsAVX2(int delta) {
+	return _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(delta));
+}
+
+KERNEL_AVX2 static void mixNearestAVX2(int* dst, const s16* src, int pos, int delta, int n, int vol) {
+	__m256i v = _mm256_set1_epi16((short)vol);
+	if(delta == 0x10000) {
+		const s16* s = src + (pos >> 16) * 2;
+		while(n >= 8) {
+			addAVX2(dst, scaleAVX2(_mm256_loadu_si256((const __m256i*)s), v));
+			s += 16;
+			pos += 8 << 16;
+			dst += 16;
+			n -= 8;
+		}
+	} else {
+		__m256i steps = stepsAVX2(delta);
+		while(n >= 8) {
+			__m256i p = _mm256_add_epi32(_mm256_set1_epi32(pos), steps);
+			__m256i f = _mm256_i32gather_epi32((const int*)src, _mm256_srai_epi32(p, 16), 4);
+			addAVX2(dst, scaleAVX2(f, v));
+			pos += delta * 8;
+			dst += 16;
+			n -= 8;
+		}
+	}
+	// the SSE2 code would pay for switching from AVX
+	_mm256_zeroupper();
+	mixNearestSSE2(dst, src, pos, delta, n, vol);
+}
+
+KERNEL_AVX2 static void mixLinearAVX2(int* dst, const s16* src, int pos, int delta, int n, int vol) {
+	__m256i v = _mm256_set1_epi16((short)vol);
+	if(delta == 0x10000) {
+		const s16* s = src + (pos >> 16) * 2;
+		__m256i w = _mm256_set1_epi32(weightsAt(pos));
+		while(n >= 8) {
+			__m256i a = _mm256_loadu_si256((const __m256i*)s);
+			__m256i b = _mm256_loadu_si256((const __m256i*)(s + 2));
+			addAVX2(dst, scaleAVX2(lerpAVX2(a, b, w), v));
+			s += 16;
+			pos += 8 << 16;
+			dst += 16;
+			n -= 8;
+		}
+	} else {
+		__m256i steps = stepsAVX2(delta);
+		__m256i one = _mm256_set1_epi32(1);
+		__m256i fraction = _mm256_set1_epi32(0xffff);
+		__m256i whole = _mm256_set1_epi32(16384);
+		while(n >= 8) {
+			__m256i p = _mm256_add_epi32(_mm256_set1_epi32(pos), steps);
+			__m256i i = _mm256_srai_epi32(p, 16);
+			__m256i a = _mm256_i32gather_epi32((const int*)src, i, 4);
+			__m256i b = _mm256_i32gather_epi32((const int*)src, _mm256_add_epi32(i, one), 4);
+			__m256i w1 = _mm256_srli_epi32(_mm256_and_si256(p, fraction), 2);
+			__m256i w = _mm256_or_si256(_mm256_sub_epi32(whole, w1), _mm256_slli_epi32(w1, 16));
+			addAVX2(dst, scaleAVX2(lerpAVX2(a, b, w), v));
+			pos += delta * 8;
+			dst += 16;
+			n -= 8;
+		}
+	}
+	_mm256_zeroupper();
+	mixLinearSSE2(dst, src, pos, delta, n, vol);
+}
+
+KERNEL_AVX2 static void saturate16AVX2(s16* dst, const int* src, int n) {
+	int i = 0;
+	for(; i + 16 <= n; i += 16) {
+		__m256i a = _mm256_loadu_si256((const __m256i*)(src + i));
+		__m256i b = _mm256_loadu_si256((const __m256i*)(src + i + 8));
+		// packs works within lanes; put the quarters back in order.
+		__m256i s = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), _MM_SHUFFLE(3, 1, 2, 0));
+		_mm256_storeu_si256((__m256i*)(dst + i), s);
+	}
+	_mm256_zeroupper();
+	saturate16SSE2(dst + i, src + i, n - i);
+}
+
+// conversion is bound by memory; SSE2 does it as fast.
+static const AudioKernels sAVX2 = {
+	"avx2",
+	convertSSE2,
+	mixNearestAVX2, NULL, mixLinearAVX2,
+	saturate16AVX2,
+};
+
+#endif	//KERNELS_AVX2
+
+#endif	//KERNELS_X86
+
+const AudioKernels* getAudioKernels(AudioKernelSet set) {
+	switch(set) {
+	case AUDIO_KERNELS_SCALAR:
+		return &sScalar;
+#ifdef KERNELS_X86
+	case AUDIO_KERNELS_SSE2:
+		return cpuHasSSE2() ? &sSSE2 : NULL;
+#ifdef KERNELS_AVX2
+	case AUDIO_KERNELS_AVX2:
+		return cpuHasSSE2() && cpuHasAVX2() ? &sAVX2 : NULL;
+#endif
+#endif
+	default:
+		return NULL;
+	}
+}
+
+static const AudioKernels* sBest = NULL;
+
+const AudioKernels& audioKernels() {
+	if(!sBest) {
+		const AudioKernels* k = getAudioKernels(AUDIO_KERNELS_AVX2);
+		if(!k)
+			k = getAudioKernels(AUDIO_KERNELS_SSE2);
+		if(!k)
+			k = &sScalar;
+		sBest = k;
+	}
+	return *sBest;
+}
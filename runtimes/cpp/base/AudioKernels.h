@@ -0,0 +1,74 @@
+/* Copyright (C) 2009 Mobile Sorcery AB
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License, version 2, as published by
+the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING.  If not, write to the Free
+Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.
+*/
+
+#ifndef _AUDIO_KERNELS_H_
+#define _AUDIO_KERNELS_H_
+
+#include "helpers/types.h"
+
+// in the order of AudioSource::Format.
+enum AudioSampleFormat {
+	AUDIO_SAMPLE_S8,
+	AUDIO_SAMPLE_U8,
+	AUDIO_SAMPLE_S16,
+	AUDIO_SAMPLE_U16
+};
+
+// The loops of the mixer. Every set of kernels writes exactly the same
+// samples as the scalar one.
+//
+// A channel is mixed in two steps: its source frames are converted to 16 bit
+// signed stereo, and then resampled, scaled by the channel volume and added
+// to the 32 bit stereo mix. The mix is saturated to 16 bits once, when all
+// channels are in.
+//
+// Positions and steps are in source frames, in 16.16 fixed point.
+// Volumes are [0,1) in 16.16 fixed point; a sample s becomes (s*vol)>>16.
+struct AudioKernels {
+	const char* name;
+
+	// n source frames to n 16 bit stereo frames.
+	void (*convert)(s16* dst, const void* src, int n, AudioSampleFormat format, int channels);
+
+	// adds n frames to dst, each the src frame at pos.
+	void (*mixNearest)(int* dst, const s16* src, int pos, int delta, int n, int vol);
+	// convert followed by mixNearest, reading the source frames where they
+	// are. NULL in the sets where converting first is faster.
+	void (*mixNearestFrom)(int* dst, const void* src, AudioSampleFormat format, int channels,
+		int pos, int delta, int n, int vol);
+	// adds n frames to dst, each interpolated between the src frames around
+	// pos, with the fraction rounded down to 14 bits. Reads one frame past
+	// the last pos.
+	void (*mixLinear)(int* dst, const s16* src, int pos, int delta, int n, int vol);
+
+	// n samples, clamped to [-32768, 32767].
+	void (*saturate16)(s16* dst, const int* src, int n);
+};
+
+enum AudioKernelSet {
+	AUDIO_KERNELS_SCALAR,
+	AUDIO_KERNELS_SSE2,
+	AUDIO_KERNELS_AVX2
+};
+
+// NULL if this build or CPU can't run the set.
+const AudioKernels* getAudioKernels(AudioKernelSet set);
+
+// the best set this CPU can run, chosen on the first call.
+const AudioKernels& audioKernels();
+
+#endif	//_AUDIO_KERNELS_H_
@@ -0,0 +1,97 @@
+/* Copyright (C) 2009 Mobile Sorcery AB
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License, version 2, as published by
+the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING.  If not, write to the Free
+Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.
+*/
+
+#ifndef _CPU_FEATURES_H_
+#define _CPU_FEATURES_H_
+
+// What the SIMD kernels (ImageKernels, AudioKernels) can be built with, and
+// what the CPU they run on has.
+//
+// KERNELS_X86 is defined where SSE2 kernels can be built, KERNELS_AVX2 where
+// AVX2 ones can too. Functions that use them are marked KERNEL_SSE2 or
+// KERNEL_AVX2, so the rest of the file can be built for any x86.
+
+#if (defined(__i386__) || defined(__x86_64__) || defined(_M_IX86) || defined(_M_X64)) && \
+	!defined(_WIN32_WCE) && !defined(SYMBIAN)
+#define KERNELS_X86
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define KERNEL_SSE2
+#else
+#include <cpuid.h>
+#define KERNEL_SSE2 __attribute__((target("sse2")))
+#endif
+
+#if defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))) || \
+	(defined(_MSC_VER) && _MSC_VER >= 1700)
+#define KERNELS_AVX2
+#include <immintrin.h>
+#ifdef _MSC_VER
+#define KERNEL_AVX2
+#else
+#define KERNEL_AVX2 __attribute__((target("avx2")))
+#endif
+#endif	//AVX2 compilers
+
+static inline void cpuid(unsigned leaf, unsigned subleaf, unsigned regs[4]) {
+#ifdef _MSC_VER
+	__cpuidex((int*)regs, leaf, subleaf);
+#else
+	__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+static inline bool cpuHasSSE2() {
+#if defined(__x86_64__) || defined(_M_X64)
+	return true;
+#else
+	unsigned regs[4];
+	cpuid(1, 0, regs);
+	return (regs[3] & (1 << 26)) != 0;
+#endif
+}
+
+#ifdef KERNELS_AVX2
+static inline bool cpuHasAVX2() {
+	unsigned regs[4];
+	cpuid(0, 0, regs);
+	if(regs[0] < 7)
+		return false;
+
+	// the OS must save the ymm registers too.
+	cpuid(1, 0, regs);
+	if(!(regs[2] & (1 << 27)) || !(regs[2] & (1 << 28)))
+		return false;
+#ifdef _MSC_VER
+	unsigned long long xcr0 = _xgetbv(0);
+#else
+	unsigned eax, edx;
+	__asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	unsigned long long xcr0 = eax | ((unsigned long long)edx << 32);
+#endif
+	if((xcr0 & 6) != 6)
+		return false;
+
+	cpuid(7, 0, regs);
+	return (regs[1] & (1 << 5)) != 0;
+}
+#endif
+
+#endif	//x86
+
+#endif	//_CPU_FEATURES_H_
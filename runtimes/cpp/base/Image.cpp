@@ -16,6 +16,7 @@ Software Foundation, 59 Temple Place - Suite 330, Boston, MA
 */
 
 #include "Image.h"
+#include "ImageKernels.h"
 #include <stdlib.h>
 #include <config_platform.h>
 #include <helpers/helpers.h>
@@ -164,6 +165,19 @@ void initMulTable() {
 Image::Image() {
 }
 
+static BlendFormat blendFormat(const Image* img) {
+	BlendFormat f;
+	f.redMask = img->redMask;
+	f.greenMask = img->greenMask;
+	f.blueMask = img->blueMask;
+	f.alphaMask = img->alphaMask;
+	f.redShift = img->redShift;
+	f.greenShift = img->greenShift;
+	f.blueShift = img->blueShift;
+	f.alphaShift = img->alphaShift;
+	return f;
+}
+
 bool Image::hasData() {if(data==NULL) return false; return true;}
 
 bool Image::hasAlpha() {if(alpha==NULL) return false; return true;}
@@ -569,42 +583,12 @@ void Image::drawImageRegion(int left, int top, ClipRect *srcRect, Image *img, in
 			{
 				srcPitchX>>=1;
 				unsigned char *salpha = &img->alpha[transTopLeftX + transTopLeftY*img->alphaPitch];
-				unsigned char *ascan;
-				unsigned short *src_scan;
-				unsigned short *dst_scan;
+				const ImageKernels& k = imageKernels();
+				BlendFormat dstFormat = blendFormat(this), srcFormat = blendFormat(img);
 
 				while(transHeight--) {
-					src_scan = (unsigned short*)src;
-					dst_scan = (unsigned short*)dst;
-					ascan = salpha;
-					int x = transWidth;
-					while(x--) {
-						int sr = (((*src_scan)&img->redMask)>>img->redShift);
-						int sg = (((*src_scan)&img->greenMask)>>img->greenShift);
-						int sb = (((*src_scan)&img->blueMask)>>img->blueShift);
-						int dr = (((*dst_scan)&redMask)>>redShift);
-						int dg = (((*dst_scan)&greenMask)>>greenShift);
-						int db = (((*dst_scan)&blueMask)>>blueShift);
-
-						if(*ascan == 255) {
-							*dst_scan = (((sr)<< redShift)&redMask) |
-								(((sg)<< greenShift)&greenMask) |
-								(((sb)<< blueShift)&blueMask);
-						} else if(*ascan == 0) {
-							*dst_scan = (((dr)<< redShift)&redMask) |
-								(((dg)<< greenShift)&greenMask) |
-								(((db)<< blueShift)&blueMask);
-						} else {
-							*dst_scan =
-								(((dr + (((sr-dr)*(*ascan))>>8)) << redShift)&redMask) |
-								(((dg + (((sg-dg)*(*ascan))>>8)) << greenShift)&greenMask) |
-								(((db + (((sb-db)*(*ascan))>>8)) << blueShift)&blueMask);
-						}
-
-						src_scan+=srcPitchX;
-						dst_scan++;
-						ascan+=srcAPX;
-					}
+					k.blend16((unsigned short*)dst, (unsigned short*)src, srcPitchX, salpha, srcAPX,
+						transWidth, dstFormat, srcFormat);
 					src += srcPitchY;
 					dst += pitch;
 					salpha += srcAPY;
@@ -615,49 +599,12 @@ void Image::drawImageRegion(int left, int top, ClipRect *srcRect, Image *img, in
 			{
 				srcPitchX>>=2;
 				unsigned char *salpha = &img->alpha[transTopLeftX + transTopLeftY*img->alphaPitch];
-				unsigned char *ascan;
-				unsigned int *src_scan;
-				unsigned int *dst_scan;
-				//DUMP(srcPitchX);
-				//DUMP(srcPitchY);
-				//DUMP(transWidth);
-				//DUMP(transHeight);
-				//DUMP(pitch);
-				//DUMP(transTopLeftX);
-				//DUMP(transTopLeftY);
+				const ImageKernels& k = imageKernels();
+				BlendFormat dstFormat = blendFormat(this), srcFormat = blendFormat(img);
 
 				while(transHeight--) {
-					src_scan = (unsigned int*)src;
-					dst_scan = (unsigned int*)dst;
-					ascan = salpha;
-					int x = transWidth;
-					while(x--) {
-						int sr = (((*src_scan)&img->redMask)>>img->redShift);
-						int sg = (((*src_scan)&img->greenMask)>>img->greenShift);
-						int sb = (((*src_scan)&img->blueMask)>>img->blueShift);
-						int dr = (((*dst_scan)&redMask)>>redShift);
-						int dg = (((*dst_scan)&greenMask)>>greenShift);
-						int db = (((*dst_scan)&blueMask)>>blueShift);
-
-						if(*ascan == 255) {
-							*dst_scan = (((sr)<< redShift)&redMask) |
-								(((sg)<< greenShift)&greenMask) |
-								(((sb)<< blueShift)&blueMask);
-						} else if(*ascan == 0) {
-							*dst_scan = (((dr)<< redShift)&redMask) |
-								(((dg)<< greenShift)&greenMask) |
-								(((db)<< blueShift)&blueMask);
-						} else {
-							*dst_scan =
-								(((dr + (((sr-dr)*(*ascan))>>8)) << redShift)&redMask) |
-								(((dg + (((sg-dg)*(*ascan))>>8)) << greenShift)&greenMask) |
-								(((db + (((sb-db)*(*ascan))>>8)) << blueShift)&blueMask);
-						}
-
-						src_scan+=srcPitchX;
-						dst_scan++;
-						ascan+=srcAPX;
-					}
+					k.blend32((unsigned int*)dst, (unsigned int*)src, srcPitchX, salpha, srcAPX,
+						transWidth, dstFormat, srcFormat);
 					src += srcPitchY;
 					dst += pitch;
 					salpha += srcAPY;
@@ -675,40 +622,12 @@ void Image::drawImageRegion(int left, int top, ClipRect *srcRect, Image *img, in
 			case 4:
 			{
 				srcPitchX>>=2;
-				unsigned int *src_scan;
-				unsigned int *dst_scan;
+				const ImageKernels& k = imageKernels();
+				BlendFormat dstFormat = blendFormat(this), srcFormat = blendFormat(img);
 
 				while(transHeight--) {
-					src_scan = (unsigned int*)src;
-					dst_scan = (unsigned int*)dst;
-					int x = transWidth;
-					while(x--) {
-						int sr = (((*src_scan)&img->redMask)>>img->redShift);
-						int sg = (((*src_scan)&img->greenMask)>>img->greenShift);
-						int sb = (((*src_scan)&img->blueMask)>>img->blueShift);
-						int sa = (((*src_scan)&img->alphaMask)>>img->alphaShift);
-
-						int dr = (((*dst_scan)&redMask)>>redShift);
-						int dg = (((*dst_scan)&greenMask)>>greenShift);
-						int db = (((*dst_scan)&blueMask)>>blueShift);
-
-						if(sa == 255) {
-							*dst_scan = (((sr)<< redShift)&redMask) |
-							(((sg)<< greenShift)&greenMask) |
-							(((sb)<< blueShift)&blueMask);
-						} else if(sa == 0) {
-							*dst_scan = (((dr)<< redShift)&redMask) |
-							(((dg)<< greenShift)&greenMask) |
-							(((db)<< blueShift)&blueMask);
-						} else {
-							*dst_scan =
-							(((dr + (((sr-dr)*(sa))>>8)) << redShift)&redMask) |
-							(((dg + (((sg-dg)*(sa))>>8)) << greenShift)&greenMask) |
-							(((db + (((sb-db)*(sa))>>8)) << blueShift)&blueMask);
-						}
-						src_scan+=srcPitchX;
-						dst_scan++;
-					}
+					k.blend32((unsigned int*)dst, (unsigned int*)src, srcPitchX, NULL, 0,
+						transWidth, dstFormat, srcFormat);
 					src += srcPitchY;
 					dst += pitch;
 				}
@@ -717,6 +636,17 @@ void Image::drawImageRegion(int left, int top, ClipRect *srcRect, Image *img, in
 			default:
 				BIG_PHAT_ERROR(ERR_UNSUPPORTED_BPP);
 			}
+		} else if(bytesPerPixel == bpp && (bpp == 2 || bpp == 4) && srcPitchX % bpp == 0) {
+			const ImageKernels& k = imageKernels();
+			int srcStep = srcPitchX / bpp;
+			while(transHeight--) {
+				if(bpp == 2)
+					k.copy16((unsigned short*)dst, (unsigned short*)src, srcStep, transWidth);
+				else
+					k.copy32((unsigned int*)dst, (unsigned int*)src, srcStep, transWidth);
+				src += srcPitchY;
+				dst += pitch;
+			}
 		} else {
 			int dstOffsetY = -transWidth*bytesPerPixel + pitch;
 			int srcOffsetY = -srcPitchX*transWidth + srcPitchY;
@@ -1000,33 +930,23 @@ void Image::drawFilledRect(int x, int y, int rectWidth, int rectHeight, int real
 			rectHeight -= (y + rectHeight) - (clipRect.y + clipRect.height);
 
 		unsigned char *dst = &data[x*bytesPerPixel + y*pitch];
-		unsigned int w;
+		const ImageKernels& k = imageKernels();
 
 		switch(bytesPerPixel) {
 			case 2:
 				{
-					unsigned short *scan;
 					unsigned short color = realColor&0xffff;
 					while(rectHeight--) {
-						w = rectWidth;
-						scan = (unsigned short*) dst;
-						while(w--) {
-							*scan++ = color;
-						}
+						k.fill16((unsigned short*) dst, color, rectWidth);
 						dst+=pitch;
 					}
 				}
 				break;
 			case 4:
 				{
-					unsigned int *scan;
 					unsigned int color = realColor;
 					while(rectHeight--) {
-						w = rectWidth;
-						scan = (unsigned int*) dst;
-						while(w--) {
-							*scan++ = color;
-						}
+						k.fill32((unsigned int*) dst, color, rectWidth);
 						dst+=pitch;
 					}
 				}
@@ -1246,16 +1166,14 @@ void Image::drawTriangleWithoutClipping(int x1, int y1, int x2, int y2, int x3,
 	}
 
 	unsigned char *dst = &data[y1*pitch];
+	const ImageKernels& k = imageKernels();
 	switch(bytesPerPixel) {
 		case 2:
 			for(int y = y1; y < y2; y++) {
 				int x_start = fp_ceil(x_left);
 				int w = (fp_ceil(x_right)-x_start);
-				if(w>0) {
-					short *scan = (short*)dst;
-					scan+=x_start;
-					while(w--) *scan++=color;
-				}
+				if(w>0)
+					k.fill16((unsigned short*)dst + x_start, (unsigned short)color, w);
 				dst+=pitch;
 				x_left+=dxdy_left1;
 				x_right+=dxdy_right1;
@@ -1266,11 +1184,8 @@ void Image::drawTriangleWithoutClipping(int x1, int y1, int x2, int y2, int x3,
 			for(int y = y2; y < y3; y++) {
 				int x_start = fp_ceil(x_left);
 				int w = (fp_ceil(x_right)-x_start);
-				if(w>0) {
-					short *scan = (short*)dst;
-					scan+=x_start;
-					while(w--) *scan++=color;
-				}
+				if(w>0)
+					k.fill16((unsigned short*)dst + x_start, (unsigned short)color, w);
 				dst+=pitch;
 				x_left+=dxdy_left2;
 				x_right+=dxdy_right2;
@@ -1280,11 +1195,8 @@ void Image::drawTriangleWithoutClipping(int x1, int y1, int x2, int y2, int x3,
 			for(int y = y1; y < y2; y++) {
 				int x_start = fp_ceil(x_left);
 				int w = (fp_ceil(x_right)-x_start);
-				if(w>0) {
-					int *scan = (int*)dst;
-					scan+=x_start;
-					while(w--) *scan++=color;
-				}
+				if(w>0)
+					k.fill32((unsigned int*)dst + x_start, color, w);
 				dst+=pitch;
 				x_left+=dxdy_left1;
 				x_right+=dxdy_right1;
@@ -1295,11 +1207,8 @@ void Image::drawTriangleWithoutClipping(int x1, int y1, int x2, int y2, int x3,
 			for(int y = y2; y < y3; y++) {
 				int x_start = fp_ceil(x_left);
 				int w = (fp_ceil(x_right)-x_start);
-				if(w>0) {
-					int *scan = (int*)dst;
-					scan+=x_start;
-					while(w--) *scan++=color;
-				}
+				if(w>0)
+					k.fill32((unsigned int*)dst + x_start, color, w);
 				dst+=pitch;
 				x_left+=dxdy_left2;
 				x_right+=dxdy_right2;
@@ -0,0 +1,562 @@
+/* Copyright (C) 2009 Mobile Sorcery AB
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License, version 2, as published by
+the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING.  If not, write to the Free
+Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.
+*/
+
+#include "ImageKernels.h"
+#include "CpuFeatures.h"
+#include <string.h>
+
+//******************************************************************************
+// Scalar
+//******************************************************************************
+
+// the loops Image used to have, one pixel at a time.
+static inline u32 blendPixel(u32 d, u32 s, int a, const BlendFormat& df, const BlendFormat& sf) {
+	int sr = ((s&sf.redMask)>>sf.redShift);
+	int sg = ((s&sf.greenMask)>>sf.greenShift);
+	int sb = ((s&sf.blueMask)>>sf.blueShift);
+	int dr = ((d&df.redMask)>>df.redShift);
+	int dg = ((d&df.greenMask)>>df.greenShift);
+	int db = ((d&df.blueMask)>>df.blueShift);
+
+	if(a == 255) {
+		return (((sr)<< df.redShift)&df.redMask) |
+			(((sg)<< df.greenShift)&df.greenMask) |
+			(((sb)<< df.blueShift)&df.blueMask);
+	} else if(a == 0) {
+		return (((dr)<< df.redShift)&df.redMask) |
+			(((dg)<< df.greenShift)&df.greenMask) |
+			(((db)<< df.blueShift)&df.blueMask);
+	} else {
+		return
+			(((dr + (((sr-dr)*(a))>>8)) << df.redShift)&df.redMask) |
+			(((dg + (((sg-dg)*(a))>>8)) << df.greenShift)&df.greenMask) |
+			(((db + (((sb-db)*(a))>>8)) << df.blueShift)&df.blueMask);
+	}
+}
+
+// the fills are unrolled by hand: compilers don't vectorize a loop of unknown
+// length at -O2, but they do merge runs of stores to neighbouring pixels.
+static void fill16Scalar(u16* dst, u16 color, int n) {
+	for(; n >= 16; n -= 16, dst += 16) {
+		dst[0] = color; dst[1] = color; dst[2] = color; dst[3] = color;
+		dst[4] = color; dst[5] = color; dst[6] = color; dst[7] = color;
+		dst[8] = color; dst[9] = color; dst[10] = color; dst[11] = color;
+		dst[12] = color; dst[13] = color; dst[14] = color; dst[15] = color;
+	}
+	while(n-- > 0)
+		*dst++ = color;
+}
+
+static void fill32Scalar(u32* dst, u32 color, int n) {
+	for(; n >= 8; n -= 8, dst += 8) {
+		dst[0] = color; dst[1] = color; dst[2] = color; dst[3] = color;
+		dst[4] = color; dst[5] = color; dst[6] = color; dst[7] = color;
+	}
+	while(n-- > 0)
+		*dst++ = color;
+}
+
+static void copy16Scalar(u16* dst, const u16* src, int srcStep, int n) {
+	if(srcStep == 1) {
+		memcpy(dst, src, n * 2);
+		return;
+	}
+	while(n--) {
+		*dst++ = *src;
+		src += srcStep;
+	}
+}
+
+static void copy32Scalar(u32* dst, const u32* src, int srcStep, int n) {
+	if(srcStep == 1) {
+		memcpy(dst, src, n * 4);
+		return;
+	}
+	while(n--) {
+		*dst++ = *src;
+		src += srcStep;
+	}
+}
+
+static void blend16Scalar(u16* dst, const u16* src, int srcStep, const u8* alpha, int alphaStep,
+	int n, const BlendFormat& df, const BlendFormat& sf)
+{
+	while(n--) {
+		*dst = (u16)blendPixel(*dst, *src, *alpha, df, sf);
+		src += srcStep;
+		dst++;
+		alpha += alphaStep;
+	}
+}
+
+static void blend32Scalar(u32* dst, const u32* src, int srcStep, const u8* alpha, int alphaStep,
+	int n, const BlendFormat& df, const BlendFormat& sf)
+{
+	while(n--) {
+		int a = alpha ? *alpha : (int)((*src&sf.alphaMask)>>sf.alphaShift);
+		*dst = blendPixel(*dst, *src, a, df, sf);
+		src += srcStep;
+		dst++;
+		if(alpha)
+			alpha += alphaStep;
+	}
+}
+
+static const ImageKernels sScalar = {
+	"scalar",
+	fill16Scalar, fill32Scalar,
+	copy16Scalar, copy32Scalar,
+	blend16Scalar, blend32Scalar,
+};
+
+#ifdef KERNELS_X86
+
+//******************************************************************************
+// Formats the SIMD blends handle
+//******************************************************************************
+
+// 8-bit channels on byte boundaries, the same in src and dst.
+static bool byteChannels(const BlendFormat& df, const BlendFormat& sf, bool srcAlpha) {
+	if(df.redMask != sf.redMask || df.greenMask != sf.greenMask || df.blueMask != sf.blueMask ||
+		df.redShift != sf.redShift || df.greenShift != sf.greenShift || df.blueShift != sf.blueShift)
+		return false;
+	if((df.redShift & 7) || df.redMask != 0xffu << df.redShift ||
+		(df.greenShift & 7) || df.greenMask != 0xffu << df.greenShift ||
+		(df.blueShift & 7) || df.blueMask != 0xffu << df.blueShift)
+		return false;
+	if(srcAlpha && ((sf.alphaShift & 7) || sf.alphaMask != 0xffu << sf.alphaShift))
+		return false;
+	return true;
+}
+
+static bool narrowChannel(u32 mask, u32 shift) {
+	u32 max = mask >> shift;
+	return shift < 16 && max <= 255 && mask == max << shift;
+}
+
+// channels of at most 8 bits, the same in src and dst.
+static bool shortChannels(const BlendFormat& df, const BlendFormat& sf) {
+	if(df.redMask != sf.redMask || df.greenMask != sf.greenMask || df.blueMask != sf.blueMask ||
+		df.redShift != sf.redShift || df.greenShift != sf.greenShift || df.blueShift != sf.blueShift)
+		return false;
+	return narrowChannel(df.redMask, df.redShift) && narrowChannel(df.greenMask, df.greenShift) &&
+		narrowChannel(df.blueMask, df.blueShift);
+}
+
+// (s - d) * a >> 8 is mulhi((s - d) << 7, a << 1), which fits 16 bits
+// for channels of up to 8 bits and rounds the same way.
+
+//******************************************************************************
+// SSE2
+//******************************************************************************
+
+KERNEL_SSE2 static inline __m128i blendChannels(__m128i d, __m128i s, __m128i a2) {
+	__m128i t = _mm_slli_epi16(_mm_sub_epi16(s, d), 7);
+	return _mm_add_epi16(d, _mm_mulhi_epi16(t, a2));
+}
+
+KERNEL_SSE2 static void fill16SSE2(u16* dst, u16 color, int n) {
+	__m128i c = _mm_set1_epi16((short)color);
+	while(n >= 16) {
+		_mm_storeu_si128((__m128i*)dst, c);
+		_mm_storeu_si128((__m128i*)(dst + 8), c);
+		dst += 16;
+		n -= 16;
+	}
+	if(n >= 8) {
+		_mm_storeu_si128((__m128i*)dst, c);
+		dst += 8;
+		n -= 8;
+	}
+	while(n--)
+		*dst++ = color;
+}
+
+KERNEL_SSE2 static void fill32SSE2(u32* dst, u32 color, int n) {
+	__m128i c = _mm_set1_epi32((int)color);
+	while(n >= 8) {
+		_mm_storeu_si128((__m128i*)dst, c);
+		_mm_storeu_si128((__m128i*)(dst + 4), c);
+		dst += 8;
+		n -= 8;
+	}
+	if(n >= 4) {
+		_mm_storeu_si128((__m128i*)dst, c);
+		dst += 4;
+		n -= 4;
+	}
+	while(n--)
+		*dst++ = color;
+}
+
+// mirrored rows are read backwards a vector at a time, and reversed.
+KERNEL_SSE2 static void copy16SSE2(u16* dst, const u16* src, int srcStep, int n) {
+	if(srcStep != -1) {
+		copy16Scalar(dst, src, srcStep, n);
+		return;
+	}
+	while(n >= 8) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(src - 7));
+		v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+		v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+		v = _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2));
+		_mm_storeu_si128((__m128i*)dst, v);
+		src -= 8;
+		dst += 8;
+		n -= 8;
+	}
+	copy16Scalar(dst, src, srcStep, n);
+}
+
+KERNEL_SSE2 static void copy32SSE2(u32* dst, const u32* src, int srcStep, int n) {
+	if(srcStep != -1) {
+		copy32Scalar(dst, src, srcStep, n);
+		return;
+	}
+	while(n >= 4) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(src - 3));
+		_mm_storeu_si128((__m128i*)dst, _mm_shuffle_epi32(v, _MM_SHUFFLE(0, 1, 2, 3)));
+		src -= 4;
+		dst += 4;
+		n -= 4;
+	}
+	copy32Scalar(dst, src, srcStep, n);
+}
+
+KERNEL_SSE2 static void blend16SSE2(u16* dst, const u16* src, int srcStep, const u8* alpha, int alphaStep,
+	int n, const BlendFormat& df, const BlendFormat& sf)
+{
+	if(!shortChannels(df, sf)) {
+		blend16Scalar(dst, src, srcStep, alpha, alphaStep, n, df, sf);
+		return;
+	}
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i opaque = _mm_set1_epi16(255);
+	const __m128i rgb = _mm_set1_epi16((short)(df.redMask | df.greenMask | df.blueMask));
+	const __m128i shifts[3] = { _mm_cvtsi32_si128(df.redShift), _mm_cvtsi32_si128(df.greenShift),
+		_mm_cvtsi32_si128(df.blueShift) };
+	const __m128i masks[3] = { _mm_set1_epi16((short)df.redMask), _mm_set1_epi16((short)df.greenMask),
+		_mm_set1_epi16((short)df.blueMask) };
+	const __m128i lows[3] = { _mm_set1_epi16((short)(df.redMask >> df.redShift)),
+		_mm_set1_epi16((short)(df.greenMask >> df.greenShift)),
+		_mm_set1_epi16((short)(df.blueMask >> df.blueShift)) };
+
+	while(n >= 8) {
+		__m128i s, a;
+		if(srcStep == 1) {
+			s = _mm_loadu_si128((const __m128i*)src);
+		} else {
+			s = _mm_set_epi16(src[7*srcStep], src[6*srcStep], src[5*srcStep], src[4*srcStep],
+				src[3*srcStep], src[2*srcStep], src[srcStep], src[0]);
+		}
+		if(alphaStep == 1) {
+			a = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)alpha), zero);
+		} else {
+			a = _mm_set_epi16(alpha[7*alphaStep], alpha[6*alphaStep], alpha[5*alphaStep], alpha[4*alphaStep],
+				alpha[3*alphaStep], alpha[2*alphaStep], alpha[alphaStep], alpha[0]);
+		}
+		__m128i d = _mm_loadu_si128((const __m128i*)dst);
+		__m128i a2 = _mm_slli_epi16(a, 1);
+
+		__m128i r = zero;
+		for(int i = 0; i < 3; i++) {
+			__m128i sc = _mm_and_si128(_mm_srl_epi16(s, shifts[i]), lows[i]);
+			__m128i dc = _mm_and_si128(_mm_srl_epi16(d, shifts[i]), lows[i]);
+			__m128i c = blendChannels(dc, sc, a2);
+			r = _mm_or_si128(r, _mm_and_si128(_mm_sll_epi16(c, shifts[i]), masks[i]));
+		}
+		__m128i full = _mm_cmpeq_epi16(a, opaque);
+		r = _mm_or_si128(_mm_and_si128(full, _mm_and_si128(s, rgb)), _mm_andnot_si128(full, r));
+		_mm_storeu_si128((__m128i*)dst, r);
+
+		src += 8*srcStep;
+		alpha += 8*alphaStep;
+		dst += 8;
+		n -= 8;
+	}
+	blend16Scalar(dst, src, srcStep, alpha, alphaStep, n, df, sf);
+}
+
+KERNEL_SSE2 static void blend32SSE2(u32* dst, const u32* src, int srcStep, const u8* alpha, int alphaStep,
+	int n, const BlendFormat& df, const BlendFormat& sf)
+{
+	if(!byteChannels(df, sf, alpha == NULL)) {
+		blend32Scalar(dst, src, srcStep, alpha, alphaStep, n, df, sf);
+		return;
+	}
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i opaque = _mm_set1_epi32(255);
+	const __m128i rgb = _mm_set1_epi32((int)(df.redMask | df.greenMask | df.blueMask));
+	const __m128i alphaShift = _mm_cvtsi32_si128(sf.alphaShift);
+
+	while(n >= 4) {
+		__m128i s, a;
+		if(srcStep == 1) {
+			s = _mm_loadu_si128((const __m128i*)src);
+		} else {
+			s = _mm_set_epi32(src[3*srcStep], src[2*srcStep], src[srcStep], src[0]);
+		}
+		if(alpha) {
+			a = _mm_set_epi32(alpha[3*alphaStep], alpha[2*alphaStep], alpha[alphaStep], alpha[0]);
+		} else {
+			a = _mm_and_si128(_mm_srl_epi32(s, alphaShift), opaque);
+		}
+		__m128i d = _mm_loadu_si128((const __m128i*)dst);
+
+		// a*2 in every 16-bit lane of its pixel
+		__m128i a2 = _mm_slli_epi16(_mm_or_si128(a, _mm_slli_epi32(a, 16)), 1);
+		__m128i lo = blendChannels(_mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi8(s, zero),
+			_mm_unpacklo_epi32(a2, a2));
+		__m128i hi = blendChannels(_mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi8(s, zero),
+			_mm_unpackhi_epi32(a2, a2));
+		__m128i r = _mm_packus_epi16(lo, hi);
+
+		__m128i full = _mm_cmpeq_epi32(a, opaque);
+		r = _mm_or_si128(_mm_and_si128(full, s), _mm_andnot_si128(full, r));
+		_mm_storeu_si128((__m128i*)dst, _mm_and_si128(r, rgb));
+
+		src += 4*srcStep;
+		if(alpha)
+			alpha += 4*alphaStep;
+		dst += 4;
+		n -= 4;
+	}
+	blend32Scalar(dst, src, srcStep, alpha, alphaStep, n, df, sf);
+}
+
+static const ImageKernels sSSE2 = {
+	"sse2",
+	fill16SSE2, fill32SSE2,
+	copy16SSE2, copy32SSE2,
+	blend16SSE2, blend32SSE2,
+};
+
+//******************************************************************************
+// AVX2
+//******************************************************************************
+
+#ifdef KERNELS_AVX2
+
+KERNEL_AVX2 static inline __m256i blendChannelsAVX2(__m256i d, __m256i s, __m256i a2) {
+	__m256i t = _mm256_slli_epi16(_mm256_sub_epi16(s, d), 7);
+	return _mm256_add_epi16(d, _mm256_mulhi_epi16(t, a2));
+}
+
+KERNEL_AVX2 static void fill16AVX2(u16* dst, u16 color, int n) {
+	__m256i c = _mm256_set1_epi16((short)color);
+	while(n >= 32) {
+		_mm256_storeu_si256((__m256i*)dst, c);
+		_mm256_storeu_si256((__m256i*)(dst + 16), c);
+		dst += 32;
+		n -= 32;
+	}
+	if(n >= 16) {
+		_mm256_storeu_si256((__m256i*)dst, c);
+		dst += 16;
+		n -= 16;
+	}
+	while(n--)
+		*dst++ = color;
+}
+
+KERNEL_AVX2 static void fill32AVX2(u32* dst, u32 color, int n) {
+	__m256i c = _mm256_set1_epi32((int)color);
+	while(n >= 16) {
+		_mm256_storeu_si256((__m256i*)dst, c);
+		_mm256_storeu_si256((__m256i*)(dst + 8), c);
+		dst += 16;
+		n -= 16;
+	}
+	if(n >= 8) {
+		_mm256_storeu_si256((__m256i*)dst, c);
+		dst += 8;
+		n -= 8;
+	}
+	while(n--)
+		*dst++ = color;
+}
+
+// rotated rows are gathered from a column.
+KERNEL_AVX2 static void copy32AVX2(u32* dst, const u32* src, int srcStep, int n) {
+	if(srcStep == 1) {
+		memcpy(dst, src, n * 4);
+		return;
+	}
+	__m256i index = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+		_mm256_set1_epi32(srcStep));
+	while(n >= 8) {
+		_mm256_storeu_si256((__m256i*)dst, _mm256_i32gather_epi32((const int*)src, index, 4));
+		src += 8*srcStep;
+		dst += 8;
+		n -= 8;
+	}
+	copy32Scalar(dst, src, srcStep, n);
+}
+
+KERNEL_AVX2 static void blend16AVX2(u16* dst, const u16* src, int srcStep, const u8* alpha, int alphaStep,
+	int n, const BlendFormat& df, const BlendFormat& sf)
+{
+	if(!shortChannels(df, sf)) {
+		blend16Scalar(dst, src, srcStep, alpha, alphaStep, n, df, sf);
+		return;
+	}
+	const __m256i opaque = _mm256_set1_epi16(255);
+	const __m256i rgb = _mm256_set1_epi16((short)(df.redMask | df.greenMask | df.blueMask));
+	const __m128i shifts[3] = { _mm_cvtsi32_si128(df.redShift), _mm_cvtsi32_si128(df.greenShift),
+		_mm_cvtsi32_si128(df.blueShift) };
+	const __m256i masks[3] = { _mm256_set1_epi16((short)df.redMask), _mm256_set1_epi16((short)df.greenMask),
+		_mm256_set1_epi16((short)df.blueMask) };
+	const __m256i lows[3] = { _mm256_set1_epi16((short)(df.redMask >> df.redShift)),
+		_mm256_set1_epi16((short)(df.greenMask >> df.greenShift)),
+		_mm256_set1_epi16((short)(df.blueMask >> df.blueShift)) };
+
+	while(n >= 16) {
+		__m256i s, a;
+		if(srcStep == 1) {
+			s = _mm256_loadu_si256((const __m256i*)src);
+		} else {
+			u16 gathered[16];
+			for(int i = 0; i < 16; i++)
+				gathered[i] = src[i*srcStep];
+			s = _mm256_loadu_si256((const __m256i*)gathered);
+		}
+		if(alphaStep == 1) {
+			a = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)alpha));
+		} else {
+			u8 gathered[16];
+			for(int i = 0; i < 16; i++)
+				gathered[i] = alpha[i*alphaStep];
+			a = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)gathered));
+		}
+		__m256i d = _mm256_loadu_si256((const __m256i*)dst);
+		__m256i a2 = _mm256_slli_epi16(a, 1);
+
+		__m256i r = _mm256_setzero_si256();
+		for(int i = 0; i < 3; i++) {
+			__m256i sc = _mm256_and_si256(_mm256_srl_epi16(s, shifts[i]), lows[i]);
+			__m256i dc = _mm256_and_si256(_mm256_srl_epi16(d, shifts[i]), lows[i]);
+			__m256i c = blendChannelsAVX2(dc, sc, a2);
+			r = _mm256_or_si256(r, _mm256_and_si256(_mm256_sll_epi16(c, shifts[i]), masks[i]));
+		}
+		__m256i full = _mm256_cmpeq_epi16(a, opaque);
+		r = _mm256_blendv_epi8(r, _mm256_and_si256(s, rgb), full);
+		_mm256_storeu_si256((__m256i*)dst, r);
+
+		src += 16*srcStep;
+		alpha += 16*alphaStep;
+		dst += 16;
+		n -= 16;
+	}
+	// the SSE2 code would pay for switching from AVX
+	_mm256_zeroupper();
+	blend16SSE2(dst, src, srcStep, alpha, alphaStep, n, df, sf);
+}
+
+KERNEL_AVX2 static void blend32AVX2(u32* dst, const u32* src, int srcStep, const u8* alpha, int alphaStep,
+	int n, const BlendFormat& df, const BlendFormat& sf)
+{
+	if(!byteChannels(df, sf, alpha == NULL)) {
+		blend32Scalar(dst, src, srcStep, alpha, alphaStep, n, df, sf);
+		return;
+	}
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i opaque = _mm256_set1_epi32(255);
+	const __m256i rgb = _mm256_set1_epi32((int)(df.redMask | df.greenMask | df.blueMask));
+	const __m128i alphaShift = _mm_cvtsi32_si128(sf.alphaShift);
+	const __m256i index = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+		_mm256_set1_epi32(srcStep));
+
+	while(n >= 8) {
+		__m256i s, a;
+		if(srcStep == 1) {
+			s = _mm256_loadu_si256((const __m256i*)src);
+		} else {
+			s = _mm256_i32gather_epi32((const int*)src, index, 4);
+		}
+		if(!alpha) {
+			a = _mm256_and_si256(_mm256_srl_epi32(s, alphaShift), opaque);
+		} else if(alphaStep == 1) {
+			a = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)alpha));
+		} else {
+			a = _mm256_setr_epi32(alpha[0], alpha[alphaStep], alpha[2*alphaStep], alpha[3*alphaStep],
+				alpha[4*alphaStep], alpha[5*alphaStep], alpha[6*alphaStep], alpha[7*alphaStep]);
+		}
+		__m256i d = _mm256_loadu_si256((const __m256i*)dst);
+
+		// the unpacks and the pack work within each half, so the pixels stay in order.
+		__m256i a2 = _mm256_slli_epi16(_mm256_or_si256(a, _mm256_slli_epi32(a, 16)), 1);
+		__m256i lo = blendChannelsAVX2(_mm256_unpacklo_epi8(d, zero), _mm256_unpacklo_epi8(s, zero),
+			_mm256_unpacklo_epi32(a2, a2));
+		__m256i hi = blendChannelsAVX2(_mm256_unpackhi_epi8(d, zero), _mm256_unpackhi_epi8(s, zero),
+			_mm256_unpackhi_epi32(a2, a2));
+		__m256i r = _mm256_packus_epi16(lo, hi);
+
+		r = _mm256_blendv_epi8(r, s, _mm256_cmpeq_epi32(a, opaque));
+		_mm256_storeu_si256((__m256i*)dst, _mm256_and_si256(r, rgb));
+
+		src += 8*srcStep;
+		if(alpha)
+			alpha += 8*alphaStep;
+		dst += 8;
+		n -= 8;
+	}
+	// the SSE2 code would pay for switching from AVX
+	_mm256_zeroupper();
+	blend32SSE2(dst, src, srcStep, alpha, alphaStep, n, df, sf);
+}
+
+static const ImageKernels sAVX2 = {
+	"avx2",
+	fill16AVX2, fill32AVX2,
+	copy16SSE2, copy32AVX2,
+	blend16AVX2, blend32AVX2,
+};
+
+#endif	//KERNELS_AVX2
+
+#endif	//KERNELS_X86
+
+const ImageKernels* getImageKernels(ImageKernelSet set) {
+	switch(set) {
+	case IMAGE_KERNELS_SCALAR:
+		return &sScalar;
+#ifdef KERNELS_X86
+	case IMAGE_KERNELS_SSE2:
+		return cpuHasSSE2() ? &sSSE2 : NULL;
+#ifdef KERNELS_AVX2
+	case IMAGE_KERNELS_AVX2:
+		return cpuHasSSE2() && cpuHasAVX2() ? &sAVX2 : NULL;
+#endif
+#endif
+	default:
+		return NULL;
+	}
+}
+
+static const ImageKernels* sBest = NULL;
+
+const ImageKernels& imageKernels() {
+	if(!sBest) {
+		const ImageKernels* k = getImageKernels(IMAGE_KERNELS_AVX2);
+		if(!k)
+			k = getImageKernels(IMAGE_KERNELS_SSE2);
+		if(!k)
+			k = &sScalar;
+		sBest = k;
+	}
+	return *sBest;
+}
@@ -0,0 +1,64 @@
+/* Copyright (C) 2009 Mobile Sorcery AB
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License, version 2, as published by
+the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING.  If not, write to the Free
+Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.
+*/
+
+#ifndef _IMAGE_KERNELS_H_
+#define _IMAGE_KERNELS_H_
+
+#include "helpers/types.h"
+
+// the channels of the pixels a blend reads or writes.
+struct BlendFormat {
+	u32 redMask, greenMask, blueMask, alphaMask;
+	u32 redShift, greenShift, blueShift, alphaShift;
+};
+
+// The scanline loops of Image. Every set of kernels writes exactly the same
+// pixels as the scalar one; the SIMD sets fall back to it for the formats
+// they don't handle.
+//
+// Steps are in pixels (or alpha bytes), and may be negative, so the rotated
+// and mirrored blits read along a column or backwards along a row.
+struct ImageKernels {
+	const char* name;
+
+	void (*fill16)(u16* dst, u16 color, int n);
+	void (*fill32)(u32* dst, u32 color, int n);
+
+	void (*copy16)(u16* dst, const u16* src, int srcStep, int n);
+	void (*copy32)(u32* dst, const u32* src, int srcStep, int n);
+
+	// dst + ((src - dst) * a) >> 8 per channel, with a from the alpha bytes.
+	void (*blend16)(u16* dst, const u16* src, int srcStep, const u8* alpha, int alphaStep,
+		int n, const BlendFormat& dstFormat, const BlendFormat& srcFormat);
+	// if alpha is NULL, a is the alpha channel of src.
+	void (*blend32)(u32* dst, const u32* src, int srcStep, const u8* alpha, int alphaStep,
+		int n, const BlendFormat& dstFormat, const BlendFormat& srcFormat);
+};
+
+enum ImageKernelSet {
+	IMAGE_KERNELS_SCALAR,
+	IMAGE_KERNELS_SSE2,
+	IMAGE_KERNELS_AVX2
+};
+
+// NULL if this build or CPU can't run the set.
+const ImageKernels* getImageKernels(ImageKernelSet set);
+
+// the best set this CPU can run, chosen on the first call.
+const ImageKernels& imageKernels();
+
+#endif	//_IMAGE_KERNELS_H_
@@ -0,0 +1,157 @@
+/* Copyright (C) 2009 Mobile Sorcery AB
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License, version 2, as published by
+the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING.  If not, write to the Free
+Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.
+*/
+
+#include "MappedFileStream.h"
+
+#ifdef USE_MAPPED_PROGRAM
+
+#include <sys/mman.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <signal.h>
+
+static size_t pageSize() {
+	static size_t size = 0;
+	if(size == 0)
+		size = (size_t)sysconf(_SC_PAGESIZE);
+	return size;
+}
+
+static size_t roundUpToPage(size_t size) {
+	return (size + pageSize() - 1) & ~(pageSize() - 1);
+}
+
+// A file that is truncated while it is mapped raises SIGBUS on the next
+// access to a page past its new end. The handler explains the crash when
+// the address is in a mapped section, then lets the default action run.
+#define MAX_GUARDED_SECTIONS 8
+static struct { byte* start; size_t size; } sGuarded[MAX_GUARDED_SECTIONS];
+static struct sigaction sOldBusAction;
+static bool sBusHandlerInstalled = false;
+
+static void busHandler(int, siginfo_t* info, void*) {
+	byte* addr = (byte*)info->si_addr;
+	for(int i=0; i<MAX_GUARDED_SECTIONS; i++) {
+		if(addr >= sGuarded[i].start && addr < sGuarded[i].start + sGuarded[i].size) {
+			static const char msg[] = "The program file changed on disk while it was mapped.\n"
+				"Don't rebuild a program while it runs with -mapprogram.\n";
+			if(write(2, msg, sizeof(msg) - 1)) {}
+			break;
+		}
+	}
+	// returning retries the access, which now gets the old action.
+	sigaction(SIGBUS, &sOldBusAction, NULL);
+}
+
+static void guardSection(byte* start, size_t size) {
+	if(!sBusHandlerInstalled) {
+		struct sigaction action;
+		memset(&action, 0, sizeof(action));
+		action.sa_sigaction = busHandler;
+		action.sa_flags = SA_SIGINFO;
+		sigemptyset(&action.sa_mask);
+		if(sigaction(SIGBUS, &action, &sOldBusAction) < 0)
+			return;
+		sBusHandlerInstalled = true;
+	}
+	for(int i=0; i<MAX_GUARDED_SECTIONS; i++) {
+		if(sGuarded[i].start == NULL) {
+			sGuarded[i].size = size;
+			sGuarded[i].start = start;
+			return;
+		}
+	}
+}
+
+static void unguardSection(byte* start) {
+	for(int i=0; i<MAX_GUARDED_SECTIONS; i++) {
+		if(sGuarded[i].start == start) {
+			sGuarded[i].start = NULL;
+			sGuarded[i].size = 0;
+		}
+	}
+}
+
+namespace Base {
+
+	MappedFileStream::MappedFileStream(const char* filename) : FileStream(filename) {}
+
+	void* MappedFileStream::mapSection(int len, int size, bool writable) {
+		int pos, fileLen;
+		if(!isOpen() || len < 0 || len > size)
+			return NULL;
+		if(!tell(pos) || !length(fileLen))
+			return NULL;
+		if((pos & 3) != 0 || pos + len > fileLen)
+			return NULL;
+
+		// mmap() offsets must be page-aligned, so the region starts at the
+		// page that holds the section's first byte.
+		size_t pageOffset = pos & (pageSize() - 1);
+		size_t total = roundUpToPage(pageOffset + size);
+
+		// reserve the whole region as zeroed memory, then map the file over the start of it.
+		byte* base = (byte*)mmap(NULL, total, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if(base == MAP_FAILED) {
+			LOG("mmap(%i) failed: %i(%s)\n", (int)total, errno, strerror(errno));
+			return NULL;
+		}
+		if(len > 0) {
+			void* res = mmap(base, pageOffset + len, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_FIXED, mFd, pos - pageOffset);
+			if(res == MAP_FAILED) {
+				LOG("mmap(%s, %i, %i) failed: %i(%s)\n", getFilename(), pos, len,
+					errno, strerror(errno));
+				munmap(base, total);
+				return NULL;
+			}
+			// the section's last page continues with whatever follows it in the file.
+			// this writes to one page only; the rest stay shared with the page cache.
+			size_t end = pageOffset + len;
+			size_t endOfPage = roundUpToPage(end);
+			if(endOfPage > end)
+				memset(base + end, 0, endOfPage - end);
+		}
+		if(!writable) {
+			if(mprotect(base, total, PROT_READ) < 0) {
+				LOG("mprotect failed: %i(%s)\n", errno, strerror(errno));
+				munmap(base, total);
+				return NULL;
+			}
+		}
+		if(!seek(Seek::Current, len)) {
+			munmap(base, total);
+			return NULL;
+		}
+		if(len > 0)
+			guardSection(base, pageOffset + len);
+		return base + pageOffset;
+	}
+
+	void MappedFileStream::unmapSection(void* section, int size) {
+		if(section == NULL)
+			return;
+		size_t pageOffset = (size_t)section & (pageSize() - 1);
+		unguardSection((byte*)section - pageOffset);
+		munmap((byte*)section - pageOffset, roundUpToPage(pageOffset + size));
+	}
+
+} // namespace Base
+
+#endif	//USE_MAPPED_PROGRAM
@@ -0,0 +1,61 @@
+/* Copyright (C) 2009 Mobile Sorcery AB
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License, version 2, as published by
+the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING.  If not, write to the Free
+Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.
+*/
+
+#ifndef _BASE_MAPPED_FILE_STREAM_H_
+#define _BASE_MAPPED_FILE_STREAM_H_
+
+#include "config_platform.h"
+
+// mmap() is only used on POSIX hosts.
+#if defined(USE_MAPPED_PROGRAM) && (defined(WIN32) || defined(_android) ||\
+	defined(SYMBIAN) || defined(__IPHONE__))
+#undef USE_MAPPED_PROGRAM
+#endif
+
+#ifdef USE_MAPPED_PROGRAM
+
+#include "FileStream.h"
+
+namespace Base {
+
+	// A read-only file stream that can map sections of the file into memory
+	// instead of copying them. Used by the core to load programs.
+	// The file must not change while a section is mapped: pages that haven't
+	// been read yet see the new contents, and pages past a truncated end raise
+	// SIGBUS. That is reported as such before the process dies.
+	class MappedFileStream : public FileStream {
+	public:
+		MappedFileStream(const char* filename);
+
+		// Sections that aren't writable are mapped read-only. Writable sections
+		// are private copy-on-write mappings, so only the pages that the program
+		// modifies take up memory of their own.
+		// The current position must be 4-byte aligned, so that the section is too.
+		virtual void* mapSection(int len, int size, bool writable);
+
+		// Frees a section returned by mapSection(). size must be the same.
+		static void unmapSection(void* section, int size);
+
+		Stream* createLimitedCopy(int /*size*/) const { FAIL; }
+		Stream* createCopy() const { FAIL; }
+	};
+
+} // namespace Base
+
+#endif	//USE_MAPPED_PROGRAM
+
+#endif // _BASE_MAPPED_FILE_STREAM_H_
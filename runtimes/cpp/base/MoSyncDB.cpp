@@ -34,8 +34,129 @@ MA 02110-1301, USA.
 #include "hashmap/hashmap.h"
 #include <stdio.h>
 #include <string.h>
+#include <string>
+#include <list>
+#include <map>
 
 using namespace Base;
+
+/**
+ * Number of prepared statements kept for each database.
+ */
+#define MODB_STATEMENT_CACHE_SIZE 16
+
+/**
+ * Class that represents an open database, with a cache
+ * of the statements that have been run on it.
+ */
+class MoDB
+{
+private:
+	struct CachedStatement
+	{
+		std::string sql;
+		sqlite3_stmt* statement;
+	};
+	typedef std::list<CachedStatement> StatementList;
+	typedef std::map<std::string, StatementList::iterator> StatementIndex;
+
+	sqlite3* mDB;
+
+	/**
+	 * Prepared statements that are not in use,
+	 * most recently used first.
+	 */
+	StatementList mStatements;
+
+	/**
+	 * The statements in mStatements, by SQL text.
+	 */
+	StatementIndex mStatementIndex;
+
+public:
+	MoDB(sqlite3* db) :
+		mDB(db)
+	{
+	}
+
+	virtual ~MoDB()
+	{
+		StatementList::iterator i = mStatements.begin();
+		for (; i != mStatements.end(); ++i)
+		{
+			sqlite3_finalize(i->statement);
+		}
+		sqlite3_close(mDB);
+	}
+
+	sqlite3* getDB()
+	{
+		return mDB;
+	}
+
+	/**
+	 * Get a statement for the SQL text, from the cache if it
+	 * is there, otherwise a newly prepared one. The caller owns
+	 * the statement until it is given back with releaseStatement().
+	 * @return An SQLite result code.
+	 */
+	int prepareStatement(const char* sql, sqlite3_stmt*& statement)
+	{
+		StatementIndex::iterator i = mStatementIndex.find(sql);
+		if (i != mStatementIndex.end())
+		{
+			statement = i->second->statement;
+			mStatements.erase(i->second);
+			mStatementIndex.erase(i);
+			return SQLITE_OK;
+		}
+		return sqlite3_prepare_v2(mDB, sql, -1, &statement, NULL);
+	}
+
+	/**
+	 * Reset a statement and put it first in the cache.
+	 * If the cache is full, the least recently used
+	 * statement is finalized.
+	 */
+	void releaseStatement(const char* sql, sqlite3_stmt* statement)
+	{
+		if (NULL == statement)
+		{
+			return;
+		}
+
+		sqlite3_reset(statement);
+		sqlite3_clear_bindings(statement);
+
+		// The same SQL may have been run again while a
+		// cursor had this statement. Keep only one.
+		if (mStatementIndex.find(sql) != mStatementIndex.end())
+		{
+			sqlite3_finalize(statement);
+			return;
+		}
+
+		CachedStatement entry;
+		entry.sql = sql;
+		entry.statement = statement;
+		mStatements.push_front(entry);
+		mStatementIndex[entry.sql] = mStatements.begin();
+
+		if (mStatementIndex.size() > MODB_STATEMENT_CACHE_SIZE)
+		{
+			CachedStatement& last = mStatements.back();
+			sqlite3_finalize(last.statement);
+			mStatementIndex.erase(last.sql);
+			mStatements.pop_back();
+		}
+	}
+};
+
+static void MoDBReleaseStatement(
+	MAHandle databaseHandle,
+	const char* sql,
+	sqlite3_stmt* statement);
+
 /**
  * Class that represents a cursor for a query result.
  */
@@ -53,16 +174,25 @@ private:
 	 */
 	int mCursorPosition;
 
+	/**
+	 * The database and SQL text of the statement, so it
+	 * can go back to the statement cache.
+	 */
+	MAHandle mDatabaseHandle;
+	std::string mSQL;
+
 public:
-	MoDBCursor(sqlite3_stmt* statement) :
+	MoDBCursor(sqlite3_stmt* statement, MAHandle databaseHandle, const char* sql) :
 		mStatement(statement),
-		mCursorPosition(0)
+		mCursorPosition(0),
+		mDatabaseHandle(databaseHandle),
+		mSQL(sql)
 	{
 	}
 
 	virtual ~MoDBCursor()
 	{
-		sqlite3_finalize(mStatement);
+		MoDBReleaseStatement(mDatabaseHandle, mSQL.c_str(), mStatement);
 	}
 
 	sqlite3_stmt* getStatement()
@@ -102,25 +232,21 @@ static int gDatabaseHandle = 0;
 static int gCursorHandle = 0;
 
 // Object tables.
-static HashMapNoDelete<sqlite3> gDatabaseTable;
+static HashMap<MoDB> gDatabaseTable;
 static HashMap<MoDBCursor> gCursorTable;
 
 void MoSyncDBInit(void) {
 }
 void MoSyncDBClose(void) {
+	// Cursors first, their statements go back to the databases.
 	gCursorTable.close();
-
-	HashMapNoDelete<sqlite3>::TIteratorC itr = gDatabaseTable.begin();
-	while(itr.hasMore()) {
-		sqlite3_close(itr.next().value);
-	}
 	gDatabaseTable.close();
 }
 
-static sqlite3* MoDBGetDatabase(MAHandle databaseHandle)
+static MoDB* MoDBGetDatabase(MAHandle databaseHandle)
 {
 	// Check if handle exists.
-	sqlite3* db = gDatabaseTable.find(databaseHandle);
+	MoDB* db = gDatabaseTable.find(databaseHandle);
 	if (db)
 	{
 		return db;
@@ -137,7 +263,7 @@ static MAHandle MoDBCreateDatabaseHandle(sqlite3* db)
 {
 	// Create new table entry.
 	++gDatabaseHandle;
-	gDatabaseTable.insert(gDatabaseHandle, db);
+	gDatabaseTable.insert(gDatabaseHandle, new MoDB(db));
 	return gDatabaseHandle;
 }
 
@@ -180,14 +306,35 @@ static MoDBCursor* MoDBGetCursor(MAHandle cursorHandle, int index, int* result)
 	return c;
 }
 
-static MAHandle MoDBCreateCursorHandle(sqlite3_stmt* statement)
+static MAHandle MoDBCreateCursorHandle(
+	sqlite3_stmt* statement,
+	MAHandle databaseHandle,
+	const char* sql)
 {
 	// Create new table entry.
 	++gCursorHandle;
-	gCursorTable.insert(gCursorHandle, new MoDBCursor(statement));
+	gCursorTable.insert(gCursorHandle,
+		new MoDBCursor(statement, databaseHandle, sql));
 	return gCursorHandle;
 }
 
+static void MoDBReleaseStatement(
+	MAHandle databaseHandle,
+	const char* sql,
+	sqlite3_stmt* statement)
+{
+	// The database may have been closed while the statement was in use.
+	MoDB* db = gDatabaseTable.find(databaseHandle);
+	if (db)
+	{
+		db->releaseStatement(sql, statement);
+	}
+	else
+	{
+		sqlite3_finalize(statement);
+	}
+}
+
 extern "C"
 int maDBOpen(const char* path)
 {
@@ -218,33 +365,53 @@ int maDBOpen(const char* path)
 extern "C"
 int maDBClose(MAHandle databaseHandle)
 {
-	sqlite3* db = MoDBGetDatabase(databaseHandle);
+	MoDB* db = MoDBGetDatabase(databaseHandle);
 	if (NULL == db)
 	{
 		return MA_DB_ERROR;
 	}
-	sqlite3_close(db);
 	gDatabaseTable.erase(databaseHandle);
 	return MA_DB_OK;
 }
 
+static int MoDBExecSimple(MAHandle databaseHandle, const char* sql)
+{
+	MoDB* db = MoDBGetDatabase(databaseHandle);
+	if (NULL == db)
+	{
+		return MA_DB_ERROR;
+	}
+	if (SQLITE_OK != sqlite3_exec(db->getDB(), sql, NULL, NULL, NULL))
+	{
+		return MA_DB_ERROR;
+	}
+	return MA_DB_OK;
+}
+
+extern "C"
+int maDBBeginTransaction(MAHandle databaseHandle)
+{
+	return MoDBExecSimple(databaseHandle, "BEGIN");
+}
+
+extern "C"
+int maDBCommitTransaction(MAHandle databaseHandle)
+{
+	return MoDBExecSimple(databaseHandle, "COMMIT");
+}
+
 static int prepStatement(MAHandle databaseHandle, const char* sql, sqlite3_stmt*& statement)
 {
 	// Get database object.
-	sqlite3* db = MoDBGetDatabase(databaseHandle);
+	MoDB* db = MoDBGetDatabase(databaseHandle);
 	if (NULL == db)
 	{
 		//LOGD("MoDBGetDatabase failed\n");
 		return MA_DB_ERROR;
 	}
 
-	// Prepare the query.
-	int result = sqlite3_prepare_v2(
-		db,
-		sql,
-		-1,
-		&statement,
-		NULL);
+	// Prepare the query, or reuse it if it has been run before.
+	int result = db->prepareStatement(sql, statement);
 	if (SQLITE_OK != result)
 	{
 		//LOGD("sqlite3_prepare_v2 failed\n");
@@ -253,7 +420,7 @@ static int prepStatement(MAHandle databaseHandle, const char* sql, sqlite3_stmt*
 	return MA_DB_OK;
 }
 
-static int runStatement(sqlite3_stmt* statement)
+static int runStatement(MAHandle databaseHandle, const char* sql, sqlite3_stmt* statement)
 {
 	// Run the query.
 	int result = sqlite3_step(statement);
@@ -265,14 +432,14 @@ static int runStatement(sqlite3_stmt* statement)
 	{
 		// The result was an error.
 		//LOGD("sqlite3_step failed\n");
-		sqlite3_finalize(statement);
+		MoDBReleaseStatement(databaseHandle, sql, statement);
 		return MA_DB_ERROR;
 	}
 
 	// Was the query completed?
 	if (SQLITE_DONE == result)
 	{
-		sqlite3_finalize(statement);
+		MoDBReleaseStatement(databaseHandle, sql, statement);
 		return MA_DB_OK;
 	}
 
@@ -282,7 +449,7 @@ static int runStatement(sqlite3_stmt* statement)
 		// Return the handle to a cursor object
 		// that can be used for further processing
 		// of the result.
-		return MoDBCreateCursorHandle(statement);
+		return MoDBCreateCursorHandle(statement, databaseHandle, sql);
 	}
 	DEBIG_PHAT_ERROR;
 }
@@ -294,7 +461,7 @@ int maDBExecSQL(MAHandle databaseHandle, const char* sql)
 	int result = prepStatement(databaseHandle, sql, statement);
 	if (result < 0)
 		return result;
-	return runStatement(statement);
+	return runStatement(databaseHandle, sql, statement);
 }
 
 extern "C"
@@ -362,7 +529,7 @@ MAHandle maDBExecSQLParams(MAHandle databaseHandle, const char* sql,
 		DEBUG_ASSERT(result == SQLITE_OK);
 	}
 
-	return runStatement(statement);
+	return runStatement(databaseHandle, sql, statement);
 }
 
 extern "C"
@@ -34,6 +34,8 @@ extern "C" {
 
 MAHandle maDBOpen(const char* path);
 int maDBClose(MAHandle databaseHandle);
+int maDBBeginTransaction(MAHandle databaseHandle);
+int maDBCommitTransaction(MAHandle databaseHandle);
 MAHandle maDBExecSQL(MAHandle databaseHandle, const char* sql);
 MAHandle maDBExecSQLParams(MAHandle databaseHandle, const char* sql,
 	const MADBValue* params, int paramCount);
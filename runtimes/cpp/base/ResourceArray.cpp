@@ -56,6 +56,14 @@ namespace Base {
 		mResSize(0),
 		mRes(NULL),
 		mResTypes(NULL),
+#ifdef USE_LAZY_RESOURCES
+		mResLazy(NULL),
+		mResLazyTypes(NULL),
+#ifdef RESOURCE_MEMORY_LIMIT
+		mResLazyReserve(NULL),
+#endif
+		mLazyLoader(NULL),
+#endif
 		mDynResSize(1),
 		mDynResCapacity(1),
 		mDynRes(NULL),
@@ -81,6 +89,19 @@ namespace Base {
 		MYASSERT(mRes != NULL, ERR_OOM);
 		mResTypes = new byte[mResSize];
 		MYASSERT(mResTypes != NULL, ERR_OOM);
+#ifdef USE_LAZY_RESOURCES
+		unsigned* oldLazy = mResLazy;
+		byte* oldLazyTypes = mResLazyTypes;
+		mResLazy = new unsigned[mResSize];
+		MYASSERT(mResLazy != NULL, ERR_OOM);
+		mResLazyTypes = new byte[mResSize];
+		MYASSERT(mResLazyTypes != NULL, ERR_OOM);
+#ifdef RESOURCE_MEMORY_LIMIT
+		uint* oldLazyReserve = mResLazyReserve;
+		mResLazyReserve = new uint[mResSize];
+		MYASSERT(mResLazyReserve != NULL, ERR_OOM);
+#endif
+#endif
 
 		if(oldRes) {
 			memcpy(mRes, oldRes, oldResSize*sizeof(void*));
@@ -88,6 +109,20 @@ namespace Base {
 			delete[] oldRes;
 			delete[] oldTypes;
 		}
+#ifdef USE_LAZY_RESOURCES
+		if(oldLazy) {
+			memcpy(mResLazy, oldLazy, oldResSize*sizeof(unsigned));
+			memcpy(mResLazyTypes, oldLazyTypes, oldResSize*sizeof(byte));
+			delete[] oldLazy;
+			delete[] oldLazyTypes;
+		}
+#ifdef RESOURCE_MEMORY_LIMIT
+		if(oldLazyReserve) {
+			memcpy(mResLazyReserve, oldLazyReserve, oldResSize*sizeof(uint));
+			delete[] oldLazyReserve;
+		}
+#endif
+#endif
 
 		if(mResSize > oldResSize) {
 			// Clear the new objects.
@@ -96,6 +131,13 @@ namespace Base {
 			memset(&mRes[oldResSize], 0, (mResSize - oldResSize) * sizeof(void*));
 			// Set to placeholder type.
 			memset(mResTypes + oldResSize, RT_PLACEHOLDER, (mResSize - oldResSize));
+#ifdef USE_LAZY_RESOURCES
+			memset(&mResLazy[oldResSize], 0, (mResSize - oldResSize) * sizeof(unsigned));
+			memset(mResLazyTypes + oldResSize, RT_PLACEHOLDER, (mResSize - oldResSize));
+#ifdef RESOURCE_MEMORY_LIMIT
+			memset(&mResLazyReserve[oldResSize], 0, (mResSize - oldResSize) * sizeof(uint));
+#endif
+#endif
 		}
 	}
 
@@ -110,6 +152,13 @@ namespace Base {
 		}
 		delete[] mRes;
 		delete[] mResTypes;
+#ifdef USE_LAZY_RESOURCES
+		delete[] mResLazy;
+		delete[] mResLazyTypes;
+#ifdef RESOURCE_MEMORY_LIMIT
+		delete[] mResLazyReserve;
+#endif
+#endif
 
 		// Destroy dynamic resources.
 		for(unsigned i=1; i<mDynResSize; ++i) {
@@ -138,6 +187,10 @@ namespace Base {
 			return mDynResTypes[index];
 		} else {
 			TESTINDEX(index, mResSize);
+#ifdef USE_LAZY_RESOURCES
+			if(mResLazy[index] != 0)
+				return mResLazyTypes[index];
+#endif
 			return mResTypes[index];
 		}
 	}
@@ -156,6 +209,11 @@ namespace Base {
 			TESTINDEX(index, mDynResSize);
 		} else {
 			TESTINDEX(index, mResSize);
+#ifdef USE_LAZY_RESOURCES
+			// A lazy resource counts as loaded; it is read when first used.
+			if(mResLazy[index] != 0)
+				return true;
+#endif
 		}
 
 		if (res[index] != NULL)
@@ -323,6 +381,51 @@ namespace Base {
 		return RES_OK;
 	}
 
+#ifdef USE_LAZY_RESOURCES
+	bool ResourceArray::add_lazy(unsigned index, unsigned source, byte type, uint reserve) {
+		// Only empty static resources can be loaded lazily.
+		if(index&DYNAMIC_PLACEHOLDER_BIT)
+			return false;
+		TESTINDEX(index, mResSize);
+		if(mRes[index] != NULL || mResTypes[index] != RT_PLACEHOLDER || mResLazy[index] != 0)
+			return false;
+#ifdef RESOURCE_MEMORY_LIMIT
+		// the same test as _add(), so running out is reported now, not on first use.
+		if(mResmem + reserve >= mResmemMax || mResmem + reserve < mResmem)
+			return false;
+		mResmem += reserve;
+		mResLazyReserve[index] = reserve;
+#endif
+		mResLazy[index] = source;
+		mResLazyTypes[index] = type;
+		return true;
+	}
+
+	void ResourceArray::clearLazy(unsigned index) {
+		mResLazy[index] = 0;
+#ifdef RESOURCE_MEMORY_LIMIT
+		mResmem -= mResLazyReserve[index];
+		mResLazyReserve[index] = 0;
+#endif
+	}
+
+	void ResourceArray::materialize(unsigned index) {
+		unsigned source = mResLazy[index];
+		byte type = mResLazyTypes[index];
+		LOGD("Lazy load %i from %i\n", index, source);
+		DEBUG_ASSERT(mLazyLoader != NULL);
+		// the loader stores the resource like any other, into the then empty slot.
+		clearLazy(index);
+		if(!mLazyLoader(index, source) || mRes[index] == NULL || mResTypes[index] != type) {
+			LOG("Lazy load of resource %i failed.\n", index);
+			// the same panic as when the resource is loaded at once.
+			if(type == RT_IMAGE)
+				BIG_PHAT_ERROR(ERR_IMAGE_LOAD_FAILED);
+			BIG_PHAT_ERROR(ERR_RES_FILE_INCONSISTENT);
+		}
+	}
+#endif
+
 	void ResourceArray::logEverything() {
 #ifdef LOGGING_ENABLED
 #define RESOURCE_STRINGS(R, T, D) resourceStrings[R] = #R;
@@ -359,7 +462,12 @@ namespace Base {
 			return _add(index, obj, type);
 		} else {
 			TESTINDEX(index, mResSize);
-			if(mRes[index] != NULL) {
+			if(mRes[index] != NULL
+#ifdef USE_LAZY_RESOURCES
+				|| mResLazy[index] != 0
+#endif
+				)
+			{
 				_destroy(index);
 			}
 			return _add(index, obj, type);
@@ -396,6 +504,12 @@ namespace Base {
 		if(res[index] != NULL || types[index] != RT_PLACEHOLDER) {
 			BIG_PHAT_ERROR(ERR_RES_OVERWRITE);
 		}
+#ifdef USE_LAZY_RESOURCES
+		// so is a static resource that will be loaded when first used.
+		if(res == mRes && mResLazy[index] != 0) {
+			BIG_PHAT_ERROR(ERR_RES_OVERWRITE);
+		}
+#endif
 
 #ifdef RESOURCE_MEMORY_LIMIT
 		int oldResmem = mResmem;
@@ -431,6 +545,10 @@ namespace Base {
 			TESTINDEX(index, mDynResSize);
 		} else {
 			TESTINDEX(index, mResSize);
+#ifdef USE_LAZY_RESOURCES
+			if(mResLazy[index] != 0)
+				materialize(index);
+#endif
 		}
 
 		if(types[index] != R) {
@@ -449,6 +567,10 @@ namespace Base {
 			TESTINDEX(index, mDynResSize);
 		} else {
 			TESTINDEX(index, mResSize);
+#ifdef USE_LAZY_RESOURCES
+			if(mResLazy[index] != 0)
+				materialize(index);
+#endif
 		}
 
 		if(types[index] != R) {
@@ -492,6 +614,10 @@ LOGD("%s: %s %s %i\n", #R, #D, #T, index); break;
 		}
 
 		MYASSERT(types[index] != RT_FLUX, ERR_RES_DESTROY_FLUX);
+#ifdef USE_LAZY_RESOURCES
+		if(res == mRes && mResLazy[index] != 0)
+			clearLazy(index);
+#endif
 
 #ifdef RESOURCE_MEMORY_LIMIT
 		switch(types[index]) {
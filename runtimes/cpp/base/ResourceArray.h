@@ -40,6 +40,11 @@ using namespace MoSyncError;
 // should be found in the main cpp directory for the platform.
 #include "ResourceDefs.h"
 
+// Symbian and Android load their resources their own way.
+#if defined(SYMBIAN) || defined(_android)
+#undef USE_LAZY_RESOURCES
+#endif
+
 namespace Base {
 
 	/**
@@ -76,6 +81,10 @@ namespace Base {
 		//the sizes they return need not be exact.
 #define DECLARE_SIZEFUNCS(R, T, D) uint size_##R(T*);
 		TYPES(DECLARE_SIZEFUNCS);
+#ifdef USE_LAZY_RESOURCES
+		//the size an image will have once it is loaded.
+		uint size_RT_IMAGE(int width, int height);
+#endif
 #endif
 
 #define DECLARE_RESOURCE_TYPES(R, T, D) typedef T R##_Type;
@@ -167,6 +176,29 @@ namespace Base {
 
 		void logEverything();
 
+#ifdef USE_LAZY_RESOURCES
+		/**
+		 * Loads static resource \a index from the resource file,
+		 * using the file's resource \a source.
+		 * @return false on failure.
+		 */
+		typedef bool (*LazyLoader)(unsigned index, unsigned source);
+
+		void setLazyLoader(LazyLoader loader) { mLazyLoader = loader; }
+
+		/**
+		 * Marks an empty static resource to be loaded the first time it is used.
+		 * @param index The static resource handle.
+		 * @param source The handle of the resource in the resource file.
+		 * @param type The type the resource will have once loaded.
+		 * @param reserve The memory the resource will take once loaded. With
+		 * RESOURCE_MEMORY_LIMIT, it is counted as used until then.
+		 * @return false if \a index is dynamic or already in use,
+		 * or if there is no room for \a reserve.
+		 */
+		bool add_lazy(unsigned index, unsigned source, byte type, uint reserve);
+#endif
+
 	private:
 
 		/**
@@ -199,6 +231,19 @@ namespace Base {
 
 		void _destroy(unsigned index);
 
+#ifdef USE_LAZY_RESOURCES
+		/**
+		 * Loads a lazy static resource. Panics if the load fails.
+		 */
+		void materialize(unsigned index);
+
+		/**
+		 * Makes a lazy static resource an empty one again,
+		 * and gives back the memory reserved for it.
+		 */
+		void clearLazy(unsigned index);
+#endif
+
 #ifdef RESOURCE_MEMORY_LIMIT
 		// Max size of all resource data.
 		const uint mResmemMax;
@@ -218,6 +263,17 @@ namespace Base {
 		void** mRes;
 		// Resource type info array.
 		byte* mResTypes;
+#ifdef USE_LAZY_RESOURCES
+		// For each resource that is not loaded yet, the handle to
+		// load it from (zero if there is none), and its future type.
+		unsigned* mResLazy;
+		byte* mResLazyTypes;
+#ifdef RESOURCE_MEMORY_LIMIT
+		// The memory reserved for each resource that is not loaded yet.
+		uint* mResLazyReserve;
+#endif
+		LazyLoader mLazyLoader;
+#endif
 
 		// ****** Dynamic resources ****** //
 
@@ -79,6 +79,12 @@ namespace Base {
 		virtual const void* ptrc() { return NULL; }
 		virtual void* ptr() { return NULL; }
 
+		//supported only by MappedFileStream.
+		//maps len bytes, from the current position, into a new region of size bytes
+		//and advances the position. the rest of the region is zeroed.
+		//returns NULL on failure, in which case the position is unchanged.
+		virtual void* mapSection(int /*len*/, int /*size*/, bool /*writable*/) { return NULL; }
+
 		//Creates a copy of this stream, with the current position as the copy's starting point
 		//and the specified size. The default size, < 0, means that (src_size - pos) will be used.
 		//Returns NULL on failure.
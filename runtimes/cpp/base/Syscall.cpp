@@ -61,6 +61,17 @@ Software Foundation, 59 Temple Place - Suite 330, Boston, MA
 #endif	//WIN32
 #endif	//SYMBIAN && _WIN32_WCE
 
+#ifndef __SDL__
+#undef USE_PARALLEL_IMAGE_DECODE
+#endif
+
+#ifdef USE_PARALLEL_IMAGE_DECODE
+#include "ThreadPool.h"
+#ifndef WIN32
+#include <unistd.h>
+#endif
+#endif
+
 #if defined(LINUX) || defined(__IPHONE__) || defined(DARWIN)
 #include <sys/statvfs.h>
 #define stricmp(x, y) strcasecmp(x, y)
@@ -128,6 +139,11 @@ namespace Base {
 	static int sFileListNextHandle = 1;
 #endif	//SYMBIAN
 
+#ifdef USE_LAZY_RESOURCES
+	// Lazy resources are read through this stream, which stays open.
+	static FileStream* sLazyResourceFile = NULL;
+#endif
+
 	void Syscall::init() {
 		mPanicOnProgrammerError = true;
 		gStoreNextId = 1;
@@ -138,11 +154,112 @@ namespace Base {
 		LOGD("~Syscall\n");
 		gStores.close();
 		gFileHandles.close();
+#ifdef USE_LAZY_RESOURCES
+		delete sLazyResourceFile;
+		sLazyResourceFile = NULL;
+#endif
 		platformDestruct();
 	}
 
+#ifdef USE_PARALLEL_IMAGE_DECODE
+	// The images in a resource buffer are decoded on a pool of threads, one per core.
+	// Only the decoding is done there; the images are converted to the display
+	// format, added to the resource array, and any errors are reported, on the
+	// calling thread.
+	struct ImageDecodeJob {
+		int rI;
+		MemStream* data;
+		SDL_Surface* image;	//as decoded, not yet in the display format
+	};
+
+	// Owns the queued image data and the decoded images that haven't been
+	// converted yet, so that nothing leaks if loading fails half-way.
+	class ImageDecodeJobs : public std::vector<ImageDecodeJob> {
+	public:
+		~ImageDecodeJobs() {
+			for(size_t i=0; i<size(); i++) {
+				ImageDecodeJob& job((*this)[i]);
+				delete job.data;
+				if(job.image)
+					SDL_FreeSurface(job.image);
+			}
+		}
+	};
+
+	struct SpriteJob {
+		int rI;
+		ushort indexSource, left, top, width, height;
+		short cx, cy;
+	};
+
+	class ImageDecoder : public Runnable {
+	public:
+		ImageDecoder(std::vector<ImageDecodeJob>& jobs, uint& next,
+			MoSyncSemaphore& lock, MoSyncSemaphore& done)
+			: mJobs(jobs), mNext(next), mLock(lock), mDone(done) {}
+
+		void run() {
+			while(true) {
+				mLock.wait();
+				uint i = mNext++;
+				mLock.post();
+				if(i >= mJobs.size())
+					break;
+				ImageDecodeJob& job(mJobs[i]);
+				int size;
+				if(job.data->length(size))
+					job.image = Syscall::decodeImage(job.data->ptr(), size);
+			}
+			mDone.post();
+		}
+	private:
+		std::vector<ImageDecodeJob>& mJobs;
+		uint& mNext;
+		MoSyncSemaphore& mLock;
+		MoSyncSemaphore& mDone;
+	};
+
+	static int countProcessors() {
+#ifdef WIN32
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		return info.dwNumberOfProcessors;
+#else
+		return sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	}
+
+	static void decodeImages(std::vector<ImageDecodeJob>& jobs) {
+		if(jobs.empty())
+			return;
+
+		// The image library loads its format libraries on first use,
+		// which must not happen on several threads at once.
+		Syscall::initImageDecoders();
+
+		// This thread decodes along with the workers.
+		uint next = 0;
+		MoSyncSemaphore lock, done;
+		lock.post();
+		int nWorkers = MAX(MIN(countProcessors(), (int)jobs.size()) - 1, 0);
+		ThreadPool pool(MAX(nWorkers, 1));
+		for(int i=0; i<nWorkers; i++) {
+			pool.execute(new ImageDecoder(jobs, next, lock, done));
+		}
+		ImageDecoder(jobs, next, lock, done).run();
+		for(int i=0; i<nWorkers + 1; i++) {
+			done.wait();
+		}
+		pool.close();
+		LOG_RES("Decoded %i images on %i threads\n", (int)jobs.size(), nWorkers + 1);
+	}
+#endif
+
 	/*
 	* Loads all resources from the given buffer.
+	* This is always done at once, even with USE_LAZY_RESOURCES: the buffer is
+	* a data object that the program may change or destroy as soon as
+	* maLoadResources returns, so there is nothing to load from later.
 	*/
 	bool Syscall::loadResourcesFromBuffer(Stream& file, const char* aFilename)  {
 		bool hasResources = true;
@@ -170,6 +287,13 @@ namespace Base {
 		DAR_UVINT(rSize);
 		resources.init(nResources);
 
+#ifdef USE_PARALLEL_IMAGE_DECODE
+		// Images are decoded after the loop, and sprites are cut out
+		// after that, in the order they appear in the buffer.
+		ImageDecodeJobs imageJobs;
+		std::vector<SpriteJob> spriteJobs;
+#endif
+
 		// rI is the resource index.
 		int rI = 1;
 
@@ -225,6 +349,14 @@ namespace Base {
 				ROOM(resources.dadd_RT_PLACEHOLDER(rI, NULL));
 				break;
 			case RT_IMAGE:
+#ifdef USE_PARALLEL_IMAGE_DECODE
+				{
+					ImageDecodeJob job = { rI, new MemStream(size), NULL };
+					imageJobs.push_back(job);
+					TEST(file.readFully(*job.data));
+				}
+				break;
+#endif
 				{
 					MemStream b(size);
 					TEST(file.readFully(b));
@@ -263,7 +395,10 @@ namespace Base {
 					DAR_USHORT(height);
 					DAR_SHORT(cx);
 					DAR_SHORT(cy);
-#ifndef _android
+#ifdef USE_PARALLEL_IMAGE_DECODE
+					SpriteJob job = { rI, indexSource, left, top, width, height, cx, cy };
+					spriteJobs.push_back(job);
+#elif !defined(_android)
 					ROOM(resources.dadd_RT_IMAGE(rI, loadSprite(resources.get_RT_IMAGE(indexSource),
 						left, top, width, height, cx, cy)));
 #endif
@@ -301,6 +436,26 @@ namespace Base {
 			LOG("rI %i, nR %i\n", rI, nResources);
 			BIG_PHAT_ERROR(ERR_RES_FILE_INCONSISTENT);
 		}
+#ifdef USE_PARALLEL_IMAGE_DECODE
+		decodeImages(imageJobs);
+		for(size_t i=0; i<imageJobs.size(); i++) {
+			ImageDecodeJob& job(imageJobs[i]);
+			delete job.data;
+			job.data = NULL;
+			if(!job.image)
+				BIG_PHAT_ERROR(ERR_IMAGE_LOAD_FAILED);
+			RT_IMAGE_Type* image = convertImage(job.image);
+			job.image = NULL;
+			if(!image)
+				BIG_PHAT_ERROR(ERR_IMAGE_LOAD_FAILED);
+			ROOM(resources.dadd_RT_IMAGE(job.rI, image));
+		}
+		for(size_t i=0; i<spriteJobs.size(); i++) {
+			SpriteJob& job(spriteJobs[i]);
+			ROOM(resources.dadd_RT_IMAGE(job.rI, loadSprite(resources.get_RT_IMAGE(job.indexSource),
+				job.left, job.top, job.width, job.height, job.cx, job.cy)));
+		}
+#endif
 		LOG_RES("ResLoad complete\n");
 		return true;
 	}
@@ -315,6 +470,146 @@ namespace Base {
 	int *resourceType;
 #endif
 
+#ifdef USE_LAZY_RESOURCES
+	static bool loadLazyResource(unsigned index, unsigned source) {
+		if(sLazyResourceFile == NULL)
+			sLazyResourceFile = new FileStream(resourcesFilename);
+		return gSyscall->loadResource(*sLazyResourceFile, source, index);
+	}
+
+#ifdef RESOURCE_MEMORY_LIMIT
+	static int readBigEndian(const byte* p, int n) {
+		int v = 0;
+		for(int i=0; i<n; i++)
+			v = (v << 8) | p[i];
+		return v;
+	}
+
+	// Reads the size of the PNG or JPEG image at offset in the file.
+	static bool readImageDimensions(Stream& file, int offset, int size, int& width, int& height) {
+		static const byte pngSignature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+		byte h[24];
+		if(size < (int)sizeof(h))
+			return false;
+		TEST(file.seek(Seek::Start, offset));
+		TEST(file.read(h, sizeof(h)));
+		if(memcmp(h, pngSignature, 8) == 0 && memcmp(h + 12, "IHDR", 4) == 0) {
+			width = readBigEndian(h + 16, 4);
+			height = readBigEndian(h + 20, 4);
+			return width > 0 && height > 0;
+		}
+		if(h[0] != 0xFF || h[1] != 0xD8)
+			return false;
+
+		// JPEG: skip segments up to the first start of frame.
+		int pos = 2;
+		while(pos + 9 <= size) {
+			byte m[9];
+			TEST(file.seek(Seek::Start, offset + pos));
+			TEST(file.read(m, sizeof(m)));
+			int len = readBigEndian(m + 2, 2);
+			if(m[0] != 0xFF || len < 2)
+				return false;
+			if(m[1] >= 0xC0 && m[1] <= 0xCF && m[1] != 0xC4 && m[1] != 0xC8 && m[1] != 0xCC) {
+				height = readBigEndian(m + 5, 2);
+				width = readBigEndian(m + 7, 2);
+				return width > 0 && height > 0;
+			}
+			pos += 2 + len;
+		}
+		return false;
+	}
+#endif
+
+	// The memory resource handle will take once it is loaded. With
+	// RESOURCE_MEMORY_LIMIT, it is reserved when the resource is made lazy,
+	// so running out is found by maLoadResource, as without lazy resources.
+	// Returns false if that can't be told without loading the resource.
+	static bool getLazyReserve(int handle, uint& reserve) {
+		reserve = 0;
+#ifdef RESOURCE_MEMORY_LIMIT
+		int size = resourceSize[handle - 1];
+		if(resourceType[handle - 1] == RT_BINARY) {
+			reserve = sizeof(MemStream) + size;
+			return true;
+		}
+		if(sLazyResourceFile == NULL)
+			sLazyResourceFile = new FileStream(resourcesFilename);
+		int width, height;
+		if(!readImageDimensions(*sLazyResourceFile, resourceOffset[handle - 1], size,
+			width, height))
+		{
+			return false;
+		}
+		reserve = size_RT_IMAGE(width, height);
+#endif
+		return true;
+	}
+
+	// The resource index is cached in a file next to the resource file,
+	// so the next launch doesn't have to walk all the resource headers.
+	// The cache is only used if the resource file is unchanged.
+#define RESOURCE_INDEX_MAGIC 0x5844494d	//"MIDX"
+#define RESOURCE_INDEX_VERSION 1
+
+	struct ResourceIndexHeader {
+		int magic, version;
+		int fileSize, fileTime;
+		int start, nResources;
+	};
+
+	static bool getResourceIndexHeader(ResourceIndexHeader& h, const char* aFilename,
+		int start, int nResources)
+	{
+		struct _stat st;
+		if(_stat(aFilename, &st) != 0)
+			return false;
+		h.magic = RESOURCE_INDEX_MAGIC;
+		h.version = RESOURCE_INDEX_VERSION;
+		h.fileSize = (int)st.st_size;
+		h.fileTime = (int)st.st_mtime;
+		h.start = start;
+		h.nResources = nResources;
+		return true;
+	}
+
+	static bool readResourceIndex(const char* aFilename, int start, int nResources) {
+		ResourceIndexHeader h, ch;
+		if(!getResourceIndexHeader(h, aFilename, start, nResources))
+			return false;
+		std::string name = std::string(aFilename) + ".idx";
+		FileStream cache(name.c_str());
+		if(!cache.isOpen())
+			return false;
+		if(!cache.read(&ch, sizeof(ch)) || memcmp(&h, &ch, sizeof(h)) != 0) {
+			LOG_RES("Resource index %s is stale\n", name.c_str());
+			return false;
+		}
+		int bytes = nResources * sizeof(int);
+		return cache.read(resourceOffset, bytes) &&
+			cache.read(resourceSize, bytes) &&
+			cache.read(resourceType, bytes);
+	}
+
+	static void writeResourceIndex(const char* aFilename, int start, int nResources) {
+		ResourceIndexHeader h;
+		if(!getResourceIndexHeader(h, aFilename, start, nResources))
+			return;
+		std::string name = std::string(aFilename) + ".idx";
+		WriteFileStream cache(name.c_str());
+		int bytes = nResources * sizeof(int);
+		if(!(cache.write(&h, sizeof(h)) &&
+			cache.write(resourceOffset, bytes) &&
+			cache.write(resourceSize, bytes) &&
+			cache.write(resourceType, bytes)))
+		{
+			// not fatal; the index is simply rebuilt next time.
+			LOG("Could not write resource index %s\n", name.c_str());
+			cache.truncate(0);
+		}
+	}
+#endif
+
 	/*
 	* Loads all resources from the stream, except images, binaries and sprites.
 	*/
@@ -351,6 +646,27 @@ namespace Base {
 		resourcesFilename = new char[strlen(aFilename) + 1];
 		strcpy(resourcesFilename, aFilename);
 
+#ifdef USE_LAZY_RESOURCES
+		// Images and binaries are loaded on first use.
+		resources.setLazyLoader(loadLazyResource);
+		delete sLazyResourceFile;
+		sLazyResourceFile = NULL;
+
+		int start;
+		TEST(file.tell(start));
+		if(readResourceIndex(aFilename, start, nResources)) {
+			for(int i=0; i<nResources; i++) {
+				int type = resourceType[i];
+				if(type == RT_UBIN || type == RT_PLACEHOLDER || type == RT_LABEL) {
+					TEST(file.seek(Seek::Start, resourceOffset[i]));
+					TEST(loadResourceEntry(file, aFilename, i + 1, type, resourceSize[i]));
+				}
+			}
+			LOG_RES("ResLoad complete, using cached index\n");
+			return true;
+		}
+#endif
+
 		// rI is the resource index.
 		int rI = 1;
 
@@ -370,66 +686,80 @@ namespace Base {
 			resourceSize[index] = size;
 			resourceType[index] = type;
 
-			switch(type) {
-			case RT_UBIN:
-				{
-					int pos;
-					MYASSERT(aFilename, ERR_RES_LOAD_UBIN);
-					TEST(file.tell(pos));
+			TEST(loadResourceEntry(file, aFilename, rI, type, size));
+
+			rI++;
+		}
+		if(rI != nResources + 1) {
+			LOG("rI %i, nR %i\n", rI, nResources);
+			BIG_PHAT_ERROR(ERR_RES_FILE_INCONSISTENT);
+		}
+#ifdef USE_LAZY_RESOURCES
+		writeResourceIndex(aFilename, start, nResources);
+#endif
+		LOG_RES("ResLoad complete\n");
+		return true;
+	}
+
+	/*
+	* Loads one resource at the current position of the stream,
+	* unless it's an image, binary or sprite, which are skipped.
+	*/
+	bool Syscall::loadResourceEntry(Stream& file, const char* aFilename,
+		int rI, int type, int size)
+	{
+		switch(type) {
+		case RT_UBIN:
+			{
+				int pos;
+				MYASSERT(aFilename, ERR_RES_LOAD_UBIN);
+				TEST(file.tell(pos));
 #ifndef _android
-					ROOM(resources.dadd_RT_BINARY(rI,
-						new LimitedFileStream(aFilename, pos, size)));
+				ROOM(resources.dadd_RT_BINARY(rI,
+					new LimitedFileStream(aFilename, pos, size)));
 #else
-					// Android loads ubins by using JNI.
-					loadUBinary(rI, pos, size);
-					ROOM(resources.dadd_RT_BINARY(rI,
-						new LimitedFileStream(
-							aFilename,
-							pos,
-							size,
-							getJNIEnvironment(),
-							getJNIThis())));
+				// Android loads ubins by using JNI.
+				loadUBinary(rI, pos, size);
+				ROOM(resources.dadd_RT_BINARY(rI,
+					new LimitedFileStream(
+						aFilename,
+						pos,
+						size,
+						getJNIEnvironment(),
+						getJNIThis())));
 #endif
-					TEST(file.seek(Seek::Current, size));
-				}
-				break;
-			case RT_PLACEHOLDER:
-				ROOM(resources.dadd_RT_PLACEHOLDER(rI, NULL));
-				break;
-			case RT_LABEL:
-				{
-					MemStream b(size);
-					TEST(file.readFully(b));
-					ROOM(resources.dadd_RT_LABEL(rI, new Label((const char*)b.ptr(), rI)));
-				}
-				break;
+				TEST(file.seek(Seek::Current, size));
+			}
+			break;
+		case RT_PLACEHOLDER:
+			ROOM(resources.dadd_RT_PLACEHOLDER(rI, NULL));
+			break;
+		case RT_LABEL:
+			{
+				MemStream b(size);
+				TEST(file.readFully(b));
+				ROOM(resources.dadd_RT_LABEL(rI, new Label((const char*)b.ptr(), rI)));
+			}
+			break;
 
 #ifdef LOGGING_ENABLED
-			case 99:  //testtype
+		case 99:  //testtype
 #define DUMP_UVI { DAR_UVINT(u); LOG_RES("u %i\n", u); }
 #define DUMP_SVI { DAR_SVINT(s); LOG_RES("s %i\n", s); }
-				DUMP_UVI;
-				DUMP_UVI;
-				DUMP_UVI;
-				DUMP_SVI;
-				DUMP_SVI;
-				DUMP_SVI;
-				DUMP_SVI;
-				DUMP_SVI;
-				DUMP_SVI;
-				break;
+			DUMP_UVI;
+			DUMP_UVI;
+			DUMP_UVI;
+			DUMP_SVI;
+			DUMP_SVI;
+			DUMP_SVI;
+			DUMP_SVI;
+			DUMP_SVI;
+			DUMP_SVI;
+			break;
 #endif
-			default:
-				TEST(file.seek(Seek::Current, size));
-			}
-
-			rI++;
-		}
-		if(rI != nResources + 1) {
-			LOG("rI %i, nR %i\n", rI, nResources);
-			BIG_PHAT_ERROR(ERR_RES_FILE_INCONSISTENT);
+		default:
+			TEST(file.seek(Seek::Current, size));
 		}
-		LOG_RES("ResLoad complete\n");
 		return true;
 	}
 
@@ -763,6 +1093,65 @@ namespace Base {
 		MYASSERT(dst->writeStream(*src, a->size), ERR_DATA_OOB);
 	}
 
+	static int compareHandles(const void* a, const void* b) {
+		MAHandle x = *(const MAHandle*)a;
+		MAHandle y = *(const MAHandle*)b;
+		return x < y ? -1 : x > y;
+	}
+
+	int Syscall::maConcatData(MAHandle placeholder, const void* handles, int count, int size) {
+		MYASSERT(size >= 0 && count >= 0 && count <= INT_MAX / (int)sizeof(MAHandle),
+			ERR_DATA_OOB);
+		ValidateMemRange(handles, count * sizeof(MAHandle));
+		const MAHandle* h = (const MAHandle*)handles;
+
+		// Check everything before changing anything.
+		int left = size;
+		for(int i=0; i<count; i++) {
+			MYASSERT(h[i] != placeholder, ERR_DATA_OOB);
+			int len;
+			MYASSERT(resources.get_RT_BINARY(h[i])->length(len), ERR_DATA_OOB);
+			left -= MIN(len, left);
+		}
+		MYASSERT(left == 0, ERR_DATA_OOB);
+
+		// A handle given twice would be read after it was destroyed.
+		if(count > 1) {
+			MAHandle* sorted = new MAHandle[count];
+			memcpy(sorted, h, count * sizeof(MAHandle));
+			qsort(sorted, count, sizeof(MAHandle), compareHandles);
+			bool duplicate = false;
+			for(int i=1; i<count && !duplicate; i++) {
+				duplicate = sorted[i] == sorted[i-1];
+			}
+			delete[] sorted;
+			MYASSERT(!duplicate, ERR_DATA_OOB);
+		}
+
+		int res = maCreateData(placeholder, size);
+		if(res != RES_OK)
+			return res;
+		Stream* dst = resources.get_RT_BINARY(placeholder);
+
+		// The new object's pages are only used as they are written, so
+		// freeing each part as soon as it is copied keeps the memory in use
+		// at about one copy of the data, plus one part.
+		left = size;
+		for(int i=0; i<count; i++) {
+			Stream* src = resources.get_RT_BINARY(h[i]);
+			int len;
+			src->length(len);
+			len = MIN(len, left);
+			if(len > 0) {
+				MYASSERT(src->seek(Seek::Start, 0), ERR_DATA_OOB);
+				MYASSERT(dst->writeStream(*src, len), ERR_DATA_OOB);
+				left -= len;
+			}
+			maDestroyObject(h[i]);
+		}
+		return RES_OK;
+	}
+
 #if !defined(_android)
 #ifdef SYMBIAN
 #else
@@ -932,6 +1321,23 @@ namespace Base {
 #ifndef _android
 	SYSCALL(int, maLoadResource(MAHandle handle, MAHandle placeholder, int flag)) {
 		DEBUG_ASSERT(resourcesFilename != NULL);
+#ifdef USE_LAZY_RESOURCES
+		// Images and binaries are only read when first used. Sprites are cut out
+		// now, from the image their source handle refers to at this point.
+		if(handle > 0 && handle <= resourcesCount) {
+			int type = resourceType[handle - 1];
+			uint reserve;
+			if((type == RT_BINARY || type == RT_IMAGE) && getLazyReserve(handle, reserve) &&
+				SYSCALL_THIS->resources.add_lazy(placeholder, handle, (byte)type, reserve))
+			{
+				if(((flag & MA_RESOURCE_CLOSE) != 0) && (resource != NULL)) {
+					delete resource;
+					resource = NULL;
+				}
+				return 1;
+			}
+		}
+#endif
 		if (((flag & MA_RESOURCE_OPEN) != 0) && (resource == NULL))
 		{
 			resource = new FileStream(resourcesFilename);
@@ -50,6 +50,7 @@ namespace Base {
 		bool loadResourcesFromBuffer(Stream& file, const char* aFilename);
 		bool loadResources(Stream& file, const char* aFilename);
 		bool loadResource(Stream& file, MAHandle originalHandle, MAHandle destHandle);
+		bool loadResourceEntry(Stream& file, const char* aFilename, int rI, int type, int size);
 		int countResources();
 
 		void init();
@@ -146,6 +147,8 @@ namespace Base {
 		int maFileListNext(MAHandle list, char* nameBuf, int bufSize);
 		int maFileListClose(MAHandle list);
 
+		int maConcatData(MAHandle placeholder, const void* handles, int count, int size);
+
 		ResourceArray resources;
 
 		void ValidateMemRange(const void* ptr, int size);
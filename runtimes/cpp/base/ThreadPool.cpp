@@ -18,24 +18,34 @@ Software Foundation, 59 Temple Place - Suite 330, Boston, MA
 #include "config_platform.h"
 
 #include <helpers/helpers.h>
+#include <helpers/fifo.h>
+#include <helpers/timer.h>
 
 #include "ThreadPool.h"
 
 using namespace MoSyncError;
 
+#define THREADPOOL_QUEUE_SIZE 1024
+
+struct Task {
+	Runnable* r;	//NULL tells the thread to stop.
+	ProfTime queued;
+};
+
+class TaskQueue : public MpmcFifo<Task, THREADPOOL_QUEUE_SIZE> {};
 
 class WorkerThread {
 public:
-	WorkerThread();
-	~WorkerThread();
+	WorkerThread(ThreadPool& pool);
+	void join();	//waits for the thread to stop.
 
-	bool isAvailable();
-	void start(Runnable* r);
+	//written only by the thread itself, with the pool's mStatsLock held.
+	int mExecuted;
+	double mTotalWaitMs, mMaxWaitMs;
+	double mTotalRunMs, mMaxRunMs;
 private:
+	ThreadPool& mPool;
 	MoSyncThread mThread;
-	MoSyncSemaphore mSem;
-	Runnable* mR;
-	bool mQuit;
 
 	void run();
 	static int homeRun(void*);
@@ -43,38 +53,111 @@ private:
 
 Runnable::~Runnable() {}
 
+static void addStats(ThreadPoolStats& s, const WorkerThread& wt) {
+	s.executed += wt.mExecuted;
+	s.totalWaitMs += wt.mTotalWaitMs;
+	s.maxWaitMs = MAX(s.maxWaitMs, wt.mMaxWaitMs);
+	s.totalRunMs += wt.mTotalRunMs;
+	s.maxRunMs = MAX(s.maxRunMs, wt.mMaxRunMs);
+}
+
 //*****************************************************************************
 //ThreadPool
 //*****************************************************************************
 
-void ThreadPool::execute(Runnable* r) {
-	WorkerThread* wt = NULL;
-	for(uint i=0; i<mThreads.size(); i++) {
-		WorkerThread* temp = mThreads[i];
-		if(temp->isAvailable()) {
-			wt = temp;
-			break;
-		}
+ThreadPool::ThreadPool(int maxThreads) : mMaxThreads(maxThreads), mQueue(new TaskQueue),
+	mIdle(0), mQueued(0), mMaxQueued(0), mFullWaits(0)
+{
+	DEBUG_ASSERT(maxThreads > 0);
+	memset(&mClosedStats, 0, sizeof(mClosedStats));
+	for(int i=0; i<THREADPOOL_QUEUE_SIZE; i++) {
+		mSpace.post();
 	}
-	if(wt == NULL) {	//no available threads; we must make another.
-		wt = new WorkerThread();
-		mThreads.push_back(wt);
+	mThreadsLock.post();
+	mStatsLock.post();
+}
+
+void ThreadPool::put(Runnable* r) {
+	//a slot is free once its get() has returned, so this put() will succeed.
+	if(atomicLoad(&mQueued) >= THREADPOOL_QUEUE_SIZE)
+		atomicAdd(&mFullWaits, 1);
+	mSpace.wait();
+	Task t;
+	t.r = r;
+	t.queued = ProfTime::now();
+	if(!mQueue->put(t)) {
+		DEBIG_PHAT_ERROR;
 	}
-	wt->start(r);
+	atomicMax(&mMaxQueued, atomicAdd(&mQueued, 1));
+	mWork.post();
+}
+
+void ThreadPool::execute(Runnable* r) {
+	DEBUG_ASSERT(r != NULL);
+	put(r);
+	//if no thread is free, start a new one, unless we have enough.
+	if(atomicLoad(&mQueued) > atomicLoad(&mIdle))
+		startThread();
+}
+
+void ThreadPool::startThread() {
+	mThreadsLock.wait();
+	if((int)mThreads.size() < mMaxThreads) {
+		mThreads.push_back(new WorkerThread(*this));
+	}
+	mThreadsLock.post();
 }
 
 //this will wait for all outstanding operations to complete. not so useful.
 void ThreadPool::close() {
-	LOGD("Closing %i threads.\n", mThreads.size());
-	for(uint i=0; i<mThreads.size(); i++) {
-		WorkerThread* wt = mThreads[i];
+	mThreadsLock.wait();
+	std::vector<WorkerThread*> threads;
+	threads.swap(mThreads);
+	mThreadsLock.post();
+
+	LOGD("Closing %i threads.\n", threads.size());
+	//the stop tasks are behind everything that was queued before.
+	for(uint i=0; i<threads.size(); i++) {
+		put(NULL);
+	}
+	for(uint i=0; i<threads.size(); i++) {
+		WorkerThread* wt = threads[i];
+		wt->join();
+		mStatsLock.wait();
+		addStats(mClosedStats, *wt);
+		mStatsLock.post();
 		delete wt;
 	}
-	mThreads.clear();
 }
 
 ThreadPool::~ThreadPool() {
 	DEBUG_ASSERT(mThreads.size() == 0);	//make sure it's closed
+	delete mQueue;
+}
+
+void ThreadPool::getStats(ThreadPoolStats& s) {
+	mThreadsLock.wait();
+	mStatsLock.wait();
+	s = mClosedStats;
+	s.threads = mThreads.size();
+	for(uint i=0; i<mThreads.size(); i++) {
+		addStats(s, *mThreads[i]);
+	}
+	mStatsLock.post();
+	mThreadsLock.post();
+	s.queued = atomicLoad(&mQueued);
+	s.maxQueued = atomicLoad(&mMaxQueued);
+	s.fullWaits = atomicLoad(&mFullWaits);
+}
+
+void ThreadPool::logStats() {
+	ThreadPoolStats s;
+	getStats(s);
+	int n = MAX(s.executed, 1);
+	LOG("ThreadPool: %i threads (max %i), %i executed, %i queued, max queued %i, %i full waits\n",
+		s.threads, mMaxThreads, s.executed, s.queued, s.maxQueued, s.fullWaits);
+	LOG("ThreadPool: wait avg %.2f max %.2f ms, run avg %.2f max %.2f ms\n",
+		s.totalWaitMs / n, s.maxWaitMs, s.totalRunMs / n, s.maxRunMs);
 }
 
 //*****************************************************************************
@@ -85,24 +168,13 @@ ThreadPool::~ThreadPool() {
 #pragma warning(disable:4355)
 #endif
 
-WorkerThread::WorkerThread() : mR(NULL), mQuit(false) {
+WorkerThread::WorkerThread(ThreadPool& pool) : mExecuted(0),
+	mTotalWaitMs(0), mMaxWaitMs(0), mTotalRunMs(0), mMaxRunMs(0), mPool(pool)
+{
 	mThread.start(homeRun, this);
 }
 
-bool WorkerThread::isAvailable() {
-	return mR == NULL;
-}
-
-void WorkerThread::start(Runnable* r) {
-	//LOG("wtStart\n");
-	DEBUG_ASSERT(isAvailable());
-	mR = r;
-	mSem.post();
-}
-
-WorkerThread::~WorkerThread() {
-	mQuit = true;
-	mSem.post();
+void WorkerThread::join() {
 	mThread.join();
 }
 
@@ -114,17 +186,35 @@ int WorkerThread::homeRun(void* data) {
 }
 
 void WorkerThread::run() {
-	while(!mQuit) {
-		do {
-			mSem.wait();
-			if(mQuit)
-				return;
-		} while(mR == NULL);
+	while(true) {
+		atomicAdd(&mPool.mIdle, 1);
+		mPool.mWork.wait();
+		atomicAdd(&mPool.mIdle, -1);
+
+		//there is a task for us, but its put() may not be quite done yet.
+		Task t;
+		while(!mPool.mQueue->get(t)) {
+			MoSyncThread::sleep(0);
+		}
+		atomicAdd(&mPool.mQueued, -1);
+		mPool.mSpace.post();
+		if(t.r == NULL)
+			return;
 
+		ProfTime start = ProfTime::now();
+		double waitMs = (start - t.queued).toMilliSeconds();
 		LOGD("WTrun\n");
-		mR->run();
+		t.r->run();
 		LOGD("WTend\n");
-		delete mR;
-		mR = NULL;
+		delete t.r;
+		double runMs = (ProfTime::now() - start).toMilliSeconds();
+
+		mPool.mStatsLock.wait();
+		mExecuted++;
+		mTotalWaitMs += waitMs;
+		mMaxWaitMs = MAX(mMaxWaitMs, waitMs);
+		mTotalRunMs += runMs;
+		mMaxRunMs = MAX(mMaxRunMs, runMs);
+		mPool.mStatsLock.post();
 	}
 }
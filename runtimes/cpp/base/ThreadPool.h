@@ -28,18 +28,57 @@ public:
 };
 
 class WorkerThread;
+class TaskQueue;
 
+/// Counters for a ThreadPool, since it was created.
+struct ThreadPoolStats {
+	int threads;	///< Threads running now.
+	int executed;	///< Runnables that have completed.
+	int queued;	///< Runnables waiting for a thread now.
+	int maxQueued;	///< The most Runnables that have been waiting at once.
+	int fullWaits;	///< Times execute() had to wait because the queue was full.
+	double totalWaitMs, maxWaitMs;	///< Time between execute() and the start of run().
+	double totalRunMs, maxRunMs;	///< Time spent in run().
+};
+
+#ifndef THREADPOOL_DEFAULT_SIZE
+#define THREADPOOL_DEFAULT_SIZE 16
+#endif
+
+/// Runs Runnables on at most a fixed number of threads.
+/// Threads are started as they are needed; Runnables that find no free thread
+/// wait in a lock-free queue. A Runnable that blocks holds its thread,
+/// so the pool must be big enough for all Runnables that can block at the same time.
+/// If the queue is full, execute() blocks until a thread takes a Runnable from it.
 class ThreadPool {
 public:
+	ThreadPool(int maxThreads = THREADPOOL_DEFAULT_SIZE);
 	~ThreadPool();
 
 	/// In a separate thread: calls Runnable::run(), then deletes \a r.
 	void execute(Runnable* r);
 
-	/// Waits until all Runnables passed to execute() has completed.
+	/// Waits until all Runnables passed to execute() has completed,
+	/// then stops the threads.
 	void close();
+
+	void getStats(ThreadPoolStats& stats);
+	void logStats();
 private:
+	friend class WorkerThread;
+
+	void startThread();
+	void put(Runnable* r);
+
+	const int mMaxThreads;
+	TaskQueue* mQueue;
+	MoSyncSemaphore mWork;	///< Posted once for each item put in the queue.
+	MoSyncSemaphore mSpace;	///< Posted once for each free slot in the queue.
+	MoSyncSemaphore mThreadsLock;	///< Guards mThreads.
+	MoSyncSemaphore mStatsLock;	///< Guards mClosedStats and the threads' counters.
 	std::vector<WorkerThread*> mThreads;
+	volatile int mIdle, mQueued, mMaxQueued, mFullWaits;
+	ThreadPoolStats mClosedStats;	///< Counters of threads stopped by close().
 };
 
 #endif	//THREADPOOL_H
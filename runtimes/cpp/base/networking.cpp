@@ -33,6 +33,12 @@ int gConnNextHandle;
 ThreadPool* gpThreadPool = NULL;
 #define gThreadPool (*gpThreadPool)
 MoSyncMutex* gpConnMutex = NULL;
+static HttpConnectionPool* gpHttpPool = NULL;
+#define gHttpPool (*gpHttpPool)
+#ifdef USE_EPOLL_CONNECTIONS
+EpollEngine* gpEngine = NULL;
+#define gEngine (*gpEngine)
+#endif
 
 //***************************************************************************
 //Initialization
@@ -41,9 +47,20 @@ MoSyncMutex* gpConnMutex = NULL;
 void MANetworkInit() {
 	gConnNextHandle = 1;
 	gpConnMutex = new MoSyncMutex;
-	gpThreadPool = new ThreadPool;
+	//a connection has at most three operations in progress: a read, a write,
+	//and a connect or an HTTP finish. a server connection has only an accept.
+	//maConnClose waits for the operations to end, so this many threads
+	//can never leave an operation waiting.
+	gpThreadPool = new ThreadPool(3 * CONN_MAX);
 	gpConnections = new ConnMap;
+	gpHttpPool = new HttpConnectionPool;
 	gConnMutex.init();
+#ifdef USE_EPOLL_CONNECTIONS
+	gpEngine = new EpollEngine;
+	if(!gEngine.start()) {
+		SAFE_DELETE(gpEngine);	//everything runs on the thread pool
+	}
+#endif
 	MANetworkSslInit();
 }
 
@@ -56,6 +73,9 @@ void MANetworkReset() {
 		MAHandle conn = itr->first;
 		maConnClose(conn);
 	}
+	gConnMutex.lock();
+	gHttpPool.clear();
+	gConnMutex.unlock();
 	gConnNextHandle = 1;
 }
 
@@ -63,8 +83,16 @@ void MANetworkClose() {
 	MANetworkReset();
 	MANetworkSslClose();
 
+#ifdef USE_EPOLL_CONNECTIONS
+	if(gpEngine) {
+		gEngine.close();
+		SAFE_DELETE(gpEngine);
+	}
+#endif
 	gThreadPool.close();
+	gThreadPool.logStats();
 	gConnMutex.close();
+	SAFE_DELETE(gpHttpPool);
 	SAFE_DELETE(gpConnections);
 	SAFE_DELETE(gpThreadPool);
 	SAFE_DELETE(gpConnMutex);
@@ -93,6 +121,38 @@ static MAStreamConn& getStreamConn(MAHandle conn) {
 	return (MAStreamConn&)mac;
 }
 
+//If the connection has read its whole HTTP response, and the server keeps the
+//transport open, puts the transport in the pool instead of closing it.
+static void keepHttpTransport(MAStreamConn& mac) {
+	if(mac.httpKey.empty())
+		return;
+	HttpConnection* http = mac.conn->http();
+	gConnMutex.lock();
+	if(mac.state == 0 && http->isReusable()) {
+		std::string unread;
+		Connection* transport = http->releaseTransport(unread);
+		if(unread.empty()) {
+			LOGS("ConnClose: keeping the transport to %s\n", mac.httpKey.c_str());
+			gHttpPool.give(mac.httpKey, static_cast<TcpConnection*>(transport));
+		} else {
+			delete transport;	//the server sent more than it should have
+		}
+	}
+	gConnMutex.unlock();
+}
+
+#ifdef USE_EPOLL_CONNECTIONS
+//Returns the socket, if the engine can do the connection's reads and writes.
+static MoSyncSocket engineSocket(MAStreamConn& mac) {
+	if(gpEngine == NULL)
+		return INVALID_SOCKET;
+	InetConnection* inet = mac.conn->inet();
+	if(inet == NULL)
+		return INVALID_SOCKET;
+	return inet->getSocket();
+}
+#endif
+
 int rtspCreateConnection(const char* url, RtspConnection*& conn) {
 	Uint16 port;
 	const char *path;
@@ -396,19 +456,35 @@ static int createSocketConnection(const char* parturl, Connection*& conn, ConnTy
 }
 
 //returns >0 or CONNERR.
-static int httpCreateConnection(const char* parturl, HttpConnection*& conn, int method, bool ssl) {
+//The connection gets an idle transport to the same server, if there is one.
+static int httpCreateConnection(const char* parturl, HttpConnection*& conn, int method, bool ssl,
+	std::string& key)
+{
 	u16 port;
 	const char *path;
 	std::string hostname;
 	if(parseProtocolURL(parturl, &port, ssl ? 443 : 80, &path, hostname)!=SUCCESS) return CONNERR_URL;
-	Connection* transport = newSocketConnection(hostname, port, ssl ? Ssl : Socket);
-	conn = new HttpConnection(transport, hostname, path, method);
+	key = HttpConnectionPool::key(hostname, port, ssl);
+	Connection* transport;
+	gConnMutex.lock();
+	transport = gHttpPool.take(key);
+	gConnMutex.unlock();
+	if(transport) {
+		LOGS("HttpCreate: reusing a transport to %s\n", key.c_str());
+		conn = new HttpConnection(NULL, hostname, path, method);
+		conn->adoptTransport(transport, std::string());
+	} else {
+		transport = newSocketConnection(hostname, port, ssl ? Ssl : Socket);
+		conn = new HttpConnection(transport, hostname, path, method);
+	}
 	return 1;
 }
 
-static int httpCreateFinishingGetConnection(const char* parturl, Connection*& conn, bool ssl) {
+static int httpCreateFinishingGetConnection(const char* parturl, Connection*& conn, bool ssl,
+	std::string& key)
+{
 	HttpConnection* http;
-	TLTZ_PASS(httpCreateConnection(parturl, http, HTTP_GET, ssl));
+	TLTZ_PASS(httpCreateConnection(parturl, http, HTTP_GET, ssl, key));
 	http->mState = HttpConnection::FINISHING;
 	conn = http;
 	return 1;
@@ -423,13 +499,14 @@ SYSCALL(MAHandle, maConnect(const char* url)) {
 	if(gConnections.size() >= CONN_MAX)
 		return CONNERR_MAX;
 	Connection* conn;
+	std::string httpKey;
 	if(sstrcmp(url, http_string) == 0) {
 		const char* parturl = url + sizeof(http_string) - 1;
-		TLTZ_PASS(httpCreateFinishingGetConnection(parturl, conn, false));
+		TLTZ_PASS(httpCreateFinishingGetConnection(parturl, conn, false, httpKey));
 
 	} else if(sstrcmp(url, https_string) == 0) {
 		const char* parturl = url + sizeof(https_string) - 1;
-		TLTZ_PASS(httpCreateFinishingGetConnection(parturl, conn, true));
+		TLTZ_PASS(httpCreateFinishingGetConnection(parturl, conn, true, httpKey));
 
 	} else if(sstrcmp(url, socket_string) == 0) {
 		//possible forms:
@@ -564,6 +641,7 @@ SYSCALL(MAHandle, maConnect(const char* url)) {
 	gConnMutex.lock();
 	{
 		MAStreamConn* mac = new MAStreamConn(gConnNextHandle, conn);
+		mac->httpKey = httpKey;
 		gConnections.insert(ConnPair(gConnNextHandle, mac));
 		mac->state = CONNOP_CONNECT;
 		gThreadPool.execute(new Connect(*mac));
@@ -576,6 +654,16 @@ SYSCALL(MAHandle, maConnect(const char* url)) {
 SYSCALL(void, maConnClose(MAHandle conn)) {
 	LOGST("ConnClose %i", conn);
 	MAConn& mac = getConn(conn);
+	if(mac.type == eStreamConn) {
+		keepHttpTransport((MAStreamConn&)mac);
+	}
+#ifdef USE_EPOLL_CONNECTIONS
+	if(mac.type == eStreamConn) {
+		MoSyncSocket sock = engineSocket((MAStreamConn&)mac);
+		if(sock != INVALID_SOCKET)
+			gEngine.cancel(sock);	//before the socket is closed
+	}
+#endif
 	mac.close();	//may take too long
 	delete &mac;
 	gConnMutex.lock();
@@ -619,6 +707,13 @@ SYSCALL(void, maConnRead(MAHandle conn, void* dst, int size)) {
 	MAStreamConn& mac = getStreamConn(conn);
 	MYASSERT((mac.state & CONNOP_READ) == 0, ERR_CONN_ALREADY_READING);
 	mac.state |= CONNOP_READ;
+#ifdef USE_EPOLL_CONNECTIONS
+	MoSyncSocket sock = engineSocket(mac);
+	if(sock != INVALID_SOCKET) {
+		gEngine.read(sock, dst, size, new ConnEngineOp(mac, CONNOP_READ));
+		return;
+	}
+#endif
 	gThreadPool.execute(new ConnRead(mac, dst, size));
 }
 
@@ -628,6 +723,13 @@ SYSCALL(void, maConnReadFrom(MAHandle conn, void* dst, int size, MAConnAddr* src
 	MAStreamConn& mac = getStreamConn(conn);
 	MYASSERT((mac.state & CONNOP_READ) == 0, ERR_CONN_ALREADY_READING);
 	mac.state |= CONNOP_READ;
+#ifdef USE_EPOLL_CONNECTIONS
+	MoSyncSocket sock = engineSocket(mac);
+	if(sock != INVALID_SOCKET) {
+		gEngine.readFrom(sock, dst, size, *src, new ConnEngineOp(mac, CONNOP_READ));
+		return;
+	}
+#endif
 	gThreadPool.execute(new ConnReadFrom(mac, dst, size, src));
 }
 
@@ -637,6 +739,13 @@ SYSCALL(void, maConnWrite(MAHandle conn, const void* src, int size)) {
 	MAStreamConn& mac = getStreamConn(conn);
 	MYASSERT((mac.state & CONNOP_WRITE) == 0, ERR_CONN_ALREADY_WRITING);
 	mac.state |= CONNOP_WRITE;
+#ifdef USE_EPOLL_CONNECTIONS
+	MoSyncSocket sock = engineSocket(mac);
+	if(sock != INVALID_SOCKET) {
+		gEngine.write(sock, src, size, new ConnEngineOp(mac, CONNOP_WRITE));
+		return;
+	}
+#endif
 	gThreadPool.execute(new ConnWrite(mac, src, size));
 }
 
@@ -646,6 +755,13 @@ SYSCALL(void, maConnWriteTo(MAHandle conn, const void* src, int size, const MACo
 	MAStreamConn& mac = getStreamConn(conn);
 	MYASSERT((mac.state & CONNOP_WRITE) == 0, ERR_CONN_ALREADY_WRITING);
 	mac.state |= CONNOP_WRITE;
+#ifdef USE_EPOLL_CONNECTIONS
+	MoSyncSocket sock = engineSocket(mac);
+	if(sock != INVALID_SOCKET) {
+		gEngine.writeTo(sock, src, size, *dst, new ConnEngineOp(mac, CONNOP_WRITE));
+		return;
+	}
+#endif
 	gThreadPool.execute(new ConnWriteTo(mac, src, size, *dst));
 }
 
@@ -668,6 +784,14 @@ SYSCALL(void, maConnReadToData(MAHandle conn, MAHandle data, int offset, int siz
 	}
 
 	mac.state |= CONNOP_READ;
+#ifdef USE_EPOLL_CONNECTIONS
+	MoSyncSocket sock = engineSocket(mac);
+	if(sock != INVALID_SOCKET) {
+		gEngine.read(sock, (byte*)stream.ptr() + offset, size,
+			new ConnEngineDataOp(mac, CONNOP_READ, stream, data));
+		return;
+	}
+#endif
 	gThreadPool.execute(new ConnReadToData(mac, (MemStream&)stream, data, offset, size));
 }
 
@@ -689,6 +813,14 @@ SYSCALL(void, maConnWriteFromData(MAHandle conn, MAHandle data, int offset, int
 	}
 
 	mac.state |= CONNOP_WRITE;
+#ifdef USE_EPOLL_CONNECTIONS
+	MoSyncSocket sock = engineSocket(mac);
+	if(sock != INVALID_SOCKET && stream.ptrc() != NULL) {
+		gEngine.write(sock, (byte*)stream.ptrc() + offset, size,
+			new ConnEngineDataOp(mac, CONNOP_WRITE, stream, data));
+		return;
+	}
+#endif
 	gThreadPool.execute(new ConnWriteFromData(mac, stream, data, offset, size));
 }
 
@@ -697,16 +829,18 @@ SYSCALL(MAHandle, maHttpCreate(const char* url, int method)) {
 	if(gConnections.size() >= CONN_MAX)
 		return CONNERR_MAX;
 	HttpConnection* conn;
+	std::string httpKey;
 	if(sstrcmp(url, http_string) == 0) {
 		const char* parturl = url + sizeof(http_string) - 1;
-		TLTZ_PASS(httpCreateConnection(parturl, conn, method, false));
+		TLTZ_PASS(httpCreateConnection(parturl, conn, method, false, httpKey));
 	} else if(sstrcmp(url, https_string) == 0) {
 		const char* parturl = url + sizeof(https_string) - 1;
-		TLTZ_PASS(httpCreateConnection(parturl, conn, method, true));
+		TLTZ_PASS(httpCreateConnection(parturl, conn, method, true, httpKey));
 	} else {
 		return CONNERR_URL;
 	}
-	MAConn* mac = new MAStreamConn(gConnNextHandle, conn);
+	MAStreamConn* mac = new MAStreamConn(gConnNextHandle, conn);
+	mac->httpKey = httpKey;
 	gConnections.insert(ConnPair(gConnNextHandle, mac));
 	return gConnNextHandle++;
 }
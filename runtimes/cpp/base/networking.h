@@ -35,6 +35,13 @@ Software Foundation, 59 Temple Place - Suite 330, Boston, MA
 #include "ThreadPool.h"
 #include "netImpl.h"
 
+#if !defined(__SDL__) || !defined(LINUX)
+#undef USE_EPOLL_CONNECTIONS
+#endif
+#ifdef USE_EPOLL_CONNECTIONS
+#include "EpollEngine.h"
+#endif
+
 using namespace Base;
 using namespace MoSyncError;
 
@@ -113,6 +120,7 @@ struct MAConn {
 struct MAStreamConn : public MAConn {
 	MAStreamConn(MAHandle h, Connection* c) : MAConn(h, eStreamConn, c), conn(c) {}
 	Connection* conn;
+	std::string httpKey;	//of the pool its transport came from, and goes back to
 };
 
 struct MAServerConn : public MAConn {
@@ -124,35 +132,40 @@ struct MAServerConn : public MAConn {
 //Glue classes, ConnOp
 //***************************************************************************
 
+//Sends the result of an operation to the program.
+inline void ConnHandleResult(MAConn& mac, int opcode, int result, bool lock = true) {
+	LOGST("ConnOp::handleResult %i %i %i", mac.handle, opcode, result);
+	if(lock)
+	{
+		gConnMutex.lock();
+	}
+	if(result < 0 && mac.cancel) {
+		result = CONNERR_CANCELED;
+	}
+	DEBUG_ASSERT(mac.state & opcode);
+
+	MAEvent* ep = new MAEvent;
+	ep->type = EVENT_TYPE_CONN;
+	ep->conn.handle = mac.handle;
+	ep->conn.opType = opcode;
+	ep->conn.result = result;
+
+	mac.state &= ~opcode;
+
+	ConnPushEvent(ep);	//send event to be processed
+	if(lock)
+	{
+		gConnMutex.unlock();
+	}
+}
+
 class ConnOp : public Runnable {
 protected:
 	ConnOp(MAConn& m) : mac(m) {}
 	MAConn& mac;
 
 	void handleResult(int opcode, int result, bool lock = true) {
-		LOGST("ConnOp::handleResult %i %i %i", mac.handle, opcode, result);
-		if(lock)
-		{
-			gConnMutex.lock();
-		}
-        if(result < 0 && mac.cancel) {
-			result = CONNERR_CANCELED;
-		}
-		DEBUG_ASSERT(mac.state & opcode);
-
-		MAEvent* ep = new MAEvent;
-		ep->type = EVENT_TYPE_CONN;
-		ep->conn.handle = mac.handle;
-		ep->conn.opType = opcode;
-		ep->conn.result = result;
-
-		mac.state &= ~opcode;
-
-		ConnPushEvent(ep);	//send event to be processed
-		if(lock)
-		{
-			gConnMutex.unlock();
-		}
+		ConnHandleResult(mac, opcode, result, lock);
 	}
 };
 
@@ -311,6 +324,48 @@ private:
 	MAServerConn& masc;
 };
 
+#ifdef USE_EPOLL_CONNECTIONS
+//***************************************************************************
+//Glue classes, EpollEngine
+//***************************************************************************
+
+//Reads and writes on plain sockets run on the EpollEngine instead of the ThreadPool.
+class ConnEngineOp : public EpollEngine::Op {
+public:
+	ConnEngineOp(MAConn& m, int o) : mac(m), opcode(o) {}
+	void complete(int result) {
+		LOGST("ConnEngineOp %i %i", mac.handle, opcode);
+		ConnHandleResult(mac, opcode, result);
+	}
+private:
+	MAConn& mac;
+	const int opcode;
+};
+
+class ConnEngineDataOp : public EpollEngine::Op {
+public:
+	ConnEngineDataOp(MAConn& m, int o, Stream& s, MAHandle h) : mac(m), opcode(o),
+		stream(s), handle(h) {}
+	void complete(int result) {
+		LOGST("ConnEngineDataOp %i %i", mac.handle, opcode);
+		gConnMutex.lock();
+		{
+			DefluxBinPushEvent(handle, stream);
+
+			ConnHandleResult(mac, opcode, result, false);
+		}
+		gConnMutex.unlock();
+	}
+private:
+	MAConn& mac;
+	const int opcode;
+	Stream& stream;
+	const MAHandle handle;
+};
+
+extern EpollEngine* gpEngine;
+#endif	//USE_EPOLL_CONNECTIONS
+
 //***************************************************************************
 //Functions
 //***************************************************************************
@@ -34,6 +34,7 @@ Software Foundation, 59 Temple Place - Suite 330, Boston, MA
 #include <helpers/maapi_defs.h>
 
 #include <base/FileStream.h>
+#include <base/MappedFileStream.h>
 
 #include "helpers/TranslateSyscall.h"
 //#undef LOGC
@@ -94,6 +95,10 @@ __inline void chrashTestDummy(const char* fmt, ...) {
 
 #include "Core.h"
 
+#ifdef USE_X64_RECOMPILER
+#include "Recompiler/X64Recompiler.h"
+#endif
+
 #if defined (FAKE_CALL_STACK)
 #include "sld.h"
 #endif
@@ -111,6 +116,13 @@ __inline void chrashTestDummy(const char* fmt, ...) {
 #include <vector>
 #endif
 
+#ifdef USE_SAMPLING_PROFILER
+//the profiler reads IP from its sampler thread. this costs a store per
+//instruction whether or not the profiler is running.
+#define UPDATE_IP
+#include <helpers/atomic.h>
+#endif
+
 namespace Core {
 
 using namespace Base;
@@ -324,11 +336,82 @@ public:
 #ifdef USE_ARM_RECOMPILER
 	MoSync::ArmRecompiler recompiler;
 #endif
+#ifdef USE_X64_RECOMPILER
+	MoSync::X64Recompiler recompiler;
+	bool mRecompilerActive;
+#endif
+
+#ifdef USE_THREADED_DISPATCH
+#ifdef USE_SUPERINSTRUCTIONS
+	// Instruction pairs that ThreadedFuse() replaces with a single handler.
+	// The bodies are in core_run_threaded.h.
+#define SUPERINSTRUCTIONS(m)\
+	m(LDI, LDI)\
+	m(LDR, LDR)\
+	m(LDI, ADD)\
+	m(LDR, ADDI)\
+	m(SLLI, ADD)\
+	m(ADDI, LDW)\
+	m(LDW, LDW)\
+	m(STW, STW)\
+	m(LDW, ADD)\
+	COMPARE_BRANCHES(m, LDW)\
+	COMPARE_BRANCHES(m, LDI)\
+	COMPARE_BRANCHES(m, ADDI)\
+	m(PUSH, SUBI)\
+	m(ADDI, POP)\
+	m(POP, RET)\
+
+	// Every conditional jump, as the second half of a pair.
+#define COMPARE_BRANCHES(m, first)\
+	m(first, JC_EQ) m(first, JC_NE)\
+	m(first, JC_GE) m(first, JC_GT) m(first, JC_LE) m(first, JC_LT)\
+	m(first, JC_LTU) m(first, JC_GEU) m(first, JC_GTU) m(first, JC_LEU)
+
+#define DECLARE_SUPERINSTRUCTION_KIND(first, second) TK_##first##_##second,
+#endif
+
+	// Handler kinds of the threaded core. Plain opcodes use their own value.
+	enum ThreadedKind {
+		TK_FAR = _ENDOP,	//FAR-prefixed opcodes, indexed by the second opcode
+		TK_DECODE = TK_FAR + _ENDOP,
+		TK_ILLEGAL,
+		TK_FAR_ILLEGAL,
+		TK_ILLEGAL_FORM,
+		TK_OOB,
+#ifdef GDB_DEBUG
+		TK_DBG_OP,
+#endif
+#ifdef USE_SUPERINSTRUCTIONS
+		SUPERINSTRUCTIONS(DECLARE_SUPERINSTRUCTION_KIND)
+#endif
+		_TK_END
+	};
+
+	// A decoded instruction. mem_dc has one of these for every byte of
+	// mem_cs, so that any jump target can be dispatched without a lookup.
+	struct ThreadedOp {
+		const void* handler;
+		int32_t imm;	//constants are resolved from mem_cp
+		byte rd, rs;
+		byte size;	//encoded length, including any FAR prefix
+		byte op;
+	};
+
+	ThreadedOp* mem_dc;
+	const void* const* threadedHandlers;
+#endif
 
 #ifdef MEMORY_DEBUG
 	int InstCount;
 #endif
 
+#ifdef USE_MAPPED_PROGRAM
+	// Sizes of the segments that LoadVM mapped from the program file.
+	// 0 if the segment was allocated and read instead.
+	int mMappedCsSize, mMappedDsSize, mMappedCpSize;
+#endif
+
 #ifdef INSTRUCTION_PROFILING
 	int* instruction_count;
 #endif
@@ -337,6 +420,10 @@ public:
 	int* fakeCallStack;
 	int fakeCallStackDepth;	//measured in ints
 	int fakeCallStackCapacity;	//measured in ints
+#ifdef USE_SAMPLING_PROFILER
+	//outgrown stacks. the profiler may still be reading one, so they live as long as the core.
+	std::vector<int*> oldFakeCallStacks;
+#endif
 
 #ifdef FUNCTION_PROFILING
 	class ProfTree {
@@ -564,15 +651,51 @@ public:
 	void freeFakeCallStack() {
 		if(fakeCallStack != NULL)
 			free(fakeCallStack);
+#ifdef USE_SAMPLING_PROFILER
+		for(size_t i=0; i<oldFakeCallStacks.size(); i++) {
+			free(oldFakeCallStacks[i]);
+		}
+		oldFakeCallStacks.clear();
+#endif
 	}
 
+#ifdef USE_SAMPLING_PROFILER
+	//the new stack is published before its capacity, so a sampler that sees
+	//the new capacity also sees the new stack.
+	void growFakeCallStack() {
+		int* temp = (int*)malloc(fakeCallStackCapacity * 2 * sizeof(int));
+		DEBUG_ASSERT(temp != NULL);
+		memcpy(temp, fakeCallStack, fakeCallStackDepth * sizeof(int));
+		oldFakeCallStacks.push_back(fakeCallStack);
+		fakeCallStack = temp;
+		atomicStoreRelease(&fakeCallStackCapacity, fakeCallStackCapacity * 2);
+	}
+
+	int sampleFakeCallStack(int* dst, int max) {
+		int capacity = atomicLoadAcquire(&fakeCallStackCapacity);
+		const int* stack = *(int* volatile*)&fakeCallStack;
+		int depth = *(volatile int*)&fakeCallStackDepth;
+		if(depth > capacity)
+			depth = capacity;
+		int n = MIN(depth, max);
+		for(int i=0; i<n; i++) {
+			dst[i] = stack[depth - n + i];
+		}
+		return n;
+	}
+#endif
+
 	//core functions
 	void fakePush(int returnAddress, int callAddress) {
 		if(fakeCallStackDepth == fakeCallStackCapacity) {
+#ifdef USE_SAMPLING_PROFILER
+			growFakeCallStack();
+#else
 			fakeCallStackCapacity *= 2;
 			int* temp = (int*)realloc(fakeCallStack, fakeCallStackCapacity * sizeof(int));
 			DEBUG_ASSERT(temp != NULL);	//should cause destructor to be called on failure
 			fakeCallStack = temp;
+#endif
 		}
 		fakeCallStack[fakeCallStackDepth++] = returnAddress;
 #ifdef FUNCTION_PROFILING
@@ -603,6 +726,20 @@ public:
 		//aIP = RunArm(aIP);
 		rIP = (byte*)recompiler.run((int)rIP);
 #else
+#ifdef USE_X64_RECOMPILER
+		if(mRecompilerActive) {
+			rIP = mem_cs + recompiler.run((int)(rIP - mem_cs));
+			if(!recompiler.bailedOut())
+				return;
+			//the interpreter continues from where the generated code gave up.
+		}
+#endif
+#ifdef USE_THREADED_DISPATCH
+		if(mem_dc != NULL) {
+			rIP = RunThreaded(rIP);
+			return;
+		}
+#endif
 		rIP = Run(rIP);
 #endif
 	}
@@ -655,9 +792,18 @@ public:
 	bool LoadVMApp(const char* modfile, const char* resfile) {
 		InitVM();
 
-		FileStream mod(modfile);
-		if(!LoadVM(mod))
-			return false;
+#ifdef USE_MAPPED_PROGRAM
+		if(mMapProgram) {
+			MappedFileStream mod(modfile);
+			if(!LoadVM(mod))
+				return false;
+		} else
+#endif
+		{
+			FileStream mod(modfile);
+			if(!LoadVM(mod))
+				return false;
+		}
 
 		FileStream res(resfile);
 		if(!mSyscall.loadResources(res, resfile))
@@ -700,6 +846,11 @@ public:
 	}
 #endif
 
+	// LoadVM() maps the program only from a MappedFileStream, which can map
+	// sections at any 4-byte aligned offset in the file. No caller passes
+	// one: maLoadProgram() hands over a data object, which is a resource or
+	// memory, and the only caller with a combined file is the Symbian
+	// runtime, which has no mmap(). So a program loaded here is copied.
 	bool LoadVMApp(Stream& stream, const char* combfile) {
 		LOG("LoadVMApp...\n");
 		InitVM();
@@ -749,12 +900,40 @@ public:
 		LOG("Close recompiler\n");
 		recompiler.close();
 		LOG("Recompiler Closed!\n");
+#endif
+#ifdef USE_X64_RECOMPILER
+		recompiler.close();
+		mRecompilerActive = false;
 #endif
 	}
 
 	//****************************************
 	//Loader
 	//****************************************
+
+	// Frees mem_cs, mem_ds and mem_cp, however they were allocated.
+	void FreeSegments() {
+#ifdef USE_MAPPED_PROGRAM
+		if(mMappedCsSize) {
+			MappedFileStream::unmapSection(mem_cs, mMappedCsSize);
+			mem_cs = NULL;
+			mMappedCsSize = 0;
+		}
+		if(mMappedDsSize) {
+			MappedFileStream::unmapSection(mem_ds, mMappedDsSize);
+			mem_ds = NULL;
+			mMappedDsSize = 0;
+		}
+		if(mMappedCpSize) {
+			MappedFileStream::unmapSection(mem_cp, mMappedCpSize);
+			mem_cp = NULL;
+			mMappedCpSize = 0;
+		}
+#endif
+		SAFE_DELETE(mem_cs);
+		SAFE_DELETE(mem_ds);
+		SAFE_DELETE(mem_cp);
+	}
 	int LoadVM(Stream& file) {
 
 		LOG("LoadVM\n");
@@ -766,9 +945,11 @@ public:
 			FAIL;
 		}
 
-		SAFE_DELETE(mem_cs);
-		SAFE_DELETE(mem_ds);
-		SAFE_DELETE(mem_cp);
+		FreeSegments();
+#ifdef USE_THREADED_DISPATCH
+		delete[] mem_dc;
+		mem_dc = NULL;
+#endif
 
 #ifdef MEMORY_PROTECTION
 		SAFE_DELETE(protectionSet);
@@ -797,16 +978,29 @@ public:
 		DUMPHEX(Head.CodeLen);
 		if(Head.CodeLen > 0) {
 			CODE_SEGMENT_SIZE = nextPowerOf2(2, Head.CodeLen);
-			mem_cs = new byte[CODE_SEGMENT_SIZE];
-			if(!mem_cs) BIG_PHAT_ERROR(ERR_OOM);
 #ifdef INSTRUCTION_PROFILING
 			SAFE_DELETE(instruction_count);
 			instruction_count = new int[CODE_SEGMENT_SIZE];
 			if(!instruction_count) BIG_PHAT_ERROR(ERR_OOM);
 			ZEROMEM(instruction_count, sizeof(int)*CODE_SEGMENT_SIZE);
 #endif
-			TEST(file.read(mem_cs, Head.CodeLen));
-			ZEROMEM(mem_cs + Head.CodeLen, CODE_SEGMENT_SIZE - Head.CodeLen);
+#ifdef USE_MAPPED_PROGRAM
+			bool writableCode = false;
+#ifdef GDB_DEBUG
+			//the debugger writes breakpoints into mem_cs.
+			writableCode = mGdbOn;
+#endif
+			mem_cs = (byte*)file.mapSection(Head.CodeLen, CODE_SEGMENT_SIZE, writableCode);
+			if(mem_cs) {
+				mMappedCsSize = CODE_SEGMENT_SIZE;
+			} else
+#endif
+			{
+				mem_cs = new byte[CODE_SEGMENT_SIZE];
+				if(!mem_cs) BIG_PHAT_ERROR(ERR_OOM);
+				TEST(file.read(mem_cs, Head.CodeLen));
+				ZEROMEM(mem_cs + Head.CodeLen, CODE_SEGMENT_SIZE - Head.CodeLen);
+			}
 		} else {
 			BIG_PHAT_ERROR(ERR_PROGRAM_FILE_BROKEN);
 		}
@@ -858,13 +1052,24 @@ public:
 			mJniEnv->DeleteLocalRef(cls);
 			mJniEnv->DeleteLocalRef(byteBuffer);
 
-#else
-			mem_ds = new int[DATA_SEGMENT_SIZE / sizeof(int)];
-#endif
-
 			if(!mem_ds) BIG_PHAT_ERROR(ERR_OOM);
 			TEST(file.read(mem_ds, Head.DataLen));
 			ZEROMEM((byte*)mem_ds + Head.DataLen, DATA_SEGMENT_SIZE - Head.DataLen);
+#else
+#ifdef USE_MAPPED_PROGRAM
+			//copy-on-write; pages the program never writes to stay shared with the file.
+			mem_ds = (int*)file.mapSection(Head.DataLen, DATA_SEGMENT_SIZE, true);
+			if(mem_ds) {
+				mMappedDsSize = DATA_SEGMENT_SIZE;
+			} else
+#endif
+			{
+				mem_ds = new int[DATA_SEGMENT_SIZE / sizeof(int)];
+				if(!mem_ds) BIG_PHAT_ERROR(ERR_OOM);
+				TEST(file.read(mem_ds, Head.DataLen));
+				ZEROMEM((byte*)mem_ds + Head.DataLen, DATA_SEGMENT_SIZE - Head.DataLen);
+			}
+#endif	//_android
 #ifdef MEMORY_PROTECTION
 			protectionSet = new byte[(DATA_SEGMENT_SIZE+7)>>3];
 			ZEROMEM(protectionSet, (DATA_SEGMENT_SIZE+7)>>3);
@@ -878,9 +1083,17 @@ public:
 
 		DUMPHEX(Head.IntLen);
 		if(Head.IntLen > 0) {
-			mem_cp = new int[Head.IntLen];
-			if(!mem_cp) BIG_PHAT_ERROR(ERR_OOM);
-			TEST(file.read(mem_cp, Head.IntLen * 4));
+#ifdef USE_MAPPED_PROGRAM
+			mem_cp = (int*)file.mapSection(Head.IntLen * 4, Head.IntLen * 4, false);
+			if(mem_cp) {
+				mMappedCpSize = Head.IntLen * 4;
+			} else
+#endif
+			{
+				mem_cp = new int[Head.IntLen];
+				if(!mem_cp) BIG_PHAT_ERROR(ERR_OOM);
+				TEST(file.read(mem_cp, Head.IntLen * 4));
+			}
 		} else {
 			BIG_PHAT_ERROR(ERR_PROGRAM_FILE_BROKEN);
 		}
@@ -894,6 +1107,21 @@ public:
 
 		customEventPointer = ((char*)mem_ds) + (Head.DataSize - maxCustomEventSize);
 
+#ifdef USE_THREADED_DISPATCH
+		bool threaded = mThreadedDispatch;
+#ifdef GDB_DEBUG
+		//breakpoints are written into mem_cs, which the threaded core doesn't see.
+		threaded = threaded && !mGdbOn;
+#endif
+		if(threaded) {
+			ThreadedDecodeAll();
+#ifdef USE_SUPERINSTRUCTIONS
+			if(mSuperinstructions)
+				ThreadedFuse();
+#endif
+		}
+#endif
+
 #ifdef USE_ARM_RECOMPILER
 		//initRecompilerVariables();
 #ifndef _android
@@ -903,9 +1131,172 @@ public:
 #endif
 #endif
 
+#ifdef USE_X64_RECOMPILER
+		mRecompilerActive = mRecompile;
+#ifdef GDB_DEBUG
+		//the debugger needs the interpreter for breakpoints and single-stepping.
+		mRecompilerActive = mRecompilerActive && !mGdbOn;
+#endif
+		if(mRecompilerActive) {
+			recompiler.init(this, &VM_Yield, &IP);
+		}
+#endif
+
 		return 1; //good load
 	}
 
+#ifdef USE_THREADED_DISPATCH
+	//****************************************
+	//Threaded decoder
+	//****************************************
+#define TD_IB(dst) do { if(p >= end) { goto oob; } dst = *p++; } while(0)
+#define TD_CONST do { TD_IB(i); if(i > 127) { TD_IB(j); i = ((i & 127) << 8) + j; }\
+	if(i >= uint(Head.IntLen)) { goto form; } t.imm = mem_cp[i]; } while(0)
+#define TD_IMM16 TD_IB(i); TD_IB(j); t.imm = (i << 8) + j;
+#define TD_IMM24 TD_IB(i); TD_IB(j); TD_IB(k); t.imm = (i << 16) + (j << 8) + k;
+
+	// Decodes the instruction at \a address into mem_dc.
+	// The result depends only on mem_cs and mem_cp, so decoding is idempotent.
+	// Returns the size of the instruction.
+	uint ThreadedDecode(uint address) {
+		ThreadedOp& t(mem_dc[address]);
+		const byte* p = mem_cs + address;
+		const byte* end = mem_cs + CODE_SEGMENT_SIZE;
+		uint i, j, k;
+		int kind;
+
+		t.rd = t.rs = 0;
+		t.imm = 0;
+		t.op = *p++;
+		kind = t.op;
+		switch(t.op) {
+		case _ADD: case _SUB: case _MUL: case _AND: case _OR: case _XOR:
+		case _DIVU: case _DIV: case _SLL: case _SRA: case _SRL:
+		case _NOT: case _NEG: case _LDR: case _XB: case _XH:
+			TD_IB(t.rd); TD_IB(t.rs);
+			break;
+		case _ADDI: case _SUBI: case _MULI: case _ANDI: case _ORI: case _XORI:
+		case _DIVUI: case _DIVI: case _LDI:
+			TD_IB(t.rd); TD_CONST;
+			break;
+		case _SLLI: case _SRAI: case _SRLI: case _PUSH: case _POP:
+			TD_IB(t.rd); TD_IB(i); t.imm = i;
+			break;
+		case _LDB: case _LDH: case _LDW: case _STB: case _STH: case _STW:
+			TD_IB(t.rd); TD_IB(t.rs); TD_CONST;
+			break;
+		case _RET:
+			break;
+		case _CALL: case _JPR:
+			TD_IB(t.rd);
+			break;
+		case _CALLI: case _JPI:
+			TD_IMM16;
+			break;
+		case _JC_EQ: case _JC_NE: case _JC_GE: case _JC_GT: case _JC_LE: case _JC_LT:
+		case _JC_LTU: case _JC_GEU: case _JC_GTU: case _JC_LEU:
+			TD_IB(t.rd); TD_IB(t.rs); TD_IMM16;
+			break;
+		case _SYSCALL:
+			TD_IB(i); t.imm = i;
+			break;
+		case _CASE:
+			TD_IB(t.rd); TD_IMM24;
+			break;
+		case _FAR:
+			TD_IB(t.op);
+			kind = TK_FAR + t.op;
+			switch(t.op) {
+			case _CALLI: case _JPI:
+				TD_IMM24;
+				break;
+			case _JC_EQ: case _JC_NE: case _JC_GE: case _JC_GT: case _JC_LE: case _JC_LT:
+			case _JC_LTU: case _JC_GEU: case _JC_GTU: case _JC_LEU:
+				TD_IB(t.rd); TD_IB(t.rs); TD_IMM24;
+				break;
+			default:
+				kind = TK_FAR_ILLEGAL;
+			}
+			break;
+#ifdef GDB_DEBUG
+		case _DBG_OP:
+			kind = TK_DBG_OP;
+			break;
+#endif
+		default:
+			kind = TK_ILLEGAL;
+		}
+		t.size = byte(p - (mem_cs + address));
+		t.handler = threadedHandlers[kind];
+		return t.size;
+form:
+		t.size = byte(p - (mem_cs + address));
+		t.handler = threadedHandlers[TK_ILLEGAL_FORM];
+		return t.size;
+oob:
+		t.size = byte(p - (mem_cs + address));
+		t.handler = threadedHandlers[TK_OOB];
+		return t.size;
+	}
+#undef TD_IB
+#undef TD_CONST
+#undef TD_IMM16
+#undef TD_IMM24
+
+	// Builds mem_dc by a linear sweep of the program's code.
+	// Bytes not reached by the sweep are decoded on demand by the threaded core.
+	void ThreadedDecodeAll() {
+		if(threadedHandlers == NULL)
+			RunThreaded(NULL);
+		mem_dc = new ThreadedOp[CODE_SEGMENT_SIZE];
+		if(!mem_dc) BIG_PHAT_ERROR(ERR_OOM);
+		for(uint a=0; a<CODE_SEGMENT_SIZE; a++) {
+			mem_dc[a].handler = threadedHandlers[TK_DECODE];
+			mem_dc[a].size = 0;
+		}
+		uint a = 0;
+		while(a < uint(Head.CodeLen)) {
+			a += ThreadedDecode(a);
+		}
+	}
+
+#ifdef USE_SUPERINSTRUCTIONS
+	// Gives every instruction found by ThreadedDecodeAll() that starts one of
+	// the SUPERINSTRUCTIONS pairs the fused handler, which runs both
+	// instructions with one dispatch. The second instruction keeps its own
+	// entry, so jumping to it still works. mem_cs is not changed.
+	void ThreadedFuse() {
+#define SUPERINSTRUCTION_PAIR(first, second) { _##first, _##second, TK_##first##_##second },
+		static const struct { byte first, second; int kind; } pairs[] = {
+			SUPERINSTRUCTIONS(SUPERINSTRUCTION_PAIR)
+		};
+#undef SUPERINSTRUCTION_PAIR
+		const uint nPairs = sizeof(pairs) / sizeof(pairs[0]);
+		int nFused = 0;
+		uint a = 0;
+		while(a < uint(Head.CodeLen)) {
+			ThreadedOp& t(mem_dc[a]);
+			uint b = a + t.size;
+			//the fused handler skips the code segment bounds check of the second instruction.
+			if(b < uint(Head.CodeLen) && b < CODE_SEGMENT_SIZE - 4) {
+				const void* second = mem_dc[b].handler;
+				for(uint i=0; i<nPairs; i++) {
+					if(t.handler == threadedHandlers[pairs[i].first] &&
+						second == threadedHandlers[pairs[i].second])
+					{
+						t.handler = threadedHandlers[pairs[i].kind];
+						nFused++;
+						break;
+					}
+				}
+			}
+			a = b;
+		}
+		LOGD("Fused %i instruction pairs\n", nFused);
+	}
+#endif	//USE_SUPERINSTRUCTIONS
+#endif	//USE_THREADED_DISPATCH
+
 	//****************************************
 	//Definitions
 	//****************************************
@@ -1238,6 +1629,227 @@ void WRITE_REG(int reg, int value) {
 #endif
 	}
 
+#ifdef USE_SYSCALL_INTRINSICS
+	//****************************************
+	//			Syscall intrinsics
+	//****************************************
+	// The soft-float and memory syscalls, run straight from the registers.
+	// Anything that would be an error is left to InvokeSysCall, which reports it.
+
+	static bool IsIntrinsic(int id) {
+		switch(id) {
+		case SYSCALL_ID_memset:
+		case SYSCALL_ID_memcpy:
+		case SYSCALL_ID_strcmp:
+		case SYSCALL_ID_strcpy:
+		case SYSCALL_ID___adddf3:
+		case SYSCALL_ID___subdf3:
+		case SYSCALL_ID___muldf3:
+		case SYSCALL_ID___divdf3:
+		case SYSCALL_ID___negdf2:
+		case SYSCALL_ID___fixdfsi:
+		case SYSCALL_ID___fixunsdfsi:
+		case SYSCALL_ID___floatsidf:
+		case SYSCALL_ID___extendsfdf2:
+		case SYSCALL_ID_dcmp:
+		case SYSCALL_ID___addsf3:
+		case SYSCALL_ID___subsf3:
+		case SYSCALL_ID___mulsf3:
+		case SYSCALL_ID___divsf3:
+		case SYSCALL_ID___negsf2:
+		case SYSCALL_ID___fixsfsi:
+		case SYSCALL_ID___fixunssfsi:
+		case SYSCALL_ID___floatsisf:
+		case SYSCALL_ID___truncdfsf2:
+		case SYSCALL_ID_fcmp:
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	//The halves were just written as ints. Reading them back as one double
+	//would stall on store forwarding, so read them one at a time.
+	double intrinsicDouble(int reg) const {
+		const volatile int* r = regs;
+		MA_DV dv;
+		dv.MA_DV_HI = r[reg];
+		dv.MA_DV_LO = r[reg + 1];
+		return dv.d;
+	}
+	void intrinsicReturn(double d) {
+		MA_DV dv;
+		dv.d = d;
+		REG(REG_r14) = dv.MA_DV_HI;
+		REG(REG_r15) = dv.MA_DV_LO;
+	}
+	float intrinsicFloat(int reg) const {
+		return MAKE(float, REG(reg));
+	}
+	void intrinsicReturn(float f) {
+		REG(REG_r14) = MAKE(int, f);
+	}
+
+	//Same conditions as ValidateMemRange().
+	bool intrinsicRange(uint address, uint size) const {
+		if(address >= DATA_SEGMENT_SIZE || (address+size) > DATA_SEGMENT_SIZE ||
+			size > DATA_SEGMENT_SIZE)
+			return false;
+#ifdef MEMORY_PROTECTION
+		if(protectionEnabled) {
+			for(uint i = address; i < address+size; i++)
+				if(GET_PROTECTION(i))
+					return false;
+		}
+#endif
+		return true;
+	}
+	//Returns -1 if the string isn't valid.
+	int intrinsicStrLen(uint address) const {
+		if(address >= DATA_SEGMENT_SIZE)
+			return -1;
+		const char* str = (char*)mem_ds + address;
+		const char* end = (const char*)memchr(str, 0, DATA_SEGMENT_SIZE - address);
+		if(end == NULL || !intrinsicRange(address, end - str + 1))
+			return -1;
+		return end - str;
+	}
+
+	static bool divisorOk(double b) {
+#ifndef ALLOW_FLOAT_DIVISION_BY_ZERO
+		//InvokeSysCall knows if the emulator allows it.
+		return b != 0;
+#else
+		return true;
+#endif
+	}
+
+	//Kept apart from RunIntrinsic() so the arithmetic doesn't pay for its stack frame.
+	bool runMemoryIntrinsic(int id) {
+		char* ds = (char*)mem_ds;
+		switch(id) {
+		case SYSCALL_ID_memset:
+		case SYSCALL_ID_memcpy:
+			{
+				uint dst = REG(REG_i0), size = REG(REG_i2);
+				if(!intrinsicRange(dst, size))
+					return false;
+				if(id == SYSCALL_ID_memset) {
+					memset(ds + dst, REG(REG_i1), size);
+				} else {
+					uint src = REG(REG_i1);
+					if(!intrinsicRange(src, size))
+						return false;
+					memcpy(ds + dst, ds + src, size);
+				}
+				REG(REG_r14) = dst;
+			}
+			return true;
+		case SYSCALL_ID_strcmp:
+			if(intrinsicStrLen(REG(REG_i0)) < 0 || intrinsicStrLen(REG(REG_i1)) < 0)
+				return false;
+			REG(REG_r14) = strcmp(ds + REG(REG_i0), ds + REG(REG_i1));
+			return true;
+		case SYSCALL_ID_strcpy:
+			{
+				int len = intrinsicStrLen(REG(REG_i1));
+				if(len < 0 || !intrinsicRange(REG(REG_i0), len + 1))
+					return false;
+				memmove(ds + REG(REG_i0), ds + REG(REG_i1), len + 1);
+				REG(REG_r14) = REG(REG_i0);
+			}
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	bool RunIntrinsic(int id) {
+		switch(id) {
+		case SYSCALL_ID_memset:
+		case SYSCALL_ID_memcpy:
+		case SYSCALL_ID_strcmp:
+		case SYSCALL_ID_strcpy:
+			return runMemoryIntrinsic(id);
+
+		case SYSCALL_ID___adddf3:
+			intrinsicReturn(intrinsicDouble(REG_i0) + intrinsicDouble(REG_i2));
+			return true;
+		case SYSCALL_ID___subdf3:
+			intrinsicReturn(intrinsicDouble(REG_i0) - intrinsicDouble(REG_i2));
+			return true;
+		case SYSCALL_ID___muldf3:
+			intrinsicReturn(intrinsicDouble(REG_i0) * intrinsicDouble(REG_i2));
+			return true;
+		case SYSCALL_ID___divdf3:
+			if(!divisorOk(intrinsicDouble(REG_i2)))
+				return false;
+			intrinsicReturn(intrinsicDouble(REG_i0) / intrinsicDouble(REG_i2));
+			return true;
+		case SYSCALL_ID___negdf2:
+			intrinsicReturn(-intrinsicDouble(REG_i0));
+			return true;
+		case SYSCALL_ID___fixdfsi:
+			REG(REG_r14) = (int)intrinsicDouble(REG_i0);
+			return true;
+		case SYSCALL_ID___fixunsdfsi:
+			REG(REG_r14) = (uint)intrinsicDouble(REG_i0);
+			return true;
+		case SYSCALL_ID___floatsidf:
+			intrinsicReturn((double)REG(REG_i0));
+			return true;
+		case SYSCALL_ID___extendsfdf2:
+			intrinsicReturn((double)intrinsicFloat(REG_i0));
+			return true;
+		case SYSCALL_ID_dcmp:
+			{
+				double a = intrinsicDouble(REG_i0), b = intrinsicDouble(REG_i2);
+				REG(REG_r14) = a > b ? 1 : (a == b ? 0 : -1);
+			}
+			return true;
+
+		case SYSCALL_ID___addsf3:
+			intrinsicReturn(intrinsicFloat(REG_i0) + intrinsicFloat(REG_i1));
+			return true;
+		case SYSCALL_ID___subsf3:
+			intrinsicReturn(intrinsicFloat(REG_i0) - intrinsicFloat(REG_i1));
+			return true;
+		case SYSCALL_ID___mulsf3:
+			intrinsicReturn(intrinsicFloat(REG_i0) * intrinsicFloat(REG_i1));
+			return true;
+		case SYSCALL_ID___divsf3:
+			if(!divisorOk(intrinsicFloat(REG_i1)))
+				return false;
+			intrinsicReturn(intrinsicFloat(REG_i0) / intrinsicFloat(REG_i1));
+			return true;
+		case SYSCALL_ID___negsf2:
+			intrinsicReturn(-intrinsicFloat(REG_i0));
+			return true;
+		case SYSCALL_ID___fixsfsi:
+			REG(REG_r14) = (int)intrinsicFloat(REG_i0);
+			return true;
+		case SYSCALL_ID___fixunssfsi:
+			REG(REG_r14) = (uint)intrinsicFloat(REG_i0);
+			return true;
+		case SYSCALL_ID___floatsisf:
+			intrinsicReturn((float)REG(REG_i0));
+			return true;
+		case SYSCALL_ID___truncdfsf2:
+			intrinsicReturn((float)intrinsicDouble(REG_i0));
+			return true;
+		case SYSCALL_ID_fcmp:
+			{
+				float a = intrinsicFloat(REG_i0), b = intrinsicFloat(REG_i1);
+				REG(REG_r14) = a > b ? 1 : (a == b ? 0 : -1);
+			}
+			return true;
+
+		default:
+			return false;
+		}
+	}
+#endif	//USE_SYSCALL_INTRINSICS
+
 	/*
 #ifdef USE_ARM_RECOMPILER
 #include "recompiler_core.h"
@@ -1265,6 +1877,12 @@ void WRITE_REG(int reg, int value) {
 #undef RUN_NAME
 #undef RUN_LOOP
 
+#ifdef USE_THREADED_DISPATCH
+#define RUN_NAME RunThreaded
+#include "core_run_threaded.h"
+#undef RUN_NAME
+#endif
+
 #if 0//def GDB_DEBUG
 #define RUN_NAME Step
 #define RUN_LOOP return ip
@@ -1300,6 +1918,15 @@ void WRITE_REG(int reg, int value) {
 
 	VMCoreInt(Syscall& aSyscall)
 	: rIP(NULL)
+#ifdef USE_MAPPED_PROGRAM
+	, mMappedCsSize(0), mMappedDsSize(0), mMappedCpSize(0)
+#endif
+#ifdef USE_X64_RECOMPILER
+	, mRecompilerActive(false)
+#endif
+#ifdef USE_THREADED_DISPATCH
+	, mem_dc(NULL), threadedHandlers(NULL)
+#endif
 #ifdef MEMORY_DEBUG
 	, InstCount(0)
 #endif
@@ -1336,9 +1963,10 @@ void WRITE_REG(int reg, int value) {
 #ifdef COUNT_INSTRUCTION_USE
 	logInstructionUse();
 #endif
-		delete mem_cs;
-		delete mem_ds;
-		delete mem_cp;
+		FreeSegments();
+#ifdef USE_THREADED_DISPATCH
+		delete[] mem_dc;
+#endif
 
 #ifdef MEMORY_PROTECTION
 		delete protectionSet;
@@ -1352,6 +1980,9 @@ void WRITE_REG(int reg, int value) {
 		//closeRecompiler();
 		recompiler.close();
 #endif
+#ifdef USE_X64_RECOMPILER
+		recompiler.close();
+#endif
 
 #ifdef FAKE_CALL_STACK
 		freeFakeCallStack();
@@ -1391,6 +2022,21 @@ VMCore::VMCore() : mem_cs(NULL), mem_ds(NULL), mem_cp(NULL)
 #ifdef GDB_DEBUG
 	, mGdbStub(NULL), mGdbOn(false)
 #endif
+#ifdef USE_THREADED_DISPATCH
+	, mThreadedDispatch(true)
+#endif
+#ifdef USE_SUPERINSTRUCTIONS
+	, mSuperinstructions(true)
+#endif
+#ifdef USE_X64_RECOMPILER
+	, mRecompile(true)
+#endif
+#ifdef USE_SYSCALL_INTRINSICS
+	, mIntrinsics(true)
+#endif
+#ifdef USE_MAPPED_PROGRAM
+	, mMapProgram(false)
+#endif
 {}
 
 //Functions for outside access
@@ -1450,6 +2096,20 @@ int GetFakeCallStackDepth(const VMCore* core) {
 const int* GetFakeCallStack(const VMCore* core) {
 	return CORE->fakeCallStack;
 }
+#ifdef USE_SAMPLING_PROFILER
+int SampleFakeCallStack(const VMCore* core, int* dst, int max) {
+	return CORE->sampleFakeCallStack(dst, max);
+}
+#endif
+#endif
+
+#ifdef USE_SYSCALL_INTRINSICS
+bool IsIntrinsic(int id) {
+	return VMCoreInt::IsIntrinsic(id);
+}
+bool RunIntrinsic(VMCore* core, int id) {
+	return CORE->RunIntrinsic(id);
+}
 #endif
 
 #ifdef MOBILEAUTHOR
@@ -47,11 +47,52 @@ typedef unsigned short wchar;
 
 #define USE_VAR_INT
 
+// The threaded core uses GCC's labels-as-values and can't single-step.
+#if defined(USE_THREADED_DISPATCH) && (!defined(__GNUC__) || defined(CORE_DEBUGGING_MODE) ||\
+	defined(USE_DELAY))
+#undef USE_THREADED_DISPATCH
+#endif
+
+// Superinstructions are handlers of the threaded core.
+#if defined(USE_SUPERINSTRUCTIONS) && !defined(USE_THREADED_DISPATCH)
+#undef USE_SUPERINSTRUCTIONS
+#endif
+
+// The x86-64 recompiler is written for the System V calling convention and
+// registers its own unwind info with libgcc, so it only works on x86-64 Linux.
+#if defined(USE_X64_RECOMPILER) && (!defined(__GNUC__) || !defined(__x86_64__) ||\
+	!defined(__linux__) || defined(USE_ARM_RECOMPILER) || defined(CORE_DEBUGGING_MODE) ||\
+	defined(USE_DELAY))
+#undef USE_X64_RECOMPILER
+#endif
+
+// Programs are mapped with mmap(), which only the POSIX hosts have.
+#if defined(USE_MAPPED_PROGRAM) && (defined(WIN32) || defined(_android) ||\
+	defined(SYMBIAN) || defined(__IPHONE__))
+#undef USE_MAPPED_PROGRAM
+#endif
+
+// Intrinsics skip the syscall logging and aren't implemented for the cores
+// that run the soft-float syscalls elsewhere.
+#if defined(USE_SYSCALL_INTRINSICS) && (defined(_android) || defined(MOBILEAUTHOR) ||\
+	defined(SYSCALL_DEBUGGING_MODE) || defined(CORE_DEBUGGING_MODE))
+#undef USE_SYSCALL_INTRINSICS
+#endif
+
+// The sampling profiler walks the fake call stack from its own thread.
+#if defined(USE_SAMPLING_PROFILER) && !defined(FAKE_CALL_STACK)
+#undef USE_SAMPLING_PROFILER
+#endif
+
 #ifdef GDB_DEBUG
 class GdbStub;
 #include "GdbCommon.h"
 #endif
 
+#ifdef USE_SYSCALL_INTRINSICS
+#include <helpers/asm_config.h>
+#endif
+
 namespace Base {
 #ifdef MOBILEAUTHOR
 #define Syscall DeimosSyscall
@@ -133,6 +174,32 @@ namespace Core {
 		GdbSignal mGdbSignal;	//used for exec-interrupt and exec-step
 #endif
 
+#ifdef USE_THREADED_DISPATCH
+		//if false, the switch core is used. must be set before LoadVMApp().
+		bool mThreadedDispatch;
+#endif
+
+#ifdef USE_SUPERINSTRUCTIONS
+		//if false, the threaded core runs every instruction separately. must be set before LoadVMApp().
+		bool mSuperinstructions;
+#endif
+
+#ifdef USE_X64_RECOMPILER
+		//if false, only the interpreter is used. must be set before LoadVMApp().
+		bool mRecompile;
+#endif
+
+#ifdef USE_SYSCALL_INTRINSICS
+		//if false, every syscall goes through InvokeSysCall. must be set before LoadVMApp().
+		bool mIntrinsics;
+#endif
+
+#ifdef USE_MAPPED_PROGRAM
+		//if true, LoadVMApp(modfile, resfile) maps the program file instead of copying it.
+		//the file must not be rebuilt while the program runs. must be set before LoadVMApp().
+		bool mMapProgram;
+#endif
+
 		VMCore();
 		virtual ~VMCore();
 
@@ -154,6 +221,12 @@ namespace Core {
 	void SetIp(VMCore* core, int ip);
 	int GetFakeCallStackDepth(const VMCore* core);
 	const int* GetFakeCallStack(const VMCore* core);
+#ifdef USE_SAMPLING_PROFILER
+	//Copies the innermost frames of the fake call stack, outermost first, and returns
+	//how many were copied. Safe to call from another thread while the core is running;
+	//the result may then be a few calls out of date.
+	int SampleFakeCallStack(const VMCore* core, int* dst, int max);
+#endif
 
 	//returns false on failure
 #ifdef MOBILEAUTHOR
@@ -169,6 +242,20 @@ namespace Core {
 	void Run2(VMCore* core);
 
 
+#ifdef USE_SYSCALL_INTRINSICS
+	//SYSCALL_ID_<name>
+#define SYSCALL_ID_ENUM(number, reType, name, arg1, argD) SYSCALL_ID_##name = number,
+	enum SyscallId { SYSCALLS(SYSCALL_ID_ENUM, , , ) };
+#undef SYSCALL_ID_ENUM
+
+	//for the recompiler.
+	//Returns true if syscall \a id is one that RunIntrinsic() can run.
+	bool IsIntrinsic(int id);
+	//Runs syscall \a id straight from the registers, without InvokeSysCall.
+	//Returns false, having changed nothing, if the syscall would fail.
+	bool RunIntrinsic(VMCore* core, int id);
+#endif
+
 	//for debugger
 #ifdef ENABLE_DEBUGGER
 	bool initDebugger(VMCore* core, int port);
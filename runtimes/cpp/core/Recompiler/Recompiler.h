@@ -19,10 +19,10 @@ Software Foundation, 59 Temple Place - Suite 330, Boston, MA
 #define _RECOMPILER_H_
 
 #include <config_platform.h>
+#include <Core.h>
 
-#ifdef USE_ARM_RECOMPILER
+#if defined(USE_ARM_RECOMPILER) || defined(USE_X64_RECOMPILER)
 
-#include <Core.h>
 #include "Recompiler.h"
 #include "disassembler.h"
 
@@ -363,7 +363,7 @@ endOfFunction:
 					}
 					*/
 
-					if(ip>mCurrentFunction->end) { 
+					if(ip>mCurrentFunction->end && mCurrentFunction->next) { 
 						thisImpl->endFunction(mCurrentFunction);
 						mCurrentFunction = mCurrentFunction->next; 
 						mNextLabel = mCurrentFunction->labels;
@@ -413,6 +413,6 @@ endOfFunction:
 
 } // namespace MoSync
 
-#endif	//USE_ARM_RECOMPILER
+#endif	//USE_ARM_RECOMPILER || USE_X64_RECOMPILER
 
 #endif
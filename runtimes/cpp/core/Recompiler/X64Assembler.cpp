@@ -0,0 +1,389 @@
+/* Copyright (C) 2009 Mobile Sorcery AB
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License, version 2, as published by
+the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING.  If not, write to the Free
+Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.
+*/
+
+#include "X64Assembler.h"
+
+#ifdef USE_X64_RECOMPILER
+
+#include <string.h>
+
+namespace MoSync {
+
+	X64Assembler::X64Assembler() : mCode(NULL), mOffset(0) {
+	}
+
+	void X64Assembler::reset(unsigned char* code) {
+		mCode = code;
+		mOffset = 0;
+	}
+
+	void X64Assembler::emit32(int i) {
+		emit((unsigned char)i);
+		emit((unsigned char)(i >> 8));
+		emit((unsigned char)(i >> 16));
+		emit((unsigned char)(i >> 24));
+	}
+
+	// reg, index and base may be Unknown.
+	// force is needed to address SPL, BPL, SIL and DIL as byte registers.
+	void X64Assembler::emitRex(bool w, int reg, int index, int base, bool force) {
+		unsigned char rex = 0x40;
+		if(w) rex |= 8;
+		if(reg > 7) rex |= 4;
+		if(index > 7) rex |= 2;
+		if(base > 7) rex |= 1;
+		if(rex != 0x40 || force)
+			emit(rex);
+	}
+
+	// always uses a 32-bit displacement if there is one, so the encoding
+	// doesn't depend on the value of disp.
+	void X64Assembler::emitModRM(int reg, Register base, Register index, int scale, int disp) {
+		bool needDisp = disp != 0 || (base & 7) == RBP;
+		int mod = needDisp ? 0x80 : 0x00;
+		if(index == Unknown && (base & 7) != RSP) {
+			emit(mod | ((reg & 7) << 3) | (base & 7));
+		} else {
+			emit(mod | ((reg & 7) << 3) | 4);
+			int i = (index == Unknown) ? 4 : (index & 7);
+			emit((scale << 6) | (i << 3) | (base & 7));
+		}
+		if(needDisp)
+			emit32(disp);
+	}
+
+	void X64Assembler::emitMem(int prefix, int opLength, const unsigned char* op, int reg,
+		Register base, Register index, int scale, int disp, bool byteReg)
+	{
+		if(prefix)
+			emit((unsigned char)prefix);
+		emitRex(false, reg, index, base, byteReg && reg > 3);
+		for(int i = 0; i < opLength; i++)
+			emit(op[i]);
+		emitModRM(reg, base, index, scale, disp);
+	}
+
+	//****************************************
+	// Moves
+	//****************************************
+
+	void X64Assembler::MOV(Register dst, Register src) {
+		emitRex(false, src, Unknown, dst);
+		emit(0x89);
+		emitModRM_reg(src, dst);
+	}
+
+	void X64Assembler::MOV64(Register dst, Register src) {
+		emitRex(true, src, Unknown, dst);
+		emit(0x89);
+		emitModRM_reg(src, dst);
+	}
+
+	void X64Assembler::MOV_imm32(Register dst, int imm) {
+		emitRex(false, Unknown, Unknown, dst);
+		emit(0xb8 + (dst & 7));
+		emit32(imm);
+	}
+
+	void X64Assembler::MOV_imm64(Register dst, const void* imm) {
+		unsigned long long i = (unsigned long long)(size_t)imm;
+		emitRex(true, Unknown, Unknown, dst);
+		emit(0xb8 + (dst & 7));
+		emit32((int)i);
+		emit32((int)(i >> 32));
+	}
+
+	static const unsigned char sMovLoad[] = { 0x8b };
+	static const unsigned char sMovStore[] = { 0x89 };
+	static const unsigned char sMovStore8[] = { 0x88 };
+	static const unsigned char sMovsx8[] = { 0x0f, 0xbe };
+	static const unsigned char sMovsx16[] = { 0x0f, 0xbf };
+	static const unsigned char sMovzx8[] = { 0x0f, 0xb6 };
+	static const unsigned char sMovImm[] = { 0xc7 };
+	static const unsigned char sAluImm[] = { 0x81 };
+
+	void X64Assembler::LOAD(Register dst, Register base, int disp) {
+		emitMem(0, 1, sMovLoad, dst, base, Unknown, 0, disp);
+	}
+
+	void X64Assembler::LOAD(Register dst, Register base, Register index, int scale, int disp) {
+		emitMem(0, 1, sMovLoad, dst, base, index, scale, disp);
+	}
+
+	void X64Assembler::LOAD_s8(Register dst, Register base, Register index, int disp) {
+		emitMem(0, 2, sMovsx8, dst, base, index, 0, disp);
+	}
+
+	void X64Assembler::LOAD_s16(Register dst, Register base, Register index, int disp) {
+		emitMem(0, 2, sMovsx16, dst, base, index, 0, disp);
+	}
+
+	void X64Assembler::LOAD_u8(Register dst, Register base, Register index, int disp) {
+		emitMem(0, 2, sMovzx8, dst, base, index, 0, disp);
+	}
+
+	void X64Assembler::STORE(Register base, int disp, Register src) {
+		emitMem(0, 1, sMovStore, src, base, Unknown, 0, disp);
+	}
+
+	void X64Assembler::STORE(Register base, Register index, int scale, int disp, Register src) {
+		emitMem(0, 1, sMovStore, src, base, index, scale, disp);
+	}
+
+	void X64Assembler::STORE_8(Register base, Register index, int disp, Register src) {
+		emitMem(0, 1, sMovStore8, src, base, index, 0, disp, true);
+	}
+
+	void X64Assembler::STORE_16(Register base, Register index, int disp, Register src) {
+		emitMem(0x66, 1, sMovStore, src, base, index, 0, disp);
+	}
+
+	void X64Assembler::STORE_imm32(Register base, int disp, int imm) {
+		emitMem(0, 1, sMovImm, 0, base, Unknown, 0, disp);
+		emit32(imm);
+	}
+
+	void X64Assembler::CMP_mem_imm32(Register base, int disp, int imm) {
+		emitMem(0, 1, sAluImm, CMP, base, Unknown, 0, disp);
+		emit32(imm);
+	}
+
+	//****************************************
+	// Arithmetic
+	//****************************************
+
+	void X64Assembler::ALU(AluOp op, Register dst, Register src) {
+		emitRex(false, src, Unknown, dst);
+		emit((op << 3) | 1);
+		emitModRM_reg(src, dst);
+	}
+
+	void X64Assembler::ALU_imm32(AluOp op, Register dst, int imm) {
+		emitRex(false, Unknown, Unknown, dst);
+		emit(0x81);
+		emitModRM_reg(op, dst);
+		emit32(imm);
+	}
+
+	void X64Assembler::ALU64_imm32(AluOp op, Register dst, int imm) {
+		emitRex(true, Unknown, Unknown, dst);
+		emit(0x81);
+		emitModRM_reg(op, dst);
+		emit32(imm);
+	}
+
+	void X64Assembler::ALU_mem(AluOp op, Register dst, Register base, int disp) {
+		unsigned char opcode = (unsigned char)((op << 3) | 3);
+		emitMem(0, 1, &opcode, dst, base, Unknown, 0, disp);
+	}
+
+	void X64Assembler::IMUL(Register dst, Register src) {
+		emitRex(false, dst, Unknown, src);
+		emit(0x0f);
+		emit(0xaf);
+		emitModRM_reg(dst, src);
+	}
+
+	void X64Assembler::IMUL_imm32(Register dst, Register src, int imm) {
+		emitRex(false, dst, Unknown, src);
+		emit(0x69);
+		emitModRM_reg(dst, src);
+		emit32(imm);
+	}
+
+	void X64Assembler::SHIFT_CL(ShiftOp op, Register dst) {
+		emitRex(false, Unknown, Unknown, dst);
+		emit(0xd3);
+		emitModRM_reg(op, dst);
+	}
+
+	void X64Assembler::SHIFT_imm8(ShiftOp op, Register dst, int imm) {
+		emitRex(false, Unknown, Unknown, dst);
+		emit(0xc1);
+		emitModRM_reg(op, dst);
+		emit((unsigned char)imm);
+	}
+
+	void X64Assembler::NOT(Register dst) {
+		emitRex(false, Unknown, Unknown, dst);
+		emit(0xf7);
+		emitModRM_reg(2, dst);
+	}
+
+	void X64Assembler::NEG(Register dst) {
+		emitRex(false, Unknown, Unknown, dst);
+		emit(0xf7);
+		emitModRM_reg(3, dst);
+	}
+
+	void X64Assembler::TEST_reg(Register a, Register b) {
+		emitRex(false, b, Unknown, a);
+		emit(0x85);
+		emitModRM_reg(b, a);
+	}
+
+	void X64Assembler::TEST_imm32(Register a, int imm) {
+		emitRex(false, Unknown, Unknown, a);
+		emit(0xf7);
+		emitModRM_reg(0, a);
+		emit32(imm);
+	}
+
+	void X64Assembler::MOVSX_8(Register dst, Register src) {
+		emitRex(false, dst, Unknown, src, src > 3);
+		emit(0x0f);
+		emit(0xbe);
+		emitModRM_reg(dst, src);
+	}
+
+	void X64Assembler::MOVSX_16(Register dst, Register src) {
+		emitRex(false, dst, Unknown, src);
+		emit(0x0f);
+		emit(0xbf);
+		emitModRM_reg(dst, src);
+	}
+
+	void X64Assembler::CDQ() {
+		emit(0x99);
+	}
+
+	void X64Assembler::IDIV(Register src) {
+		emitRex(false, Unknown, Unknown, src);
+		emit(0xf7);
+		emitModRM_reg(7, src);
+	}
+
+	void X64Assembler::DIV(Register src) {
+		emitRex(false, Unknown, Unknown, src);
+		emit(0xf7);
+		emitModRM_reg(6, src);
+	}
+
+	//****************************************
+	// SSE2
+	//****************************************
+
+	void X64Assembler::MOVD_to_xmm(int xmm, Register src) {
+		emit(0x66);
+		emitRex(false, Unknown, Unknown, src);
+		emit(0x0f);
+		emit(0x6e);
+		emitModRM_reg(xmm, src);
+	}
+
+	void X64Assembler::MOVD_from_xmm(Register dst, int xmm) {
+		emit(0x66);
+		emitRex(false, Unknown, Unknown, dst);
+		emit(0x0f);
+		emit(0x7e);
+		emitModRM_reg(xmm, dst);
+	}
+
+	void X64Assembler::PUNPCKLDQ(int dst, int src) {
+		emit(0x66);
+		emit(0x0f);
+		emit(0x62);
+		emitModRM_reg(dst, (Register)src);
+	}
+
+	void X64Assembler::PSRLQ_imm8(int xmm, int imm) {
+		emit(0x66);
+		emit(0x0f);
+		emit(0x73);
+		emitModRM_reg(2, (Register)xmm);
+		emit((unsigned char)imm);
+	}
+
+	void X64Assembler::SSE_SD(SseOp op, int dst, int src) {
+		emit(0xf2);
+		emit(0x0f);
+		emit((unsigned char)op);
+		emitModRM_reg(dst, (Register)src);
+	}
+
+	void X64Assembler::SSE_SS(SseOp op, int dst, int src) {
+		emit(0xf3);
+		emit(0x0f);
+		emit((unsigned char)op);
+		emitModRM_reg(dst, (Register)src);
+	}
+
+	//****************************************
+	// Control flow
+	//****************************************
+
+	int X64Assembler::JMP(int target) {
+		emit(0xe9);
+		int at = mOffset;
+		emit32(target - (at + 4));
+		return at;
+	}
+
+	int X64Assembler::Jcc(Condition cond, int target) {
+		emit(0x0f);
+		emit(0x80 | cond);
+		int at = mOffset;
+		emit32(target - (at + 4));
+		return at;
+	}
+
+	void X64Assembler::JMP_reg(Register target) {
+		emitRex(false, Unknown, Unknown, target);
+		emit(0xff);
+		emitModRM_reg(4, target);
+	}
+
+	void X64Assembler::JMP_mem(Register base, Register index, int scale) {
+		emitRex(false, Unknown, index, base);
+		emit(0xff);
+		emitModRM(4, base, index, scale, 0);
+	}
+
+	void X64Assembler::CALL(Register target) {
+		emitRex(false, Unknown, Unknown, target);
+		emit(0xff);
+		emitModRM_reg(2, target);
+	}
+
+	void X64Assembler::RET() {
+		emit(0xc3);
+	}
+
+	void X64Assembler::PUSH(Register r) {
+		emitRex(false, Unknown, Unknown, r);
+		emit(0x50 + (r & 7));
+	}
+
+	void X64Assembler::POP(Register r) {
+		emitRex(false, Unknown, Unknown, r);
+		emit(0x58 + (r & 7));
+	}
+
+	void X64Assembler::INT3() {
+		emit(0xcc);
+	}
+
+	void X64Assembler::patch(int at, int target) {
+		if(mCode) {
+			int rel = target - (at + 4);
+			memcpy(mCode + at, &rel, 4);
+		}
+	}
+
+} // namespace MoSync
+
+#endif	//USE_X64_RECOMPILER
@@ -0,0 +1,158 @@
+/* Copyright (C) 2009 Mobile Sorcery AB
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License, version 2, as published by
+the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING.  If not, write to the Free
+Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.
+*/
+
+#ifndef _X64_ASSEMBLER_H_
+#define _X64_ASSEMBLER_H_
+
+#include <Core.h>	//may undefine USE_X64_RECOMPILER
+
+#ifdef USE_X64_RECOMPILER
+
+#include <stddef.h>
+
+namespace MoSync {
+
+	// Emits x86-64 machine code.
+	// Unless noted otherwise, operations are 32 bits wide, which is what the
+	// MoSync registers are. Register-to-memory forms take a base register,
+	// an optional index register (scaled by 1 << scale) and a 32-bit displacement.
+	//
+	// The encoding of an instruction depends only on its operands, never on
+	// where it ends up. Together with rel32 branches, this means a first pass
+	// with a NULL buffer gives the exact size and offsets of the final code.
+	class X64Assembler {
+	public:
+		enum Register {
+			RAX = 0, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+			R8, R9, R10, R11, R12, R13, R14, R15,
+			Unknown = -1
+		};
+
+		// condition codes, as encoded in Jcc.
+		enum Condition {
+			O = 0, NO, B, AE, E, NE, BE, A,
+			S, NS, P, NP, L, GE, LE, G
+		};
+
+		// ALU operations, as encoded in the reg field of 0x81.
+		enum AluOp {
+			ADD = 0, OR = 1, AND = 4, SUB = 5, XOR = 6, CMP = 7
+		};
+
+		// shift operations, as encoded in the reg field of 0xC1/0xD3.
+		enum ShiftOp {
+			SHL = 4, SHR = 5, SAR = 7
+		};
+
+		// scalar SSE arithmetic, as encoded after the F2/F3 prefix and 0x0F.
+		enum SseOp {
+			SSE_ADD = 0x58, SSE_MUL = 0x59, SSE_SUB = 0x5c, SSE_DIV = 0x5e
+		};
+
+		X64Assembler();
+
+		// starts emitting into \a code. if \a code is NULL, nothing is
+		// written, but offsets are still counted.
+		void reset(unsigned char* code);
+		int offset() const { return mOffset; }
+		unsigned char* code() const { return mCode; }
+
+		// register moves
+		void MOV(Register dst, Register src);
+		void MOV64(Register dst, Register src);
+		void MOV_imm32(Register dst, int imm);
+		void MOV_imm64(Register dst, const void* imm);
+
+		// loads and stores. 32 bits unless noted.
+		void LOAD(Register dst, Register base, int disp);
+		void LOAD(Register dst, Register base, Register index, int scale, int disp);
+		void LOAD_s8(Register dst, Register base, Register index, int disp);
+		void LOAD_s16(Register dst, Register base, Register index, int disp);
+		void LOAD_u8(Register dst, Register base, Register index, int disp);
+		void STORE(Register base, int disp, Register src);
+		void STORE(Register base, Register index, int scale, int disp, Register src);
+		void STORE_8(Register base, Register index, int disp, Register src);
+		void STORE_16(Register base, Register index, int disp, Register src);
+		void STORE_imm32(Register base, int disp, int imm);
+		void CMP_mem_imm32(Register base, int disp, int imm);
+
+		// arithmetic
+		void ALU(AluOp op, Register dst, Register src);
+		void ALU_imm32(AluOp op, Register dst, int imm);
+		void ALU64_imm32(AluOp op, Register dst, int imm);
+		void ALU_mem(AluOp op, Register dst, Register base, int disp);
+		void IMUL(Register dst, Register src);
+		void IMUL_imm32(Register dst, Register src, int imm);
+		void SHIFT_CL(ShiftOp op, Register dst);
+		void SHIFT_imm8(ShiftOp op, Register dst, int imm);
+		void NOT(Register dst);
+		void NEG(Register dst);
+		void TEST_reg(Register a, Register b);
+		void TEST_imm32(Register a, int imm);
+		void MOVSX_8(Register dst, Register src);
+		void MOVSX_16(Register dst, Register src);
+		void CDQ();
+		void IDIV(Register src);
+		void DIV(Register src);
+
+		// SSE2. xmm registers are given by number, 0 to 7.
+		void MOVD_to_xmm(int xmm, Register src);
+		void MOVD_from_xmm(Register dst, int xmm);
+		// interleaves the low dwords: dst = dst[0] | src[0] << 32.
+		void PUNPCKLDQ(int dst, int src);
+		void PSRLQ_imm8(int xmm, int imm);
+		void SSE_SD(SseOp op, int dst, int src);	// double
+		void SSE_SS(SseOp op, int dst, int src);	// float
+
+		// control flow. jumps return the offset of their rel32 field, so that
+		// forward jumps can be emitted with a 0 target and patched later.
+		int JMP(int target);
+		int Jcc(Condition cond, int target);
+		void JMP_reg(Register target);
+		void JMP_mem(Register base, Register index, int scale);
+		void CALL(Register target);
+		void RET();
+		void PUSH(Register r);
+		void POP(Register r);
+		void INT3();
+
+		// points the rel32 field at \a at to \a target.
+		void patch(int at, int target);
+		// points the rel32 field at \a at to the current offset.
+		void bind(int at) { patch(at, mOffset); }
+
+	protected:
+		void emit(unsigned char b) {
+			if(mCode) mCode[mOffset] = b;
+			mOffset++;
+		}
+		void emit32(int i);
+		void emitRex(bool w, int reg, int index, int base, bool force = false);
+		void emitModRM(int reg, Register base, Register index, int scale, int disp);
+		void emitModRM_reg(int reg, Register rm) { emit(0xc0 | ((reg & 7) << 3) | (rm & 7)); }
+		void emitMem(int prefix, int opLength, const unsigned char* op, int reg,
+			Register base, Register index, int scale, int disp, bool byteReg = false);
+
+		unsigned char* mCode;
+		int mOffset;
+	};
+
+} // namespace MoSync
+
+#endif	//USE_X64_RECOMPILER
+
+#endif	//_X64_ASSEMBLER_H_
@@ -0,0 +1,1175 @@
+/* Copyright (C) 2009 Mobile Sorcery AB
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License, version 2, as published by
+the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING.  If not, write to the Free
+Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.
+*/
+
+#include "X64Recompiler.h"
+
+#ifdef USE_X64_RECOMPILER
+
+#include <helpers/helpers.h>
+#include <base/base_errors.h>
+using namespace MoSyncError;
+
+using namespace Core;
+
+#include <string.h>
+#include <sys/mman.h>
+
+// from libgcc. lets exceptions thrown by syscalls unwind through generated code.
+extern "C" void __register_frame(void*);
+extern "C" void __deregister_frame(void*);
+
+#define SETUP_DEFAULT_VISITOR_ELEM(inst) defaultVisitors[_##inst] = &X64Recompiler::visit_##inst;
+
+#define CURRENT_IP (mInstructions[0].ip)
+#define NEXT_IP (mInstructions[0].ip + mInstructions[0].length)
+
+// registers above 127 don't exist. let the interpreter deal with them.
+#define FETCH_RD byte rd = mInstructions[0].rd; if(rd > 127) { emitBail(CURRENT_IP); return; }
+#define FETCH_RS byte rs = mInstructions[0].rs; if(rs > 127) { emitBail(CURRENT_IP); return; }
+#define FETCH_RD_RS FETCH_RD FETCH_RS
+#define FETCH_IMM int imm32 = mInstructions[0].imm;
+
+#define REG_DISP(msReg) ((msReg) * (int)sizeof(int))
+#define DS_SIZE ((uint)mEnvironment.dataMask + 1)
+#define CS_SIZE ((uint)mEnvironment.codeMask + 1)
+
+// bytes pushed by the entry point below the return address:
+// six callee-saved registers and padding to keep the stack 16-byte aligned.
+#define FRAME_SIZE (7 * 8)
+
+namespace MoSync {
+
+	static void invokeSysCallThunk(VMCore *core, int id) {
+		core->invokeSysCall(id);
+	}
+
+#ifdef USE_SYSCALL_INTRINSICS
+	static bool runIntrinsicThunk(VMCore *core, int id) {
+		return Core::RunIntrinsic(core, id);
+	}
+#endif
+
+	X64Recompiler::X64Recompiler() :
+		Recompiler<X64Recompiler>(2),
+		mIP(NULL),
+		mBailedOut(0),
+		mIsStart(NULL),
+		mOffsets(NULL),
+		mLastIp(-1),
+		mPipeToX64Map(NULL),
+		mCode(NULL),
+		mCodeSize(0),
+		mExitOffset(0), mBailOffset(0), mBodyOffset(0),
+		mUnwindInfo(NULL),
+		mFailed(false)
+	{
+		mInstructions = NULL;
+		mFunctions = NULL;
+		INSTRUCTIONS(SETUP_DEFAULT_VISITOR_ELEM);
+		defaultVisitors[_NUL] = &X64Recompiler::visitIllegal;
+	}
+
+	X64Recompiler::~X64Recompiler() {
+		close();
+	}
+
+	void X64Recompiler::init(VMCore *core, int *VM_Yield, uint *IP) {
+		close();
+		Recompiler<X64Recompiler>::init(core, VM_Yield);
+		mIP = IP;
+		mInstructions = new Instruction[mInstructionsToFetch];
+		mIsStart = new byte[mEnvironment.codeSize];
+		mOffsets = new int[mEnvironment.codeSize];
+		// allocated here, so that its address can be baked into the code.
+		mPipeToX64Map = new void*[CS_SIZE];
+		mFailed = false;
+		mStopped = true;
+	}
+
+	void X64Recompiler::freeFunctions() {
+		while(mFunctions) {
+			Function *f = mFunctions;
+			Label *l = f->labels;
+			while(l) {
+				Label *next = l->next;
+				delete l;
+				l = next;
+			}
+			mFunctions = f->next;
+			delete f;
+		}
+	}
+
+	void X64Recompiler::close() {
+		deregisterUnwindInfo();
+		if(mCode) {
+			freeCodeMemory(mCode, mCodeSize);
+			mCode = NULL;
+		}
+		freeFunctions();
+		delete[] mPipeToX64Map;
+		mPipeToX64Map = NULL;
+		delete[] mOffsets;
+		mOffsets = NULL;
+		delete[] mIsStart;
+		mIsStart = NULL;
+		delete[] mInstructions;
+		mInstructions = NULL;
+		mStopped = true;
+	}
+
+	//****************************************
+	// Memory
+	//****************************************
+
+	void* X64Recompiler::allocateCodeMemory(int size) {
+		void *addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if(addr == MAP_FAILED) {
+			LOG("X64Recompiler: mmap(%i) failed\n", size);
+			return NULL;
+		}
+		return addr;
+	}
+
+	void X64Recompiler::freeCodeMemory(void *addr, int size) {
+		munmap(addr, size);
+	}
+
+	int X64Recompiler::protectMemory(void *addr, int size) {
+		return mprotect(addr, size, PROT_READ | PROT_EXEC);
+	}
+
+	// Describes the frame set up by the entry point, which is the same for all
+	// of the body, as one CIE and one FDE in .eh_frame format.
+	void X64Recompiler::registerUnwindInfo() {
+		static const unsigned char cie[] = {
+			20, 0, 0, 0,	// length
+			0, 0, 0, 0,	// CIE id
+			1,	// version
+			'z', 'R', 0,	// augmentation
+			1,	// code alignment factor
+			0x78,	// data alignment factor, -8
+			16,	// return address register, rip
+			1,	// augmentation data length
+			0,	// FDE pointer encoding, DW_EH_PE_absptr
+			0x0c, 7, 8,	// DW_CFA_def_cfa rsp+8
+			0x90, 1,	// DW_CFA_offset rip at cfa-8
+			0, 0,	// padding
+		};
+		static const unsigned char fdeInstructions[] = {
+			0,	// augmentation data length
+			0x0e, FRAME_SIZE + 8,	// DW_CFA_def_cfa_offset
+			0x83, 2,	// DW_CFA_offset rbx at cfa-16
+			0x86, 3,	// rbp
+			0x8c, 4,	// r12
+			0x8d, 5,	// r13
+			0x8e, 6,	// r14
+			0x8f, 7,	// r15
+			0,	// padding
+		};
+		const int fdeLength = 4 + 8 + 8 + sizeof(fdeInstructions);
+		const int size = sizeof(cie) + 4 + fdeLength + 4;
+
+		mUnwindInfo = new unsigned char[size];
+		unsigned char *p = mUnwindInfo;
+		memcpy(p, cie, sizeof(cie));
+		p += sizeof(cie);
+
+		int i = fdeLength;
+		memcpy(p, &i, 4);
+		p += 4;
+		i = (int)(p - mUnwindInfo);	// offset back to the CIE
+		memcpy(p, &i, 4);
+		p += 4;
+		unsigned char *begin = mCode + mBodyOffset;
+		memcpy(p, &begin, 8);
+		p += 8;
+		long long range = mCodeSize - mBodyOffset;
+		memcpy(p, &range, 8);
+		p += 8;
+		memcpy(p, fdeInstructions, sizeof(fdeInstructions));
+		p += sizeof(fdeInstructions);
+		memset(p, 0, 4);	// terminator
+
+		__register_frame(mUnwindInfo);
+	}
+
+	void X64Recompiler::deregisterUnwindInfo() {
+		if(mUnwindInfo) {
+			__deregister_frame(mUnwindInfo);
+			delete[] mUnwindInfo;
+			mUnwindInfo = NULL;
+		}
+	}
+
+	//****************************************
+	// Analysis
+	//****************************************
+
+	// Makes sure the code can be decoded from start to end without running
+	// off the code segment or the constant pool, which the disassembler
+	// doesn't check, and marks the start of every instruction.
+	bool X64Recompiler::validateCode() {
+		const byte *mem_cs = mEnvironment.mem_cs;
+		int codeSize = mEnvironment.codeSize;
+		if(codeSize < 1)
+			return false;
+		memset(mIsStart, 0, codeSize);
+
+		int ip = 1;
+		Instruction inst;
+		while(ip < codeSize) {
+			byte op = mem_cs[ip];
+			if(op >= _ENDOP)
+				return false;
+
+			int constOffset = 0;
+			switch(op) {
+			case _LDI: case _ADDI: case _SUBI: case _MULI: case _ANDI: case _ORI:
+			case _XORI: case _DIVUI: case _DIVI:
+				constOffset = 2;
+				break;
+			case _LDB: case _LDH: case _LDW: case _STB: case _STH: case _STW:
+				constOffset = 3;
+				break;
+			}
+			if(constOffset) {
+				if(ip + constOffset >= codeSize)
+					return false;
+				int index = mem_cs[ip + constOffset];
+				if(index > 127) {
+					if(ip + constOffset + 1 >= codeSize)
+						return false;
+					index = ((index & 127) << 8) + mem_cs[ip + constOffset + 1];
+				}
+				if(index >= mEnvironment.constantPoolSize / (int)sizeof(int))
+					return false;
+			}
+
+			mIsStart[ip] = 1;
+			ip += decodeInstruction(&mem_cs[ip], inst);
+		}
+		return ip == codeSize;
+	}
+
+	// Same heuristic as the ARM recompiler: count register uses,
+	// weighted by how deeply nested in backward branches they are.
+	void X64Recompiler::analyze() {
+		int registerCount[128];
+		memset(registerCount, 0, sizeof(registerCount));
+
+		int codeSize = mEnvironment.codeSize;
+		byte *loopWeights = new byte[codeSize];
+		memset(loopWeights, 0, codeSize);
+
+		Instruction inst;
+		for(int ip = 1; ip < codeSize; ip++) {
+			if(!mIsStart[ip]) continue;
+			decodeInstruction(&mEnvironment.mem_cs[ip], inst);
+			byte op = inst.op == _FAR ? inst.op2 : inst.op;
+			switch(op) {
+			case _JC_EQ: case _JC_NE: case _JC_GE: case _JC_GEU: case _JC_GT:
+			case _JC_GTU: case _JC_LE: case _JC_LEU: case _JC_LT: case _JC_LTU:
+			case _JPI:
+				if(inst.imm > 0 && inst.imm < ip) {
+					for(int i = inst.imm; i < ip; i++)
+						if(loopWeights[i] < 15) loopWeights[i]++;
+				}
+				break;
+			}
+		}
+
+		for(int ip = 1; ip < codeSize; ip++) {
+			if(!mIsStart[ip]) continue;
+			int loopWeight = loopWeights[ip];
+			loopWeight = 1 + loopWeight * loopWeight;
+			inst.rd = 0xff;
+			inst.rs = 0xff;
+			decodeInstruction(&mEnvironment.mem_cs[ip], inst);
+			if(inst.rd < 128) registerCount[inst.rd] += loopWeight;
+			if(inst.rs < 128) registerCount[inst.rs] += loopWeight;
+		}
+		delete[] loopWeights;
+
+		FREE_X64_REGISTERS;
+
+		for(int i = 0; i < NUM_STATICALLY_ALLOCATED_REGISTERS; i++) {
+			int max = 0, maxIndex = -1;
+			for(int j = 0; j < 128; j++) {
+				if(registerCount[j] > max) {
+					max = registerCount[j];
+					maxIndex = j;
+				}
+			}
+			registerMapping[i].x64Reg = freeX64Registers[i];
+			registerMapping[i].msReg = maxIndex;
+			if(maxIndex >= 0)
+				registerCount[maxIndex] = -1;
+		}
+
+		LOG("Statically allocated registers:\n");
+		for(int i = 0; i < NUM_STATICALLY_ALLOCATED_REGISTERS; i++) {
+			LOG("Reg%d\n", registerMapping[i].msReg);
+		}
+	}
+
+	//****************************************
+	// Passes
+	//****************************************
+
+	// The first pass only measures, the second one emits into memory of
+	// exactly the measured size.
+	void X64Recompiler::beginPass() {
+		if(mPass == 1) {
+			analyze();
+			for(int i = 0; i < mEnvironment.codeSize; i++)
+				mOffsets[i] = -1;
+			assm.reset(NULL);
+		} else {
+			mCodeSize = assm.offset();
+			mCode = (unsigned char*)allocateCodeMemory(mCodeSize);
+			if(!mCode)
+				mFailed = true;
+			assm.reset(mCode);
+		}
+		mExits.clear();
+		mLastIp = -1;
+		generateEntryPoint();
+	}
+
+	void X64Recompiler::endPass() {
+		generateExits();
+		if(mPass != mNumPasses || !mCode)
+			return;
+
+		DEBUG_ASSERT(assm.offset() == mCodeSize);
+		for(uint i = 0; i < CS_SIZE; i++)
+			mPipeToX64Map[i] = mCode + mBailOffset;
+		for(int i = 0; i < mEnvironment.codeSize; i++) {
+			if(mIsStart[i])
+				mPipeToX64Map[i] = mCode + mOffsets[i];
+		}
+		protectMemory(mCode, mCodeSize);
+		registerUnwindInfo();
+	}
+
+	void X64Recompiler::beginInstruction(int ip) {
+		// called twice for the first instruction of each function.
+		if(ip == mLastIp)
+			return;
+		mLastIp = ip;
+		if(mPass == 1)
+			mOffsets[ip] = assm.offset();
+		else if(mCode) {
+			DEBUG_ASSERT(mOffsets[ip] == assm.offset());
+		}
+#ifdef MEMORY_DEBUG
+		// the interpreter refuses to execute the last four bytes of mem_cs.
+		if(uint(ip) >= CS_SIZE - 4)
+			emitBail(ip);
+#endif
+	}
+
+	void X64Recompiler::beginFunction(Function *f) {
+	}
+
+	void X64Recompiler::endFunction(Function *f) {
+	}
+
+	int X64Recompiler::run(int ip) {
+		if(mStopped) {
+			mStopped = false;
+			if(validateCode()) {
+				LOG("Recompiling...\n");
+				recompile();
+				freeFunctions();
+				LOG("Finished recompiling. %i bytes of code.\n", mCodeSize);
+			} else {
+				LOG("X64Recompiler: code could not be decoded. Interpreting.\n");
+				mFailed = true;
+			}
+		}
+		if(mFailed) {
+			mBailedOut = 1;
+			return ip;
+		}
+
+		mBailedOut = 0;
+		*mEnvironment.VM_Yield = 0;
+		ip &= mEnvironment.codeMask;
+		typedef int (*EntryPoint)(void *target, int ip);
+		return ((EntryPoint)mCode)(mPipeToX64Map[ip], ip);
+	}
+
+	//****************************************
+	// Entry point and exits
+	//****************************************
+
+	// int entryPoint(void *target, int ip)
+	// Also contains the code all exits go through, which returns eax.
+	void X64Recompiler::generateEntryPoint() {
+		assm.PUSH(XA::RBX);
+		assm.PUSH(XA::RBP);
+		assm.PUSH(XA::R12);
+		assm.PUSH(XA::R13);
+		assm.PUSH(XA::R14);
+		assm.PUSH(XA::R15);
+		assm.ALU64_imm32(XA::SUB, XA::RSP, 8);
+		assm.MOV64(XA::RCX, XA::RDI);
+		assm.MOV(XA::RAX, XA::RSI);	// ip, in case target is the bail code
+		assm.MOV_imm64(REGISTER_ADDR, mEnvironment.regs);
+		assm.MOV_imm64(MEMORY_ADDR, mEnvironment.mem_ds);
+		assm.MOV_imm64(PIPE_TO_X64_MAP, mPipeToX64Map);
+		loadStaticRegisters();
+		assm.JMP_reg(XA::RCX);
+
+		mExitOffset = assm.offset();
+		saveStaticRegisters();
+		assm.ALU64_imm32(XA::ADD, XA::RSP, 8);
+		assm.POP(XA::R15);
+		assm.POP(XA::R14);
+		assm.POP(XA::R13);
+		assm.POP(XA::R12);
+		assm.POP(XA::RBP);
+		assm.POP(XA::RBX);
+		assm.RET();
+
+		mBailOffset = assm.offset();
+		assm.MOV_imm64(XA::RCX, &mBailedOut);
+		assm.STORE_imm32(XA::RCX, 0, 1);
+		assm.JMP(mExitOffset);
+
+		mBodyOffset = assm.offset();
+	}
+
+	void X64Recompiler::addExit(int at, int ip, bool bail) {
+		Exit e = { at, ip, bail };
+		mExits.push_back(e);
+	}
+
+	// one stub per exit, shared by consecutive exits to the same address.
+	void X64Recompiler::generateExits() {
+		int stub = 0, lastIp = -1;
+		bool lastBail = false;
+		for(size_t i = 0; i < mExits.size(); i++) {
+			const Exit& e = mExits[i];
+			if(e.ip != lastIp || e.bail != lastBail) {
+				stub = assm.offset();
+				assm.MOV_imm32(XA::RAX, e.ip);
+				assm.JMP(e.bail ? mBailOffset : mExitOffset);
+				lastIp = e.ip;
+				lastBail = e.bail;
+			}
+			assm.patch(e.at, stub);
+		}
+	}
+
+	void X64Recompiler::emitBail(int ip) {
+		addExit(assm.JMP(0), ip, true);
+	}
+
+	void X64Recompiler::emitBail(XA::Condition cond, int ip) {
+		addExit(assm.Jcc(cond, 0), ip, true);
+	}
+
+	//****************************************
+	// Registers
+	//****************************************
+
+	XA::Register X64Recompiler::findStaticRegister(int msReg) {
+		for(int i = 0; i < NUM_STATICALLY_ALLOCATED_REGISTERS; i++) {
+			if(registerMapping[i].msReg == msReg)
+				return registerMapping[i].x64Reg;
+		}
+		return XA::Unknown;
+	}
+
+	void X64Recompiler::saveStaticRegisters() {
+		for(int i = 0; i < NUM_STATICALLY_ALLOCATED_REGISTERS; i++) {
+			if(registerMapping[i].msReg >= 0)
+				assm.STORE(REGISTER_ADDR, REG_DISP(registerMapping[i].msReg), registerMapping[i].x64Reg);
+		}
+	}
+
+	void X64Recompiler::loadStaticRegisters() {
+		for(int i = 0; i < NUM_STATICALLY_ALLOCATED_REGISTERS; i++) {
+			if(registerMapping[i].msReg >= 0)
+				assm.LOAD(registerMapping[i].x64Reg, REGISTER_ADDR, REG_DISP(registerMapping[i].msReg));
+		}
+	}
+
+	XA::Register X64Recompiler::getSaveRegister(int msReg, XA::Register temp) {
+		XA::Register reg = findStaticRegister(msReg);
+		return reg == XA::Unknown ? temp : reg;
+	}
+
+	void X64Recompiler::saveRegister(int msReg, XA::Register reg) {
+		XA::Register staticReg = findStaticRegister(msReg);
+		if(staticReg == XA::Unknown)
+			assm.STORE(REGISTER_ADDR, REG_DISP(msReg), reg);
+		else if(staticReg != reg)
+			assm.MOV(staticReg, reg);
+	}
+
+	void X64Recompiler::loadRegisterTo(int msReg, XA::Register dst) {
+		XA::Register staticReg = findStaticRegister(msReg);
+		if(staticReg == XA::Unknown)
+			assm.LOAD(dst, REGISTER_ADDR, REG_DISP(msReg));
+		else if(staticReg != dst)
+			assm.MOV(dst, staticReg);
+	}
+
+	XA::Register X64Recompiler::loadRegister(int msReg, XA::Register temp, bool shouldCopy) {
+		XA::Register staticReg = findStaticRegister(msReg);
+		if(staticReg != XA::Unknown && !shouldCopy)
+			return staticReg;
+		loadRegisterTo(msReg, temp);
+		return temp;
+	}
+
+	// the register to compute a result for msReg in.
+	// if the result must be verified before it is written, that's \a temp.
+	XA::Register X64Recompiler::getResultRegister(int msReg, XA::Register temp) {
+#ifdef STACK_POINTER_VERIFICATION
+		if(msReg == REG_sp)
+			return temp;
+#endif
+		return getSaveRegister(msReg, temp);
+	}
+
+	//****************************************
+	// Checks
+	//****************************************
+
+	// bails out unless low <= reg <= high, unsigned.
+	void X64Recompiler::emitRangeCheck(XA::Register reg, uint low, uint high) {
+		assm.ALU_imm32(XA::CMP, reg, (int)low);
+		emitBail(XA::B, CURRENT_IP);
+		assm.ALU_imm32(XA::CMP, reg, (int)high);
+		emitBail(XA::A, CURRENT_IP);
+	}
+
+	void X64Recompiler::emitStackPointerCheck(int msReg, XA::Register reg) {
+#ifdef STACK_POINTER_VERIFICATION
+		if(msReg == REG_sp) {
+			VMCore *core = mEnvironment.core;
+			emitRangeCheck(reg, core->STACK_BOTTOM, core->STACK_TOP);
+		}
+#endif
+	}
+
+	// Protection checks clobber rcx, rdx and r11.
+	// Returns a jump to be bound by emitProtectionEnd(), or -1.
+	int X64Recompiler::emitProtectionBegin() {
+#if defined(MEMORY_DEBUG) && defined(MEMORY_PROTECTION)
+		assm.MOV_imm64(XA::R11, &mEnvironment.core->protectionEnabled);
+		assm.CMP_mem_imm32(XA::R11, 0, 0);
+		int skip = assm.Jcc(XA::E, 0);
+		assm.MOV_imm64(XA::R11, mEnvironment.core->protectionSet);
+		return skip;
+#else
+		return -1;
+#endif
+	}
+
+	// addr + disp must be aligned to size.
+	void X64Recompiler::emitProtectionCheck(XA::Register addr, int disp, int size) {
+#if defined(MEMORY_DEBUG) && defined(MEMORY_PROTECTION)
+		assm.MOV(XA::RDX, addr);
+		if(disp)
+			assm.ALU_imm32(XA::ADD, XA::RDX, disp);
+		assm.MOV(XA::RCX, XA::RDX);
+		assm.SHIFT_imm8(XA::SHR, XA::RDX, 3);
+		assm.LOAD_u8(XA::RDX, XA::R11, XA::RDX, 0);
+		assm.ALU_imm32(XA::AND, XA::RCX, 7);
+		assm.SHIFT_CL(XA::SHR, XA::RDX);
+		assm.TEST_imm32(XA::RDX, (1 << size) - 1);
+		emitBail(XA::NE, CURRENT_IP);
+#endif
+	}
+
+	void X64Recompiler::emitProtectionEnd(int skip) {
+		if(skip >= 0)
+			assm.bind(skip);
+	}
+
+	// Validates the address in addr like the interpreter does, then masks it.
+	// addr must not be rcx, rdx or r11.
+	void X64Recompiler::emitMemoryCheck(XA::Register addr, int size) {
+#ifdef MEMORY_DEBUG
+		emitRangeCheck(addr, 4, DS_SIZE - size);
+		if(size > 1) {
+			assm.TEST_imm32(addr, size - 1);
+			emitBail(XA::NE, CURRENT_IP);
+		}
+		int skip = emitProtectionBegin();
+		emitProtectionCheck(addr, 0, size);
+		emitProtectionEnd(skip);
+#endif
+		assm.ALU_imm32(XA::AND, addr, mEnvironment.dataMask & ~(size - 1));
+	}
+
+	//****************************************
+	// Jumps
+	//****************************************
+
+	// cond is an XA::Condition, or -1 for an unconditional jump.
+	void X64Recompiler::emitJump(int address, int cond) {
+#ifdef MEMORY_DEBUG
+		if((uint)address >= CS_SIZE) {
+			if(cond < 0) emitBail(CURRENT_IP);
+			else emitBail((XA::Condition)cond, CURRENT_IP);
+			return;
+		}
+#else
+		address &= mEnvironment.codeMask;
+#endif
+		int at = cond < 0 ? assm.JMP(0) : assm.Jcc((XA::Condition)cond, 0);
+		if(address < mEnvironment.codeSize && mIsStart[address])
+			assm.patch(at, mOffsets[address]);
+		else
+			addExit(at, address, true);
+	}
+
+	// jumps to the MoSync address in eax.
+	void X64Recompiler::emitDynamicJump() {
+#ifdef MEMORY_DEBUG
+		assm.ALU_imm32(XA::CMP, XA::RAX, CS_SIZE);
+		emitBail(XA::AE, CURRENT_IP);
+#else
+		assm.ALU_imm32(XA::AND, XA::RAX, mEnvironment.codeMask);
+#endif
+		assm.JMP_mem(PIPE_TO_X64_MAP, XA::RAX, 3);
+	}
+
+	void X64Recompiler::emitConditionalJump(XA::Condition cond) {
+		FETCH_RD_RS;
+		FETCH_IMM;
+		XA::Register a = loadRegister(rd, XA::RAX);
+		XA::Register b = loadRegister(rs, XA::RCX);
+		assm.ALU(XA::CMP, a, b);
+		emitJump(imm32, cond);
+	}
+
+	void X64Recompiler::emitCall(int address) {
+		XA::Register rt = getSaveRegister(REG_rt, XA::RAX);
+		assm.MOV_imm32(rt, NEXT_IP);
+		saveRegister(REG_rt, rt);
+		emitJump(address, -1);
+	}
+
+	//****************************************
+	// Arithmetic
+	//****************************************
+
+	void X64Recompiler::emitArithmetic(XA::AluOp op) {
+		FETCH_RD_RS;
+		XA::Register s = loadRegister(rs, XA::RCX);
+		XA::Register d = getResultRegister(rd, XA::RAX);
+		loadRegisterTo(rd, d);
+		assm.ALU(op, d, s);
+		emitStackPointerCheck(rd, d);
+		saveRegister(rd, d);
+	}
+
+	void X64Recompiler::emitArithmeticImm(XA::AluOp op) {
+		FETCH_RD;
+		FETCH_IMM;
+		XA::Register d = getResultRegister(rd, XA::RAX);
+		loadRegisterTo(rd, d);
+		assm.ALU_imm32(op, d, imm32);
+		emitStackPointerCheck(rd, d);
+		saveRegister(rd, d);
+	}
+
+	void X64Recompiler::emitShift(XA::ShiftOp op) {
+		FETCH_RD_RS;
+		loadRegisterTo(rs, XA::RCX);
+		XA::Register d = getResultRegister(rd, XA::RAX);
+		loadRegisterTo(rd, d);
+		assm.SHIFT_CL(op, d);
+		emitStackPointerCheck(rd, d);
+		saveRegister(rd, d);
+	}
+
+	void X64Recompiler::emitShiftImm(XA::ShiftOp op) {
+		FETCH_RD;
+		FETCH_IMM;
+		XA::Register d = getResultRegister(rd, XA::RAX);
+		loadRegisterTo(rd, d);
+		assm.SHIFT_imm8(op, d, imm32);
+		emitStackPointerCheck(rd, d);
+		saveRegister(rd, d);
+	}
+
+	// division by zero bails out, so the interpreter can report it.
+	void X64Recompiler::emitDivide(bool isSigned, bool isImm) {
+		FETCH_RD;
+		if(isImm) {
+			FETCH_IMM;
+			if(imm32 == 0) {
+				emitBail(CURRENT_IP);
+				return;
+			}
+			assm.MOV_imm32(XA::RCX, imm32);
+		} else {
+			FETCH_RS;
+			loadRegisterTo(rs, XA::RCX);
+			assm.TEST_reg(XA::RCX, XA::RCX);
+			emitBail(XA::E, CURRENT_IP);
+		}
+		loadRegisterTo(rd, XA::RAX);
+		if(isSigned) {
+			assm.CDQ();
+			assm.IDIV(XA::RCX);
+		} else {
+			assm.ALU(XA::XOR, XA::RDX, XA::RDX);
+			assm.DIV(XA::RCX);
+		}
+		emitStackPointerCheck(rd, XA::RAX);
+		saveRegister(rd, XA::RAX);
+	}
+
+	void X64Recompiler::visit_ADD() { emitArithmetic(XA::ADD); }
+	void X64Recompiler::visit_ADDI() { emitArithmeticImm(XA::ADD); }
+	void X64Recompiler::visit_SUB() { emitArithmetic(XA::SUB); }
+	void X64Recompiler::visit_SUBI() { emitArithmeticImm(XA::SUB); }
+	void X64Recompiler::visit_AND() { emitArithmetic(XA::AND); }
+	void X64Recompiler::visit_ANDI() { emitArithmeticImm(XA::AND); }
+	void X64Recompiler::visit_OR() { emitArithmetic(XA::OR); }
+	void X64Recompiler::visit_ORI() { emitArithmeticImm(XA::OR); }
+	void X64Recompiler::visit_XOR() { emitArithmetic(XA::XOR); }
+	void X64Recompiler::visit_XORI() { emitArithmeticImm(XA::XOR); }
+
+	void X64Recompiler::visit_MUL() {
+		FETCH_RD_RS;
+		XA::Register s = loadRegister(rs, XA::RCX);
+		XA::Register d = getResultRegister(rd, XA::RAX);
+		loadRegisterTo(rd, d);
+		assm.IMUL(d, s);
+		emitStackPointerCheck(rd, d);
+		saveRegister(rd, d);
+	}
+
+	void X64Recompiler::visit_MULI() {
+		FETCH_RD;
+		FETCH_IMM;
+		XA::Register s = loadRegister(rd, XA::RAX);
+		XA::Register d = getResultRegister(rd, XA::RAX);
+		assm.IMUL_imm32(d, s, imm32);
+		emitStackPointerCheck(rd, d);
+		saveRegister(rd, d);
+	}
+
+	void X64Recompiler::visit_DIVU() { emitDivide(false, false); }
+	void X64Recompiler::visit_DIVUI() { emitDivide(false, true); }
+	void X64Recompiler::visit_DIV() { emitDivide(true, false); }
+	void X64Recompiler::visit_DIVI() { emitDivide(true, true); }
+
+	void X64Recompiler::visit_SLL() { emitShift(XA::SHL); }
+	void X64Recompiler::visit_SLLI() { emitShiftImm(XA::SHL); }
+	void X64Recompiler::visit_SRA() { emitShift(XA::SAR); }
+	void X64Recompiler::visit_SRAI() { emitShiftImm(XA::SAR); }
+	void X64Recompiler::visit_SRL() { emitShift(XA::SHR); }
+	void X64Recompiler::visit_SRLI() { emitShiftImm(XA::SHR); }
+
+	void X64Recompiler::visit_NOT() {
+		FETCH_RD_RS;
+		XA::Register d = getResultRegister(rd, XA::RAX);
+		loadRegisterTo(rs, d);
+		assm.NOT(d);
+		emitStackPointerCheck(rd, d);
+		saveRegister(rd, d);
+	}
+
+	void X64Recompiler::visit_NEG() {
+		FETCH_RD_RS;
+		XA::Register d = getResultRegister(rd, XA::RAX);
+		loadRegisterTo(rs, d);
+		assm.NEG(d);
+		emitStackPointerCheck(rd, d);
+		saveRegister(rd, d);
+	}
+
+	// XB and XH write RD directly in the interpreter, without verification.
+	void X64Recompiler::visit_XB() {
+		FETCH_RD_RS;
+		XA::Register s = loadRegister(rs, XA::RAX);
+		XA::Register d = getSaveRegister(rd, XA::RAX);
+		assm.MOVSX_8(d, s);
+		saveRegister(rd, d);
+	}
+
+	void X64Recompiler::visit_XH() {
+		FETCH_RD_RS;
+		XA::Register s = loadRegister(rs, XA::RAX);
+		XA::Register d = getSaveRegister(rd, XA::RAX);
+		assm.MOVSX_16(d, s);
+		saveRegister(rd, d);
+	}
+
+	void X64Recompiler::visit_LDI() {
+		FETCH_RD;
+		FETCH_IMM;
+		XA::Register d = getResultRegister(rd, XA::RAX);
+		assm.MOV_imm32(d, imm32);
+		emitStackPointerCheck(rd, d);
+		saveRegister(rd, d);
+	}
+
+	void X64Recompiler::visit_LDR() {
+		FETCH_RD_RS;
+		XA::Register s = loadRegister(rs, XA::RAX);
+		emitStackPointerCheck(rd, s);
+		saveRegister(rd, s);
+	}
+
+	//****************************************
+	// Memory access
+	//****************************************
+
+	void X64Recompiler::emitLoad(int size) {
+		FETCH_RD_RS;
+		FETCH_IMM;
+		loadRegisterTo(rs, XA::RAX);
+		if(imm32)
+			assm.ALU_imm32(XA::ADD, XA::RAX, imm32);
+		emitMemoryCheck(XA::RAX, size);
+		XA::Register d = getResultRegister(rd, XA::RCX);
+		switch(size) {
+		case 1: assm.LOAD_s8(d, MEMORY_ADDR, XA::RAX, 0); break;
+		case 2: assm.LOAD_s16(d, MEMORY_ADDR, XA::RAX, 0); break;
+		default: assm.LOAD(d, MEMORY_ADDR, XA::RAX, 0, 0); break;
+		}
+		emitStackPointerCheck(rd, d);
+		saveRegister(rd, d);
+	}
+
+	void X64Recompiler::emitStore(int size) {
+		FETCH_RD_RS;
+		FETCH_IMM;
+		loadRegisterTo(rd, XA::RAX);
+		if(imm32)
+			assm.ALU_imm32(XA::ADD, XA::RAX, imm32);
+		emitMemoryCheck(XA::RAX, size);
+		XA::Register s = loadRegister(rs, XA::RCX);
+		switch(size) {
+		case 1: assm.STORE_8(MEMORY_ADDR, XA::RAX, 0, s); break;
+		case 2: assm.STORE_16(MEMORY_ADDR, XA::RAX, 0, s); break;
+		default: assm.STORE(MEMORY_ADDR, XA::RAX, 0, 0, s); break;
+		}
+	}
+
+	void X64Recompiler::visit_LDB() { emitLoad(1); }
+	void X64Recompiler::visit_LDH() { emitLoad(2); }
+	void X64Recompiler::visit_LDW() { emitLoad(4); }
+	void X64Recompiler::visit_STB() { emitStore(1); }
+	void X64Recompiler::visit_STH() { emitStore(2); }
+	void X64Recompiler::visit_STW() { emitStore(4); }
+
+	// All checks are done before anything is written,
+	// so a bail out leaves the registers and memory untouched.
+	void X64Recompiler::visit_PUSH() {
+		FETCH_RD;
+		FETCH_IMM;
+		int n = imm32;
+		if(rd < 2 || rd + n > 32 || n == 0) {
+			emitBail(CURRENT_IP);
+			return;
+		}
+
+		loadRegisterTo(REG_sp, XA::RAX);
+#ifdef STACK_POINTER_VERIFICATION
+		VMCore *core = mEnvironment.core;
+		assm.MOV(XA::RCX, XA::RAX);
+		assm.ALU_imm32(XA::SUB, XA::RCX, 4);
+		emitRangeCheck(XA::RCX, core->STACK_BOTTOM, core->STACK_TOP);
+		assm.MOV(XA::RCX, XA::RAX);
+		assm.ALU_imm32(XA::SUB, XA::RCX, 4 * n);
+		emitRangeCheck(XA::RCX, core->STACK_BOTTOM, core->STACK_TOP);
+#endif
+#ifdef MEMORY_DEBUG
+		assm.TEST_imm32(XA::RAX, 3);
+		emitBail(XA::NE, CURRENT_IP);
+		assm.MOV(XA::RCX, XA::RAX);
+		assm.ALU_imm32(XA::SUB, XA::RCX, 4);
+		emitRangeCheck(XA::RCX, 4, DS_SIZE - 4);
+		assm.MOV(XA::RCX, XA::RAX);
+		assm.ALU_imm32(XA::SUB, XA::RCX, 4 * n);
+		emitRangeCheck(XA::RCX, 4, DS_SIZE - 4);
+		int skip = emitProtectionBegin();
+		for(int i = 1; i <= n; i++)
+			emitProtectionCheck(XA::RAX, -4 * i, 4);
+		emitProtectionEnd(skip);
+#endif
+		for(int i = 1; i <= n; i++) {
+			assm.MOV(XA::RCX, XA::RAX);
+			assm.ALU_imm32(XA::SUB, XA::RCX, 4 * i);
+			assm.ALU_imm32(XA::AND, XA::RCX, mEnvironment.dataMask & ~3);
+			XA::Register value = loadRegister(rd + i - 1, XA::RDX);
+			assm.STORE(MEMORY_ADDR, XA::RCX, 0, 0, value);
+		}
+		assm.ALU_imm32(XA::SUB, XA::RAX, 4 * n);
+		saveRegister(REG_sp, XA::RAX);
+	}
+
+	void X64Recompiler::visit_POP() {
+		FETCH_RD;
+		FETCH_IMM;
+		int n = imm32;
+		if(rd > 31 || rd - n < 1 || n == 0) {
+			emitBail(CURRENT_IP);
+			return;
+		}
+
+		loadRegisterTo(REG_sp, XA::RAX);
+#ifdef STACK_POINTER_VERIFICATION
+		VMCore *core = mEnvironment.core;
+		assm.MOV(XA::RCX, XA::RAX);
+		assm.ALU_imm32(XA::ADD, XA::RCX, 4);
+		emitRangeCheck(XA::RCX, core->STACK_BOTTOM, core->STACK_TOP);
+		assm.MOV(XA::RCX, XA::RAX);
+		assm.ALU_imm32(XA::ADD, XA::RCX, 4 * n);
+		emitRangeCheck(XA::RCX, core->STACK_BOTTOM, core->STACK_TOP);
+#endif
+#ifdef MEMORY_DEBUG
+		assm.TEST_imm32(XA::RAX, 3);
+		emitBail(XA::NE, CURRENT_IP);
+		emitRangeCheck(XA::RAX, 4, DS_SIZE - 4);
+		assm.MOV(XA::RCX, XA::RAX);
+		assm.ALU_imm32(XA::ADD, XA::RCX, 4 * (n - 1));
+		emitRangeCheck(XA::RCX, 4, DS_SIZE - 4);
+		int skip = emitProtectionBegin();
+		for(int i = 0; i < n; i++)
+			emitProtectionCheck(XA::RAX, 4 * i, 4);
+		emitProtectionEnd(skip);
+#endif
+		for(int i = 0; i < n; i++) {
+			assm.MOV(XA::RCX, XA::RAX);
+			if(i)
+				assm.ALU_imm32(XA::ADD, XA::RCX, 4 * i);
+			assm.ALU_imm32(XA::AND, XA::RCX, mEnvironment.dataMask & ~3);
+			XA::Register d = getSaveRegister(rd - i, XA::RDX);
+			assm.LOAD(d, MEMORY_ADDR, XA::RCX, 0, 0);
+			saveRegister(rd - i, d);
+		}
+		assm.ALU_imm32(XA::ADD, XA::RAX, 4 * n);
+		saveRegister(REG_sp, XA::RAX);
+	}
+
+	//****************************************
+	// Control flow
+	//****************************************
+
+	void X64Recompiler::visit_CALL() {
+		FETCH_RD;
+		XA::Register rt = getSaveRegister(REG_rt, XA::RAX);
+		assm.MOV_imm32(rt, NEXT_IP);
+		saveRegister(REG_rt, rt);
+		loadRegisterTo(rd, XA::RAX);
+		emitDynamicJump();
+	}
+
+	void X64Recompiler::visit_CALLI() {
+		emitCall(mInstructions[0].imm);
+	}
+
+	void X64Recompiler::visit_RET() {
+		loadRegisterTo(REG_rt, XA::RAX);
+		emitDynamicJump();
+	}
+
+	void X64Recompiler::visit_JPR() {
+		FETCH_RD;
+		loadRegisterTo(rd, XA::RAX);
+		emitDynamicJump();
+	}
+
+	void X64Recompiler::visit_JPI() {
+		emitJump(mInstructions[0].imm, -1);
+	}
+
+	void X64Recompiler::visit_JC_EQ() { emitConditionalJump(XA::E); }
+	void X64Recompiler::visit_JC_NE() { emitConditionalJump(XA::NE); }
+	void X64Recompiler::visit_JC_GE() { emitConditionalJump(XA::GE); }
+	void X64Recompiler::visit_JC_GEU() { emitConditionalJump(XA::AE); }
+	void X64Recompiler::visit_JC_GT() { emitConditionalJump(XA::G); }
+	void X64Recompiler::visit_JC_GTU() { emitConditionalJump(XA::A); }
+	void X64Recompiler::visit_JC_LE() { emitConditionalJump(XA::LE); }
+	void X64Recompiler::visit_JC_LEU() { emitConditionalJump(XA::BE); }
+	void X64Recompiler::visit_JC_LT() { emitConditionalJump(XA::L); }
+	void X64Recompiler::visit_JC_LTU() { emitConditionalJump(XA::B); }
+
+	void X64Recompiler::visit_FAR() {
+		switch(mInstructions[0].op2) {
+		case _CALLI: visit_CALLI(); break;
+		case _JC_EQ: visit_JC_EQ(); break;
+		case _JC_NE: visit_JC_NE(); break;
+		case _JC_GE: visit_JC_GE(); break;
+		case _JC_GEU: visit_JC_GEU(); break;
+		case _JC_GT: visit_JC_GT(); break;
+		case _JC_GTU: visit_JC_GTU(); break;
+		case _JC_LE: visit_JC_LE(); break;
+		case _JC_LEU: visit_JC_LEU(); break;
+		case _JC_LT: visit_JC_LT(); break;
+		case _JC_LTU: visit_JC_LTU(); break;
+		case _JPI: visit_JPI(); break;
+		default: visitIllegal(); break;
+		}
+	}
+
+	// Table layout, at imm * 4: start, length, default address, jump table.
+	void X64Recompiler::visit_CASE() {
+		FETCH_RD;
+		uint base = (uint)mInstructions[0].imm << 2;
+		uint startAddr = base, lengthAddr = base + 4, defaultAddr = base + 8;
+		uint mask = mEnvironment.dataMask & ~3;
+
+#ifdef MEMORY_DEBUG
+		// constant addresses are validated here instead of at run time.
+		if(startAddr < 4 || lengthAddr > DS_SIZE - 4) {
+			emitBail(CURRENT_IP);
+			return;
+		}
+		int skip = emitProtectionBegin();
+		assm.MOV_imm32(XA::RAX, startAddr);
+		emitProtectionCheck(XA::RAX, 0, 4);
+		emitProtectionCheck(XA::RAX, 4, 4);
+		emitProtectionEnd(skip);
+#endif
+		loadRegisterTo(rd, XA::RAX);
+		assm.ALU_mem(XA::SUB, XA::RAX, MEMORY_ADDR, startAddr & mask);
+		assm.ALU_mem(XA::CMP, XA::RAX, MEMORY_ADDR, lengthAddr & mask);
+		int defaultCase = assm.Jcc(XA::A, 0);
+		assm.SHIFT_imm8(XA::SHL, XA::RAX, 2);
+		assm.ALU_imm32(XA::ADD, XA::RAX, base + 12);
+		emitMemoryCheck(XA::RAX, 4);
+		assm.LOAD(XA::RAX, MEMORY_ADDR, XA::RAX, 0, 0);
+		emitDynamicJump();
+
+		assm.bind(defaultCase);
+#ifdef MEMORY_DEBUG
+		if(defaultAddr > DS_SIZE - 4) {
+			emitBail(CURRENT_IP);
+			return;
+		}
+		skip = emitProtectionBegin();
+		assm.MOV_imm32(XA::RAX, defaultAddr);
+		emitProtectionCheck(XA::RAX, 0, 4);
+		emitProtectionEnd(skip);
+#endif
+		assm.LOAD(XA::RAX, MEMORY_ADDR, defaultAddr & mask);
+		emitDynamicJump();
+	}
+
+	// Syscalls may read and write any register, so the static ones are
+	// spilled around the call. Exits if the syscall made the VM yield.
+#ifdef USE_SYSCALL_INTRINSICS
+	// Emits the float and double add, subtract, multiply and divide intrinsics
+	// as SSE2 instructions. Returns false for any other syscall.
+	// The first register of a double holds its low half, as in MA_DV.
+	bool X64Recompiler::emitFloatIntrinsic(int id) {
+		XA::SseOp op;
+		bool isDouble;
+		switch(id) {
+		case SYSCALL_ID___adddf3: op = XA::SSE_ADD; isDouble = true; break;
+		case SYSCALL_ID___subdf3: op = XA::SSE_SUB; isDouble = true; break;
+		case SYSCALL_ID___muldf3: op = XA::SSE_MUL; isDouble = true; break;
+		case SYSCALL_ID___divdf3: op = XA::SSE_DIV; isDouble = true; break;
+		case SYSCALL_ID___addsf3: op = XA::SSE_ADD; isDouble = false; break;
+		case SYSCALL_ID___subsf3: op = XA::SSE_SUB; isDouble = false; break;
+		case SYSCALL_ID___mulsf3: op = XA::SSE_MUL; isDouble = false; break;
+		case SYSCALL_ID___divsf3: op = XA::SSE_DIV; isDouble = false; break;
+		default: return false;
+		}
+
+#ifndef ALLOW_FLOAT_DIVISION_BY_ZERO
+		// the interpreter knows if the emulator allows it.
+		if(op == XA::SSE_DIV) {
+			loadRegisterTo(isDouble ? REG_i3 : REG_i1, XA::RCX);
+			assm.ALU_imm32(XA::AND, XA::RCX, 0x7fffffff);
+			if(isDouble)
+				assm.ALU(XA::OR, XA::RCX, loadRegister(REG_i2, XA::RDX));
+			emitBail(XA::E, CURRENT_IP);
+		}
+#endif
+
+		if(isDouble) {
+			assm.MOVD_to_xmm(0, loadRegister(REG_i0, XA::RAX));
+			assm.MOVD_to_xmm(2, loadRegister(REG_i1, XA::RAX));
+			assm.PUNPCKLDQ(0, 2);
+			assm.MOVD_to_xmm(1, loadRegister(REG_i2, XA::RAX));
+			assm.MOVD_to_xmm(2, loadRegister(REG_i3, XA::RAX));
+			assm.PUNPCKLDQ(1, 2);
+			assm.SSE_SD(op, 0, 1);
+		} else {
+			assm.MOVD_to_xmm(0, loadRegister(REG_i0, XA::RAX));
+			assm.MOVD_to_xmm(1, loadRegister(REG_i1, XA::RAX));
+			assm.SSE_SS(op, 0, 1);
+		}
+		XA::Register r = getSaveRegister(REG_r14, XA::RAX);
+		assm.MOVD_from_xmm(r, 0);
+		saveRegister(REG_r14, r);
+		if(isDouble) {
+			assm.PSRLQ_imm8(0, 32);
+			r = getSaveRegister(REG_r15, XA::RAX);
+			assm.MOVD_from_xmm(r, 0);
+			saveRegister(REG_r15, r);
+		}
+		return true;
+	}
+#endif	//USE_SYSCALL_INTRINSICS
+
+	void X64Recompiler::visit_SYSCALL() {
+#ifdef USE_SYSCALL_INTRINSICS
+		if(mEnvironment.core->mIntrinsics && emitFloatIntrinsic(mInstructions[0].imm))
+			return;
+		// intrinsics never yield and don't need IP. if one fails,
+		// the interpreter runs the syscall again and reports the error.
+		if(mEnvironment.core->mIntrinsics && Core::IsIntrinsic(mInstructions[0].imm)) {
+			saveStaticRegisters();
+			assm.MOV_imm64(XA::RDI, mEnvironment.core);
+			assm.MOV_imm32(XA::RSI, mInstructions[0].imm);
+			assm.MOV_imm64(XA::RAX, (const void*)(size_t)&runIntrinsicThunk);
+			assm.CALL(XA::RAX);
+			assm.TEST_imm32(XA::RAX, 0xff);
+			loadStaticRegisters();
+			emitBail(XA::E, CURRENT_IP);
+			return;
+		}
+#endif
+		saveStaticRegisters();
+		assm.MOV_imm64(XA::RCX, mIP);
+		assm.STORE_imm32(XA::RCX, 0, CURRENT_IP);
+		assm.MOV_imm64(XA::RDI, mEnvironment.core);
+		assm.MOV_imm32(XA::RSI, mInstructions[0].imm);
+		assm.MOV_imm64(XA::RAX, (const void*)(size_t)&invokeSysCallThunk);
+		assm.CALL(XA::RAX);
+		loadStaticRegisters();
+		assm.MOV_imm64(XA::RCX, mEnvironment.VM_Yield);
+		assm.CMP_mem_imm32(XA::RCX, 0, 0);
+		addExit(assm.Jcc(XA::NE, 0), NEXT_IP, false);
+	}
+
+	// the interpreter reports the error.
+	void X64Recompiler::visitIllegal() {
+		emitBail(CURRENT_IP);
+	}
+
+} // namespace MoSync
+
+#endif	//USE_X64_RECOMPILER
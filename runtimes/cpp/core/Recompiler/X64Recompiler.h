@@ -0,0 +1,176 @@
+/* Copyright (C) 2009 Mobile Sorcery AB
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License, version 2, as published by
+the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING.  If not, write to the Free
+Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.
+*/
+
+#ifndef _X64_RECOMPILER_H_
+#define _X64_RECOMPILER_H_
+
+#include "Recompiler.h"
+#include "X64Assembler.h"
+
+#ifdef USE_X64_RECOMPILER
+
+#include <vector>
+
+typedef MoSync::X64Assembler XA;
+
+namespace MoSync {
+
+	// Recompiles a whole MoSync program to x86-64 code.
+	//
+	// All MoSync state stays in VMCore::regs and mem_ds whenever the generated
+	// code calls out or returns, so the interpreter can take over at any
+	// instruction boundary. That is how anything the recompiler doesn't
+	// handle is dealt with: the generated code "bails out", returning the
+	// address of the offending instruction, and the core interprets from there
+	// until the next yield. Illegal instructions, division by zero and failed
+	// memory checks all bail out, so errors are reported by the interpreter
+	// exactly as before.
+	class X64Recompiler : public Recompiler<X64Recompiler> {
+	public:
+		friend class Recompiler<X64Recompiler>;
+
+		X64Recompiler();
+		~X64Recompiler();
+
+		// returns the MoSync address at which execution stopped.
+		// if bailedOut() is true afterwards, the interpreter must continue
+		// from there, otherwise the program yielded.
+		int run(int ip);
+		bool bailedOut() const { return mBailedOut != 0; }
+
+		// IP is set to the address of each syscall before it is invoked.
+		void init(Core::VMCore *core, int *VM_Yield, uint *IP);
+		void close();
+
+	protected:
+
+#define REGISTER_ADDR XA::RBX	// pointer to VMCore::regs
+#define MEMORY_ADDR XA::R12	// mem_ds
+#define PIPE_TO_X64_MAP XA::R13	// one code pointer for every byte of mem_cs
+
+		// rax, rcx, rdx and r11 are temporaries. everything else that's free
+		// holds the most used MoSync registers.
+#define FREE_X64_REGISTERS\
+	XA::Register freeX64Registers[] = {\
+	XA::RBP,\
+	XA::R14,\
+	XA::R15,\
+	XA::RSI,\
+	XA::RDI,\
+	XA::R8,\
+	XA::R9,\
+	XA::R10 \
+}
+
+#define NUM_STATICALLY_ALLOCATED_REGISTERS 8
+
+		struct RegisterMapElement {
+			int msReg;
+			XA::Register x64Reg;
+		};
+
+		// a rel32 field that jumps to a stub returning \a ip.
+		struct Exit {
+			int at;
+			int ip;
+			bool bail;
+		};
+
+		void* allocateCodeMemory(int size);
+		void freeCodeMemory(void *addr, int size);
+		int protectMemory(void *addr, int size);
+		void registerUnwindInfo();
+		void deregisterUnwindInfo();
+
+		bool validateCode();
+		void analyze();
+
+		void beginPass();
+		void endPass();
+		void beginInstruction(int ip);
+		void beginFunction(Function *f);
+		void endFunction(Function *f);
+
+		// declare instruction visitors, so that you get
+		// a compilation errors if you have unimplemented visitors.
+		INSTRUCTIONS(DECLARE_DEFAULT_VISITOR_ELEM)
+		void visitIllegal();
+
+		void generateEntryPoint();
+		void generateExits();
+
+		XA::Register findStaticRegister(int msReg);
+		void saveStaticRegisters();
+		void loadStaticRegisters();
+		XA::Register getSaveRegister(int msReg, XA::Register temp);
+		void saveRegister(int msReg, XA::Register reg);
+		XA::Register loadRegister(int msReg, XA::Register temp, bool shouldCopy=false);
+		void loadRegisterTo(int msReg, XA::Register dst);
+		XA::Register getResultRegister(int msReg, XA::Register temp);
+		void freeFunctions();
+
+		void addExit(int at, int ip, bool bail);
+		void emitBail(int ip);
+		void emitBail(XA::Condition cond, int ip);
+		void emitJump(int address, int cond);
+		void emitDynamicJump();
+		void emitRangeCheck(XA::Register reg, uint low, uint high);
+		void emitStackPointerCheck(int msReg, XA::Register reg);
+		int emitProtectionBegin();
+		void emitProtectionCheck(XA::Register addr, int disp, int size);
+		void emitProtectionEnd(int skip);
+		void emitMemoryCheck(XA::Register addr, int size);
+		void emitArithmetic(XA::AluOp op);
+		void emitArithmeticImm(XA::AluOp op);
+		void emitShift(XA::ShiftOp op);
+		void emitShiftImm(XA::ShiftOp op);
+		void emitDivide(bool isSigned, bool isImm);
+		void emitLoad(int size);
+		void emitStore(int size);
+		void emitConditionalJump(XA::Condition cond);
+		void emitCall(int address);
+#ifdef USE_SYSCALL_INTRINSICS
+		bool emitFloatIntrinsic(int id);
+#endif
+
+		RegisterMapElement registerMapping[NUM_STATICALLY_ALLOCATED_REGISTERS];
+		XA assm;
+
+		uint *mIP;
+		int mBailedOut;
+
+		byte *mIsStart;	// set for every instruction found by a linear sweep
+		int *mOffsets;	// code offset of every instruction, filled by the first pass
+		int mLastIp;	// last ip passed to beginInstruction()
+		void **mPipeToX64Map;
+
+		unsigned char *mCode;
+		int mCodeSize;
+		int mExitOffset, mBailOffset, mBodyOffset;
+		std::vector<Exit> mExits;
+
+		unsigned char *mUnwindInfo;
+
+		// true if validateCode() failed; everything is then interpreted.
+		bool mFailed;
+	};
+
+} // namespace MoSync
+
+#endif	//USE_X64_RECOMPILER
+
+#endif	//_X64_RECOMPILER_H_
@@ -304,11 +304,16 @@ VMLOOP_LABEL
 		OPC(SYSCALL)
 		{
 			int syscallNumber = IB;
-			fakePush((int32_t) (ip - mem_cs), -syscallNumber);
-			InvokeSysCall(syscallNumber);
-			fakePop();
-			if (VM_Yield)
-				return ip;
+#ifdef USE_SYSCALL_INTRINSICS
+			if(!(mIntrinsics && RunIntrinsic(syscallNumber)))
+#endif
+			{
+				fakePush((int32_t) (ip - mem_cs), -syscallNumber);
+				InvokeSysCall(syscallNumber);
+				fakePop();
+				if (VM_Yield)
+					return ip;
+			}
 		}
 		EOP;
 
@@ -0,0 +1,417 @@
+/* Copyright (C) 2009 Mobile Sorcery AB
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License, version 2, as published by
+the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING.  If not, write to the Free
+Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.
+*/
+
+// Direct-threaded version of core_run.h.
+// Instead of re-decoding the byte code on every step, it dispatches through
+// mem_dc, which ThreadedDecode() fills with handler addresses and operands.
+// The instruction bodies must be kept in sync with core_run.h.
+// Included from inside VMCoreInt; requires GCC's labels-as-values.
+
+// Threaded instruction header. Operands are already in rd, rs and imm32.
+// For FAR instructions, d->op is the second opcode byte.
+#ifdef COUNT_INSTRUCTION_USE
+#define TOPC(opcode) top_##opcode: LOGC("%x: %i %s", (int)(ip - mem_cs - d->size), d->op, #opcode);\
+	countInstructionUse(#opcode, d->op);
+#define TFAROPC(opcode) tfar_##opcode: LOGC("%x: FAR %i %s", (int)(ip - mem_cs - d->size), d->op, #opcode);\
+	countInstructionUse(#opcode, d->op);
+#else
+#define TOPC(opcode) top_##opcode: LOGC("%x: %i %s", (int)(ip - mem_cs - d->size), d->op, #opcode);
+#define TFAROPC(opcode) tfar_##opcode: LOGC("%x: FAR %i %s", (int)(ip - mem_cs - d->size), d->op, #opcode);
+#endif
+
+#define TEOP LOGC("\n"); CHECK_SIGNAL goto vmloop;
+
+#define SET_THREADED_HANDLER(inst) handlers[_##inst] = &&top_##inst;
+
+// Bodies of the instructions that appear in superinstructions,
+// shared by the plain and the fused handlers.
+#define TB_ADD	ARITH(rd, RD, +, RS);
+#define TB_ADDI	ARITH(rd, RD, +, IMM);
+#define TB_SUBI	ARITH(rd, RD, -, IMM);
+#define TB_SLLI	ARITH(rd, RDU, <<, IMMU);
+#define TB_LDW	WRITE_REG(rd, MEM(int32_t, RS + IMM, READ)); LOGC("\t%i", RD);
+#define TB_STW	MEM(unsigned int, RD + IMM, WRITE) = RS;
+#define TB_LDI	WRITE_REG(rd, IMM);
+#define TB_LDR	WRITE_REG(rd, RS);
+#define TB_JC_EQ	if (RD == RS)	{ JMP_IMM; }
+#define TB_JC_NE	if (RD != RS)	{ JMP_IMM; }
+#define TB_JC_LT	if (RD <  RS)	{ JMP_IMM; }
+#define TB_JC_GE	if (RD >= RS)	{ JMP_IMM; }
+#define TB_JC_GT	if (RD >  RS)	{ JMP_IMM; }
+#define TB_JC_LE	if (RD <= RS)	{ JMP_IMM; }
+#define TB_JC_LTU	if (RDU <  RSU)	{ JMP_IMM; }
+#define TB_JC_GEU	if (RDU >= RSU)	{ JMP_IMM; }
+#define TB_JC_GTU	if (RDU >  RSU)	{ JMP_IMM; }
+#define TB_JC_LEU	if (RDU <= RSU)	{ JMP_IMM; }
+#define TB_RET\
+	fakePop();\
+	JMP_GENERIC(REG(REG_rt));
+
+#define TB_PUSH\
+	{\
+		byte r = rd;\
+		unsigned n = imm32;\
+		if(rd < 2 || int(rd) + n > 32) {\
+			DUMPINT(rd);\
+			DUMPINT(n);\
+			BIG_PHAT_ERROR(ERR_ILLEGAL_INSTRUCTION_FORM); /*raise hell*/\
+		}\
+\
+		do {\
+			ARITH(REG_sp, regs[REG_sp], -, 4);\
+			MEM(int32_t, REG(REG_sp), WRITE) = REG(r);\
+			LOGC("\t0x%x", REG(r));\
+			r++;\
+		} while(--n);\
+	}
+
+#define TB_POP\
+	{\
+		byte r = rd;\
+		unsigned n = imm32;\
+		if(rd > 31 || int(rd) - n < 1)\
+			BIG_PHAT_ERROR(ERR_ILLEGAL_INSTRUCTION_FORM); /*raise hell*/\
+\
+		do {\
+			REG(r) = MEM(int32_t, REG(REG_sp), READ);\
+			ARITH(REG_sp, regs[REG_sp], +, 4);\
+			LOGC("\t0x%x", REG(r));\
+			r--;\
+		} while(--n);\
+	}
+
+#ifdef USE_SUPERINSTRUCTIONS
+// Superinstruction header. The second half starts with TFUSE_NEXT.
+#ifdef COUNT_INSTRUCTION_USE
+#define TFUSE(first, second) tfuse_##first##_##second:\
+	LOGC("%x: %i %s", (int)(ip - mem_cs - d->size), d->op, #first);\
+	countInstructionUse(#first, d->op);
+#define TFUSE_COUNT(second) countInstructionUse(#second, d->op);
+#else
+#define TFUSE(first, second) tfuse_##first##_##second:\
+	LOGC("%x: %i %s", (int)(ip - mem_cs - d->size), d->op, #first);
+#define TFUSE_COUNT(second)
+#endif
+
+// Does what vmloop does for the second instruction of a superinstruction,
+// except the code segment bounds check, which ThreadedFuse() has done.
+#ifdef UPDATE_IP
+#define TFUSE_UPDATE_IP IP = uint(ip - mem_cs);
+#else
+#define TFUSE_UPDATE_IP
+#endif
+#ifdef MEMORY_DEBUG
+#define TFUSE_COUNT_INST InstCount++;
+#else
+#define TFUSE_COUNT_INST
+#endif
+#if defined(INSTRUCTION_PROFILING) && defined(UPDATE_IP) && defined(MEMORY_DEBUG)
+#define TFUSE_PROFILE instruction_count[IP]++;
+#else
+#define TFUSE_PROFILE
+#endif
+#ifdef LOG_STATE_CHANGE
+#define TFUSE_LOG_STATE logStateChange((int)(ip-mem_cs));
+#else
+#define TFUSE_LOG_STATE
+#endif
+
+#define TFUSE_NEXT(second) LOGC("\n");\
+	TFUSE_UPDATE_IP TFUSE_COUNT_INST TFUSE_PROFILE TFUSE_LOG_STATE\
+	d += d->size;\
+	rd = d->rd;\
+	rs = d->rs;\
+	imm32 = d->imm;\
+	ip += d->size;\
+	LOGC("%x: %i %s", (int)(ip - mem_cs - d->size), d->op, #second);\
+	TFUSE_COUNT(second)
+
+#define SET_SUPERINSTRUCTION_HANDLER(first, second)\
+	handlers[TK_##first##_##second] = &&tfuse_##first##_##second;
+
+// A complete superinstruction, built from the shared bodies.
+#define TSUPER(first, second) TFUSE(first, second) TB_##first TFUSE_NEXT(second) TB_##second TEOP;
+#endif	//USE_SUPERINSTRUCTIONS
+
+__attribute__((noinline)) byte* RUN_NAME(byte* ip) {
+	static const void* handlers[_TK_END];
+	const ThreadedOp* d;
+	byte rd,rs;
+	uint32_t imm32;
+
+	// Called by ThreadedDecode() to fetch the label addresses.
+	// They're constant for the lifetime of the program.
+	if(ip == NULL) {
+		for(int i=0; i<_TK_END; i++) {
+			handlers[i] = &&t_ILLEGAL;
+		}
+		INSTRUCTIONS(SET_THREADED_HANDLER);
+		handlers[TK_FAR + _CALLI] = &&tfar_CALLI;
+		handlers[TK_FAR + _JC_EQ] = &&tfar_JC_EQ;
+		handlers[TK_FAR + _JC_NE] = &&tfar_JC_NE;
+		handlers[TK_FAR + _JC_GE] = &&tfar_JC_GE;
+		handlers[TK_FAR + _JC_GT] = &&tfar_JC_GT;
+		handlers[TK_FAR + _JC_LE] = &&tfar_JC_LE;
+		handlers[TK_FAR + _JC_LT] = &&tfar_JC_LT;
+		handlers[TK_FAR + _JC_LTU] = &&tfar_JC_LTU;
+		handlers[TK_FAR + _JC_GEU] = &&tfar_JC_GEU;
+		handlers[TK_FAR + _JC_GTU] = &&tfar_JC_GTU;
+		handlers[TK_FAR + _JC_LEU] = &&tfar_JC_LEU;
+		handlers[TK_FAR + _JPI] = &&tfar_JPI;
+		handlers[TK_DECODE] = &&t_DECODE;
+		handlers[TK_ILLEGAL] = &&t_ILLEGAL;
+		handlers[TK_FAR_ILLEGAL] = &&t_FAR_ILLEGAL;
+		handlers[TK_ILLEGAL_FORM] = &&t_ILLEGAL_FORM;
+		handlers[TK_OOB] = &&t_OOB;
+#ifdef GDB_DEBUG
+		handlers[TK_DBG_OP] = &&t_DBG_OP;
+#endif
+#ifdef USE_SUPERINSTRUCTIONS
+		SUPERINSTRUCTIONS(SET_SUPERINSTRUCTION_HANDLER);
+#endif
+		threadedHandlers = handlers;
+		return NULL;
+	}
+
+	VM_Yield = 0;
+
+vmloop:
+#ifdef UPDATE_IP
+	IP = uint(ip - mem_cs);
+#endif
+
+#ifdef MEMORY_DEBUG
+	InstCount++;
+	if(uint(ip - mem_cs) >= (CODE_SEGMENT_SIZE - 4)) {
+		uint currentIP = uint(ip - mem_cs);
+		DUMPHEX(IP);
+		DUMPHEX(currentIP);
+		DUMPINT(InstCount);
+		IP = currentIP;
+		BIG_PHAT_ERROR(ERR_IMEM_OOB);
+	}
+#endif	//MEMORY_DEBUG
+#if defined(INSTRUCTION_PROFILING) && defined(UPDATE_IP) && defined(MEMORY_DEBUG)
+	instruction_count[IP]++;
+#endif
+
+#ifdef LOG_STATE_CHANGE
+	logStateChange((int)(ip-mem_cs));
+#endif
+	d = mem_dc + (ip - mem_cs);
+tdispatch:
+	rd = d->rd;
+	rs = d->rs;
+	imm32 = d->imm;
+	ip += d->size;
+	goto *d->handler;
+
+	TOPC(ADD)	TB_ADD	TEOP;
+	TOPC(ADDI)	TB_ADDI	TEOP;
+	TOPC(SUB)	ARITH(rd, RD, -, RS);	TEOP;
+	TOPC(SUBI)	TB_SUBI	TEOP;
+	TOPC(MUL)	ARITH(rd, RD, *, RS);	TEOP;
+	TOPC(MULI)	ARITH(rd, RD, *, IMM);	TEOP;
+	TOPC(AND)	ARITH(rd, RD, &, RS);	TEOP;
+	TOPC(ANDI)	ARITH(rd, RD, &, IMM);	TEOP;
+	TOPC(OR)	ARITH(rd, RD, |, RS);	TEOP;
+	TOPC(ORI)	ARITH(rd, RD, |, IMM);	TEOP;
+	TOPC(XOR)	ARITH(rd, RD, ^, RS);	TEOP;
+	TOPC(XORI)	ARITH(rd, RD, ^, IMM);	TEOP;
+	TOPC(DIVU)	DIVIDE(rd, RDU, RSU);	TEOP;
+	TOPC(DIVUI)	DIVIDE(rd, RDU, IMMU);	TEOP;
+	TOPC(DIV)	DIVIDE(rd, RD, RS);		TEOP;
+	TOPC(DIVI)	DIVIDE(rd, RD, IMM);	TEOP;
+	TOPC(SLL)	ARITH(rd, RDU, <<, RSU);	TEOP;
+	TOPC(SLLI)	TB_SLLI	TEOP;
+	TOPC(SRA)	ARITH(rd, RD, >>, RS);	TEOP;
+	TOPC(SRAI)	ARITH(rd, RD, >>, IMM);	TEOP;
+	TOPC(SRL)	ARITH(rd, RDU, >>, RSU);	TEOP;
+	TOPC(SRLI)	ARITH(rd, RDU, >>, IMMU);	TEOP;
+
+	TOPC(NOT)	WRITE_REG(rd, ~RS);	TEOP;
+	TOPC(NEG)	WRITE_REG(rd, -RS);	TEOP;
+
+	TOPC(PUSH)	TB_PUSH	TEOP;
+
+	TOPC(POP)	TB_POP	TEOP;
+
+	TOPC(LDB)	WRITE_REG(rd, MEM(char, RS + IMM, READ));	LOGC("\t%i", RD);	TEOP;
+	TOPC(LDH)	WRITE_REG(rd, MEM(short, RS + IMM, READ));	LOGC("\t%i", RD);	TEOP;
+	TOPC(LDW)	TB_LDW	TEOP;
+
+	TOPC(STB)	MEM(byte, RD + IMM, WRITE) = RS;	TEOP;
+	TOPC(STH)	MEM(unsigned short, RD + IMM, WRITE) = RS;	TEOP;
+	TOPC(STW)	TB_STW	TEOP;
+
+	TOPC(LDI)	TB_LDI	TEOP;
+	TOPC(LDR)	TB_LDR	TEOP;
+
+	TOPC(RET)	TB_RET	TEOP;
+
+	TOPC(CALL)
+		CALL_RD
+		fakePush(REG(REG_rt), RD);
+	TEOP;
+	TOPC(CALLI)
+		CALL_IMM
+		fakePush(REG(REG_rt), IMM);
+	TEOP;
+
+	TOPC(JC_EQ)	TB_JC_EQ	TEOP;
+	TOPC(JC_NE)	TB_JC_NE	TEOP;
+	TOPC(JC_GE)	TB_JC_GE	TEOP;
+	TOPC(JC_GT)	TB_JC_GT	TEOP;
+	TOPC(JC_LE)	TB_JC_LE	TEOP;
+	TOPC(JC_LT)	TB_JC_LT	TEOP;
+
+	TOPC(JC_LTU)	TB_JC_LTU	TEOP;
+	TOPC(JC_GEU)	TB_JC_GEU	TEOP;
+	TOPC(JC_GTU)	TB_JC_GTU	TEOP;
+	TOPC(JC_LEU)	TB_JC_LEU	TEOP;
+
+	TOPC(JPI)	JMP_IMM	TEOP;
+	TOPC(JPR)	JMP_RD	TEOP;
+
+	TFAROPC(CALLI)
+		CALL_IMM
+		fakePush(REG(REG_rt), IMM);
+	TEOP;
+
+	TFAROPC(JC_EQ)	if (RD == RS)	{ JMP_IMM; }	TEOP;
+	TFAROPC(JC_NE)	if (RD != RS)	{ JMP_IMM; }	TEOP;
+	TFAROPC(JC_GE)	if (RD >= RS)	{ JMP_IMM; }	TEOP;
+	TFAROPC(JC_GT)	if (RD >  RS)	{ JMP_IMM; }	TEOP;
+	TFAROPC(JC_LE)	if (RD <= RS)	{ JMP_IMM; }	TEOP;
+	TFAROPC(JC_LT)	if (RD <  RS)	{ JMP_IMM; }	TEOP;
+
+	TFAROPC(JC_LTU)	if (RDU <  RSU)	{ JMP_IMM; }	TEOP;
+	TFAROPC(JC_GEU)	if (RDU >= RSU)	{ JMP_IMM; }	TEOP;
+	TFAROPC(JC_GTU)	if (RDU >  RSU)	{ JMP_IMM; }	TEOP;
+	TFAROPC(JC_LEU)	if (RDU <= RSU)	{ JMP_IMM; }	TEOP;
+
+	TFAROPC(JPI)	JMP_IMM	TEOP;
+
+	TOPC(XB)	RD = ((RS & 0x80) == 0) ? (RS & 0xFF) : (RS | ~0xFF);	TEOP;
+	TOPC(XH)	RD = ((RS & 0x8000) == 0) ? (RS & 0xFFFF) : (RS | ~0xFFFF);	TEOP;
+
+	TOPC(SYSCALL)
+	{
+		int syscallNumber = imm32;
+#ifdef USE_SYSCALL_INTRINSICS
+		if(!(mIntrinsics && RunIntrinsic(syscallNumber)))
+#endif
+		{
+			fakePush((int32_t) (ip - mem_cs), -syscallNumber);
+			InvokeSysCall(syscallNumber);
+			fakePop();
+			if (VM_Yield)
+				return ip;
+		}
+	}
+	TEOP;
+
+	TOPC(CASE) {
+		imm32 <<= 2;
+		uint CaseStart = MEM(int, imm32, READ);
+		uint CaseLength = MEM(int, imm32 + 1*sizeof(int), READ);
+		uint index = RD - CaseStart;
+		if(index <= CaseLength) {
+			int tableAddress = imm32 + 3*sizeof(int);
+			JMP_GENERIC(MEM(int, tableAddress + index*sizeof(int), READ));
+		} else {
+			int DefaultCaseAddress = MEM(int, imm32 + 2*sizeof(int), READ);
+			JMP_GENERIC(DefaultCaseAddress);
+		}
+	} TEOP;
+
+#ifdef USE_SUPERINSTRUCTIONS
+	// Pairs of instructions run with one dispatch. See ThreadedFuse().
+	SUPERINSTRUCTIONS(TSUPER)
+#endif
+
+	// FAR is resolved by the decoder; an entry with this handler is never created.
+	TOPC(FAR)
+		DEBIG_PHAT_ERROR;
+
+	// Not reached by the linear decode in LoadVM; typically a jump into the
+	// middle of an instruction. Decode it now and run it.
+t_DECODE:
+	ip -= d->size;
+	ThreadedDecode(uint(ip - mem_cs));
+	goto tdispatch;
+
+t_ILLEGAL:
+	LOG("Illegal instruction 0x%02X @ 0x%04X\n", d->op, (int)(size_t)(ip - mem_cs) - 1);
+	BIG_PHAT_ERROR(ERR_ILLEGAL_INSTRUCTION);
+
+t_FAR_ILLEGAL:
+	LOG("Illegal far instruction 0x%02X @ 0x%04X\n", d->op, (int)(size_t)(ip - mem_cs) - 1);
+	BIG_PHAT_ERROR(ERR_ILLEGAL_INSTRUCTION);
+
+	// The instruction refers to a constant outside of the pool.
+t_ILLEGAL_FORM:
+	BIG_PHAT_ERROR(ERR_ILLEGAL_INSTRUCTION_FORM);
+
+	// The instruction runs past the end of the code segment.
+t_OOB:
+	BIG_PHAT_ERROR(ERR_IMEM_OOB);
+
+#ifdef GDB_DEBUG
+	// The threaded core is not used while gdb is attached,
+	// so there's nobody to handle the breakpoint.
+t_DBG_OP:
+	DEBIG_PHAT_ERROR;
+#endif
+}
+
+#undef TOPC
+#undef TFAROPC
+#undef TEOP
+#undef SET_THREADED_HANDLER
+#undef TB_ADD
+#undef TB_ADDI
+#undef TB_SUBI
+#undef TB_SLLI
+#undef TB_LDW
+#undef TB_STW
+#undef TB_LDI
+#undef TB_LDR
+#undef TB_JC_EQ
+#undef TB_JC_NE
+#undef TB_JC_LT
+#undef TB_JC_GE
+#undef TB_JC_GT
+#undef TB_JC_LE
+#undef TB_JC_LTU
+#undef TB_JC_GEU
+#undef TB_JC_GTU
+#undef TB_JC_LEU
+#undef TB_RET
+#undef TB_PUSH
+#undef TB_POP
+#ifdef USE_SUPERINSTRUCTIONS
+#undef TFUSE
+#undef TFUSE_COUNT
+#undef TFUSE_UPDATE_IP
+#undef TFUSE_COUNT_INST
+#undef TFUSE_PROFILE
+#undef TFUSE_LOG_STATE
+#undef TFUSE_NEXT
+#undef SET_SUPERINSTRUCTION_HANDLER
+#undef TSUPER
+#endif
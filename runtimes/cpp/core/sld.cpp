@@ -17,6 +17,9 @@ Software Foundation, 59 Temple Place - Suite 330, Boston, MA
 
 #include <string.h>
 #include <stdio.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <algorithm>
 #include <set>
 //#include <functional>
 
@@ -46,52 +49,55 @@ using namespace std;
 #define stricmp strcasecmp
 #endif
 
-struct linemap_file_line_less
-//	: public std::binary_function<LineMapping, LineMapping, bool>
-{	// functor for operator<
-	bool operator()(const LineMapping& _Left, const LineMapping& _Right) const
-	{	// apply operator< to operands
-		if(_Left.file != _Right.file)
-			return _Left.file < _Right.file;
-		else
-			return _Left.line < _Right.line;
-	}
+//The tables are flat arrays, sorted once at load and binary searched after that.
+//Lines come either from the text SLD, or straight from the binary one
+//that pipe-tool writes next to it (see tools/pipe-tool/SldBinary.c).
+
+struct SldLine {
+	int ip, line, file;
 };
 
-struct funcmap_start_less
-//	: public std::binary_function<FuncMapping*, FuncMapping*, bool>
-{
-	bool operator()(const FuncMapping* const& l, const FuncMapping* const& r) const
-	{
-		return l->start < r->start;
-	}
+//sorts line numbers into sLines by file, line and address.
+struct address_less {
+	bool operator()(int l, int r) const;
 };
 
-struct funcmap_name_less
-//	: public std::binary_function<FuncMapping*, FuncMapping*, bool>
-{
-	bool operator()(const FuncMapping* const& l, const FuncMapping* const& r) const
-	{
-		return l->name < r->name;
+struct funcmap_start_less {
+	bool operator()(const FuncMapping& l, const FuncMapping& r) const {
+		return l.start < r.start;
 	}
+	bool operator()(const FuncMapping& l, int r) const {
+		return l.start < r;
+	}
+	bool operator()(int l, const FuncMapping& r) const {
+		return l < r.start;
+	}
+};
+
+//sorts indices into sFunctions by name.
+struct funcmap_name_less {
+	bool operator()(int l, int r) const;
+	bool operator()(int l, const char* r) const;
+	bool operator()(const char* l, int r) const;
 };
 
 static Vector<FileMapping> gFiles;
 
-static std::set<LineMapping> sLineSet;	//maps addresses to lines
+//maps addresses to lines, by address.
+static const SldLine* sLines;
+static size_t sLineCount;
 
 //maps lines to addresses.
 //multiple addresses may map to the same line.
-//this map will only contain the first.
-typedef std::multiset<LineMapping, linemap_file_line_less> AddressSet;
-static AddressSet gAddressSet;
+static const int* sAddresses;
 
-typedef set<FuncMapping*, funcmap_start_less> FuncMapAddr;
-static FuncMapAddr sFuncMapAddr;
+//storage for the text SLD. The binary one is used where it was read.
+static Vector<SldLine> sLineStore;
+static Vector<int> sAddressStore;
+static Vector<int> sBinary;
 
-//should probably be a hash set, for fastest lookup
-typedef set<FuncMapping*, funcmap_name_less> FuncMapName;
-static FuncMapName sFuncMapName;
+static Vector<FuncMapping> sFunctions;	//by start
+static Vector<int> sFunctionNames;	//by name
 
 struct VarMapping {
 	int scope;
@@ -101,10 +107,30 @@ struct VarMapping {
 //TODO: make into a set, for faster lookup.
 Vector<VarMapping> gVarMap;
 
+bool address_less::operator()(int l, int r) const {
+	const SldLine& a(sLines[l]);
+	const SldLine& b(sLines[r]);
+	if(a.file != b.file)
+		return a.file < b.file;
+	if(a.line != b.line)
+		return a.line < b.line;
+	return a.ip < b.ip;
+}
+
+bool funcmap_name_less::operator()(int l, int r) const {
+	return sFunctions[l].name < sFunctions[r].name;
+}
+bool funcmap_name_less::operator()(int l, const char* r) const {
+	return strcmp(sFunctions[l].name.c_str(), r) < 0;
+}
+bool funcmap_name_less::operator()(const char* l, int r) const {
+	return strcmp(l, sFunctions[r].name.c_str()) < 0;
+}
+
 
 class File {
 public:
-	File(const char* filename) : file(fopen(filename, "r")) {}
+	File(const char* filename, const char* mode = "r") : file(fopen(filename, mode)) {}
 	~File() {
 		if(file)
 			fclose(file);
@@ -126,19 +152,15 @@ static bool readLine(char* dst, int maxLen, File& file) {
 }
 
 const FuncMapping* mapFunctionEx(int ip) {
-	FuncMapping temp;
-	temp.start = ip;
-	FuncMapAddr::const_iterator itr = sFuncMapAddr.lower_bound(&temp);
-	if(itr == sFuncMapAddr.end())
+	//the last function that starts at or before ip.
+	Vector<FuncMapping>::const_iterator itr =
+		upper_bound(sFunctions.begin(), sFunctions.end(), ip, funcmap_start_less());
+	if(itr == sFunctions.begin())
 		return NULL;
-	if((*itr)->start > ip) {
-		if(itr == sFuncMapAddr.begin())
-			return NULL;
-		itr--;
-	}
-	DEBUG_ASSERT((*itr)->start <= ip);
-	if((*itr)->stop >= ip)
-		return *itr;
+	itr--;
+	DEBUG_ASSERT(itr->start <= ip);
+	if(itr->stop >= ip)
+		return &*itr;
 	else
 		return NULL;
 }
@@ -157,24 +179,13 @@ int mapFunctionStart(int ip) {
 	return fm->start;
 }
 
-#if 0
 int mapFunction(const char* name) {
-	for(size_t i=0; i<gFuncMap.size(); i++) {
-		FuncMapping& fm(gFuncMap[i]);
-		if(strcmp(name, fm.name.c_str()) == 0)
-			return fm.start;
-	}
-	return -1;
-}
-#endif
-int mapFunction(const char* name) {
-	FuncMapping temp;
-	temp.name = name;
-	FuncMapName::const_iterator itr = sFuncMapName.find(&temp);
-	if(itr == sFuncMapName.end())
+	Vector<int>::const_iterator itr =
+		lower_bound(sFunctionNames.begin(), sFunctionNames.end(), name, funcmap_name_less());
+	if(itr == sFunctionNames.end() || sFunctions[*itr].name != name)
 		return -1;
 	else
-		return (*itr)->start;
+		return sFunctions[*itr].start;
 }
 
 int mapVariable(const char* name, int scope) {
@@ -186,29 +197,40 @@ int mapVariable(const char* name, int scope) {
 	return -1;
 }
 
+//returns the index in sLines of the first line at or after address.
+static size_t lineIndex(int address) {
+	size_t lo = 0, hi = sLineCount;
+	while(lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if(sLines[mid].ip < address)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
 int nextSldEntry(int address) {
-	LineMapping key;
-	key.ip = address;
-	set<LineMapping>::iterator itr = sLineSet.find(key);
-	if(itr == sLineSet.end())
+	size_t i = lineIndex(address);
+	if(i == sLineCount || sLines[i].ip != address)
 		return -1;
-	itr++;
-	if(itr == sLineSet.end())
+	i++;
+	if(i == sLineCount)
 		return -1;
-	return itr->ip;
+	return sLines[i].ip;
 }
 
 void clearSLD() {
-	FuncMapAddr::iterator itr = sFuncMapAddr.begin();
-	while(itr != sFuncMapAddr.end()) {
-		delete *itr;
-		itr++;
-	}
-	sFuncMapAddr.clear();
-	sFuncMapName.clear();
-	sLineSet.clear();
-	gAddressSet.clear();
+	sFunctions.clear();
+	sFunctionNames.clear();
+	sLines = NULL;
+	sLineCount = 0;
+	sAddresses = NULL;
+	sLineStore.clear();
+	sAddressStore.clear();
+	sBinary.clear();
 	gFiles.clear();
+	gVarMap.clear();
 }
 
 static int fileIndexFromScope(int scope) {
@@ -219,44 +241,177 @@ static int fileIndexFromScope(int scope) {
 	return -1;
 }
 
-bool loadSLD(const char* filename) {
-	clearSLD();
+static bool addFile(int index, int scope, const char* name) {
+	if(index != (int)gFiles.size())
+		return false;
+	FileMapping fm;
+	fm.scope = scope;
+	fm.name = name;
+
+	//transform to unix-style paths for easy handling in the rest of the program.
+	for(size_t i=0; i<fm.name.size(); i++) {
+		if(fm.name[i] == '\\')
+			fm.name[i] = '/';
+	}
+#ifdef LINUX
+	//windows absolute paths cannot be parsed by unix programs
+	if(fm.name[1] == ':') {
+		fm.name[1] = '_';
+	}
+#endif
+	gFiles.push_back(fm);
+	return true;
+}
+
+static bool addFunction(const char* name, int start, int stop) {
+	if(strcmp(name, "CDTOR") == 0)
+		return true;
+	int lastStop = sFunctions.empty() ? -1 : sFunctions.back().stop;
+	if(lastStop > start || stop < start) {
+		LOG("Error in SLD file at function \"%s\".\n", name);
+		FAIL;
+	}
+	sFunctions.push_back(FuncMapping());
+	FuncMapping& fm(sFunctions.back());
+	fm.start = start;
+	fm.stop = stop;
+	if(name[0] == '_')
+		fm.name = name + 1;	//skip the extra '_'.
+	else
+		fm.name = name;
+	return true;
+}
 
+static bool addVariable(const char* name, int scope, int start) {
+	VarMapping vm;
+	vm.start = start;
+#if 0	//Check disabled because source doesn't conform. We'll live.
+	if(lastStart > vm.start) {
+		LOG("Error in SLD file at line \"%s\".\n", buffer);
+		FAIL;
+	}
+#endif
+	vm.scope = fileIndexFromScope(scope);
+	FAILIF(vm.scope < 0);
+	if(name[0] == '_') {	//because we seem to be getting a few too many variables.
+		vm.name = name + 1;	//skip the extra '_'.
+		gVarMap.push_back(vm);
+	}
+	return true;
+}
+
+//demangles the function names and sorts them for mapFunction(const char*).
+static void finishFunctions() {
+	for(size_t i=0; i<sFunctions.size(); i++) {
+		const char *mangledName = cplus_demangle_v3(sFunctions[i].name.c_str(), DMGL_PARAMS);
+		/* Only update names that we could mangle */
+		if(mangledName != NULL) {
+			sFunctions[i].name = mangledName;
+		}
+	}
+	sFunctionNames.resize(sFunctions.size());
+	for(size_t i=0; i<sFunctions.size(); i++) {
+		sFunctionNames[i] = (int)i;
+	}
+	sort(sFunctionNames.begin(), sFunctionNames.end(), funcmap_name_less());
+}
+
+#define SLDBIN_MAGIC 0x444c534d	// 'MSLD'
+#define SLDBIN_VERSION 1
+
+struct SldBinHead {
+	int magic;
+	int version;
+	int textSize;
+	int fileCount;
+	int lineCount;
+	int functionCount;
+	int variableCount;
+	int stringSize;
+};
+
+//reads <filename>.bin, if it was written with the current text SLD.
+static bool loadBinarySLD(const char* filename) {
+	String binName = String(filename) + ".bin";
+	struct stat textStat, binStat;
+	if(stat(filename, &textStat) != 0 || stat(binName.c_str(), &binStat) != 0)
+		return false;
+	if(binStat.st_mtime < textStat.st_mtime)
+		return false;
+
+	File file(binName.c_str(), "rb");
+	if(!file.file || binStat.st_size < (int)sizeof(SldBinHead))
+		return false;
+	sBinary.resize((binStat.st_size + 3) / 4);
+	if(fread(&sBinary[0], 1, binStat.st_size, file.file) != (size_t)binStat.st_size)
+		return false;
+
+	const SldBinHead& head(*(SldBinHead*)&sBinary[0]);
+	if(head.magic != SLDBIN_MAGIC || head.version != SLDBIN_VERSION ||
+		head.textSize != textStat.st_size)
+		return false;
+	if(head.fileCount < 0 || head.lineCount < 0 || head.functionCount < 0 ||
+		head.variableCount < 0 || head.stringSize <= 0)
+		return false;
+	size_t ints = sizeof(SldBinHead) / 4 + head.fileCount * 3 + head.lineCount * 4 +
+		head.functionCount * 3 + head.variableCount * 3;
+	if(ints * 4 + head.stringSize != (size_t)binStat.st_size)
+		return false;
+
+	const int* files = &sBinary[sizeof(SldBinHead) / 4];
+	const int* lines = files + head.fileCount * 3;
+	const int* addresses = lines + head.lineCount * 3;
+	const int* functions = addresses + head.lineCount;
+	const int* variables = functions + head.functionCount * 3;
+	const char* strings = (const char*)(variables + head.variableCount * 3);
+	if(strings[head.stringSize - 1] != 0)
+		return false;
+#define SLDBIN_STRING(offset) ((unsigned)(offset) < (unsigned)head.stringSize ? strings + (offset) : "")
+
+	for(int i=0; i<head.fileCount; i++) {
+		const int* f = files + i * 3;
+		TEST(addFile(f[0], f[1], SLDBIN_STRING(f[2])));
+	}
+
+	sLines = (const SldLine*)lines;
+	sLineCount = head.lineCount;
+	sAddresses = addresses;
+	for(size_t i=0; i<sLineCount; i++) {
+		FAILIF(i > 0 && sLines[i].ip <= sLines[i-1].ip);
+		FAILIF((unsigned)sAddresses[i] >= sLineCount);
+	}
+
+	sFunctions.reserve(head.functionCount);
+	for(int i=0; i<head.functionCount; i++) {
+		const int* f = functions + i * 3;
+		TEST(addFunction(SLDBIN_STRING(f[2]), f[0], f[1]));
+	}
+
+	for(int i=0; i<head.variableCount; i++) {
+		const int* v = variables + i * 3;
+		TEST(addVariable(SLDBIN_STRING(v[2]), v[0], v[1]));
+	}
+	return true;
+}
+
+static bool loadTextSLD(const char* filename) {
 	File file(filename);
 	char buffer[BUFSIZE];
 
 	//read files
-	int lastIndex = 0;
 	TEST(readLine(buffer, BUFSIZE, file));
 	FAILIF(strcmp(buffer, "Files") != 0);
 	while(1) {
 		TEST(readLine(buffer, BUFSIZE, file));
 
-		FileMapping fm;
-		int index, nameStartPoint;
-		if(sscanf(buffer, "%i:%i%n", &index, &fm.scope, &nameStartPoint) != 2)
+		int index, scope, nameStartPoint;
+		if(sscanf(buffer, "%i:%i%n", &index, &scope, &nameStartPoint) != 2)
 			break;
 		if(buffer[nameStartPoint] != ':')
 			break;
 		nameStartPoint++;
-		lastIndex++;
-		index++;
-		if(index != lastIndex)
+		if(!addFile(index, scope, buffer + nameStartPoint))
 			return 1;
-		fm.name = buffer + nameStartPoint;
-
-		//transform to unix-style paths for easy handling in the rest of the program.
-		for(size_t i=0; i<fm.name.size(); i++) {
-			if(fm.name[i] == '\\')
-				fm.name[i] = '/';
-		}
-#ifdef LINUX
-		//windows absolute paths cannot be parsed by unix programs
-		if(fm.name[1] == ':') {
-			fm.name[1] = '_';
-		}
-#endif
-		gFiles.push_back(fm);
 	}
 	//LOG("Found %i files\n", gFiles.size());
 
@@ -264,94 +419,73 @@ bool loadSLD(const char* filename) {
 	FAILIF(strcmp(buffer, "SLD") != 0);
 	while(1) {
 		TEST(readLine(buffer, BUFSIZE, file));
-		LineMapping m;
-		if(sscanf(buffer, "%x:%i:%" PFZT "i", &m.ip, &m.line, &m.file) != 3)
+		SldLine m;
+		if(sscanf(buffer, "%x:%i:%i", &m.ip, &m.line, &m.file) != 3)
 			break;
-		std::pair<std::set<LineMapping>::iterator, bool> res = sLineSet.insert(m);
-		TEST(res.second);
-		gAddressSet.insert(m);
+		sLineStore.push_back(m);
 	}
-	//LOG("Found %i lines\n", gLineMap.size());
+	//LOG("Found %i lines\n", sLineStore.size());
 
 	//read function map
 	FAILIF(strcmp(buffer, "FUNCTIONS") != 0);
 	//_ZN12CustomScreenC2EPN4MAUI6ScreenE 00000000,000000d7
-	int lastStop = -1;
 	while(1) {
 		TEST(readLine(buffer, BUFSIZE, file));
-		FuncMapping fm;
-		int nameLen;
-		if(sscanf(buffer, "%*s%n %x,%x", &nameLen, &fm.start, &fm.stop) != 2)
+		int nameLen, start, stop;
+		if(sscanf(buffer, "%*s%n %x,%x", &nameLen, &start, &stop) != 2)
 			break;
 		buffer[nameLen] = 0;
-		if(strcmp(buffer, "CDTOR") == 0)
-			continue;
-		if(lastStop > fm.start || fm.stop < fm.start) {
-			LOG("Error in SLD file at line \"%s\".\n", buffer);
-			FAIL;
-		}
-		lastStop = fm.stop;
-		FuncMapping* fmp = new FuncMapping(fm);
-		if(buffer[0] == '_')
-			fmp->name = buffer + 1;	//skip the extra '_'.
-		else
-			fmp->name = buffer;
-		sFuncMapAddr.insert(fmp);
-		sFuncMapName.insert(fmp);
+		TEST(addFunction(buffer, start, stop));
 	}
 
 	//read variable map
 	FAILIF(strcmp(buffer, "VARIABLES") != 0);
-	//int lastStart = -1;
 	while(1) {
 		TEST(readLine(buffer, BUFSIZE, file));
-		VarMapping vm;
-		int nameLen;
-		if(sscanf(buffer, "%*s%n %i %x", &nameLen, &vm.scope, &vm.start) != 2)
+		int nameLen, scope, start;
+		if(sscanf(buffer, "%*s%n %i %x", &nameLen, &scope, &start) != 2)
 			break;
 		buffer[nameLen] = 0;
-#if 0	//Check disabled because source doesn't conform. We'll live.
-		if(lastStart > vm.start) {
-			LOG("Error in SLD file at line \"%s\".\n", buffer);
-			FAIL;
-		}
-#endif
-		vm.scope = fileIndexFromScope(vm.scope);
-		FAILIF(vm.scope < 0);
-		//lastStart = vm.start;
-		if(buffer[0] == '_') {	//because we seem to be getting a few too many variables.
-			vm.name = buffer + 1;	//skip the extra '_'.
-			gVarMap.push_back(vm);
-		}
+		TEST(addVariable(buffer, scope, start));
 	}
 
-	for(FuncMapAddr::iterator itr = sFuncMapAddr.begin(); itr != sFuncMapAddr.end(); itr++) {
-		const char *mangledName = cplus_demangle_v3((*itr)->name.c_str(), DMGL_PARAMS);
-		/* Only update names that we could mangle */
-		if(mangledName != NULL) {
-			(*itr)->name = mangledName;
-		}
+	//pipe-tool writes the lines by address, each address once.
+	for(size_t i=1; i<sLineStore.size(); i++) {
+		FAILIF(sLineStore[i].ip <= sLineStore[i-1].ip);
+	}
+	sLineCount = sLineStore.size();
+	sLines = sLineCount ? &sLineStore[0] : NULL;
+	sAddressStore.resize(sLineCount);
+	for(size_t i=0; i<sLineCount; i++) {
+		sAddressStore[i] = (int)i;
+	}
+	sort(sAddressStore.begin(), sAddressStore.end(), address_less());
+	sAddresses = sLineCount ? &sAddressStore[0] : NULL;
+	return true;
+}
+
+bool loadSLD(const char* filename) {
+	clearSLD();
+	if(!loadBinarySLD(filename)) {
+		clearSLD();
+		TEST(loadTextSLD(filename));
 	}
+	finishFunctions();
 	return true;
 }
 
 bool mapIpEx(int inIp, LineMapping& lm) {
 	//find mapping with ip equal to or less than inIp.
-	LineMapping key;
-	key.ip = inIp;
-	set<LineMapping>::const_iterator itr = sLineSet.lower_bound(key);
-	//lower_bound returns >=, instead of <=. So we do this:
-	if(itr == sLineSet.end()) {
-		if(sLineSet.empty())
-			return false;
-		itr--;
-	} else if(itr->ip > inIp) {
-		itr--;
-		if(itr == sLineSet.begin())
+	size_t i = lineIndex(inIp);
+	if(i == sLineCount || sLines[i].ip > inIp) {
+		if(i == 0)
 			return false;
+		i--;
 	}
 
-	lm = *itr;
+	lm.ip = sLines[i].ip;
+	lm.line = sLines[i].line;
+	lm.file = sLines[i].file;
 	return true;
 }
 
@@ -380,7 +514,7 @@ const char* getMapFileLineError(int ret) {
 }
 
 int mapFileLine(const char* filename, int lineNumber, vector<int>& addresses) {
-	if(gAddressSet.size() == 0 || gFiles.size() == 0) {
+	if(sLineCount == 0 || gFiles.size() == 0) {
 		return ERR_NOMAP;
 	}
 	size_t fileIndex;
@@ -391,33 +525,38 @@ int mapFileLine(const char* filename, int lineNumber, vector<int>& addresses) {
 	if(fileIndex == gFiles.size())
 		return ERR_NOFILE;
 
-	LineMapping lm;
-	lm.file = fileIndex;
-	lm.line = lineNumber;
-
-	AddressSet::const_iterator itr = gAddressSet.lower_bound(lm);
+	// find first valid line
+	size_t lo = 0, hi = sLineCount;
+	while(lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		const SldLine& l(sLines[sAddresses[mid]]);
+		if(l.file < (int)fileIndex || (l.file == (int)fileIndex && l.line < lineNumber))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
 
 	addresses.clear();
 
 	set<int> foundFunctions;
 
-	// find first valid line
-	while(itr!=gAddressSet.end() && itr->file==fileIndex && itr->line<lineNumber) {
-		itr++;
-	}
-	if(itr==gAddressSet.end()) {
+	if(lo == sLineCount || sLines[sAddresses[lo]].file != (int)fileIndex) {
 		return ERR_NOLINE;
 	}
 
-	lineNumber = itr->line;
+	lineNumber = sLines[sAddresses[lo]].line;
 
-	while(itr!=gAddressSet.end() && itr->file==fileIndex && itr->line==lineNumber) {
-		const FuncMapping* fm = mapFunctionEx(itr->ip);
+	for(size_t i=lo; i<sLineCount; i++) {
+		const SldLine& l(sLines[sAddresses[i]]);
+		if(l.file != (int)fileIndex || l.line != lineNumber)
+			break;
+		const FuncMapping* fm = mapFunctionEx(l.ip);
+		if(fm == NULL)
+			continue;
 		if(foundFunctions.find(fm->start) == foundFunctions.end()) {
-			addresses.push_back(itr->ip);
+			addresses.push_back(l.ip);
 			foundFunctions.insert(fm->start);
 		}
-		itr++;
 	}
 
 	if(addresses.size() == 0)
@@ -36,6 +36,7 @@ bool loadFunctionMap(const char* filename);
 void clearFunctionMap();
 #endif
 
+//Reads filename.bin instead, if pipe-tool wrote one together with the text file.
 bool loadSLD(const char* filename);
 void clearSLD();
 
@@ -4051,6 +4051,54 @@ namespace Base
 		return (int)result;
 	}
 
+	/**
+	 * Begin a transaction.
+	 * @param databaseHandle Handle to the database.
+	 * @return #MA_DB_OK on success, #MA_DB_ERROR on error.
+	 */
+	int _maDBBeginTransaction(MAHandle databaseHandle, JNIEnv* jNIEnv, jobject jThis)
+	{
+		jclass cls = jNIEnv->GetObjectClass(jThis);
+		jmethodID methodID = jNIEnv->GetMethodID(
+			cls,
+			"maDBBeginTransaction",
+			"(I)I");
+
+		jint result = -1;
+		if (methodID != 0)
+			result = jNIEnv->CallIntMethod(
+				jThis,
+				methodID,
+				databaseHandle);
+
+		jNIEnv->DeleteLocalRef(cls);
+		return (int)result;
+	}
+
+	/**
+	 * Commit the transaction begun by maDBBeginTransaction.
+	 * @param databaseHandle Handle to the database.
+	 * @return #MA_DB_OK on success, #MA_DB_ERROR on error.
+	 */
+	int _maDBCommitTransaction(MAHandle databaseHandle, JNIEnv* jNIEnv, jobject jThis)
+	{
+		jclass cls = jNIEnv->GetObjectClass(jThis);
+		jmethodID methodID = jNIEnv->GetMethodID(
+			cls,
+			"maDBCommitTransaction",
+			"(I)I");
+
+		jint result = -1;
+		if (methodID != 0)
+			result = jNIEnv->CallIntMethod(
+				jThis,
+				methodID,
+				databaseHandle);
+
+		jNIEnv->DeleteLocalRef(cls);
+		return (int)result;
+	}
+
 	/**
 	 * Executes an SQL statement. If the statement returns a
 	 * query result, a cursor handle is returned.
@@ -1033,6 +1033,20 @@ namespace Base
 	 */
 	int _maDBClose(MAHandle databaseHandle, JNIEnv* jNIEnv, jobject jThis);
 
+	/**
+	 * Begin a transaction.
+	 * @param databaseHandle Handle to the database.
+	 * @return #MA_DB_OK on success, #MA_DB_ERROR on error.
+	 */
+	int _maDBBeginTransaction(MAHandle databaseHandle, JNIEnv* jNIEnv, jobject jThis);
+
+	/**
+	 * Commit the transaction begun by maDBBeginTransaction.
+	 * @param databaseHandle Handle to the database.
+	 * @return #MA_DB_OK on success, #MA_DB_ERROR on error.
+	 */
+	int _maDBCommitTransaction(MAHandle databaseHandle, JNIEnv* jNIEnv, jobject jThis);
+
 	/**
 	 * Executes an SQL statement. If the statement returns a
 	 * query result, a cursor handle is returned.
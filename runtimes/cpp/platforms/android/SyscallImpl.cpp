@@ -2261,6 +2261,14 @@ namespace Base
 				mJNIEnv,
 				mJThis);
 
+		// Data objects live on the native side, so this one needs no Java.
+		case maIOCtl_maConcatData:
+			return SYSCALL_THIS->maConcatData(
+				a,
+				SYSCALL_THIS->GetValidatedMemRange(b, sizeof(MAHandle)),
+				c,
+				SYSCALL_THIS->GetValidatedStackValue(0));
+
 		case maIOCtl_maFileTell:
 			return _maFileTell(
 				a,
@@ -3251,6 +3259,18 @@ namespace Base
 				mJNIEnv,
 				mJThis);
 
+		case maIOCtl_maDBBeginTransaction:
+			return _maDBBeginTransaction(
+				a,
+				mJNIEnv,
+				mJThis);
+
+		case maIOCtl_maDBCommitTransaction:
+			return _maDBCommitTransaction(
+				a,
+				mJNIEnv,
+				mJThis);
+
 		case maIOCtl_maDBExecSQL:
 			return _maDBExecSQL(
 				a,
@@ -267,6 +267,7 @@ namespace Base {
 		maIOCtl_syscall_case(maFileOpen);
 		maIOCtl_syscall_case(maFileWriteFromData);
 		maIOCtl_syscall_case(maFileReadToData);
+		maIOCtl_syscall_case(maConcatData);
 		maIOCtl_syscall_case(maFileTell);
 		maIOCtl_syscall_case(maFileSeek);
 		maIOCtl_syscall_case(maFileRead);
@@ -341,6 +342,8 @@ namespace Base {
         maIOCtl_case(maNotificationGetIconBadge);
 		maIOCtl_case(maDBOpen);
 		maIOCtl_case(maDBClose);
+		maIOCtl_case(maDBBeginTransaction);
+		maIOCtl_case(maDBCommitTransaction);
 		maIOCtl_case(maDBExecSQL);
 		maIOCtl_case(maDBExecSQLParams);
 		maIOCtl_case(maDBCursorDestroy);
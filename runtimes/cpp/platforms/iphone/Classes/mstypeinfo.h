@@ -51,7 +51,12 @@ Software Foundation, 59 Temple Place - Suite 330, Boston, MA
 void MoSyncDiv0();
 
 extern int sp;
+//rebuild.build.cpp has it for the -cpp-shards files.
+#ifdef REBUILD_SHARD
+extern int __dbl_high;
+#else
 int __dbl_high;
+#endif
 
 extern unsigned char* mem_ds;
 
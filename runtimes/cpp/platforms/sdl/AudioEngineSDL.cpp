@@ -41,29 +41,10 @@ namespace AudioEngine {
 	AudioChannel *gChannels[MAX_CHANNELS];
 	SDL_AudioSpec gAudioSpec;
 
-	static Sint32 gTempBuffer[DEFAULT_AUDIOBUF_SAMPLES*2];
-
 	static void soundCallback(void *userdata, Uint8 *buf,int len) {
 		//MutexHandler m(&gMutex);
 
-		int numSamples = len>>2;
-		memset(gTempBuffer, 0, DEFAULT_AUDIOBUF_SAMPLES*2*sizeof(Uint32));
-		for(int i = 0; i < MAX_CHANNELS; i++) {
-			AudioChannel *chnl = gChannels[i]; 
-			if(chnl->isActive()) {
-				chnl->mix(gTempBuffer, numSamples);
-			}
-		}
-
-		Sint16* dst = (Sint16*)buf;
-		for(int i = 0; i < numSamples<<1; i++) {
-			int sample = gTempBuffer[i];
-			if(sample<-32768) 
-				sample = 32768;
-			else if(sample>=32767) 
-				sample = 32767;
-			*dst++ = (Sint16) (gTempBuffer[i]);
-		}
+		mixAudioChannels((s16*)buf, gChannels, MAX_CHANNELS, len>>2);
 	}
 
 	int getSampleRate() {
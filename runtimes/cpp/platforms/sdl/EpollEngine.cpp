@@ -0,0 +1,384 @@
+/* Copyright (C) 2009 Mobile Sorcery AB
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License, version 2, as published by
+the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING.  If not, write to the Free
+Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.
+*/
+
+#include "config_platform.h"
+
+#if defined(USE_EPOLL_CONNECTIONS) && defined(LINUX)
+
+#include <helpers/helpers.h>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "EpollEngine.h"
+
+using namespace MoSyncError;
+
+#define MAX_EVENTS 256
+
+enum PendingType {
+	eRead, eReadFrom, eWrite, eWriteTo
+};
+
+struct EpollEngine::Pending {
+	PendingType type;
+	byte* buf;
+	int size;
+	int done;	//bytes written so far
+	MAConnAddr addr;	//destination of eWriteTo
+	MAConnAddr* src;	//for eReadFrom
+	Op* op;
+};
+
+//******************************************************************************
+// Non-blocking socket calls
+//******************************************************************************
+
+static bool wouldBlock() {
+	return SOCKET_ERRNO == EAGAIN || SOCKET_ERRNO == EWOULDBLOCK || SOCKET_ERRNO == EINTR;
+}
+
+//Returns true if the operation is done, with the result in \a result.
+//Returns false if it would block.
+bool EpollEngine::perform(MoSyncSocket sock, Pending& p, int& result) {
+	switch(p.type) {
+	case eRead:
+	case eReadFrom:
+		{
+			sockaddr_in from;
+			socklen_t fromlen = sizeof(from);
+			int bytesRecv = recvfrom(sock, (char*)p.buf, p.size, MSG_DONTWAIT,
+				p.type == eReadFrom ? (sockaddr*)&from : NULL,
+				p.type == eReadFrom ? &fromlen : NULL);
+			if(SOCKET_ERROR == bytesRecv) {
+				if(wouldBlock())
+					return false;
+				LOG("EpollEngine: recv failed. error code: %i\n", SOCKET_ERRNO);
+				result = CONNERR_GENERIC;
+			} else if(bytesRecv == 0) {
+				result = CONNERR_CLOSED;
+			} else {
+				if(p.type == eReadFrom) {
+					p.src->family = CONN_FAMILY_INET4;
+					p.src->inet4.port = ntohs(from.sin_port);
+					p.src->inet4.addr = ntohl(from.sin_addr.s_addr);
+				}
+				result = bytesRecv;
+			}
+			return true;
+		}
+	case eWrite:
+	case eWriteTo:
+		{
+			sockaddr_in si;
+			if(p.type == eWriteTo) {
+				DEBUG_ASSERT(p.addr.family == CONN_FAMILY_INET4);
+				si.sin_family = AF_INET;
+				si.sin_port = htons(p.addr.inet4.port);
+				si.sin_addr.s_addr = htonl(p.addr.inet4.addr);
+			}
+			while(p.done < p.size) {
+				int bytesSent = sendto(sock, (const char*)p.buf + p.done, p.size - p.done,
+					MSG_DONTWAIT | MSG_NOSIGNAL,
+					p.type == eWriteTo ? (sockaddr*)&si : NULL,
+					p.type == eWriteTo ? sizeof(si) : 0);
+				if(SOCKET_ERROR == bytesSent) {
+					if(wouldBlock())
+						return false;
+					LOG("EpollEngine: send failed. error code: %i\n", SOCKET_ERRNO);
+					result = CONNERR_GENERIC;
+					return true;
+				}
+				if(p.type == eWriteTo && bytesSent != p.size) {
+					LOG("EpollEngine: datagram truncated\n");
+					result = CONNERR_GENERIC;
+					return true;
+				}
+				p.done += bytesSent;
+			}
+			result = 1;
+			return true;
+		}
+	default:
+		DEBIG_PHAT_ERROR;
+	}
+}
+
+//******************************************************************************
+// EpollEngine
+//******************************************************************************
+
+EpollEngine::EpollEngine() : mEpoll(-1), mWake(-1), mRunning(false), mStopping(false),
+	mMutex(NULL), mImmediate(0), mWaited(0)
+{
+}
+
+EpollEngine::~EpollEngine() {
+	close();
+}
+
+bool EpollEngine::start() {
+	DEBUG_ASSERT(!mRunning);
+	mEpoll = epoll_create(MAX_EVENTS);
+	if(mEpoll < 0) {
+		LOG("EpollEngine: epoll_create failed. error code: %i\n", errno);
+		return false;
+	}
+	mWake = eventfd(0, 0);
+	if(mWake < 0) {
+		LOG("EpollEngine: eventfd failed. error code: %i\n", errno);
+		::close(mEpoll);
+		mEpoll = -1;
+		return false;
+	}
+	epoll_event ev;
+	ev.events = EPOLLIN;
+	ev.data.fd = mWake;
+	DEBUG_ASRTZERO(epoll_ctl(mEpoll, EPOLL_CTL_ADD, mWake, &ev));
+
+	mMutex = SDL_CreateMutex();
+	MYASSERT(mMutex, ERR_OOM);
+	mStopping = false;
+	mRunning = true;
+	mThread.start(threadFunc, this);
+	return true;
+}
+
+void EpollEngine::close() {
+	if(!mRunning)
+		return;
+	SDL_mutexP(mMutex);
+	mStopping = true;
+	SDL_mutexV(mMutex);
+	wake();
+	mThread.join();
+	mRunning = false;
+
+	Completions c;
+	c.swap(mDone);
+	for(SocketMap::iterator itr = mSockets.begin(); itr != mSockets.end(); itr++) {
+		Socket& s(itr->second);
+		if(s.read) {
+			c.push_back(std::make_pair(s.read->op, (int)CONNERR_CANCELED));
+			delete s.read;
+		}
+		if(s.write) {
+			c.push_back(std::make_pair(s.write->op, (int)CONNERR_CANCELED));
+			delete s.write;
+		}
+	}
+	mSockets.clear();
+	finish(c);
+
+	::close(mWake);
+	::close(mEpoll);
+	mWake = mEpoll = -1;
+	SDL_DestroyMutex(mMutex);
+	mMutex = NULL;
+	LOG("EpollEngine: %i operations done at once, %i waited\n", mImmediate, mWaited);
+}
+
+void EpollEngine::wake() {
+	uint64_t one = 1;
+	DEBUG_ASSERT(::write(mWake, &one, sizeof(one)) == sizeof(one));
+}
+
+void EpollEngine::finish(Completions& c) {
+	for(size_t i=0; i<c.size(); i++) {
+		c[i].first->complete(c[i].second);
+		delete c[i].first;
+	}
+	c.clear();
+}
+
+void EpollEngine::read(MoSyncSocket sock, void* dst, int max, Op* op) {
+	Pending* p = new Pending;
+	p->type = eRead;
+	p->buf = (byte*)dst;
+	p->size = max;
+	p->op = op;
+	submit(sock, p);
+}
+
+void EpollEngine::readFrom(MoSyncSocket sock, void* dst, int max, MAConnAddr& src, Op* op) {
+	Pending* p = new Pending;
+	p->type = eReadFrom;
+	p->buf = (byte*)dst;
+	p->size = max;
+	p->src = &src;
+	p->op = op;
+	submit(sock, p);
+}
+
+void EpollEngine::write(MoSyncSocket sock, const void* src, int len, Op* op) {
+	Pending* p = new Pending;
+	p->type = eWrite;
+	p->buf = (byte*)src;
+	p->size = len;
+	p->done = 0;
+	p->op = op;
+	submit(sock, p);
+}
+
+void EpollEngine::writeTo(MoSyncSocket sock, const void* src, int len, const MAConnAddr& dst,
+	Op* op)
+{
+	Pending* p = new Pending;
+	p->type = eWriteTo;
+	p->buf = (byte*)src;
+	p->size = len;
+	p->done = 0;
+	p->addr = dst;
+	p->op = op;
+	submit(sock, p);
+}
+
+void EpollEngine::submit(MoSyncSocket sock, Pending* p) {
+	DEBUG_ASSERT(mRunning);
+	int result;
+	SDL_mutexP(mMutex);
+	Socket& s(mSockets[sock]);
+	bool isWrite = p->type == eWrite || p->type == eWriteTo;
+	Pending*& slot(isWrite ? s.write : s.read);
+	DEBUG_ASSERT(slot == NULL);
+	if(perform(sock, *p, result)) {
+		if(s.events == 0)
+			mSockets.erase(sock);
+		mImmediate++;
+		complete(p, result);
+		SDL_mutexV(mMutex);
+		delete p;
+		return;
+	}
+	slot = p;
+	mWaited++;
+	update(sock, s);
+	SDL_mutexV(mMutex);
+}
+
+//Queues the operation's Op for the engine thread. Call with mMutex locked.
+void EpollEngine::complete(Pending* p, int result) {
+	mDone.push_back(std::make_pair(p->op, result));
+	//the loop empties mDone before it waits again.
+	if(!mThread.isCurrent() && mDone.size() == 1)
+		wake();
+}
+
+//Changes the epoll registration of \a sock to match its pending operations.
+//Erases \a s if it has none left. Call with mMutex locked.
+void EpollEngine::update(MoSyncSocket sock, Socket& s) {
+	int events = (s.read ? EPOLLIN : 0) | (s.write ? EPOLLOUT : 0);
+	if(events == s.events)
+		return;
+	epoll_event ev;
+	ev.events = events;
+	ev.data.fd = sock;
+	int op = s.events == 0 ? EPOLL_CTL_ADD : events == 0 ? EPOLL_CTL_DEL : EPOLL_CTL_MOD;
+	if(epoll_ctl(mEpoll, op, sock, &ev) < 0) {
+		LOG("EpollEngine: epoll_ctl(%i, %i) failed. error code: %i\n", op, sock, errno);
+		DEBIG_PHAT_ERROR;
+	}
+	if(events == 0)
+		mSockets.erase(sock);
+	else
+		s.events = events;
+}
+
+void EpollEngine::cancel(MoSyncSocket sock) {
+	SDL_mutexP(mMutex);
+	SocketMap::iterator itr = mSockets.find(sock);
+	if(itr != mSockets.end()) {
+		Socket& s(itr->second);
+		if(s.read) {
+			complete(s.read, CONNERR_CANCELED);
+			delete s.read;
+			s.read = NULL;
+		}
+		if(s.write) {
+			complete(s.write, CONNERR_CANCELED);
+			delete s.write;
+			s.write = NULL;
+		}
+		update(sock, s);
+	}
+	SDL_mutexV(mMutex);
+}
+
+int SDLCALL EpollEngine::threadFunc(void* arg) {
+	((EpollEngine*)arg)->loop();
+	return 0;
+}
+
+void EpollEngine::loop() {
+	epoll_event events[MAX_EVENTS];
+	Completions c;
+	int timeout = -1;
+	while(true) {
+		int n = epoll_wait(mEpoll, events, MAX_EVENTS, timeout);
+		if(n < 0) {
+			if(errno == EINTR)
+				continue;
+			LOG("EpollEngine: epoll_wait failed. error code: %i\n", errno);
+			DEBIG_PHAT_ERROR;
+		}
+		SDL_mutexP(mMutex);
+		if(mStopping) {
+			SDL_mutexV(mMutex);
+			return;
+		}
+		for(int i=0; i<n; i++) {
+			MoSyncSocket sock = events[i].data.fd;
+			if(sock == mWake) {
+				uint64_t count;
+				DEBUG_ASSERT(::read(mWake, &count, sizeof(count)) == sizeof(count));
+				continue;
+			}
+			//the operations may have been canceled since epoll_wait returned.
+			SocketMap::iterator itr = mSockets.find(sock);
+			if(itr == mSockets.end())
+				continue;
+			Socket& s(itr->second);
+			//errors and hangups are reported by the socket calls.
+			int ready = events[i].events;
+			if(ready & (EPOLLERR | EPOLLHUP))
+				ready |= EPOLLIN | EPOLLOUT;
+			int result;
+			if(s.read && (ready & EPOLLIN) && perform(sock, *s.read, result)) {
+				complete(s.read, result);
+				delete s.read;
+				s.read = NULL;
+			}
+			if(s.write && (ready & EPOLLOUT) && perform(sock, *s.write, result)) {
+				complete(s.write, result);
+				delete s.write;
+				s.write = NULL;
+			}
+			update(sock, s);
+		}
+		c.swap(mDone);
+		SDL_mutexV(mMutex);
+		finish(c);
+
+		//Ops may have started new operations that completed at once.
+		SDL_mutexP(mMutex);
+		timeout = mDone.empty() ? -1 : 0;
+		SDL_mutexV(mMutex);
+	}
+}
+
+#endif	//USE_EPOLL_CONNECTIONS && LINUX
@@ -0,0 +1,110 @@
+/* Copyright (C) 2009 Mobile Sorcery AB
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License, version 2, as published by
+the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING.  If not, write to the Free
+Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.
+*/
+
+#ifndef EPOLLENGINE_H
+#define EPOLLENGINE_H
+
+#include <vector>
+#include <SDL/SDL.h>
+
+#include <helpers/hash_map.h>
+#include <net/net.h>
+
+#include "ThreadPoolImpl.h"
+
+/// Runs socket reads and writes for any number of sockets on one thread,
+/// using epoll. Linux only.
+///
+/// Operations are first tried at once, without blocking. Those that would block
+/// wait in epoll until the socket is ready. The sockets themselves are left in
+/// blocking mode, so other code can still use them as before.
+/// Each socket can have one read and one write in progress.
+/// There is no accept: the runtime's only servers are Bluetooth SPP servers,
+/// whose sockets are hidden in BtSppServer, so maAccept stays on the ThreadPool.
+class EpollEngine {
+public:
+	/// Called when an operation is done.
+	class Op {
+	public:
+		virtual ~Op() {}
+
+		/// Called once, on the engine thread, with >0 or a CONNERR code.
+		/// Operations still pending in close() complete on the thread that called it.
+		/// New operations may be started from here.
+		/// The engine deletes the Op afterwards.
+		virtual void complete(int result) = 0;
+	};
+
+	EpollEngine();
+	~EpollEngine();
+
+	/// Starts the engine thread. Returns false if epoll isn't available.
+	bool start();
+
+	/// Cancels all operations and stops the engine thread.
+	void close();
+
+	/// Reads 1 to \a max bytes. Same results as TcpConnection::read().
+	void read(MoSyncSocket sock, void* dst, int max, Op* op);
+
+	/// Like read(), and stores the sender's address in \a src.
+	void readFrom(MoSyncSocket sock, void* dst, int max, MAConnAddr& src, Op* op);
+
+	/// Writes all \a len bytes. Same results as InetConnection::write().
+	void write(MoSyncSocket sock, const void* src, int len, Op* op);
+
+	/// Sends a datagram to \a dst. Same results as UdpConnection::writeTo().
+	void writeTo(MoSyncSocket sock, const void* src, int len, const MAConnAddr& dst, Op* op);
+
+	/// Completes all waiting operations on \a sock with CONNERR_CANCELED.
+	/// Must be called before the socket is closed.
+	void cancel(MoSyncSocket sock);
+
+	/// Number of operations that completed at once, and that had to wait.
+	int immediate() const { return mImmediate; }
+	int waited() const { return mWaited; }
+
+private:
+	struct Pending;
+	struct Socket {
+		Pending* read;
+		Pending* write;
+		int events;	//registered with epoll
+	};
+	typedef hash_map<MoSyncSocket, Socket> SocketMap;
+	typedef std::vector<std::pair<Op*, int> > Completions;
+
+	static bool perform(MoSyncSocket sock, Pending& p, int& result);
+	void submit(MoSyncSocket sock, Pending* p);
+	void complete(Pending* p, int result);
+	void update(MoSyncSocket sock, Socket& s);
+	void wake();
+	void loop();
+	static int SDLCALL threadFunc(void* arg);
+	static void finish(Completions& c);
+
+	int mEpoll;
+	int mWake;	//eventfd that stops the loop
+	bool mRunning, mStopping;
+	MoSyncThread mThread;
+	SDL_mutex* mMutex;
+	SocketMap mSockets;
+	Completions mDone;	//waiting for the engine thread
+	int mImmediate, mWaited;
+};
+
+#endif	//EPOLLENGINE_H
@@ -0,0 +1,250 @@
+/* Copyright (C) 2009 Mobile Sorcery AB
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License, version 2, as published by
+the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING.  If not, write to the Free
+Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.
+*/
+
+#include "../config_platform.h"
+
+#include <core/Core.h>
+
+#ifdef USE_SAMPLING_PROFILER
+
+#include <stdio.h>
+#include <set>
+#include <algorithm>
+
+#include <core/sld.h>
+#include <helpers/helpers.h>
+#include <helpers/atomic.h>
+
+#include "Profiler.h"
+
+using namespace std;
+
+//deeper stacks keep their innermost frames.
+#define MAX_FRAMES 256
+
+Profiler::Profiler() : mInterval(1), mStopping(0), mRunning(false),
+	mStartTime(0), mStopTime(0), mCore(NULL), mSamples(0), mUnresolved(0), mTruncated(0)
+{
+	mMutex = SDL_CreateMutex();
+	DEBUG_ASSERT(mMutex != NULL);
+}
+
+Profiler::~Profiler() {
+	stop();
+	SDL_DestroyMutex(mMutex);
+}
+
+void Profiler::start(const char* file, int intervalMs) {
+	DEBUG_ASSERT(!mRunning);
+	mFile = file;
+	mInterval = MAX(intervalMs, 1);
+	mStopping = 0;
+	mRunning = true;
+	mStartTime = SDL_GetTicks();
+	mThread.start(threadFunc, this);
+	LOG("Profiler sampling every %i ms to %s\n", mInterval, file);
+}
+
+void Profiler::stop() {
+	if(!mRunning)
+		return;
+	atomicStore(&mStopping, 1);
+	mThread.join();
+	mRunning = false;
+	mStopTime = SDL_GetTicks();
+
+	//callers and callees are counted once per sample, however often they repeat in it.
+	Functions functions;
+	for(map<Stack, int>::const_iterator itr = mStacks.begin(); itr != mStacks.end(); itr++) {
+		const Stack& stack(itr->first);
+		int count = itr->second;
+		functions[stack.back()].self += count;
+		set<int> seen;
+		set<pair<int, int> > seenCalls;
+		for(size_t i=0; i<stack.size(); i++) {
+			if(seen.insert(stack[i]).second)
+				functions[stack[i]].total += count;
+			if(i > 0 && seenCalls.insert(make_pair(stack[i-1], stack[i])).second) {
+				functions[stack[i-1]].callees[stack[i]] += count;
+				functions[stack[i]].callers[stack[i-1]] += count;
+			}
+		}
+	}
+	writeReport(functions);
+	writeFolded();
+	LOG("Profiler wrote %i samples to %s\n", mSamples, mFile.c_str());
+}
+
+void Profiler::attach(Core::VMCore* core) {
+	SDL_mutexP(mMutex);
+	mCore = core;
+	SDL_mutexV(mMutex);
+}
+
+void Profiler::detach() {
+	attach(NULL);
+}
+
+int SDLCALL Profiler::threadFunc(void* arg) {
+	((Profiler*)arg)->loop();
+	return 0;
+}
+
+void Profiler::loop() {
+	while(!atomicLoad(&mStopping)) {
+		MoSyncThread::sleep(mInterval);
+		SDL_mutexP(mMutex);
+		if(mCore != NULL)
+			sample();
+		SDL_mutexV(mMutex);
+	}
+}
+
+void Profiler::sample() {
+	int frames[MAX_FRAMES + 1];
+	int n = Core::SampleFakeCallStack(mCore, frames, MAX_FRAMES);
+	if(n == MAX_FRAMES && Core::GetFakeCallStackDepth(mCore) > MAX_FRAMES)
+		mTruncated++;
+	int ip = Core::GetIp(mCore);
+	frames[n++] = ip;
+
+	//return addresses point past the call, which may be past the end of the caller.
+	Stack stack(n);
+	for(int i=0; i<n-1; i++) {
+		stack[i] = functionAt(frames[i] - 1);
+	}
+	stack[n-1] = functionAt(ip);
+	if(mapFunctionStart(ip) < 0)
+		mUnresolved++;
+
+	mStacks[stack]++;
+	mIps[ip]++;
+	mSamples++;
+}
+
+int Profiler::functionAt(int address) {
+	int start = mapFunctionStart(address);
+	return start >= 0 ? start : address;
+}
+
+string Profiler::name(int function) {
+	const char* n = mapFunction(function);
+	if(n != NULL)
+		return n;
+	char buf[16];
+	sprintf(buf, "0x%x", function);
+	return buf;
+}
+
+struct GreaterCount {
+	template<class P> bool operator()(const P& a, const P& b) const {
+		return a.second > b.second;
+	}
+};
+
+//sorted by count, highest first.
+template<class Map> static vector<pair<typename Map::key_type, int> > byCount(const Map& m) {
+	vector<pair<typename Map::key_type, int> > v(m.begin(), m.end());
+	stable_sort(v.begin(), v.end(), GreaterCount());
+	return v;
+}
+
+void Profiler::writeReport(const Functions& functions) {
+	FILE* file = fopen(mFile.c_str(), "w");
+	if(!file) {
+		LOG("Profiler couldn't open %s for writing.\n", mFile.c_str());
+		return;
+	}
+	int samples = MAX(mSamples, 1);
+	fprintf(file, "%i samples in %u ms, %i unresolved, %i truncated\n\n", mSamples,
+		mStopTime - mStartTime, mUnresolved, mTruncated);
+
+	vector<pair<int, int> > flat;
+	for(Functions::const_iterator itr = functions.begin(); itr != functions.end(); itr++) {
+		flat.push_back(make_pair(itr->first, itr->second.self));
+	}
+	stable_sort(flat.begin(), flat.end(), GreaterCount());
+	fprintf(file, "Flat profile:\n");
+	fprintf(file, " self %%    self total %%   total  function\n");
+	for(size_t i=0; i<flat.size() && flat[i].second > 0; i++) {
+		const Function& f(functions.find(flat[i].first)->second);
+		fprintf(file, "%6.2f %7i %7.2f %7i  %s\n", f.self * 100.0 / samples, f.self,
+			f.total * 100.0 / samples, f.total, name(flat[i].first).c_str());
+	}
+
+	//lines get the samples of every address that maps to them.
+	map<pair<string, int>, int> lineCounts;
+	map<pair<string, int>, int> lineFunctions;
+	for(hash_map<int, int>::const_iterator itr = mIps.begin(); itr != mIps.end(); itr++) {
+		int line;
+		string f;
+		if(!mapIp(itr->first, line, f))
+			continue;
+		pair<string, int> key(f, line);
+		lineCounts[key] += itr->second;
+		lineFunctions[key] = functionAt(itr->first);
+	}
+	vector<pair<pair<string, int>, int> > lines = byCount(lineCounts);
+	fprintf(file, "\nHot lines:\n");
+	fprintf(file, " self %%    self  line\n");
+	for(size_t i=0; i<lines.size(); i++) {
+		fprintf(file, "%6.2f %7i  %s:%i  %s\n", lines[i].second * 100.0 / samples, lines[i].second,
+			lines[i].first.first.c_str(), lines[i].first.second,
+			name(lineFunctions[lines[i].first]).c_str());
+	}
+
+	vector<pair<int, int> > totals;
+	for(Functions::const_iterator itr = functions.begin(); itr != functions.end(); itr++) {
+		totals.push_back(make_pair(itr->first, itr->second.total));
+	}
+	stable_sort(totals.begin(), totals.end(), GreaterCount());
+	fprintf(file, "\nCall graph:\n");
+	for(size_t i=0; i<totals.size(); i++) {
+		const Function& f(functions.find(totals[i].first)->second);
+		fprintf(file, "\n%6.2f %7i  %s (self %i)\n", f.total * 100.0 / samples, f.total,
+			name(totals[i].first).c_str(), f.self);
+		vector<pair<int, int> > callers = byCount(f.callers);
+		for(size_t j=0; j<callers.size(); j++) {
+			fprintf(file, "        %7i    from %s\n", callers[j].second, name(callers[j].first).c_str());
+		}
+		vector<pair<int, int> > callees = byCount(f.callees);
+		for(size_t j=0; j<callees.size(); j++) {
+			fprintf(file, "        %7i    to %s\n", callees[j].second, name(callees[j].first).c_str());
+		}
+	}
+	fclose(file);
+}
+
+//one line per distinct stack: "outer;...;inner count", as read by flamegraph.pl.
+void Profiler::writeFolded() {
+	string filename = mFile + ".folded";
+	FILE* file = fopen(filename.c_str(), "w");
+	if(!file) {
+		LOG("Profiler couldn't open %s for writing.\n", filename.c_str());
+		return;
+	}
+	for(map<Stack, int>::const_iterator itr = mStacks.begin(); itr != mStacks.end(); itr++) {
+		const Stack& stack(itr->first);
+		for(size_t i=0; i<stack.size(); i++) {
+			fprintf(file, "%s%s", i ? ";" : "", name(stack[i]).c_str());
+		}
+		fprintf(file, " %i\n", itr->second);
+	}
+	fclose(file);
+}
+
+#endif	//USE_SAMPLING_PROFILER
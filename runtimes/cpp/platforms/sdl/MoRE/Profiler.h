@@ -0,0 +1,87 @@
+/* Copyright (C) 2009 Mobile Sorcery AB
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License, version 2, as published by
+the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING.  If not, write to the Free
+Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.
+*/
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <SDL/SDL.h>
+
+#include <core/Core.h>
+#include <helpers/hash_map.h>
+
+#include "../ThreadPoolImpl.h"
+
+/// Samples the IP and the fake call stack of a running core on a timer.
+///
+/// The core itself does no extra work for it; the samples are read from its
+/// IP, which UPDATE_IP keeps current, and from the fake call stack.
+/// Addresses are mapped to functions with the SLD loaded by -sld, so that
+/// should be loaded before start(). Without it, the reports show raw addresses.
+class Profiler {
+public:
+	Profiler();
+	~Profiler();
+
+	/// Starts the sampler thread. The reports are written to \a file, and the
+	/// folded stacks to \a file + ".folded", when stop() is called.
+	void start(const char* file, int intervalMs);
+
+	/// Stops sampling and writes the reports. Does nothing if not started.
+	void stop();
+
+	/// Sets the core to sample. The core must be detached before it is deleted,
+	/// and before the SLD is cleared.
+	void attach(Core::VMCore* core);
+	void detach();
+
+private:
+	typedef std::vector<int> Stack;	//function addresses, outermost first
+
+	struct Function {
+		int self, total;
+		std::map<int, int> callers, callees;
+		Function() : self(0), total(0) {}
+	};
+	typedef std::map<int, Function> Functions;
+
+	static int SDLCALL threadFunc(void* arg);
+	void loop();
+	void sample();
+	static int functionAt(int address);
+	static std::string name(int function);
+	void writeReport(const Functions& functions);
+	void writeFolded();
+
+	std::string mFile;
+	int mInterval;
+	volatile int mStopping;
+	bool mRunning;
+	Uint32 mStartTime, mStopTime;
+	MoSyncThread mThread;
+	SDL_mutex* mMutex;
+	Core::VMCore* mCore;	//guarded by mMutex
+
+	//only touched by the sampler thread until it has stopped.
+	int mSamples, mUnresolved, mTruncated;
+	std::map<Stack, int> mStacks;
+	hash_map<int, int> mIps;
+};
+
+#endif	//PROFILER_H
@@ -31,6 +31,9 @@ Software Foundation, 59 Temple Place - Suite 330, Boston, MA
 #endif
 #include <fcntl.h>
 #include <sys/stat.h>
+#ifndef WIN32
+#include <sys/resource.h>
+#endif
 
 #include <core/Core.h>
 #include <core/sld.h>
@@ -49,6 +52,10 @@ Software Foundation, 59 Temple Place - Suite 330, Boston, MA
 #include <core/GdbStub.h>
 #endif
 
+#ifdef USE_SAMPLING_PROFILER
+#include "Profiler.h"
+#endif
+
 #include "Skinning/SkinManager.h"
 #include "Skinning/GenericSkin.h"
 
@@ -60,6 +67,73 @@ static void DeleteCore() {
 	Core::DeleteCore(gCore);
 }
 
+#ifdef USE_SAMPLING_PROFILER
+static Profiler* gProfiler = NULL;
+
+static void StopProfiler() {
+	gProfiler->stop();
+}
+
+#define PROFILER_ATTACH if(gProfiler) gProfiler->attach(gCore)
+#define PROFILER_DETACH if(gProfiler) gProfiler->detach()
+#else
+#define PROFILER_ATTACH
+#define PROFILER_DETACH
+#endif
+
+// Logs how long the initial program load took and how much memory it used.
+static void logLoadStats(Uint32 loadTime) {
+#ifdef WIN32
+	LOG("Program loaded in %i ms.\n", (int)loadTime);
+#else
+	struct rusage usage;
+	long maxRss = 0;
+	if(getrusage(RUSAGE_SELF, &usage) == 0) {
+		maxRss = usage.ru_maxrss;
+#ifdef __APPLE__
+		maxRss /= 1024;	//bytes on Mac OS X, kilobytes elsewhere.
+#endif
+	}
+	LOG("Program loaded in %i ms. Peak RSS: %li KiB.\n", (int)loadTime, maxRss);
+#endif
+}
+
+// Core options from the command line.
+#ifdef USE_THREADED_DISPATCH
+static bool gThreadedDispatch = true;
+#endif
+#ifdef USE_X64_RECOMPILER
+static bool gRecompile = true;
+#endif
+#ifdef USE_SUPERINSTRUCTIONS
+static bool gSuperinstructions = true;
+#endif
+#ifdef USE_SYSCALL_INTRINSICS
+static bool gIntrinsics = true;
+#endif
+#ifdef USE_MAPPED_PROGRAM
+static bool gMapProgram = false;
+#endif
+
+// Gives a new core the options from the command line. Call before LoadVMApp.
+static void applyCoreOptions(Core::VMCore* core) {
+#ifdef USE_THREADED_DISPATCH
+	core->mThreadedDispatch = gThreadedDispatch;
+#endif
+#ifdef USE_SUPERINSTRUCTIONS
+	core->mSuperinstructions = gSuperinstructions;
+#endif
+#ifdef USE_X64_RECOMPILER
+	core->mRecompile = gRecompile;
+#endif
+#ifdef USE_SYSCALL_INTRINSICS
+	core->mIntrinsics = gIntrinsics;
+#endif
+#ifdef USE_MAPPED_PROGRAM
+	core->mMapProgram = gMapProgram;
+#endif
+}
+
 int main2(int argc, char **argv);
 
 #if defined(WIN32) && !defined(_MSC_VER)
@@ -105,6 +179,10 @@ int main2(int argc, char **argv) {
 #ifdef EMULATOR
 	bool allowDivZero = false;
 #endif
+#ifdef USE_SAMPLING_PROFILER
+	const char* profileFile = NULL;
+	int profileInterval = 1;
+#endif
 
 	//NOTE: could have a -no-console option used by MoBuild, otherwise use a console for error output.
 	//would be nice to detect whether launched from command line or from graphical shell.
@@ -143,6 +221,25 @@ int main2(int argc, char **argv) {
 				"  -resmem <bytes:integer>                set resource memory limit.\n"
 				"  -gdb                                   start gdb stub.\n"
 				"  -x <filename:string>                   load extension config file.\n"
+#ifdef USE_SAMPLING_PROFILER
+				"  -profile <filename:string>             sample the running program and write a profile on exit.\n"
+				"                                         use with -sld. stacks for flamegraph.pl go to <filename>.folded.\n"
+				"  -profileinterval <ms:integer>          time between samples (default: 1).\n"
+#endif
+#ifdef USE_X64_RECOMPILER
+				"  -dispatch <switch|threaded|recompiler> choose the core (default: recompiler).\n"
+#elif defined(USE_THREADED_DISPATCH)
+				"  -dispatch <switch|threaded>            choose the interpreter core (default: threaded).\n"
+#endif
+#ifdef USE_SUPERINSTRUCTIONS
+				"  -nofuse                                don't fuse instruction pairs in the threaded core.\n"
+#endif
+#ifdef USE_SYSCALL_INTRINSICS
+				"  -nointrinsics                          run the soft-float and memory syscalls as ordinary syscalls.\n"
+#endif
+#ifdef USE_MAPPED_PROGRAM
+				"  -mapprogram                            map the program file instead of copying it. don't rebuild it while MoRE runs.\n"
+#endif
 #ifdef EMULATOR
 				"  -allowdivzero                          allow floating-point division by zero. this produces ieee standard results.\n"
 				"  -timeout <seconds:integer>             close the program if it runs longer than the timeout.\n"
@@ -251,6 +348,67 @@ int main2(int argc, char **argv) {
 		} else if(strcmp(argv[i], "-gdb")==0) {
 			gdb = true;
 #endif
+#if defined(USE_THREADED_DISPATCH) || defined(USE_X64_RECOMPILER)
+		} else if(strcmp(argv[i], "-dispatch")==0) {
+			i++;
+			if(i>=argc) {
+				LOG("not enough parameters for -dispatch");
+				return 1;
+			}
+#ifdef USE_X64_RECOMPILER
+			gRecompile = strcmp(argv[i], "recompiler") == 0;
+#endif
+			if(strcmp(argv[i], "switch") == 0) {
+#ifdef USE_THREADED_DISPATCH
+				gThreadedDispatch = false;
+#endif
+			} else if(strcmp(argv[i], "threaded") == 0) {
+#ifdef USE_THREADED_DISPATCH
+				gThreadedDispatch = true;
+#else
+				LOG("threaded dispatch is not compiled in\n");
+				return 1;
+#endif
+#ifdef USE_X64_RECOMPILER
+			} else if(strcmp(argv[i], "recompiler") == 0) {
+#ifdef USE_THREADED_DISPATCH
+				//whatever the recompiler bails out on runs on the threaded core.
+				gThreadedDispatch = true;
+#endif
+#endif
+			} else {
+				LOG("unknown dispatch mode: \"%s\"\n", argv[i]);
+				return 1;
+			}
+#endif
+#ifdef USE_SUPERINSTRUCTIONS
+		} else if(strcmp(argv[i], "-nofuse")==0) {
+			gSuperinstructions = false;
+#endif
+#ifdef USE_SYSCALL_INTRINSICS
+		} else if(strcmp(argv[i], "-nointrinsics")==0) {
+			gIntrinsics = false;
+#endif
+#ifdef USE_MAPPED_PROGRAM
+		} else if(strcmp(argv[i], "-mapprogram")==0) {
+			gMapProgram = true;
+#endif
+#ifdef USE_SAMPLING_PROFILER
+		} else if(strcmp(argv[i], "-profile")==0) {
+			i++;
+			if(i>=argc) {
+				LOG("not enough parameters for -profile");
+				return 1;
+			}
+			profileFile = argv[i];
+		} else if(strcmp(argv[i], "-profileinterval")==0) {
+			i++;
+			if(i>=argc) {
+				LOG("not enough parameters for -profileinterval");
+				return 1;
+			}
+			profileInterval = atoi(argv[i]);
+#endif
 #ifdef EMULATOR
 		} else if(strcmp(argv[i], "-allowdivzero")==0) {
 			allowDivZero = true;
@@ -278,6 +436,18 @@ int main2(int argc, char **argv) {
 	}
 #endif
 
+#ifdef USE_SAMPLING_PROFILER
+	if(profileFile != NULL) {
+#ifdef USE_X64_RECOMPILER
+		//recompiled code doesn't update IP or the fake call stack.
+		gRecompile = false;
+#endif
+		if(sldFile == NULL) {
+			LOG("No -sld given; the profile will show addresses.\n");
+		}
+	}
+#endif
+
 	Base::Syscall *syscall;
 
 #ifdef __USE_FULLSCREEN__
@@ -293,12 +463,23 @@ int main2(int argc, char **argv) {
 #ifdef GDB_DEBUG
 	gCore->mGdbOn = gdb;
 #endif
+	applyCoreOptions(gCore);
 #ifdef EMULATOR
 	syscall->mAllowDivZero = allowDivZero;
 #endif
+	Uint32 loadStart = SDL_GetTicks();
 	if(!Core::LoadVMApp(gCore, programFile, resourceFile)) {
 		BIG_PHAT_ERROR(ERR_PROGRAM_LOAD_FAILED);
 	}
+	logLoadStats(SDL_GetTicks() - loadStart);
+
+#ifdef USE_SAMPLING_PROFILER
+	if(profileFile != NULL) {
+		gProfiler = new Profiler;
+		gProfiler->start(profileFile, profileInterval);
+		PROFILER_ATTACH;
+	}
+#endif
 
 	if(xFile) {
 		loadExtensions(xFile);
@@ -309,12 +490,18 @@ int main2(int argc, char **argv) {
 	atexit(Core::closeDebugger);
 #endif
 	atexit(DeleteCore);
+#ifdef USE_SAMPLING_PROFILER
+	//runs before DeleteCore.
+	if(gProfiler)
+		atexit(StopProfiler);
+#endif
 
 	while(1) {
 		try {
 			Core::Run2(gCore);
 
 			if(gReloadHandle > 0) {
+				PROFILER_DETACH;
 #ifdef FAKE_CALL_STACK
 				clearSLD();
 #endif
@@ -323,6 +510,7 @@ int main2(int argc, char **argv) {
 				Base::Stream* stream = Base::gSyscall->resources.extract_RT_BINARY(gReloadHandle);
 				delete gCore;
 				gCore = Core::CreateCore(*syscall);
+				applyCoreOptions(gCore);
 				bool res = Core::LoadVMApp(gCore, *stream);
 				delete stream;
 				gReloadHandle = 0;
@@ -330,15 +518,19 @@ int main2(int argc, char **argv) {
 					BIG_PHAT_ERROR(ERR_PROGRAM_LOAD_FAILED);
 					return 1;
 				}	//if
+				PROFILER_ATTACH;
 			}	//if
 		}	catch(ReloadException) {
 			LOG("Caught ReloadException.\n");
+			PROFILER_DETACH;
 			delete gCore;
 			gCore = Core::CreateCore(*syscall);
+			applyCoreOptions(gCore);
 			if(!Core::LoadVMApp(gCore, programFile, resourceFile)) {
 				BIG_PHAT_ERROR(ERR_PROGRAM_LOAD_FAILED);
 				return 1;
 			}
+			PROFILER_ATTACH;
 		}
 	}
 }
@@ -17,9 +17,12 @@ work.instance_eval do
 		"#{BD}/runtimes/cpp/core/sld.cpp",
 		"#{BD}/runtimes/cpp/core/GdbStub.cpp",
 		"#{BD}/runtimes/cpp/core/extensions.cpp",
+		"#{BD}/runtimes/cpp/core/disassembler.cpp",
+		"#{BD}/runtimes/cpp/core/Recompiler/X64Assembler.cpp",
+		"#{BD}/runtimes/cpp/core/Recompiler/X64Recompiler.cpp",
 		"#{BD}/intlibs/helpers/intutil.cpp",
 		]
-	@EXTRA_INCLUDES += ["../../.."]
+	@EXTRA_INCLUDES += ["../../..", "../../../core"]
 	@SPECIFIC_CFLAGS = { "Core.cpp" => " -DHAVE_IOCTL_ELLIPSIS" }
 	if(!@GCC_IS_V4 && CONFIG=="debug")
 		@SPECIFIC_CFLAGS["Core.cpp"] += " -Wno-unreachable-code"
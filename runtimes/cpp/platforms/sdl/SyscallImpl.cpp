@@ -130,7 +130,9 @@ namespace Base {
 	static MAPoint2dNative gCameraViewFinderPoint, gCameraViewFinderDirection;
 	static SDL_TimerID gCameraViewFinderTimer = NULL;
 
-	static CircularFifo<MAEvent, EVENT_BUFFER_SIZE> gEventFifo;
+	//other threads send their events through FE_PushEvent,
+	//so the main thread is both producer and consumer.
+	static SpscFifo<MAEvent, EVENT_BUFFER_SIZE> gEventFifo;
 	static bool gEventOverflow = false, gClosing = false;
 
 	static SDL_TimerID gTimerId = NULL;
@@ -555,17 +557,41 @@ namespace Base {
 	SDL_Surface* Syscall::loadImage(MemStream& s) {
 		int size;
 		TEST(s.length(size));
-		SDL_RWops* rwops = SDL_RWFromConstMem(s.ptr(), size);
+		SDL_Surface* surf = decodeImage(s.ptr(), size);
+		MYASSERT(surf, SDLERR_IMAGE_LOAD_FAILED);
+		surf = convertImage(surf);
+		MYASSERT(surf, SDLERR_IMAGE_LOAD_FAILED);
+		return surf;
+	}
+
+	SDL_Surface* Syscall::decodeImage(const void* data, int size) {
+		SDL_RWops* rwops = SDL_RWFromConstMem(data, size);
 		//SDL_Surface* surf = IMG_LoadPNG_RW(rwops);
 		//if(!surf) IMG_LoadJPG_RW(rwops);
 		SDL_Surface* surf = IMG_Load_RW(rwops, 0);
-		MYASSERT(surf, SDLERR_IMAGE_LOAD_FAILED);
-		surf = SDL_DisplayFormatAlpha(surf);
 		SDL_FreeRW(rwops);
-
 		return surf;
 	}
 
+	SDL_Surface* Syscall::convertImage(SDL_Surface* decoded) {
+		// uses the video surface's format, so it stays on the main thread.
+		SDL_Surface* display = SDL_DisplayFormatAlpha(decoded);
+		SDL_FreeSurface(decoded);
+		return display;
+	}
+
+	void Syscall::initImageDecoders() {
+		// SDL_image 1.2.8 and later load libjpeg, libpng and the others on first use.
+		// Older versions are linked to them and have nothing to load.
+#define SDL_IMAGE_AT_LEAST(patch) (SDL_IMAGE_MAJOR_VERSION > 1 ||\
+	SDL_IMAGE_MINOR_VERSION > 2 || SDL_IMAGE_PATCHLEVEL >= (patch))
+#if SDL_IMAGE_AT_LEAST(11)
+		IMG_Init(IMG_INIT_JPG | IMG_INIT_PNG | IMG_INIT_TIF | IMG_INIT_WEBP);
+#elif SDL_IMAGE_AT_LEAST(8)
+		IMG_Init(IMG_INIT_JPG | IMG_INIT_PNG | IMG_INIT_TIF);
+#endif
+	}
+
 	SDL_Surface* Syscall::loadSprite(SDL_Surface* surface, ushort left, ushort top, ushort width, ushort height, ushort cx, ushort cy) {
 		SDL_Surface* surf = SDL_CreateRGBSurface(SDL_SWSURFACE, surface->w, surface->h, surface->format->BitsPerPixel,
 			surface->format->Rmask, surface->format->Gmask, surface->format->Bmask, surface->format->Amask);
@@ -1024,7 +1050,9 @@ namespace Base {
 				{
 					LOGDT("FE_ADD_EVENT");
 					MAEvent* pe = (MAEvent*)event.user.data1;
-					gEventFifo.put(*pe);
+					if(!gEventFifo.put(*pe)) {
+						LOG("EventBuffer overflow! Lost event type %i\n", pe->type);
+					}
 					delete pe;
 				}
 				break;
@@ -1685,6 +1713,12 @@ namespace Base {
 	uint Base::size_RT_IMAGE(SDL_Surface* r) {
 		return sizeof(SDL_Surface) + r->pitch * r->h;
 	}
+#ifdef USE_LAZY_RESOURCES
+	uint Base::size_RT_IMAGE(int width, int height) {
+		//images are converted to 32 bits per pixel.
+		return sizeof(SDL_Surface) + (uint)width * 4 * height;
+	}
+#endif
 	SYSCALL(int, maFreeObjectMemory()) {
 		return maTotalObjectMemory() - gSyscall->resources.getResmem();
 	}
@@ -2187,6 +2221,8 @@ namespace Base {
 			maIOCtl_syscall_case(maFileWriteFromData);
 			maIOCtl_syscall_case(maFileReadToData);
 
+			maIOCtl_syscall_case(maConcatData);
+
 			maIOCtl_syscall_case(maFileTell);
 			maIOCtl_syscall_case(maFileSeek);
 
@@ -2203,6 +2239,8 @@ namespace Base {
 
 			maIOCtl_case(maDBOpen);
 			maIOCtl_case(maDBClose);
+			maIOCtl_case(maDBBeginTransaction);
+			maIOCtl_case(maDBCommitTransaction);
 			maIOCtl_case(maDBExecSQL);
 			maIOCtl_case(maDBExecSQLParams);
 			maIOCtl_case(maDBCursorDestroy);
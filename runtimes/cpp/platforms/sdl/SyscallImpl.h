@@ -24,6 +24,15 @@ SDL_Surface* loadImage(MemStream& s);
 SDL_Surface* loadSprite(SDL_Surface* surface, ushort left, ushort top,
 	ushort width, ushort height, ushort cx, ushort cy);
 
+public:
+//decodes an image, without converting it to the display format.
+//returns NULL on failure. may be called from any thread after initImageDecoders().
+static SDL_Surface* decodeImage(const void* data, int size);
+//converts a decoded image to the display format and frees it. returns NULL on failure.
+static SDL_Surface* convertImage(SDL_Surface* decoded);
+//loads the image format libraries, which SDL_image otherwise does on first use.
+static void initImageDecoders();
+
 public:
 		struct STARTUP_SETTINGS {
 			STARTUP_SETTINGS ( ) {
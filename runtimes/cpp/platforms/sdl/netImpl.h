@@ -46,6 +46,7 @@ public:
 	virtual int read(void* dst, int max);
 	virtual int write(const void* src, int len);
 	virtual void close();
+	InetConnection* inet() { return NULL; }	//the socket carries encrypted data
 private:
 	SSL* mSession;
 	enum State { eIdle, eInit, eHandshook } mState;
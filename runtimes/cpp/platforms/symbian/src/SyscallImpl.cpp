@@ -1606,6 +1606,8 @@ SYSCALL(longlong, maIOCtl(int function, int a, int b, int c)) {
 	maIOCtl_syscall_case(maFileWriteFromData);
 	maIOCtl_syscall_case(maFileReadToData);
 
+	maIOCtl_syscall_case(maConcatData);
+
 	maIOCtl_syscall_case(maFileTell);
 	maIOCtl_syscall_case(maFileSeek);
 
@@ -35,27 +35,8 @@ namespace AudioEngine {
 
 	CSoundServer soundServer;
 
-	static int gTempBuffer[DEFAULT_AUDIOBUF_SAMPLES*2];
-
 	static void soundCallback(void *buf,long len) {
-		int numSamples = len>>2;
-		memset(gTempBuffer, 0, DEFAULT_AUDIOBUF_SAMPLES*2*sizeof(int));
-		for(int i = 0; i < MAX_CHANNELS; i++) {
-			AudioChannel *chnl = gChannels[i]; 
-			if(chnl && chnl->isActive()) {
-				chnl->mix(gTempBuffer, numSamples);
-			}
-		}
-
-		short* dst = (short*)buf;
-		for(int i = 0; i < numSamples<<1; i++) {
-			int sample = gTempBuffer[i];
-			if(sample<-32768) 
-				sample = 32768;
-			else if(sample>=32767) 
-				sample = 32767;
-			*dst++ = (short) (gTempBuffer[i]);
-		}
+		mixAudioChannels((s16*)buf, gChannels, MAX_CHANNELS, len>>2);
 	}
 
 	int getSampleRate() {
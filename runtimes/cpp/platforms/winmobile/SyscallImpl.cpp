@@ -3014,6 +3014,8 @@ retry:
 		maIOCtl_syscall_case(maFileWriteFromData);
 		maIOCtl_syscall_case(maFileReadToData);
 
+		maIOCtl_syscall_case(maConcatData);
+
 		maIOCtl_syscall_case(maFileTell);
 		maIOCtl_syscall_case(maFileSeek);
 
@@ -86,6 +86,54 @@ public class MoSyncDB
 		}
 	}
 
+	/**
+	 * Begin a transaction.
+	 * @param databaseHandle Handle to the database.
+	 * @return MA_DB_OK on success, MA_DB_ERROR on error.
+	 */
+	public int maDBBeginTransaction(int databaseHandle)
+	{
+		if (!hasDatabase(databaseHandle))
+		{
+			return MA_DB_ERROR;
+		}
+
+		try
+		{
+			getDatabase(databaseHandle).beginTransaction();
+			return MA_DB_OK;
+		}
+		catch (SQLiteException ex)
+		{
+			logStackTrace(ex);
+			return MA_DB_ERROR;
+		}
+	}
+
+	/**
+	 * Commit the transaction begun by maDBBeginTransaction.
+	 * @param databaseHandle Handle to the database.
+	 * @return MA_DB_OK on success, MA_DB_ERROR on error.
+	 */
+	public int maDBCommitTransaction(int databaseHandle)
+	{
+		if (!hasDatabase(databaseHandle))
+		{
+			return MA_DB_ERROR;
+		}
+
+		try
+		{
+			getDatabase(databaseHandle).commitTransaction();
+			return MA_DB_OK;
+		}
+		catch (SQLiteException ex)
+		{
+			logStackTrace(ex);
+			return MA_DB_ERROR;
+		}
+	}
+
 	/**
 	 * Executes an SQL statement. If the statement returns a
 	 * query result, a cursor handle is returned.
@@ -638,6 +686,22 @@ public class MoSyncDB
 			}
 		}
 
+		/**
+		 * Same as "BEGIN" in SQL, so that "ROLLBACK"
+		 * also works as it does on the other platforms.
+		 */
+		public void beginTransaction()
+			throws SQLException
+		{
+			mDB.execSQL("BEGIN");
+		}
+
+		public void commitTransaction()
+			throws SQLException
+		{
+			mDB.execSQL("COMMIT");
+		}
+
 		public MoCursor execQuery(String sql, Object[] params)
 			throws SQLException
 		{
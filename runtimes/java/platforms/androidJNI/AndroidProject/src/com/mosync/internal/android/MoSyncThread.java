@@ -5637,6 +5637,16 @@ public class MoSyncThread extends Thread
 		return mMoSyncDB.maDBClose(databaseHandle);
 	}
 
+	int maDBBeginTransaction(int databaseHandle)
+	{
+		return mMoSyncDB.maDBBeginTransaction(databaseHandle);
+	}
+
+	int maDBCommitTransaction(int databaseHandle)
+	{
+		return mMoSyncDB.maDBCommitTransaction(databaseHandle);
+	}
+
 	int maDBExecSQL(int databaseHandle, String sql)
 	{
 		return mMoSyncDB.maDBExecSQL(databaseHandle, sql);
@@ -0,0 +1,20 @@
+#compare the switch and threaded interpreter cores of MoRE
+#on the linpack and stropbench benchmarks.
+#MoRE must be built with USE_THREADED_DISPATCH defined in config_platform.h.
+#set MODES="switch threaded recompiler" to include the x86-64 recompiler,
+#which also needs USE_X64_RECOMPILER.
+#results are taken from the log.txt written by each run.
+
+for BENCH in linpack stropbench
+do
+	cd ../$BENCH/mosync/
+	./workfile_more.rb CONFIG=
+	for MODE in ${MODES:-switch threaded}
+	do
+		DISPATCH=$MODE ./workfile_more.rb run CONFIG=
+		echo "$BENCH, $MODE dispatch:"
+		grep -E "MFLOPS|KSTROPS|^ +[0-9]" log.txt
+		mv log.txt log_$MODE.txt
+	done
+	cd ../../benchmark_suites/
+done
@@ -0,0 +1,98 @@
+/*
+Copyright (C) 2011 MoSync AB
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License,
+version 2, as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA 02110-1301, USA.
+
+/**
+ * @file main.cpp
+ *
+ * Downloads of unknown length with MAUtil::Downloader.
+ *
+ * Run server.rb on the host first. It serves a download of the given
+ * size without a Content-Length header, so the Downloader reads it in
+ * chunks and puts them together when the server closes the connection.
+ * Each run prints its time, its throughput and how many reads it took.
+ */
+
+#include <ma.h>
+#include <conprint.h>
+#include <MAUtil/Moblet.h>
+#include <MAUtil/Downloader.h>
+
+using namespace MAUtil;
+
+#define URL "http://localhost:5006/"
+#define RUNS 3
+
+class DownloadBench : public Moblet, private DownloadListener {
+public:
+	DownloadBench() : mRun(0) {
+		printf("Downloader, unknown length, %s\n", URL);
+		mDownloader.addDownloadListener(this);
+		start();
+	}
+
+	void keyPressEvent(int keyCode, int nativeCode) {
+		if(keyCode == MAK_BACK || keyCode == MAK_0)
+			close();
+	}
+
+private:
+	void start() {
+		mReads = 0;
+		mStart = maGetMilliSecondCount();
+		int res = mDownloader.beginDownloading(URL);
+		if(res <= 0)
+			done("beginDownloading", res);
+	}
+
+	void notifyProgress(Downloader* dl, int downloadedBytes, int totalBytes) {
+		mReads++;
+	}
+
+	void finishedDownloading(Downloader* dl, MAHandle data) {
+		int time = maGetMilliSecondCount() - mStart;
+		int size = maGetDataSize(data);
+		printf("%i bytes: %i ms, %i KB/s, %i reads\n", size, time,
+			time > 0 ? (int)((long long)size * 1000 / 1024 / time) : 0, mReads);
+		maDestroyPlaceholder(data);
+		if(++mRun < RUNS)
+			start();
+		else
+			done("Done", 0);
+	}
+
+	void downloadCancelled(Downloader* dl) {
+		done("cancelled", 0);
+	}
+
+	void error(Downloader* dl, int code) {
+		done("error", code);
+	}
+
+	void done(const char* what, int code) {
+		printf("%s %i. Press any key to exit.\n", what, code);
+	}
+
+	Downloader mDownloader;
+	int mRun;
+	int mStart;
+	int mReads;
+};
+
+extern "C" int MAMain() {
+	Moblet::run(new DownloadBench());
+	return 0;
+}
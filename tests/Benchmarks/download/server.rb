@@ -0,0 +1,34 @@
+#!/usr/bin/ruby
+
+# Serves a download without a Content-Length header, for main.cpp.
+# The end of the body is the end of the connection, as in HTTP/1.0.
+# usage: server.rb [megabytes, default 100]
+
+require 'socket'
+
+PORT = 5006
+size = (ARGV[0] || 100).to_i * 1024 * 1024
+block = (0...65536).map { |i| (i & 0xff).chr }.join
+
+server = TCPServer.new(PORT)
+puts "Serving #{size} bytes on port #{PORT}"
+loop do
+	client = server.accept
+	Thread.new(client) do |c|
+		begin
+			while (line = c.gets) && line != "\r\n"
+			end
+			c.write("HTTP/1.0 200 OK\r\nContent-Type: application/octet-stream\r\nConnection: close\r\n\r\n")
+			left = size
+			while left > 0
+				n = left < block.size ? left : block.size
+				c.write(block[0, n])
+				left -= n
+			end
+		rescue => e
+			puts e
+		ensure
+			c.close
+		end
+	end
+end
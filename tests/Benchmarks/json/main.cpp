@@ -0,0 +1,160 @@
+/*
+Copyright (C) 2011 MoSync AB
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License,
+version 2, as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA 02110-1301, USA.
+*/
+
+/**
+ * @file main.cpp
+ *
+ * Parse batches of Wormhole messages with the YAJLDom Value tree,
+ * with a YAJLDom::Document, and with a YAJLDom::ArrayReader.
+ *
+ * A batch is the JSON array of a "ma:" message stream, as sent by
+ * mosync.bridge.sendJSON: PhoneGap calls with a service, an action,
+ * a callback id and an args array, mixed with NativeUI calls with an
+ * args map. Each method parses the batch and, like MessageHandler,
+ * looks at the messageName and one argument of every message. Each
+ * run prints the time per batch and the number of messages it found,
+ * which should be the same for all three.
+ */
+
+#include <ma.h>
+#include <maheap.h>
+#include <mastring.h>
+#include <mavsprintf.h>
+#include <conprint.h>
+#include <MAUtil/String.h>
+
+#include <yajl/YAJLDom.h>
+#include <yajl/YAJLDocument.h>
+
+using namespace MAUtil;
+
+#define TOTAL_MESSAGES 20000
+
+static String makeBatch(int messages) {
+	String batch = "[";
+	char buf[512];
+	for(int i = 0; i < messages; i++) {
+		if(i > 0)
+			batch += ",";
+		if(i % 2 == 0) {
+			sprintf(buf, "{\"messageName\":\"PhoneGap\",\"service\":\"File\","
+				"\"action\":\"readAsText\",\"callbackId\":\"File%i\","
+				"\"args\":[\"/sdcard/data/file%i.txt\",\"UTF-8\","
+				"{\"create\":true,\"exclusive\":false}]}", i, i);
+		} else {
+			sprintf(buf, "{\"messageName\":\"NativeUI\",\"action\":\"maWidgetSetProperty\","
+				"\"callbackId\":\"NativeUI%i\",\"args\":{\"widget\":%i,"
+				"\"property\":\"text\",\"value\":\"Label \\\"%i\\\" \\u00e5\"}}", i, i, i);
+		}
+		batch += buf;
+	}
+	batch += "]";
+	return batch;
+}
+
+static int runValueTree(const String& batch, int& found) {
+	YAJLDom::Value* root = YAJLDom::parse(
+		(const unsigned char*)batch.c_str(), batch.size());
+	if(root == NULL)
+		return 0;
+	for(int i = 0; i < root->getNumChildValues(); i++) {
+		YAJLDom::Value* message = root->getValueByIndex(i);
+		if(message->getValueForKey("messageName")->toString() == "PhoneGap")
+			found += message->getValueForKey("callbackId")->toString().size() > 0;
+		else
+			found += message->getValueForKey("args")->getValueForKey("widget")->toInt() > 0;
+	}
+	YAJLDom::deleteValue(root);
+	return 1;
+}
+
+static int runDocument(YAJLDom::Document& doc, const String& batch, int& found) {
+	if(!doc.parse(batch.c_str(), batch.size()))
+		return 0;
+	YAJLDom::Node root = doc.getRoot();
+	for(int i = 0; i < root.getNumChildValues(); i++) {
+		YAJLDom::Node message = root.getValueByIndex(i);
+		if(message.getValueForKey("messageName").equals("PhoneGap"))
+			found += message.getValueForKey("callbackId").getStringLength() > 0;
+		else
+			found += message.getValueForKey("args").getValueForKey("widget").toInt() > 0;
+	}
+	return 1;
+}
+
+static int runArrayReader(YAJLDom::ArrayReader& reader, const String& batch, int& found) {
+	reader.open(batch.c_str(), batch.size());
+	while(reader.next()) {
+		YAJLDom::Node message = reader.current();
+		if(message.getValueForKey("messageName").equals("PhoneGap"))
+			found += message.getValueForKey("callbackId").getStringLength() > 0;
+		else
+			found += message.getValueForKey("args").getValueForKey("widget").toInt() > 0;
+	}
+	return !reader.hasError();
+}
+
+static void run(int messages) {
+	String batch = makeBatch(messages);
+	int batches = TOTAL_MESSAGES / messages;
+	int times[3];
+	int found[3] = { 0, 0, 0 };
+	int errors = 0;
+
+	int start = maGetMilliSecondCount();
+	for(int i = 0; i < batches; i++)
+		errors += !runValueTree(batch, found[0]);
+	times[0] = maGetMilliSecondCount() - start;
+
+	YAJLDom::Document doc;
+	start = maGetMilliSecondCount();
+	for(int i = 0; i < batches; i++)
+		errors += !runDocument(doc, batch, found[1]);
+	times[1] = maGetMilliSecondCount() - start;
+	int arenaBytes = doc.getByteSize();
+
+	YAJLDom::ArrayReader reader;
+	start = maGetMilliSecondCount();
+	for(int i = 0; i < batches; i++)
+		errors += !runArrayReader(reader, batch, found[2]);
+	times[2] = maGetMilliSecondCount() - start;
+
+	printf("%i messages, %i bytes, arena %i bytes\n", messages, batch.size(), arenaBytes);
+	// microseconds per batch
+	printf("  Value tree %i us, Document %i us, ArrayReader %i us\n",
+		times[0] * 1000 / batches, times[1] * 1000 / batches, times[2] * 1000 / batches);
+	printf("  found %i %i %i, %i errors\n", found[0], found[1], found[2], errors);
+}
+
+extern "C" int MAMain() {
+	printf("YAJL, %i messages per run\n", TOTAL_MESSAGES);
+	run(1);
+	run(4);
+	run(16);
+	run(64);
+
+	printf("Done. Press any key to exit.\n");
+	while(1) {
+		maWait(0);
+		MAEvent e;
+		while(maGetEvent(&e)) {
+			if(e.type == EVENT_TYPE_CLOSE || e.type == EVENT_TYPE_KEY_PRESSED)
+				maExit(0);
+		}
+	}
+}
@@ -0,0 +1,12 @@
+#!/usr/bin/ruby
+
+require File.expand_path(ENV['MOSYNCDIR']+'/rules/mosync_exe.rb')
+
+work = PipeExeWork.new
+work.instance_eval do
+	@SOURCES = ["."]
+	@LIBRARIES = ["mautil", "yajl"]
+	@NAME = "jsonBench"
+end
+
+work.invoke
@@ -0,0 +1,14 @@
+#!/usr/bin/ruby
+
+require File.expand_path(ENV['MOSYNCDIR']+'/rules/mosync_exe.rb')
+
+work = PipeExeWork.new
+work.instance_eval do
+	@SOURCES = []
+	@EXTRA_SOURCEFILES = ["linpack.cpp"]
+	@LIBRARIES = ["mautil", "benchdb"]
+	@NAME = "linpack"
+	@EXTRA_EMUFLAGS = " -noscreen -dispatch #{ENV['DISPATCH'] || 'threaded'}"
+end
+
+work.invoke
@@ -0,0 +1,145 @@
+/*
+Copyright (C) 2011 MoSync AB
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License,
+version 2, as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA 02110-1301, USA.
+*/
+
+/**
+ * @file main.cpp
+ *
+ * Pan and zoom through MapCache.
+ *
+ * A 5x4 tile viewport moves along the same path every run: it pans
+ * east, back west, zooms in two levels and out again. Every visible
+ * tile is looked up, and a miss is "downloaded" by making a small
+ * image and handing it to the cache, as the map source would.
+ * The cache is run with the default byte budget, with a bigger one,
+ * and with the default budget plus a tile store on the local file
+ * system, and each run prints its time and how many tiles missed.
+ */
+
+#include <ma.h>
+#include <maheap.h>
+#include <conprint.h>
+#include <MAUtil/String.h>
+
+#include <MAP/MapCache.h>
+#include <MAP/MapTile.h>
+#include <MAP/MapTileStore.h>
+#include <MAP/OpenStreetMapSource.h>
+
+using namespace MAP;
+
+#define VIEW_WIDTH 5
+#define VIEW_HEIGHT 4
+#define TILE_SIZE 64
+#define ROUNDS 20
+
+static MAUtil::String localPath() {
+	char buffer[1024];
+	int size = maGetSystemProperty("mosync.path.local", buffer, sizeof(buffer));
+	if(size < 0 || size > (int)sizeof(buffer))
+		return "/";
+	return buffer;
+}
+
+static MapTile* makeTile(MapSource* source, int x, int y, int mag) {
+	static int pixels[TILE_SIZE * TILE_SIZE];
+	for(int i = 0; i < TILE_SIZE * TILE_SIZE; i++)
+		pixels[i] = 0xff000000 | (x * 8 + y * 16 + mag * 32 + i);
+	MAHandle image = maCreatePlaceholder();
+	if(maCreateImageRaw(image, pixels, EXTENT(TILE_SIZE, TILE_SIZE), 1) != RES_OK)
+		maPanic(0, "maCreateImageRaw");
+	return new MapTile(source, x, y, mag, LonLat(), image
+		#ifdef StoreCompressedTilesInCache
+		, TILE_SIZE * TILE_SIZE * 4
+		#endif
+		);
+}
+
+// Looks up every tile of the viewport. Returns the number of misses.
+static int showView(MapSource* source, int left, int top, int mag) {
+	MapCache* cache = MapCache::get();
+	int misses = 0;
+	for(int y = top; y < top + VIEW_HEIGHT; y++) {
+		for(int x = left; x < left + VIEW_WIDTH; x++) {
+			if(cache->getTile(source, x, y, mag) == NULL) {
+				cache->tileReceived(source, makeTile(source, x, y, mag));
+				misses++;
+			}
+		}
+	}
+	return misses;
+}
+
+// One pass of the path. Returns the number of misses.
+static int panAndZoom(MapSource* source) {
+	int misses = 0;
+	int x = 100, y = 100, mag = 10;
+	for(int i = 0; i < 12; i++)
+		misses += showView(source, x + i, y, mag);
+	for(int i = 12; i >= 0; i--)
+		misses += showView(source, x + i, y + 1, mag);
+	for(int zoom = 1; zoom <= 2; zoom++)
+		misses += showView(source, (x << zoom) + 2, (y << zoom) + 2, mag + zoom);
+	for(int zoom = 2; zoom >= 0; zoom--)
+		misses += showView(source, (x << zoom) + 2, (y << zoom) + 2, mag + zoom);
+	return misses;
+}
+
+static void run(const char* name, MapSource* source, int byteCapacity, MapTileStore* store) {
+	MapCache* cache = MapCache::get();
+	cache->clear();
+	cache->setByteCapacity(byteCapacity);
+	cache->setTileStore(store);
+
+	int misses = 0;
+	int start = maGetMilliSecondCount();
+	for(int i = 0; i < ROUNDS; i++)
+		misses += panAndZoom(source);
+	int time = maGetMilliSecondCount() - start;
+
+	printf("%s: %i ms, %i misses, %i tiles\n", name, time, misses, cache->size());
+	if(store != NULL)
+		printf("  store: %i tiles, %i bytes\n", store->size(), store->getByteSize());
+
+	cache->setTileStore(NULL);
+	cache->clear();
+}
+
+extern "C" int MAMain() {
+	OpenStreetMapSource source;
+	const int tileBytes = TILE_SIZE * TILE_SIZE * 4;
+
+	printf("MapCache, %ix%i view, %i rounds\n", VIEW_WIDTH, VIEW_HEIGHT, ROUNDS);
+
+	run("40 tiles", &source, 40 * tileBytes, NULL);
+	run("200 tiles", &source, 200 * tileBytes, NULL);
+	{
+		MapTileStore store((localPath() + "mapcacheBench/").c_str(), 400 * tileBytes);
+		run("40 tiles + store", &source, 40 * tileBytes, &store);
+	}
+
+	MapCache::shutdown();
+	printf("Done. Press any key to exit.\n");
+	while(1) {
+		maWait(0);
+		MAEvent e;
+		while(maGetEvent(&e)) {
+			if(e.type == EVENT_TYPE_CLOSE || e.type == EVENT_TYPE_KEY_PRESSED)
+				maExit(0);
+		}
+	}
+}
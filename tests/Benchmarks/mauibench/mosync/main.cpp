@@ -0,0 +1,142 @@
+/*
+Copyright (C) 2011 MoSync AB
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License,
+version 2, as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA 02110-1301, USA.
+*/
+
+/**
+ * @file main.cpp
+ *
+ * Frame times of the MAUI Engine on a screen that is mostly a ListBox.
+ *
+ * Each test makes one kind of change, then repaints, FRAMES times over.
+ * The event loop isn't entered while a test runs, so every frame is
+ * exactly one change and one Engine::repaint().
+ * The last test repaints the whole screen, as every frame used to.
+ */
+
+#include <ma.h>
+#include <conprint.h>
+#include <MAUtil/Moblet.h>
+#include <MAUI/Engine.h>
+#include <MAUI/Screen.h>
+#include <MAUI/ListBox.h>
+#include <MAUI/Label.h>
+
+using namespace MAUtil;
+using namespace MAUI;
+
+#define ROWS 100
+#define ROW_HEIGHT 24
+#define STATUS_HEIGHT 20
+#define FRAMES 200
+
+class BenchScreen : public Screen {
+public:
+	BenchScreen() {
+		int scrW = EXTENT_X(maGetScrSize());
+		int scrH = EXTENT_Y(maGetScrSize());
+
+		mRoot = new Label(0, 0, scrW, scrH, NULL);
+		mRoot->setBackgroundColor(0x202020);
+		mStatus = new Label(0, 0, scrW, STATUS_HEIGHT, mRoot);
+		mStatus->setBackgroundColor(0x404080);
+		mList = new ListBox(0, STATUS_HEIGHT, scrW, scrH - STATUS_HEIGHT, mRoot,
+			ListBox::LBO_VERTICAL, ListBox::LBA_NONE, true);
+		mList->setBackgroundColor(0x000000);
+
+		for(int i = 0; i < ROWS; i++) {
+			// an opaque row, with a transparent icon and text on it
+			Label* row = new Label(0, 0, scrW, ROW_HEIGHT, mList);
+			row->setBackgroundColor(i & 1 ? 0x303030 : 0x383838);
+			Label* icon = new Label(2, 2, ROW_HEIGHT - 4, ROW_HEIGHT - 4, row);
+			icon->setDrawBackground(false);
+			Label* text = new Label(ROW_HEIGHT, 2, scrW - ROW_HEIGHT - 4, ROW_HEIGHT - 4, row);
+			text->setDrawBackground(false);
+			mRows[i] = row;
+			mTexts[i] = text;
+		}
+		setMain(mRoot);
+	}
+
+	void status(int frame) {
+		mStatus->setBackgroundColor(frame & 1 ? 0x404080 : 0x4040a0);
+	}
+
+	void text(int frame) {
+		// transparent, so the row below it is redrawn too
+		mTexts[frame % 8]->setSelected((frame / 8) & 1);
+	}
+
+	void select(int frame) {
+		mList->selectNextItem();
+	}
+
+	void whole(int frame) {
+		mRoot->requestRepaint();
+	}
+
+	int run(void (BenchScreen::*change)(int)) {
+		Engine& engine = Engine::getSingleton();
+		engine.repaint();
+		int start = maGetMilliSecondCount();
+		for(int i = 0; i < FRAMES; i++) {
+			(this->*change)(i);
+			engine.repaint();
+		}
+		return maGetMilliSecondCount() - start;
+	}
+
+private:
+	Label* mRoot;
+	Label* mStatus;
+	ListBox* mList;
+	Label* mRows[ROWS];
+	Label* mTexts[ROWS];
+};
+
+class BenchMoblet : public Moblet {
+public:
+	BenchMoblet() {
+		mScreen = new BenchScreen();
+		mScreen->show();
+
+		report("status bar", mScreen->run(&BenchScreen::status));
+		report("text in a row", mScreen->run(&BenchScreen::text));
+		report("selection", mScreen->run(&BenchScreen::select));
+		report("whole screen", mScreen->run(&BenchScreen::whole));
+		printf("Press any key to exit\n");
+	}
+
+	~BenchMoblet() {
+		delete mScreen;
+	}
+
+	void keyPressEvent(int keyCode, int nativeCode) {
+		close();
+	}
+
+private:
+	static void report(const char* name, int ms) {
+		printf("%s: %d frames in %d ms, %d us/frame\n", name, FRAMES, ms, ms * 1000 / FRAMES);
+	}
+
+	BenchScreen* mScreen;
+};
+
+extern "C" int MAMain() {
+	Moblet::run(new BenchMoblet());
+	return 0;
+}
@@ -0,0 +1,191 @@
+/*
+Copyright (C) 2011 MoSync AB
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License,
+version 2, as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA 02110-1301, USA.
+*/
+
+/**
+ * @file main.cpp
+ *
+ * Parse large XML documents with MTXml.
+ *
+ * Three documents are made in memory: a news feed with long texts,
+ * entities and some UTF-8; a data file of short elements with many
+ * attributes; and a text in a non-Latin script, where almost every
+ * character is UTF-8. Each is fed to the parser in 4 KB chunks, as a
+ * download would be, with and without processing of UTF-8 and entities.
+ * Each run prints its time and throughput, and the number of events,
+ * which should be the same from one version of the parser to the next.
+ */
+
+#include <ma.h>
+#include <maheap.h>
+#include <mastring.h>
+#include <mavsprintf.h>
+#include <conprint.h>
+#include <MAUtil/String.h>
+
+#include <MTXml/MTXml.h>
+
+using namespace Mtx;
+
+#define CHUNK_SIZE 4096
+#define ROUNDS 3
+
+class Counter : public MtxListener, public XmlListener {
+public:
+	Counter() : events(0), dataBytes(0), errors(0), remainsLen(0) {}
+
+	void mtxEncoding(const char*) { events++; }
+	void mtxTagStart(const char*, int) { events++; }
+	void mtxTagAttr(const char*, const char*) { events++; }
+	void mtxTagStartEnd() { events++; }
+	void mtxTagData(const char*, int len) { events++; dataBytes += len; }
+	void mtxTagEnd(const char*, int) { events++; }
+	void mtxParseError(int) { errors++; }
+	void mtxEmptyTagEnd() { events++; }
+
+	void mtxDataRemains(const char* data, int len) {
+		memmove(remains, data, len);
+		remainsLen = len;
+	}
+
+	int events, dataBytes, errors;
+	char remains[CHUNK_SIZE];
+	int remainsLen;
+};
+
+static MAUtil::String feedDocument(int items) {
+	MAUtil::String doc = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<rss version=\"2.0\">\n\t<channel>\n";
+	char buf[1024];
+	for(int i = 0; i < items; i++) {
+		sprintf(buf, "\t\t<item id=\"%i\">\n"
+			"\t\t\t<title>Headline number %i: markets &amp; weather</title>\n"
+			"\t\t\t<link>http://example.com/news/%i?a=1&amp;b=2</link>\n"
+			"\t\t\t<description>Caf\xc3\xa9 prices rose 3%% to \xe2\x82\xac%i, the report says. "
+			"Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do eiusmod tempor "
+			"incididunt ut labore et dolore magna aliqua. Ut enim ad minim veniam, "
+			"&lt;b&gt;quis&lt;/b&gt; nostrud exercitation.</description>\n"
+			"\t\t\t<!-- comment %i -->\n"
+			"\t\t\t<content><![CDATA[<p>Raw <b>html</b> for item %i.</p>]]></content>\n"
+			"\t\t\t<enclosure url=\"http://example.com/%i.jpg\" length=\"12345\" type=\"image/jpeg\"/>\n"
+			"\t\t</item>\n", i, i, i, i, i, i, i);
+		doc += buf;
+	}
+	doc += "\t</channel>\n</rss>\n";
+	return doc;
+}
+
+static MAUtil::String dataDocument(int rows) {
+	MAUtil::String doc = "<?xml version=\"1.0\"?>\n<table>\n";
+	char buf[256];
+	for(int i = 0; i < rows; i++) {
+		sprintf(buf, "<row id=\"%i\" x=\"%i\" y=\"%i\" z=\"-%i\" kind='point'><v>%i</v><w/></row>\n",
+			i, i * 3, i * 7, i, i * 11);
+		doc += buf;
+	}
+	doc += "</table>\n";
+	return doc;
+}
+
+static MAUtil::String utf8Document(int paragraphs) {
+	// "Greek text " in Greek letters, two bytes each.
+	static const char greek[] =
+		"\xce\x95\xce\xbb\xce\xbb\xce\xb7\xce\xbd\xce\xb9\xce\xba\xcf\x8c "
+		"\xce\xba\xce\xb5\xce\xaf\xce\xbc\xce\xb5\xce\xbd\xce\xbf ";
+	MAUtil::String doc = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<text>\n";
+	for(int i = 0; i < paragraphs; i++) {
+		doc += "<p>";
+		for(int j = 0; j < 8; j++)
+			doc += greek;
+		doc += "</p>\n";
+	}
+	doc += "</text>\n";
+	return doc;
+}
+
+// Any character outside Latin-1 becomes a '?'.
+class QuestionCounter : public Counter {
+public:
+	unsigned char mtxUnicodeCharacter(int unicode) {
+		unsigned char c = XmlListener::mtxUnicodeCharacter(unicode);
+		return c ? c : '?';
+	}
+};
+
+// Feeds the document to the parser ROUNDS times. Returns the time in ms.
+static int parse(const MAUtil::String& doc, bool process, QuestionCounter& counter) {
+	char* chunk = (char*)malloc(CHUNK_SIZE * 2 + 1);
+	int start = maGetMilliSecondCount();
+	for(int r = 0; r < ROUNDS; r++) {
+		counter = QuestionCounter();
+		Context context;
+		context.init(&counter, &counter);
+		int pos = 0;
+		while(pos < doc.size()) {
+			int len = doc.size() - pos;
+			if(len > CHUNK_SIZE)
+				len = CHUNK_SIZE;
+			memcpy(chunk, counter.remains, counter.remainsLen);
+			memcpy(chunk + counter.remainsLen, doc.c_str() + pos, len);
+			chunk[counter.remainsLen + len] = 0;
+			counter.remainsLen = 0;
+			pos += len;
+			if(process)
+				context.feedProcess(chunk);
+			else
+				context.feed(chunk);
+		}
+	}
+	int time = maGetMilliSecondCount() - start;
+	free(chunk);
+	return time;
+}
+
+static void run(const char* name, const MAUtil::String& doc, bool process) {
+	QuestionCounter counter;
+	int time = parse(doc, process, counter);
+
+	// tenths of a megabyte per second
+	int rate = time > 0 ? (int)((long long)doc.size() * ROUNDS * 10000 / time / (1024 * 1024)) : 0;
+	printf("%s%s: %i KB, %i ms, %i.%i MB/s\n", name, process ? " processed" : "",
+		doc.size() / 1024, time / ROUNDS, rate / 10, rate % 10);
+	printf("  %i events, %i data bytes, %i errors\n",
+		counter.events, counter.dataBytes, counter.errors);
+}
+
+extern "C" int MAMain() {
+	MAUtil::String feed = feedDocument(4000);
+	MAUtil::String data = dataDocument(20000);
+	MAUtil::String utf8 = utf8Document(8000);
+
+	printf("MTXml, %i rounds\n", ROUNDS);
+	run("feed", feed, false);
+	run("feed", feed, true);
+	run("data", data, false);
+	run("data", data, true);
+	run("utf8", utf8, false);
+	run("utf8", utf8, true);
+
+	printf("Done. Press any key to exit.\n");
+	while(1) {
+		maWait(0);
+		MAEvent e;
+		while(maGetEvent(&e)) {
+			if(e.type == EVENT_TYPE_CLOSE || e.type == EVENT_TYPE_KEY_PRESSED)
+				maExit(0);
+		}
+	}
+}
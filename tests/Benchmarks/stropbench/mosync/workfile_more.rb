@@ -0,0 +1,13 @@
+#!/usr/bin/ruby
+
+require File.expand_path(ENV['MOSYNCDIR']+'/rules/mosync_exe.rb')
+
+work = PipeExeWork.new
+work.instance_eval do
+	@SOURCES = ["."]
+	@LIBRARIES = ["mautil"]
+	@NAME = "stropbench"
+	@EXTRA_EMUFLAGS = " -noscreen -dispatch #{ENV['DISPATCH'] || 'threaded'}"
+end
+
+work.invoke
@@ -0,0 +1,342 @@
+/* Copyright (C) 2009 Mobile Sorcery AB
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License, version 2, as published by
+the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING.  If not, write to the Free
+Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.
+*/
+
+//Checks that every set of AudioKernels this CPU can run writes exactly the
+//samples of the scalar set, and that mixing the nearest frames straight from
+//the source matches converting them first, for all sample formats, mono and
+//stereo, and unity and fractional steps. Then measures how much of the image of a tone
+//the nearest and linear resamplers leave, and times 32 channels of mixed
+//formats and rates mixed to 44100 Hz stereo, against the loop AudioChannel
+//used to have.
+//usage: audioKernels [seconds of audio per benchmark]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <AudioKernels.h>
+
+#define FRAMES 509
+#define TRIALS 2000
+#define OUT_RATE 44100
+
+static int sErrors = 0;
+
+static void check(const char* set, const char* what, const void* a, const void* b, int bytes) {
+	if(memcmp(a, b, bytes) != 0) {
+		if(sErrors < 20)
+			printf("%s: %s differs\n", set, what);
+		sErrors++;
+	}
+}
+
+//******************************************************************************
+// Exactness
+//******************************************************************************
+
+static unsigned char sRaw[FRAMES * 4 + 16];
+static s16 sFrames[(FRAMES + 1) * 2];
+static s16 sConv[2][FRAMES * 2 + 16];
+static int sMix[2][FRAMES * 2 + 16];
+static s16 sSat[2][FRAMES * 2 + 16];
+
+static const char* sFormatNames[] = { "S8", "U8", "S16", "U16" };
+
+static void testSet(const AudioKernels& k) {
+	const AudioKernels& ref = *getAudioKernels(AUDIO_KERNELS_SCALAR);
+	char what[64];
+	srand(1);
+	for(int t = 0; t < TRIALS; t++) {
+		for(int i = 0; i < (int)sizeof(sRaw); i++)
+			sRaw[i] = (unsigned char)rand();
+
+		// conversion, from any alignment
+		AudioSampleFormat format = (AudioSampleFormat)(t & 3);
+		int channels = 1 + ((t >> 2) & 1);
+		int n = rand() % FRAMES;
+		int off = rand() & 7;
+		if(format >= AUDIO_SAMPLE_S16)
+			off &= ~1;
+		memset(sConv, 0x55, sizeof(sConv));
+		ref.convert(sConv[0], sRaw + off, n, format, channels);
+		k.convert(sConv[1], sRaw + off, n, format, channels);
+		sprintf(what, "convert %s %s n=%i", sFormatNames[format], channels == 1 ? "mono" : "stereo", n);
+		check(k.name, what, sConv[0], sConv[1], sizeof(sConv[0]));
+
+		// resampling; every position read is inside the frames.
+		ref.convert(sFrames, sRaw, FRAMES + 1, AUDIO_SAMPLE_S16, 2);
+		int delta;
+		switch(t % 3) {
+		case 0: delta = 0x10000; break;
+		case 1: delta = 0x1000 + rand() % 0x10000; break;
+		default: delta = 0x10000 + rand() % 0x40000; break;
+		}
+		int pos = (t % 3 == 0) ? (rand() % 16) << 16 : rand() % 0x40000;
+		int room = (FRAMES - 1) * 0x10000 - pos;
+		n = rand() % FRAMES;
+		if(n > 0 && (n - 1) * (long long)delta >= room)
+			n = (int)(room / delta);
+		int vol = (t & 16) ? 0xffff : rand() & 0xffff;
+		for(int i = 0; i < FRAMES * 2 + 16; i++)
+			sMix[0][i] = sMix[1][i] = rand() - RAND_MAX / 2;
+		ref.mixNearest(sMix[0], sFrames, pos, delta, n, vol);
+		k.mixNearest(sMix[1], sFrames, pos, delta, n, vol);
+		sprintf(what, "mixNearest pos=%x delta=%x n=%i", pos, delta, n);
+		check(k.name, what, sMix[0], sMix[1], sizeof(sMix[0]));
+		if(k.mixNearestFrom) {
+			// straight from the raw frames, in any format
+			ref.convert(sFrames, sRaw, FRAMES + 1, format, channels);
+			ref.mixNearest(sMix[0], sFrames, pos, delta, n, vol);
+			k.mixNearestFrom(sMix[1], sRaw, format, channels, pos, delta, n, vol);
+			sprintf(what, "mixNearestFrom %s %s pos=%x delta=%x n=%i", sFormatNames[format],
+				channels == 1 ? "mono" : "stereo", pos, delta, n);
+			check(k.name, what, sMix[0], sMix[1], sizeof(sMix[0]));
+			ref.convert(sFrames, sRaw, FRAMES + 1, AUDIO_SAMPLE_S16, 2);
+		}
+		ref.mixLinear(sMix[0], sFrames, pos, delta, n, vol);
+		k.mixLinear(sMix[1], sFrames, pos, delta, n, vol);
+		sprintf(what, "mixLinear pos=%x delta=%x n=%i", pos, delta, n);
+		check(k.name, what, sMix[0], sMix[1], sizeof(sMix[0]));
+
+		// saturation, of sums of up to 8 full scale channels
+		n = rand() % (FRAMES * 2);
+		for(int i = 0; i < n; i++)
+			sMix[0][i] = (rand() % (8 * 65536)) - 4 * 65536;
+		memset(sSat, 0x55, sizeof(sSat));
+		ref.saturate16(sSat[0], sMix[0], n);
+		k.saturate16(sSat[1], sMix[0], n);
+		sprintf(what, "saturate16 n=%i", n);
+		check(k.name, what, sSat[0], sSat[1], sizeof(sSat[0]));
+	}
+}
+
+//******************************************************************************
+// Aliasing
+//******************************************************************************
+
+// resamples a full scale sine of the given frequency from rate to OUT_RATE,
+// and returns the level of the image the resampler folds to image Hz,
+// relative to the tone, in dB.
+static double imageLevel(const AudioKernels& k, bool linear, double tone, int rate, double image) {
+	static s16 src[(OUT_RATE + 1) * 2];
+	static int dst[OUT_RATE / 2 * 2];
+	const int n = OUT_RATE / 2;
+	const int srcFrames = (int)((long long)n * rate / OUT_RATE) + 2;
+	for(int i = 0; i < srcFrames; i++)
+		src[i * 2] = src[i * 2 + 1] = (s16)(sin(2 * M_PI * tone * i / rate) * 32000);
+	memset(dst, 0, sizeof(dst));
+	int delta = (int)(((long long)rate << 16) / OUT_RATE);
+	(linear ? k.mixLinear : k.mixNearest)(dst, src, 0, delta, n, 0xffff);
+
+	// Goertzel, on the left channel
+	double level[2];
+	double freqs[2] = { tone, image };
+	for(int f = 0; f < 2; f++) {
+		double c = 2 * cos(2 * M_PI * freqs[f] / OUT_RATE);
+		double s1 = 0, s2 = 0;
+		for(int i = 0; i < n; i++) {
+			double s0 = dst[i * 2] + c * s1 - s2;
+			s2 = s1;
+			s1 = s0;
+		}
+		level[f] = sqrt(s1 * s1 + s2 * s2 - c * s1 * s2);
+	}
+	return 20 * log10(level[1] / level[0]);
+}
+
+static void testAliasing(const AudioKernels& k) {
+	static const struct {
+		int rate;
+		double image;
+	} cases[] = {
+		{ 22050, 22050 - 1000 },			// 21050 Hz
+		{ 32000, 44100 - (32000 + 1000) },	// 33000 Hz, folded to 11100 Hz
+		{ 11025, 11025 + 1000 },			// 12025 Hz
+	};
+	printf("\nimage of 1 kHz    nearest    linear\n");
+	for(int i = 0; i < 3; i++) {
+		double nearest = imageLevel(k, false, 1000, cases[i].rate, cases[i].image);
+		double linear = imageLevel(k, true, 1000, cases[i].rate, cases[i].image);
+		printf("%5i Hz        %7.1f dB %7.1f dB\n", cases[i].rate, nearest, linear);
+		if(linear > nearest - 20) {
+			printf("linear resampling leaves too much of the image\n");
+			sErrors++;
+		}
+	}
+}
+
+//******************************************************************************
+// Throughput
+//******************************************************************************
+
+// the loop AudioChannel::mix used to have, 24.8 positions and all.
+template< typename SrcT, int srcBitDepth, int srcNumChannels, bool sign >
+static void convert_audio ( int *dst, int numSamples, const SrcT *src,
+	int pos, int delta, int vol )
+{
+	int sample;
+
+	for( int i = 0; i < numSamples; i++ )
+	{
+		sample = (int)src[((pos>>8)<<(srcNumChannels>>1))];
+		if ( sign == false )
+			sample -= ((1<<srcBitDepth)>>1);
+		sample <<= 16-srcBitDepth;
+		sample = (sample*vol)>>16;
+		dst[i*2+0] += sample;
+
+		if ( srcNumChannels == 2 )
+		{
+			sample = (int)src[((pos>>8)<<1)+1];
+			if ( sign == false)
+				sample -= ((1<<srcBitDepth)>>1);
+			sample <<= 16-srcBitDepth;
+			sample = (sample*vol)>>16;
+			dst[i*2+1] += sample;
+		}
+		else
+			dst[i*2+1] += sample;
+
+		pos+=delta;
+	}
+}
+
+#define NCHANNELS 32
+#define BLOCK 1024
+#define SRC_FRAMES (BLOCK * 2 + 2)
+
+struct Channel {
+	AudioSampleFormat format;
+	int channels;
+	int rate;
+	int delta;
+	unsigned char data[SRC_FRAMES * 4];
+};
+
+static Channel sChannels[NCHANNELS];
+static s16 sChunk[(SRC_FRAMES + 1) * 2];
+static int sAccum[BLOCK * 2];
+static s16 sOut[BLOCK * 2];
+static double sSeconds;
+
+static void oldMix(const Channel& c) {
+	int delta = (c.rate << 8) / OUT_RATE;
+	bool stereo = c.channels == 2;
+	switch(c.format) {
+	case AUDIO_SAMPLE_S8:
+		if(stereo) convert_audio<signed char, 8, 2, true>(sAccum, BLOCK, (signed char*)c.data, 0, delta, 0xc000);
+		else convert_audio<signed char, 8, 1, true>(sAccum, BLOCK, (signed char*)c.data, 0, delta, 0xc000);
+		break;
+	case AUDIO_SAMPLE_U8:
+		if(stereo) convert_audio<unsigned char, 8, 2, false>(sAccum, BLOCK, c.data, 0, delta, 0xc000);
+		else convert_audio<unsigned char, 8, 1, false>(sAccum, BLOCK, c.data, 0, delta, 0xc000);
+		break;
+	case AUDIO_SAMPLE_S16:
+		if(stereo) convert_audio<short, 16, 2, true>(sAccum, BLOCK, (short*)c.data, 0, delta, 0xc000);
+		else convert_audio<short, 16, 1, true>(sAccum, BLOCK, (short*)c.data, 0, delta, 0xc000);
+		break;
+	case AUDIO_SAMPLE_U16:
+		if(stereo) convert_audio<unsigned short, 16, 2, false>(sAccum, BLOCK, (unsigned short*)c.data, 0, delta, 0xc000);
+		else convert_audio<unsigned short, 16, 1, false>(sAccum, BLOCK, (unsigned short*)c.data, 0, delta, 0xc000);
+		break;
+	}
+}
+
+// millions of output frames per second, all channels mixed.
+static double bench(const AudioKernels* k, bool linear) {
+	int blocks = (int)(sSeconds * OUT_RATE / BLOCK);
+	clock_t start = clock();
+	for(int b = 0; b < blocks; b++) {
+		memset(sAccum, 0, sizeof(sAccum));
+		for(int i = 0; i < NCHANNELS; i++) {
+			const Channel& c = sChannels[i];
+			if(!k) {
+				oldMix(c);
+				continue;
+			}
+			if(!linear && k->mixNearestFrom) {
+				k->mixNearestFrom(sAccum, c.data, c.format, c.channels, 0, c.delta, BLOCK, 0xc000);
+				continue;
+			}
+			int frames = (int)(((long long)(BLOCK - 1) * c.delta) >> 16) + 2;
+			k->convert(sChunk, c.data, frames, c.format, c.channels);
+			(linear ? k->mixLinear : k->mixNearest)(sAccum, sChunk, 0, c.delta, BLOCK, 0xc000);
+		}
+		if(k) {
+			k->saturate16(sOut, sAccum, BLOCK * 2);
+		} else {
+			for(int i = 0; i < BLOCK * 2; i++) {
+				int s = sAccum[i];
+				sOut[i] = (s16)(s < -32768 ? -32768 : (s > 32767 ? 32767 : s));
+			}
+		}
+	}
+	double s = (double)(clock() - start) / CLOCKS_PER_SEC;
+	if(s <= 0)
+		s = 1.0 / CLOCKS_PER_SEC;
+	return blocks * (double)BLOCK / s / 1e6;
+}
+
+int main(int argc, char** argv) {
+	sSeconds = argc > 1 ? atof(argv[1]) : 600;
+
+	static const AudioKernelSet sets[] = { AUDIO_KERNELS_SCALAR, AUDIO_KERNELS_SSE2, AUDIO_KERNELS_AVX2 };
+	const AudioKernels* kernels[3];
+	int nKernels = 0;
+	for(int i = 0; i < 3; i++) {
+		const AudioKernels* k = getAudioKernels(sets[i]);
+		if(k) {
+			kernels[nKernels++] = k;
+			testSet(*k);
+		}
+	}
+	printf("selected: %s\n", audioKernels().name);
+	if(sErrors) {
+		printf("%i errors\n", sErrors);
+		return 1;
+	}
+	printf("%i sets exact\n", nKernels);
+
+	testAliasing(audioKernels());
+	if(sErrors)
+		return 1;
+
+	static const int rates[] = { 8000, 11025, 22050, 44100, 48000 };
+	srand(2);
+	for(int i = 0; i < NCHANNELS; i++) {
+		Channel& c = sChannels[i];
+		c.format = (AudioSampleFormat)(i & 3);
+		c.channels = 1 + ((i >> 2) & 1);
+		c.rate = rates[i % 5];
+		c.delta = (int)(((long long)c.rate << 16) / OUT_RATE);
+		for(int j = 0; j < (int)sizeof(c.data); j++)
+			c.data[j] = (unsigned char)rand();
+	}
+
+	printf("\n%i channels, M frames/s  %9s", NCHANNELS, "old loop");
+	for(int i = 0; i < nKernels; i++)
+		printf(" %9s", kernels[i]->name);
+	printf("\nnearest                 %9.2f", bench(NULL, false));
+	for(int i = 0; i < nKernels; i++)
+		printf(" %9.2f", bench(kernels[i], false));
+	printf("\nlinear                  %9s", "");
+	for(int i = 0; i < nKernels; i++)
+		printf(" %9.2f", bench(kernels[i], true));
+	printf("\n");
+	return 0;
+}
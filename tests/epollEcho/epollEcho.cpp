@@ -0,0 +1,271 @@
+/* Copyright (C) 2009 Mobile Sorcery AB
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License, version 2, as published by
+the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING.  If not, write to the Free
+Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.
+*/
+
+//Loopback echo benchmark for EpollEngine. Opens many connections to a TcpServer
+//in the same process and bounces messages over all of them at once.
+//Every read and write, on both sides, runs on the engine thread.
+//Connections are accepted on a thread of their own.
+//usage: epollEcho [connections] [rounds] [message size]
+
+#include "config_platform.h"
+
+#ifndef USE_EPOLL_CONNECTIONS
+#error epollEcho needs USE_EPOLL_CONNECTIONS in config_platform.h
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include <helpers/atomic.h>
+#include <EpollEngine.h>
+
+static EpollEngine gEngine;
+static MoSyncSemaphore gDone;
+static volatile int gFailures = 0;
+static volatile int gClientsLeft;
+static volatile int gServersLeft;
+static int gRounds;
+static int gSize;
+
+void MoSyncErrorExit(int code) {
+	printf("MoSyncErrorExit(%i)\n", code);
+	exit(code);
+}
+
+static void fail(const char* what, int result) {
+	printf("%s failed: %i\n", what, result);
+	atomicAdd(&gFailures, 1);
+}
+
+static double now() {
+	timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+}
+
+//Calls a member function when an operation completes.
+template<class T, void (T::*F)(int)> class Call : public EpollEngine::Op {
+public:
+	Call(T& t) : mT(t) {}
+	void complete(int result) { (mT.*F)(result); }
+private:
+	T& mT;
+};
+
+//Writes back everything it reads, until the client closes.
+class EchoConn {
+public:
+	EchoConn(MoSyncSocket sock) : mConn("", 0, sock) {}
+	void start() {
+		gEngine.read(mConn.getSocket(), mBuf, sizeof(mBuf), new Call<EchoConn, &EchoConn::readDone>(*this));
+	}
+private:
+	void readDone(int result) {
+		if(result < 0) {
+			if(result != CONNERR_CLOSED)
+				fail("echo read", result);
+			if(atomicAdd(&gServersLeft, -1) == 0)
+				gDone.post();
+			mConn.close();
+			delete this;
+			return;
+		}
+		gEngine.write(mConn.getSocket(), mBuf, result, new Call<EchoConn, &EchoConn::writeDone>(*this));
+	}
+	void writeDone(int result) {
+		if(result < 0)
+			fail("echo write", result);
+		start();
+	}
+	TcpConnection mConn;
+	char mBuf[4096];
+};
+
+class Acceptor {
+public:
+	Acceptor(TcpServer& s, int n) : mServer(s), mLeft(n) {}
+	void start() {
+		mThread.start(threadFunc, this);
+	}
+	void join() {
+		mThread.join();
+	}
+private:
+	static int SDLCALL threadFunc(void* arg) {
+		Acceptor* a = (Acceptor*)arg;
+		for(; a->mLeft > 0; a->mLeft--) {
+			MoSyncSocket client = ::accept(a->mServer.getSocket(), NULL, NULL);
+			if(client == INVALID_SOCKET) {
+				fail("accept", CONNERR_GENERIC);
+				return 0;
+			}
+			(new EchoConn(client))->start();
+		}
+		return 0;
+	}
+	TcpServer& mServer;
+	MoSyncThread mThread;
+	int mLeft;
+};
+
+//Sends a message, waits for all of it to come back, and repeats.
+class Client {
+public:
+	Client(const std::string& host, u16 port, int id) : mConn(host, port), mRound(0),
+		mOut(new char[gSize]), mIn(new char[gSize])
+	{
+		for(int i=0; i<gSize; i++)
+			mOut[i] = (char)(id + i);
+	}
+	~Client() {
+		delete[] mOut;
+		delete[] mIn;
+	}
+	int connect() { return mConn.connect(); }
+	void start() {
+		mGot = 0;
+		gEngine.write(mConn.getSocket(), mOut, gSize, new Call<Client, &Client::writeDone>(*this));
+	}
+	void close() { mConn.close(); }
+private:
+	void writeDone(int result) {
+		if(result < 0) {
+			fail("write", result);
+			finish();
+			return;
+		}
+		read();
+	}
+	void read() {
+		gEngine.read(mConn.getSocket(), mIn + mGot, gSize - mGot, new Call<Client, &Client::readDone>(*this));
+	}
+	void readDone(int result) {
+		if(result < 0) {
+			fail("read", result);
+			finish();
+			return;
+		}
+		mGot += result;
+		if(mGot < gSize) {
+			read();
+			return;
+		}
+		if(memcmp(mIn, mOut, gSize) != 0) {
+			fail("compare", mRound);
+			finish();
+			return;
+		}
+		mOut[mRound % gSize]++;
+		if(++mRound < gRounds)
+			start();
+		else
+			finish();
+	}
+	void finish() {
+		if(atomicAdd(&gClientsLeft, -1) == 0)
+			gDone.post();
+	}
+	TcpConnection mConn;
+	int mRound, mGot;
+	char* mOut;
+	char* mIn;
+};
+
+int main(int argc, char** argv) {
+	int nConns = argc > 1 ? atoi(argv[1]) : 2000;
+	gRounds = argc > 2 ? atoi(argv[2]) : 100;
+	gSize = argc > 3 ? atoi(argv[3]) : 64;
+
+	//each connection has a socket at both ends.
+	rlimit rl;
+	getrlimit(RLIMIT_NOFILE, &rl);
+	rl.rlim_cur = rl.rlim_max;
+	setrlimit(RLIMIT_NOFILE, &rl);
+	if((rlim_t)nConns * 2 + 16 > rl.rlim_cur) {
+		nConns = (rl.rlim_cur - 16) / 2;
+		printf("file limit is %i; using %i connections\n", (int)rl.rlim_cur, nConns);
+	}
+
+	if(!gEngine.start()) {
+		printf("EpollEngine failed to start\n");
+		return 1;
+	}
+	TcpServer server;
+	MAConnAddr addr;
+	if(server.open(0) <= 0 || server.getAddr(addr) <= 0) {
+		printf("TcpServer failed to open\n");
+		return 1;
+	}
+	//the server listens on every interface.
+	std::string host = "127.0.0.1";
+	u16 port = ntohs(addr.inet4.port);
+	printf("%i connections to %s:%i, %i rounds of %i bytes\n", nConns, host.c_str(), port,
+		gRounds, gSize);
+
+	gClientsLeft = nConns;
+	gServersLeft = nConns;
+	Acceptor acceptor(server, nConns);
+	acceptor.start();
+
+	double start = now();
+	Client** clients = new Client*[nConns];
+	for(int i=0; i<nConns; i++) {
+		clients[i] = new Client(host, port, i);
+		int res = clients[i]->connect();
+		if(res < 0) {
+			printf("connect %i failed: %i\n", i, res);
+			return 1;
+		}
+	}
+	double connected = now();
+	for(int i=0; i<nConns; i++) {
+		clients[i]->start();
+	}
+	gDone.wait();
+	double done = now();
+
+	//closing the clients makes the echo side finish.
+	for(int i=0; i<nConns; i++) {
+		clients[i]->close();
+	}
+	gDone.wait();
+	for(int i=0; i<nConns; i++) {
+		delete clients[i];
+	}
+	delete[] clients;
+	acceptor.join();
+	server.close();
+
+	double ms = done - connected;
+	double trips = (double)nConns * gRounds;
+	printf("connect: %.0f ms\n", connected - start);
+	printf("echo: %.0f ms, %.0f round trips/s, %.1f MB/s each way\n", ms, trips * 1000 / ms,
+		trips * gSize / ms / 1000);
+	printf("immediate %i, waited %i\n", gEngine.immediate(), gEngine.waited());
+	gEngine.close();
+
+	if(gFailures == 0) {
+		printf("epollEcho: OK\n");
+		return 0;
+	} else {
+		printf("epollEcho: FAILED\n");
+		return 1;
+	}
+}
@@ -0,0 +1,37 @@
+#!/usr/bin/ruby
+
+require File.expand_path('../../rules/native_mosync.rb')
+
+work = MoSyncExe.new
+work.instance_eval do
+	@SOURCES = ['.']
+	@EXTRA_SOURCEFILES = [
+		'../../runtimes/cpp/platforms/sdl/EpollEngine.cpp',
+		'../../runtimes/cpp/platforms/sdl/ThreadPoolImpl.cpp',
+	]
+	@EXTRA_INCLUDES = ['../../intlibs', '../../runtimes/cpp/base', '../../runtimes/cpp/platforms/sdl']
+	@LOCAL_LIBS = ['net', 'mosync_log_file']
+
+	if(HOST == :linux) then
+		@LIBRARIES = ['SDL']
+	else
+		error 'epoll is only available on Linux'
+	end
+
+	@NAME = 'epollEcho'
+end
+
+target :default do
+	work.invoke
+end
+
+target :clean do
+	work.setup
+	work.execute_clean
+end
+
+target :run => :default do
+	sh work.target
+end
+
+Targets.invoke
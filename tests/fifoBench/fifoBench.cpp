@@ -0,0 +1,171 @@
+/* Copyright (C) 2009 Mobile Sorcery AB
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License, version 2, as published by
+the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING.  If not, write to the Free
+Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.
+*/
+
+//Event throughput of CircularFifo, SpscFifo and MpmcFifo.
+//"same thread" is how the SDL runtime uses its event queue: the main thread
+//puts a few events, then maGetEvent checks count() and gets them.
+//"two threads" has one thread putting and another getting, as fast as they can.
+//It needs at least two cores to mean anything.
+//usage: fifoBench [events]
+
+#include "config_platform.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <SDL/SDL.h>
+#include <helpers/fifo.h>
+#include <ThreadPoolImpl.h>
+
+#define SIZE 256	//EVENT_BUFFER_SIZE
+#define BATCH 32
+
+//same size as an MAEvent.
+struct Event {
+	int type;
+	int data[4];
+};
+
+static int gEvents;
+static volatile int gCheck;
+
+void MoSyncErrorExit(int code) {
+	printf("MoSyncErrorExit(%i)\n", code);
+	exit(code);
+}
+
+static void report(const char* name, const char* mode, Uint32 start) {
+	Uint32 ms = SDL_GetTicks() - start;
+	if(ms == 0)
+		ms = 1;
+	printf("%-13s %-10s %5u ms, %6.1f M events/s\n", name, mode, ms, gEvents / (ms * 1000.0));
+}
+
+//CircularFifo has no failing put() or getMany(), so wrap them all alike.
+template<class T, int size> class Circular : public CircularFifo<T, size> {
+public:
+	bool put(const T& t) {
+		if(this->count() == size - 1)
+			return false;
+		CircularFifo<T, size>::put(t);
+		return true;
+	}
+	bool get(T& t) {
+		if(this->count() == 0)
+			return false;
+		t = CircularFifo<T, size>::get();
+		return true;
+	}
+	int getMany(T* dst, int max) {
+		int n = 0;
+		while(n < max && get(dst[n]))
+			n++;
+		return n;
+	}
+};
+
+template<class T, int size> class Spsc : public SpscFifo<T, size> {
+public:
+	bool get(T& t) {
+		return this->getMany(&t, 1) == 1;
+	}
+};
+
+template<class T, int size> class Mpmc : public MpmcFifo<T, size> {
+public:
+	int getMany(T* dst, int max) {
+		int n = 0;
+		while(n < max && this->get(dst[n]))
+			n++;
+		return n;
+	}
+};
+
+template<class Fifo> static void sameThread(const char* name) {
+	Fifo* fifo = new Fifo;
+	Event e = { 0 };
+	int sum = 0;
+	Uint32 start = SDL_GetTicks();
+	for(int i=0; i<gEvents; i+=BATCH) {
+		for(int j=0; j<BATCH; j++) {
+			e.type = i + j;
+			fifo->put(e);
+		}
+		//maGetEvent
+		while(fifo->count() != 0) {
+			fifo->get(e);
+			sum += e.type;
+		}
+	}
+	report(name, "same", start);
+	gCheck = sum;
+	delete fifo;
+}
+
+template<class Fifo> class Producer {
+public:
+	static int SDLCALL run(void* arg) {
+		Fifo* fifo = (Fifo*)arg;
+		Event e = { 0 };
+		for(int i=0; i<gEvents; i++) {
+			e.type = i;
+			while(!fifo->put(e))
+				;
+		}
+		return 0;
+	}
+};
+
+template<class Fifo> static void twoThreads(const char* name, bool batched) {
+	Fifo* fifo = new Fifo;
+	MoSyncThread producer;
+	Event batch[BATCH];
+	int got = 0;
+	bool ok = true;
+	Uint32 start = SDL_GetTicks();
+	producer.start(Producer<Fifo>::run, fifo);
+	while(got < gEvents) {
+		int n = fifo->getMany(batch, batched ? BATCH : 1);
+		for(int i=0; i<n; i++) {
+			if(batch[i].type != got + i)
+				ok = false;
+		}
+		got += n;
+	}
+	producer.join();
+	report(name, batched ? "two batch" : "two", start);
+	if(!ok) {
+		printf("%s: events out of order!\n", name);
+		exit(1);
+	}
+	delete fifo;
+}
+
+int main(int argc, char** argv) {
+	gEvents = argc > 1 ? atoi(argv[1]) : 10000000;
+	gEvents -= gEvents % BATCH;
+
+	sameThread<Circular<Event, SIZE> >("CircularFifo");
+	sameThread<Spsc<Event, SIZE> >("SpscFifo");
+	sameThread<Mpmc<Event, SIZE> >("MpmcFifo");
+
+	twoThreads<Circular<Event, SIZE> >("CircularFifo", false);
+	twoThreads<Spsc<Event, SIZE> >("SpscFifo", false);
+	twoThreads<Spsc<Event, SIZE> >("SpscFifo", true);
+	twoThreads<Mpmc<Event, SIZE> >("MpmcFifo", false);
+	twoThreads<Mpmc<Event, SIZE> >("MpmcFifo", true);
+	return 0;
+}
@@ -0,0 +1,39 @@
+#!/usr/bin/ruby
+
+require File.expand_path('../../rules/native_mosync.rb')
+
+work = MoSyncExe.new
+work.instance_eval do
+	@SOURCES = ['.']
+	@EXTRA_SOURCEFILES = [
+		'../../runtimes/cpp/platforms/sdl/ThreadPoolImpl.cpp',
+	]
+	@EXTRA_INCLUDES = ['../../intlibs', '../../runtimes/cpp/base', '../../runtimes/cpp/platforms/sdl']
+	@LOCAL_LIBS = ['mosync_log_file']
+
+	common_libraries = ['SDL', 'SDLmain']
+	if(HOST == :win32) then
+		@CUSTOM_LIBS = common_libraries.collect do |lib| "#{lib}.lib" end
+	elsif(HOST == :linux || HOST == :darwin) then
+		@LIBRARIES = common_libraries
+	else
+		error 'Unsupported platform'
+	end
+
+	@NAME = 'fifoBench'
+end
+
+target :default do
+	work.invoke
+end
+
+target :clean do
+	work.setup
+	work.execute_clean
+end
+
+target :run => :default do
+	sh work.target
+end
+
+Targets.invoke
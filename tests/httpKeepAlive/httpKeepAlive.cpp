@@ -0,0 +1,188 @@
+/* Copyright (C) 2009 Mobile Sorcery AB
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License, version 2, as published by
+the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING.  If not, write to the Free
+Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.
+*/
+
+//Tests HttpConnection and HttpConnectionPool against server.rb:
+//reuse of kept-alive transports, chunked bodies, HTTP/1.0 bodies,
+//servers that close, and pipelined requests.
+//usage: start server.rb, then run httpKeepAlive.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+
+#include <net/net.h>
+
+#define HOST "localhost"
+#define PORT 5007
+
+static HttpConnectionPool gPool;
+static std::string gKey = HttpConnectionPool::key(HOST, PORT, false);
+static int gFailures = 0;
+
+void MoSyncErrorExit(int code) {
+	printf("MoSyncErrorExit(%i)\n", code);
+	exit(code);
+}
+
+static void check(bool ok, const char* what) {
+	if(!ok) {
+		printf("FAILED: %s\n", what);
+		gFailures++;
+	}
+}
+
+//A connection on a pooled transport, if there is one.
+static HttpConnection* create(const char* path, int method = HTTP_GET) {
+	HttpConnection* http = new HttpConnection(new TcpConnection(HOST, PORT),
+		HOST, path, method);
+	TcpConnection* idle = gPool.take(gKey);
+	if(idle)
+		http->adoptTransport(idle, std::string());
+	return http;
+}
+
+//Reads the body, and checks that byte i is (i & 0xff).
+static int readBody(HttpConnection* http) {
+	char buf[1000];
+	int total = 0;
+	bool good = true;
+	int res;
+	while((res = http->read(buf, sizeof(buf))) > 0) {
+		for(int i=0; i<res; i++) {
+			if((unsigned char)buf[i] != ((total + i) & 0xff))
+				good = false;
+		}
+		total += res;
+	}
+	check(res == CONNERR_CLOSED, "body ends with CONNERR_CLOSED");
+	check(good, "body bytes");
+	return total;
+}
+
+//Puts the transport back into the pool, if it can carry another request.
+static void done(HttpConnection* http) {
+	if(http->isReusable()) {
+		std::string unread;
+		Connection* transport = http->releaseTransport(unread);
+		check(unread.empty(), "nothing after the response");
+		gPool.give(gKey, (TcpConnection*)transport);
+	}
+	delete http;
+}
+
+static int get(const char* path, bool expectReusable) {
+	HttpConnection* http = create(path);
+	int res = http->finish();
+	if(res != 200) {
+		printf("%s: %i\n", path, res);
+		check(false, "response code");
+		delete http;
+		return -1;
+	}
+	int size = readBody(http);
+	check(http->isReusable() == expectReusable, path);
+	done(http);
+	return size;
+}
+
+static int connections() {
+	HttpConnection* http = create("/connections");
+	check(http->finish() == 200, "/connections");
+	char buf[16];
+	int res = http->read(buf, sizeof(buf) - 1);
+	buf[res > 0 ? res : 0] = 0;
+	char dummy;
+	check(http->read(&dummy, 1) == CONNERR_CLOSED, "/connections ends");
+	done(http);
+	return atoi(buf);
+}
+
+int main() {
+	int base = connections();
+
+	//Content-Length, over one transport.
+	check(get("/length/0", true) == 0, "/length/0");
+	check(get("/length/1", true) == 1, "/length/1");
+	check(get("/length/100000", true) == 100000, "/length/100000");
+	check(connections() == base, "kept alive");
+
+	//HEAD has no body, whatever its Content-Length says.
+	HttpConnection* head = create("/length/5000", HTTP_HEAD);
+	check(head->finish() == 200, "HEAD");
+	check(readBody(head) == 0, "HEAD body");
+	check(head->isReusable(), "HEAD reusable");
+	done(head);
+
+	//chunks of 1, 4, 13... bytes, with extensions and a trailer.
+	check(get("/chunked/0", true) == 0, "/chunked/0");
+	check(get("/chunked/1", true) == 1, "/chunked/1");
+	check(get("/chunked/70000", true) == 70000, "/chunked/70000");
+	check(connections() == base, "kept alive after chunks");
+
+	//the server closes after these.
+	check(get("/close/300", false) == 300, "/close/300");
+	check(get("/old/5000", false) == 5000, "/old/5000");
+	check(connections() == base + 2, "new transports after close");
+	base += 2;
+
+	//the server closes an idle transport; the pool must not hand it out.
+	HttpConnection* closer = create("/close/10");
+	check(closer->finish() == 200, "/close/10");
+	readBody(closer);
+	std::string unread;
+	gPool.give(gKey, (TcpConnection*)closer->releaseTransport(unread));
+	delete closer;
+	check(get("/length/10", true) == 10, "after a closed idle transport");
+	check(connections() == base + 1, "closed idle transport dropped");
+	base++;
+
+	//pipelining: the second request goes out before the first response is read.
+	HttpConnection* first = create("/chunked/20000");
+	HttpConnection* second = new HttpConnection(new TcpConnection(HOST, PORT),
+		HOST, "/length/30000", HTTP_GET);
+	HttpConnection* third = new HttpConnection(new TcpConnection(HOST, PORT),
+		HOST, "/length/7", HTTP_GET);
+	check(first->sendRequest() > 0, "first sent");
+	check(second->sendRequestOn(first->getTransport()) > 0, "second sent");
+	check(third->sendRequestOn(first->getTransport()) > 0, "third sent");
+	check(first->readResponse() == 200, "first response");
+	check(readBody(first) == 20000, "first body");
+	check(first->isReusable(), "first reusable");
+	Connection* transport = first->releaseTransport(unread);
+	delete first;
+	check(second->finishOn(transport, unread) == 200, "second response");
+	check(readBody(second) == 30000, "second body");
+	transport = second->releaseTransport(unread);
+	delete second;
+	check(third->finishOn(transport, unread) == 200, "third response");
+	check(readBody(third) == 7, "third body");
+	done(third);
+
+	//the connection before broke; the request is sent again.
+	HttpConnection* broken = create("/length/5");
+	check(broken->finishOn(NULL, std::string()) == 200, "resent");
+	check(readBody(broken) == 5, "resent body");
+	done(broken);
+	check(connections() == base + 1, "pipelined on one transport");
+
+	gPool.clear();
+	if(gFailures == 0)
+		printf("All tests passed.\n");
+	else
+		printf("%i failures.\n", gFailures);
+	return gFailures != 0;
+}
@@ -0,0 +1,72 @@
+#!/usr/bin/ruby
+
+# Serves the requests of httpKeepAlive.cpp.
+#  /length/N     N bytes with a Content-Length.
+#  /chunked/N    N bytes in chunks, with an extension and a trailer.
+#  /close/N      N bytes with a Content-Length, then the connection is closed.
+#  /old/N        N bytes as HTTP/1.0, ended by closing the connection.
+#  /connections  the number of connections accepted so far.
+# The body byte i is (i & 0xff).
+# usage: server.rb
+
+require 'socket'
+
+PORT = 5007
+
+def body(n)
+	(0...n).map { |i| (i & 0xff).chr }.join
+end
+
+connections = 0
+server = TCPServer.new(PORT)
+puts "Listening on port #{PORT}"
+loop do
+	client = server.accept
+	connections += 1
+	Thread.new(client) do |c|
+		begin
+			while (request = c.gets)
+				while (line = c.gets) && line != "\r\n"
+				end
+				method, path = request.split(' ')
+				head = (method == 'HEAD')
+				dummy, what, arg = path.split('/')
+				n = arg.to_i
+				case what
+				when 'length', 'close'
+					out = "HTTP/1.1 200 OK\r\nContent-Length: #{n}\r\n"
+					out += "Connection: close\r\n" if what == 'close'
+					out += "\r\n"
+					out += body(n) unless head
+					c.write(out)
+					break if what == 'close'
+				when 'chunked'
+					out = "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+					data = body(n)
+					pos = 0
+					size = 1
+					while pos < data.size
+						chunk = data[pos, size]
+						out += chunk.size.to_s(16) + ";ext=1\r\n" + chunk + "\r\n"
+						pos += chunk.size
+						size = size * 3 + 1
+					end
+					out += "0\r\nX-Trailer: yes\r\n\r\n"
+					c.write(out)
+				when 'old'
+					c.write("HTTP/1.0 200 OK\r\n\r\n" + body(n))
+					break
+				when 'connections'
+					s = connections.to_s
+					c.write("HTTP/1.1 200 OK\r\nContent-Length: #{s.size}\r\n\r\n" + s)
+				else
+					c.write("HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n")
+				end
+			end
+		rescue => e
+			puts e
+		ensure
+			c.close
+		end
+	end
+end
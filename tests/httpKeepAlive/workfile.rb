@@ -0,0 +1,26 @@
+#!/usr/bin/ruby
+
+require File.expand_path('../../rules/native_mosync.rb')
+
+work = MoSyncExe.new
+work.instance_eval do
+	@SOURCES = ['.']
+	@EXTRA_INCLUDES = ['../../intlibs', '../../runtimes/cpp/platforms/sdl']
+	@LOCAL_LIBS = ['net', 'mosync_log_file']
+	@NAME = 'httpKeepAlive'
+end
+
+target :default do
+	work.invoke
+end
+
+target :clean do
+	work.setup
+	work.execute_clean
+end
+
+target :run => :default do
+	sh work.target
+end
+
+Targets.invoke
@@ -0,0 +1,321 @@
+/* Copyright (C) 2009 Mobile Sorcery AB
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License, version 2, as published by
+the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING.  If not, write to the Free
+Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.
+*/
+
+//Checks that every set of ImageKernels this CPU can run writes exactly the
+//pixels of the loops Image::drawImageRegion and drawFilledRect used to have,
+//for all pixel formats and for straight, mirrored and rotated rows.
+//Then times each set against those loops.
+//usage: imageKernels [megapixels per benchmark]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <ImageKernels.h>
+
+#define W 67
+#define H 61
+#define TRIALS 2000
+
+struct Format {
+	const char* name;
+	int bpp;
+	BlendFormat f;
+};
+
+static const Format sFormats[] = {
+	{ "RGB444", 2, { 0x0f00, 0x00f0, 0x000f, 0, 8, 4, 0, 0 } },
+	{ "RGB555", 2, { 0x7c00, 0x03e0, 0x001f, 0, 10, 5, 0, 0 } },
+	{ "RGB565", 2, { 0xf800, 0x07e0, 0x001f, 0, 11, 5, 0, 0 } },
+	{ "RGB888", 4, { 0x00ff0000, 0x0000ff00, 0x000000ff, 0, 16, 8, 0, 0 } },
+	{ "ARGB8888", 4, { 0x00ff0000, 0x0000ff00, 0x000000ff, 0xff000000, 16, 8, 0, 24 } },
+};
+#define NFORMATS (int)(sizeof(sFormats) / sizeof(Format))
+
+//******************************************************************************
+// The old loops
+//******************************************************************************
+
+static void refFill16(u16* dst, u16 color, int n) {
+	while(n--) *dst++ = color;
+}
+
+static void refFill32(u32* dst, u32 color, int n) {
+	while(n--) *dst++ = color;
+}
+
+static void refCopy(unsigned char* dst, const unsigned char* src, int srcPitchX, int bpp, int n) {
+	while(n--) {
+		memcpy(dst, src, bpp);
+		src+=srcPitchX;
+		dst+=bpp;
+	}
+}
+
+template<class T> static void refBlend(T* dst_scan, const T* src_scan, int srcPitchX,
+	const u8* ascan, int srcAPX, int x, const BlendFormat& d, const BlendFormat& s)
+{
+	while(x--) {
+		int sr = (((*src_scan)&s.redMask)>>s.redShift);
+		int sg = (((*src_scan)&s.greenMask)>>s.greenShift);
+		int sb = (((*src_scan)&s.blueMask)>>s.blueShift);
+		int sa = ascan ? *ascan : (int)(((*src_scan)&s.alphaMask)>>s.alphaShift);
+		int dr = (((*dst_scan)&d.redMask)>>d.redShift);
+		int dg = (((*dst_scan)&d.greenMask)>>d.greenShift);
+		int db = (((*dst_scan)&d.blueMask)>>d.blueShift);
+
+		if(sa == 255) {
+			*dst_scan = (((sr)<< d.redShift)&d.redMask) |
+				(((sg)<< d.greenShift)&d.greenMask) |
+				(((sb)<< d.blueShift)&d.blueMask);
+		} else if(sa == 0) {
+			*dst_scan = (((dr)<< d.redShift)&d.redMask) |
+				(((dg)<< d.greenShift)&d.greenMask) |
+				(((db)<< d.blueShift)&d.blueMask);
+		} else {
+			*dst_scan =
+				(((dr + (((sr-dr)*(sa))>>8)) << d.redShift)&d.redMask) |
+				(((dg + (((sg-dg)*(sa))>>8)) << d.greenShift)&d.greenMask) |
+				(((db + (((sb-db)*(sa))>>8)) << d.blueShift)&d.blueMask);
+		}
+
+		src_scan+=srcPitchX;
+		dst_scan++;
+		if(ascan)
+			ascan+=srcAPX;
+	}
+}
+
+//******************************************************************************
+// Exactness
+//******************************************************************************
+
+static u32 sSrc32[W*H];
+static u16 sSrc16[W*H];
+static u8 sAlpha[W*H];
+static u32 sDst[2][W + 16];
+
+static int sErrors = 0;
+
+static void fillRandom() {
+	for(int i = 0; i < W*H; i++) {
+		sSrc32[i] = (rand() << 16) ^ rand();
+		sSrc16[i] = (u16)rand();
+		// plenty of the fully transparent and opaque pixels the loops treat apart
+		switch(rand() & 3) {
+		case 0: sAlpha[i] = 0; break;
+		case 1: sAlpha[i] = 255; break;
+		default: sAlpha[i] = (u8)rand();
+		}
+		if((rand() & 3) == 0)
+			sSrc32[i] = (sSrc32[i] & 0xffffff) | ((rand() & 1) ? 0xff000000 : 0);
+	}
+	for(int i = 0; i < W + 16; i++)
+		sDst[0][i] = sDst[1][i] = (rand() << 16) ^ rand();
+}
+
+// a random row of n pixels in a W*H image, read in one of the directions of the blits.
+static int randomRow(int n, int& step) {
+	static const int steps[] = { 1, -1, W, -W };
+	step = steps[rand() & 3];
+	int len = step == 1 || step == -1 ? W : H;
+	int first = rand() % (len - n + 1);
+	int x = rand() % W, y = rand() % H;
+	switch(step) {
+	case 1: return y*W + first;
+	case -1: return y*W + first + n - 1;
+	case W: return first*W + x;
+	default: return (first + n - 1)*W + x;
+	}
+}
+
+static void check(const char* set, const char* what, const void* a, const void* b, int bytes) {
+	if(memcmp(a, b, bytes) != 0) {
+		if(sErrors < 20)
+			printf("%s: %s differs\n", set, what);
+		sErrors++;
+	}
+}
+
+static void testSet(const ImageKernels& k) {
+	char what[64];
+	srand(1);
+	for(int t = 0; t < TRIALS; t++) {
+		fillRandom();
+		int n = rand() % (H + 1);
+		int off = rand() & 7;
+		int step;
+		int start = randomRow(n, step);
+		u32 color = (rand() << 16) ^ rand();
+
+		refFill16((u16*)sDst[0] + off, (u16)color, n);
+		k.fill16((u16*)sDst[1] + off, (u16)color, n);
+		check(k.name, "fill16", sDst[0], sDst[1], sizeof(sDst[0]));
+
+		refFill32(sDst[0] + off, color, n);
+		k.fill32(sDst[1] + off, color, n);
+		check(k.name, "fill32", sDst[0], sDst[1], sizeof(sDst[0]));
+
+		refCopy((u8*)((u16*)sDst[0] + off), (u8*)(sSrc16 + start), step*2, 2, n);
+		k.copy16((u16*)sDst[1] + off, sSrc16 + start, step, n);
+		sprintf(what, "copy16 step %i", step);
+		check(k.name, what, sDst[0], sDst[1], sizeof(sDst[0]));
+
+		refCopy((u8*)(sDst[0] + off), (u8*)(sSrc32 + start), step*4, 4, n);
+		k.copy32(sDst[1] + off, sSrc32 + start, step, n);
+		sprintf(what, "copy32 step %i", step);
+		check(k.name, what, sDst[0], sDst[1], sizeof(sDst[0]));
+
+		const Format& df = sFormats[rand() % NFORMATS];
+		const Format* sf = &df;
+		if(rand() & 1) {
+			sf = &sFormats[rand() % NFORMATS];
+			if(sf->bpp != df.bpp)
+				sf = &df;
+		}
+		sprintf(what, "blend %s onto %s step %i", sf->name, df.name, step);
+		if(df.bpp == 2) {
+			refBlend((u16*)sDst[0] + off, sSrc16 + start, step, sAlpha + start, step, n, df.f, sf->f);
+			k.blend16((u16*)sDst[1] + off, sSrc16 + start, step, sAlpha + start, step, n, df.f, sf->f);
+		} else {
+			refBlend(sDst[0] + off, sSrc32 + start, step, sAlpha + start, step, n, df.f, sf->f);
+			k.blend32(sDst[1] + off, sSrc32 + start, step, sAlpha + start, step, n, df.f, sf->f);
+			check(k.name, what, sDst[0], sDst[1], sizeof(sDst[0]));
+			if(sf->f.alphaMask) {
+				strcat(what, ", alpha in pixels");
+				refBlend(sDst[0] + off, sSrc32 + start, step, (u8*)NULL, 0, n, df.f, sf->f);
+				k.blend32(sDst[1] + off, sSrc32 + start, step, NULL, 0, n, df.f, sf->f);
+			}
+		}
+		check(k.name, what, sDst[0], sDst[1], sizeof(sDst[0]));
+	}
+}
+
+//******************************************************************************
+// Throughput
+//******************************************************************************
+
+#define BW 240
+#define BH 320
+
+static u32 sBigSrc[BW*BH];
+static u8 sBigAlpha[BW*BH];
+static u32 sBigDst[BW*BH];
+
+static int sPixels;
+
+enum Op { FILL16, FILL32, COPY32, COPY32_ROT90, COPY16_MIRROR, BLEND565, BLEND32, BLEND32_ROT90, NOPS };
+static const char* sOpNames[] = { "fill 16", "fill 32", "copy 32", "copy 32 rot90",
+	"copy 16 mirror", "blend 565", "blend 32", "blend 32 rot90" };
+
+// a row is BW pixels; rotated rows read a column of the source.
+static void runOp(const ImageKernels* k, Op op, int row) {
+	static const BlendFormat rgb565 = sFormats[2].f, argb = sFormats[4].f;
+	u32* dst = sBigDst + row*BW;
+	u16* dst16 = (u16*)dst;
+	int r = row % BH;
+	switch(op) {
+	case FILL16:
+		if(k) k->fill16(dst16, 0x1234, BW); else refFill16(dst16, 0x1234, BW);
+		break;
+	case FILL32:
+		if(k) k->fill32(dst, 0x123456, BW); else refFill32(dst, 0x123456, BW);
+		break;
+	case COPY32:
+		if(k) k->copy32(dst, sBigSrc + r*BW, 1, BW);
+		else refCopy((u8*)dst, (u8*)(sBigSrc + r*BW), 4, 4, BW);
+		break;
+	case COPY32_ROT90: {
+		const u32* src = sBigSrc + (BH-1)*BW + r % BW;
+		if(k) k->copy32(dst, src, -BW, BH < BW ? BH : BW);
+		else refCopy((u8*)dst, (u8*)src, -BW*4, 4, BH < BW ? BH : BW);
+		break; }
+	case COPY16_MIRROR: {
+		const u16* src = (u16*)(sBigSrc + r*BW) + BW - 1;
+		if(k) k->copy16(dst16, src, -1, BW); else refCopy((u8*)dst16, (u8*)src, -2, 2, BW);
+		break; }
+	case BLEND565: {
+		const u16* src = (u16*)(sBigSrc + r*BW);
+		const u8* a = sBigAlpha + r*BW;
+		if(k) k->blend16(dst16, src, 1, a, 1, BW, rgb565, rgb565);
+		else refBlend(dst16, src, 1, a, 1, BW, rgb565, rgb565);
+		break; }
+	case BLEND32:
+		if(k) k->blend32(dst, sBigSrc + r*BW, 1, NULL, 0, BW, argb, argb);
+		else refBlend(dst, sBigSrc + r*BW, 1, (u8*)NULL, 0, BW, argb, argb);
+		break;
+	case BLEND32_ROT90: {
+		int n = BH < BW ? BH : BW;
+		const u32* src = sBigSrc + (BH-1)*BW + r % BW;
+		const u8* a = sBigAlpha + (BH-1)*BW + r % BW;
+		if(k) k->blend32(dst, src, -BW, a, -BW, n, argb, argb);
+		else refBlend(dst, src, -BW, a, -BW, n, argb, argb);
+		break; }
+	default:
+		break;
+	}
+}
+
+static double bench(const ImageKernels* k, Op op) {
+	int rows = sPixels / BW;
+	clock_t start = clock();
+	for(int i = 0; i < rows; i++)
+		runOp(k, op, i % BH);
+	double s = (double)(clock() - start) / CLOCKS_PER_SEC;
+	if(s <= 0)
+		s = 1.0 / CLOCKS_PER_SEC;
+	return rows * (double)BW / s / 1e6;
+}
+
+int main(int argc, char** argv) {
+	sPixels = (argc > 1 ? atoi(argv[1]) : 64) * 1000000;
+
+	static const ImageKernelSet sets[] = { IMAGE_KERNELS_SCALAR, IMAGE_KERNELS_SSE2, IMAGE_KERNELS_AVX2 };
+	const ImageKernels* kernels[3];
+	int nKernels = 0;
+	for(int i = 0; i < 3; i++) {
+		const ImageKernels* k = getImageKernels(sets[i]);
+		if(k) {
+			kernels[nKernels++] = k;
+			testSet(*k);
+		}
+	}
+	printf("selected: %s\n", imageKernels().name);
+	if(sErrors) {
+		printf("%i errors\n", sErrors);
+		return 1;
+	}
+	printf("%i sets exact\n", nKernels);
+
+	srand(2);
+	for(int i = 0; i < BW*BH; i++) {
+		sBigSrc[i] = (rand() << 16) ^ rand();
+		sBigAlpha[i] = (u8)rand();
+	}
+
+	printf("\nM pixels/s     %9s", "old loops");
+	for(int i = 0; i < nKernels; i++)
+		printf(" %9s", kernels[i]->name);
+	printf("\n");
+	for(int op = 0; op < NOPS; op++) {
+		printf("%-14s %9.1f", sOpNames[op], bench(NULL, (Op)op));
+		for(int i = 0; i < nKernels; i++)
+			printf(" %9.1f", bench(kernels[i], (Op)op));
+		printf("\n");
+	}
+	return 0;
+}
@@ -0,0 +1,194 @@
+/* Copyright (C) 2009 Mobile Sorcery AB
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License, version 2, as published by
+the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING.  If not, write to the Free
+Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.
+*/
+
+// Exercises most MoSync opcodes and logs a checksum after each part.
+// run_diff.sh runs it on the interpreter and on the recompiler and
+// compares the logs; any difference is a recompiler bug.
+
+#include <maapi.h>
+#include <mavsprintf.h>
+#include <madmath.h>
+
+#define N 256
+
+static unsigned sHash = 2166136261u;
+
+static void mix(unsigned v) {
+	sHash = (sHash ^ v) * 16777619u;
+}
+
+static void report(const char* part) {
+	lprintfln("RDIFF %s %08x", part, sHash);
+}
+
+static int sInts[N];
+static short sShorts[N];
+static signed char sChars[N];
+static unsigned char sBytes[N];
+
+static void arithmetic(void) {
+	int i;
+	int a = 0x12345678, b = -77;
+	unsigned u = 0xfedcba98u;
+	for(i = 0; i < 1000; i++) {
+		a = a * 1103515245 + 12345;
+		b += a >> 7;
+		u ^= (unsigned)a >> (i & 31);
+		mix(a + b);
+		mix(a - b);
+		mix(a & b);
+		mix(a | b);
+		mix(a ^ b);
+		mix(~a);
+		mix(-b);
+		mix(a << (b & 31));
+		mix(a >> (b & 31));
+		mix(u >> (b & 31));
+		mix(a << 3);
+		mix(a >> 29);
+		mix(u >> 13);
+		mix(a * b);
+		mix(a * 37);
+		if(b != 0) {
+			mix(a / b);
+			mix(a % b);
+			mix(u / (unsigned)b);
+			mix(u % (unsigned)b);
+		}
+		mix(a / 7);
+		mix(a % -13);
+		mix(u / 10);
+		mix(a + 0x7fffffff);
+		mix(a & 0xffff);
+		mix(a | 0x80000000);
+	}
+	report("arithmetic");
+}
+
+static void memory(void) {
+	int i;
+	for(i = 0; i < N; i++) {
+		sInts[i] = i * 0x01010101;
+		sShorts[i] = (short)(i * 257 - 30000);
+		sChars[i] = (signed char)(i - 128);
+		sBytes[i] = (unsigned char)(255 - i);
+	}
+	for(i = 0; i < N; i++) {
+		int j = (i * 7) & (N - 1);
+		sInts[j] += sShorts[i] + sChars[(i + 3) & (N - 1)] + sBytes[i];
+		sShorts[j] ^= (short)sInts[i];
+		sChars[j] += sBytes[j];
+		mix(sInts[j]);
+		mix(sShorts[j]);
+		mix(sChars[j]);
+		mix(sBytes[(j + 1) & (N - 1)]);
+	}
+	report("memory");
+}
+
+static int pick(int x) {
+	switch(x) {
+	case 0: return 11;
+	case 1: return 23;
+	case 2: return 37;
+	case 3: return 41;
+	case 4: return 59;
+	case 5: return 61;
+	case 6: return 79;
+	case 7: return 83;
+	case 9: return 97;
+	case 10: return 101;
+	default: return -1;
+	}
+}
+
+static int compare(int a, int b) {
+	int r = 0;
+	if(a == b) r |= 1;
+	if(a != b) r |= 2;
+	if(a < b) r |= 4;
+	if(a <= b) r |= 8;
+	if(a > b) r |= 16;
+	if(a >= b) r |= 32;
+	if((unsigned)a < (unsigned)b) r |= 64;
+	if((unsigned)a <= (unsigned)b) r |= 128;
+	if((unsigned)a > (unsigned)b) r |= 256;
+	if((unsigned)a >= (unsigned)b) r |= 512;
+	return r;
+}
+
+static int fib(int n) {
+	return n < 2 ? n : fib(n - 1) + fib(n - 2);
+}
+
+static int add(int a, int b) { return a + b; }
+static int sub(int a, int b) { return a - b; }
+static int mul(int a, int b) { return a * b; }
+
+static void control(void) {
+	static int (* const ops[])(int, int) = { add, sub, mul };
+	int i;
+	for(i = -3; i < 14; i++)
+		mix(pick(i));
+	for(i = 0; i < 64; i++)
+		mix(compare(sInts[i], sInts[(i * 5) & (N - 1)]));
+	mix(compare(-1, 1));
+	mix(compare(0x7fffffff, (int)0x80000000));
+	for(i = 0; i < 300; i++)
+		mix(ops[i % 3](i, sInts[i & (N - 1)]));
+	mix(fib(22));
+	report("control");
+}
+
+static void floating(void) {
+	double d = 1.0;
+	float f = 0.5f;
+	int i;
+	for(i = 1; i < 100; i++) {
+		d = d * 1.0001 + sqrt((double)i) / i;
+		f = f * 0.75f + (float)i;
+		mix((int)d);
+		mix((int)(d * 1000.0));
+		mix((int)f);
+		mix(d < f);
+	}
+	report("floating");
+}
+
+static void yielding(void) {
+	MAEvent e;
+	int i;
+	// maWait ends the time slice, so the recompiled code
+	// must resume correctly after it.
+	for(i = 0; i < 20; i++) {
+		maWait(1);
+		while(maGetEvent(&e))
+			;
+		mix(sInts[i] + i);
+	}
+	report("yielding");
+}
+
+int MAMain(void) {
+	arithmetic();
+	memory();
+	control();
+	floating();
+	yielding();
+	lprintfln("RDIFF done");
+	return 0;
+}
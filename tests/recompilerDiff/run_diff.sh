@@ -0,0 +1,18 @@
+#run recompilerDiff on MoRE's switch interpreter and on the x86-64
+#recompiler, and compare the checksums they log.
+#MoRE must be built with USE_X64_RECOMPILER defined in config_platform.h.
+
+./workfile.rb CONFIG=
+for MODE in switch recompiler
+do
+	DISPATCH=$MODE ./workfile.rb run CONFIG=
+	grep RDIFF log.txt > rdiff_$MODE.txt
+	mv log.txt log_$MODE.txt
+done
+if diff rdiff_switch.txt rdiff_recompiler.txt && grep -q "RDIFF done" rdiff_recompiler.txt
+then
+	echo "recompilerDiff: OK"
+else
+	echo "recompilerDiff: FAILED"
+	exit 1
+fi
@@ -0,0 +1,13 @@
+#!/usr/bin/ruby
+
+require File.expand_path(ENV['MOSYNCDIR']+'/rules/mosync_exe.rb')
+
+work = PipeExeWork.new
+work.instance_eval do
+	@SOURCES = []
+	@EXTRA_SOURCEFILES = ["recompilerDiff.c"]
+	@NAME = "recompilerDiff"
+	@EXTRA_EMUFLAGS = " -noscreen -dispatch #{ENV['DISPATCH'] || 'recompiler'}"
+end
+
+work.invoke
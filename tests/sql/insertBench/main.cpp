@@ -0,0 +1,135 @@
+/*
+Copyright (C) 2011 MoSync AB
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License,
+version 2, as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA 02110-1301, USA.
+*/
+
+/**
+ * @file main.cpp
+ *
+ * Insert and lookup throughput of the Database API.
+ *
+ * Every test runs the same SQL text over and over, the way an app
+ * syncing a list of records does, so after the first row the runtime
+ * can take the statement from its cache instead of preparing it again.
+ * Inserts are timed both on their own, where each one is committed
+ * to the file, and inside maDBBeginTransaction()/maDBCommitTransaction().
+ */
+
+#include <ma.h>
+#include <conprint.h>
+#include <MAUtil/String.h>
+
+#define ROWS 1000
+
+static MAUtil::String localPath() {
+	char buffer[1024];
+	int size = maGetSystemProperty("mosync.path.local", buffer, sizeof(buffer));
+	if(size < 0 || size > (int)sizeof(buffer))
+		return "/";
+	return buffer;
+}
+
+static void check(int result, const char* what) {
+	if(result < 0) {
+		printf("%s failed: %i\n", what, result);
+		maPanic(result, what);
+	}
+}
+
+static void resetTable(MAHandle db) {
+	check(maDBExecSQL(db, "DROP TABLE IF EXISTS item"), "drop");
+	check(maDBExecSQL(db,
+		"CREATE TABLE item (id INTEGER PRIMARY KEY, name TEXT, price DOUBLE)"),
+		"create");
+}
+
+static void insertRows(MAHandle db, int first) {
+	char name[32];
+	MADBValue params[3];
+	for(int i = first; i < first + ROWS; i++) {
+		sprintf(name, "item %i", i);
+		params[0].type = MA_DB_TYPE_INT;
+		params[0].i = i;
+		params[1].type = MA_DB_TYPE_TEXT;
+		params[1].text.addr = name;
+		params[1].text.length = -1;
+		params[2].type = MA_DB_TYPE_DOUBLE;
+		params[2].d = i * 0.5;
+		check(maDBExecSQLParams(db,
+			"INSERT INTO item (id, name, price) VALUES (?, ?, ?)", params, 3),
+			"insert");
+	}
+}
+
+static int lookupRows(MAHandle db) {
+	MADBValue param;
+	int found = 0;
+	for(int i = 0; i < ROWS; i++) {
+		param.type = MA_DB_TYPE_INT;
+		param.i = i;
+		MAHandle cursor = maDBExecSQLParams(db,
+			"SELECT name, price FROM item WHERE id = ?", &param, 1);
+		check(cursor, "select");
+		if(cursor > 0) {
+			if(maDBCursorNext(cursor) == MA_DB_OK)
+				found++;
+			maDBCursorDestroy(cursor);
+		}
+	}
+	return found;
+}
+
+static void report(const char* name, int ms) {
+	if(ms == 0)
+		ms = 1;
+	printf("%s: %i rows in %i ms, %i rows/s\n", name, ROWS, ms, ROWS * 1000 / ms);
+}
+
+extern "C" int MAMain() {
+	MAUtil::String path = localPath() + "insertBench.db";
+	MAHandle db = maDBOpen(path.c_str());
+	check(db, "open");
+	resetTable(db);
+
+	int start = maGetMilliSecondCount();
+	insertRows(db, 0);
+	report("insert, one commit each", maGetMilliSecondCount() - start);
+
+	resetTable(db);
+	start = maGetMilliSecondCount();
+	check(maDBBeginTransaction(db), "begin");
+	insertRows(db, 0);
+	check(maDBCommitTransaction(db), "commit");
+	report("insert, one transaction", maGetMilliSecondCount() - start);
+
+	start = maGetMilliSecondCount();
+	int found = lookupRows(db);
+	report("lookup by id", maGetMilliSecondCount() - start);
+	if(found != ROWS)
+		printf("lookup found %i of %i rows\n", found, ROWS);
+
+	maDBClose(db);
+	printf("Press any key to exit\n");
+
+	MAEvent event;
+	for(;;) {
+		maWait(0);
+		while(maGetEvent(&event)) {
+			if(event.type == EVENT_TYPE_CLOSE || event.type == EVENT_TYPE_KEY_PRESSED)
+				return 0;
+		}
+	}
+}
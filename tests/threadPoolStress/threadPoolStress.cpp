@@ -0,0 +1,248 @@
+/* Copyright (C) 2009 Mobile Sorcery AB
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License, version 2, as published by
+the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING.  If not, write to the Free
+Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.
+*/
+
+//Stress test for ThreadPool. Runs thousands of blocking socket reads and writes,
+//the way the runtime's ConnOps use the pool, then a burst of small tasks
+//while every thread is blocked, so that the queue fills up.
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ThreadPool.h>
+#include <helpers/atomic.h>
+
+#ifdef WIN32
+#include <winsock2.h>
+typedef int socklen_t;
+#else
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+typedef int SOCKET;
+#define closesocket close
+#define INVALID_SOCKET (-1)
+#endif
+
+#define N_CONNS 32	//CONN_MAX
+#define ROUNDS 100
+#define BLOCK_SIZE 4096
+#define BURST 20000
+
+static MoSyncSemaphore gDone;
+static MoSyncSemaphore gGate;
+static volatile int gFailures = 0;
+static volatile int gBurstCount = 0;
+
+void MoSyncErrorExit(int code) {
+	printf("MoSyncErrorExit(%i)\n", code);
+	exit(code);
+}
+
+static void fail(const char* what) {
+	printf("%s failed\n", what);
+	atomicAdd(&gFailures, 1);
+}
+
+//like ConnRead; blocks until the matching ConnWrite has run.
+class ConnRead : public Runnable {
+public:
+	ConnRead(SOCKET s, char fill) : mSock(s), mFill(fill) {}
+	void run() {
+		char buf[BLOCK_SIZE];
+		int pos = 0;
+		while(pos < BLOCK_SIZE) {
+			int res = recv(mSock, buf + pos, BLOCK_SIZE - pos, 0);
+			if(res <= 0) {
+				fail("recv");
+				break;
+			}
+			pos += res;
+		}
+		for(int i=0; i<pos; i++) {
+			if(buf[i] != mFill) {
+				fail("compare");
+				break;
+			}
+		}
+		gDone.post();
+	}
+private:
+	SOCKET mSock;
+	char mFill;
+};
+
+class ConnWrite : public Runnable {
+public:
+	ConnWrite(SOCKET s, char fill) : mSock(s), mFill(fill) {}
+	void run() {
+		char buf[BLOCK_SIZE];
+		memset(buf, mFill, BLOCK_SIZE);
+		int pos = 0;
+		while(pos < BLOCK_SIZE) {
+			int res = send(mSock, buf + pos, BLOCK_SIZE - pos, 0);
+			if(res <= 0) {
+				fail("send");
+				break;
+			}
+			pos += res;
+		}
+		gDone.post();
+	}
+private:
+	SOCKET mSock;
+	char mFill;
+};
+
+//blocks its thread until the Opener has run.
+class Blocker : public Runnable {
+public:
+	void run() {
+		gGate.wait();
+		gDone.post();
+	}
+};
+
+class Opener : public Runnable {
+public:
+	Opener(int n) : mN(n) {}
+	void run() {
+		MoSyncThread::sleep(500);
+		for(int i=0; i<mN; i++) {
+			gGate.post();
+		}
+		gDone.post();
+	}
+private:
+	int mN;
+};
+
+class Count : public Runnable {
+public:
+	void run() {
+		atomicAdd(&gBurstCount, 1);
+		gDone.post();
+	}
+};
+
+//makes a connected pair of loopback sockets.
+static bool socketPair(SOCKET& a, SOCKET& b) {
+	SOCKET listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if(listener == INVALID_SOCKET)
+		return false;
+	sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+	addr.sin_port = 0;
+	socklen_t len = sizeof(addr);
+	bool ok = bind(listener, (sockaddr*)&addr, sizeof(addr)) == 0 &&
+		listen(listener, 1) == 0 &&
+		getsockname(listener, (sockaddr*)&addr, &len) == 0;
+	if(ok) {
+		a = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+		ok = a != INVALID_SOCKET && connect(a, (sockaddr*)&addr, sizeof(addr)) == 0;
+	}
+	if(ok) {
+		b = accept(listener, NULL, NULL);
+		ok = b != INVALID_SOCKET;
+	}
+	closesocket(listener);
+	return ok;
+}
+
+static void printStats(ThreadPool& pool) {
+	ThreadPoolStats s;
+	pool.getStats(s);
+	int n = s.executed > 0 ? s.executed : 1;
+	printf("threads %i, executed %i, queued %i, max queued %i, full waits %i\n",
+		s.threads, s.executed, s.queued, s.maxQueued, s.fullWaits);
+	printf("wait avg %.2f max %.2f ms, run avg %.2f max %.2f ms\n",
+		s.totalWaitMs / n, s.maxWaitMs, s.totalRunMs / n, s.maxRunMs);
+}
+
+int main() {
+#ifdef WIN32
+	WSADATA wsaData;
+	if(WSAStartup(MAKEWORD(2,2), &wsaData) != 0) {
+		printf("WSAStartup failed\n");
+		return 1;
+	}
+#endif
+	SOCKET a[N_CONNS], b[N_CONNS];
+	for(int i=0; i<N_CONNS; i++) {
+		if(!socketPair(a[i], b[i])) {
+			printf("socketPair failed\n");
+			return 1;
+		}
+	}
+
+	//the same size the runtime uses. the reads are queued first,
+	//so a smaller pool would deadlock.
+	ThreadPool pool(2 * N_CONNS);
+
+	for(int r=0; r<ROUNDS; r++) {
+		for(int i=0; i<N_CONNS; i++) {
+			pool.execute(new ConnRead(b[i], (char)(r + i)));
+			pool.execute(new ConnWrite(a[i], (char)(r + i)));
+		}
+		for(int i=0; i<2 * N_CONNS; i++) {
+			gDone.wait();
+		}
+	}
+	printf("conn ops:\n");
+	printStats(pool);
+
+	int nThreads = 2 * N_CONNS;
+	pool.execute(new Opener(nThreads - 1));
+	for(int i=0; i<nThreads - 1; i++) {
+		pool.execute(new Blocker);
+	}
+	for(int i=0; i<BURST; i++) {
+		pool.execute(new Count);
+	}
+	for(int i=0; i<nThreads + BURST; i++) {
+		gDone.wait();
+	}
+	printf("burst:\n");
+	printStats(pool);
+
+	ThreadPoolStats s;
+	pool.close();
+	pool.getStats(s);
+	for(int i=0; i<N_CONNS; i++) {
+		closesocket(a[i]);
+		closesocket(b[i]);
+	}
+
+	int expected = ROUNDS * 2 * N_CONNS + 2 * N_CONNS + BURST;
+	if(gBurstCount != BURST || s.executed != expected || s.queued != 0) {
+		printf("executed %i of %i tasks\n", s.executed, expected);
+		gFailures++;
+	}
+	if(s.fullWaits == 0) {
+		printf("the queue never filled up\n");
+		gFailures++;
+	}
+	if(gFailures == 0) {
+		printf("threadPoolStress: OK\n");
+		return 0;
+	} else {
+		printf("threadPoolStress: FAILED\n");
+		return 1;
+	}
+}
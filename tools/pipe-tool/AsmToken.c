@@ -94,6 +94,53 @@ int ScanAsmToken(void)
 	return	theSym->Value;
 }
 
+//****************************************
+//	   Get the token of a statement
+// With -cache=dir, the token found at each
+// place in the source is kept, so later
+// passes and links don't scan it again.
+// The length of the token is kept in the
+// top half.
+//****************************************
+
+int GetAsmToken(void)
+{
+	uint offset, v;
+	char *start;
+	int t;
+
+	offset = FilePtr - FileTop;
+
+	if (!ArgLinkCache || offset >= (uint) GetLibaryFileLen())
+	{
+		GetToken();
+		return ScanAsmToken();
+	}
+
+	v = ArrayGet(&AsmTokenArray, offset);
+
+	if (v)
+	{
+		int len = v >> 16;
+
+		// Like GetToken, step over the white space after it
+
+		memcpy(Name, FilePtr, len);
+		Name[len] = 0;
+		FilePtr += len + 1;
+
+		return (v & 0xffff) - 1;
+	}
+
+	start = FilePtr;
+
+	GetToken();
+	t = ScanAsmToken();
+
+	ArraySet(&AsmTokenArray, offset, ((FilePtr - start - 1) << 16) | (t + 1));
+	return t;
+}
+
 
 /*
 TOKENTAB(".extern",      		dir_extern,             0)
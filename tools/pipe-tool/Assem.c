@@ -35,10 +35,42 @@ Software Foundation, 59 Temple Place - Suite 330, Boston, MA
 
 int CodeCopyInit = 0;
 
+//****************************************
+//  Report a step's time and lookups
+//		   for -stats
+//****************************************
+
+int StatsTime;
+
+void StartStats()
+{
+	Stat_VarFinds = 0;
+	Stat_VarProbes = 0;
+	Stat_SymFinds = 0;
+	Stat_SymProbes = 0;
+
+	StatsTime = GetTickCount();
+}
+
+void PrintStats(char *step)
+{
+	if (!ArgStats)
+		return;
+
+	printf("stats: %-10s %6d ms, %8d const lookups (%9d probes), %8d symbol lookups (%9d probes)\n",
+		step, (int) (GetTickCount() - StatsTime),
+		Stat_VarFinds, Stat_VarProbes, Stat_SymFinds, Stat_SymProbes);
+}
+
+//****************************************
+//
+//****************************************
+
 void AsmMain()
 {
 	int p;
 	int t = GetTickCount();
+	char step[32];
 
 	CodeCopyInit = 0;
 
@@ -77,8 +109,16 @@ void AsmMain()
 
 	for (p=1;p<32;p++)
 	{
+		int done;
+
 		printf("pass %i. %i known symbols.\n", p, CountUsedSymbols());
-		if (AsmPass(p))
+
+		StartStats();
+		done = AsmPass(p);
+		sprintf(step, "pass %i", p);
+		PrintStats(step);
+
+		if (done)
 			break;
 	}
 
@@ -90,7 +130,9 @@ void AsmMain()
 	Final_Pass = 1;
 	RedefENum("__final__",1);
 
+	StartStats();
 	AsmPass(p+1);
+	PrintStats("final pass");
 
 //-------------------------
 //  Do dependency search
@@ -100,6 +142,8 @@ void AsmMain()
 
 	if (Do_Elimination)
 	{
+		StartStats();
+
 		SearchDep_Main();
 
 		if (ArgJavaNative)
@@ -125,6 +169,8 @@ void AsmMain()
 		{
 			Rebuild_Main();
 		}
+
+		PrintStats("rebuild");
 	}
 
 #endif
@@ -136,6 +182,8 @@ void AsmMain()
 	if (LIST)
 		printf("LocalScope %d\n",LocalScope);
 
+	StartStats();
+
 	if (!ArgJavaNative)
 		WriteModule();
 
@@ -169,6 +217,11 @@ void AsmMain()
 
 //	PerfEnd();
 
+	PrintStats("output");
+
+	if (ArgStats)
+		printf("stats: %d constants, %d symbols\n", VarCount, CountUsedSymbols());
+
 	t = GetTickCount() - t;
 
 	printf("Symbols used %d\n",CountUsedSymbols());
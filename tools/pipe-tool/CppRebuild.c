@@ -22,6 +22,11 @@ Software Foundation, 59 Temple Place - Suite 330, Boston, MA
 
 #include "compile.h"
 
+#ifndef _WIN32
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
 // fix >>>
 // put in prototypes
 // remove static
@@ -31,6 +36,8 @@ Software Foundation, 59 Temple Place - Suite 330, Boston, MA
 #ifdef INCLUDE_CPP_REBUILD
 
 //#define CPP_SHOW_LINES
+#define CPP_LOCAL_GLOBALS
+#define CPP_TAIL_CALLS
 //#define LOG_REGISTER_STATE_CHANGES
 //#define CPP_DEBUG
 
@@ -41,6 +48,8 @@ static int ThisFunctionRegs;			// Register usage for current function
 static int ThisFunctionRetType;
 static int ThisFunctionExit;			// True on last instruction
 static int ReturnCount;
+static int ThisFunctionLocalSP;			// sp is a local, stored to ::sp for calls
+static int ThisCallIsTail;				// The next instruction is a RET
 
 static int CppUsedCallReg;
 
@@ -516,6 +525,11 @@ void CppDecodeSysCall(OpcodeInfo *theOp)
 
 	param_count = syscall->Params;
 
+	// Parameters after the fourth are read from the stack
+
+	if (param_count > 4)
+		CppEmitStoreSP();
+
 	CppEmitReturnType(syscall->RetType);
 
 
@@ -661,9 +675,68 @@ int CppDecodeCall(OpcodeInfo *theOp)
 
 	ref = labref;
 
+	CppEmitStoreSP();
+
+	if (ThisCallIsTail && CppTailCallFunction(ref))
+		return 1;
+
 	return CppCallFunction(ref, 1);
 }
 
+//****************************************
+//	  Store the local sp for a callee
+//****************************************
+
+void CppEmitStoreSP()
+{
+	if (ThisFunctionLocalSP)
+		RebuildEmit("	::sp = sp;");
+}
+
+//****************************************
+//	 Return the result of a call directly
+//	 if it is what this function returns
+//****************************************
+
+int CppTailCallFunction(SYMBOL *ref)
+{
+	int param_count, need_comma, n;
+	int ours = ThisFunctionRetType;
+	int theirs = ref->RetType;
+
+	// A double call has set __dbl_high already
+
+	if (ours == RET_float)
+		ours = RET_int;
+
+	if (theirs == RET_float)
+		theirs = RET_int;
+
+	if (ours != theirs || (ours != RET_int && ours != RET_double))
+		return 0;
+
+	RebuildEmit("	return %s_%d(", ref->Name, ref->LocalScope);
+
+	param_count = ref->Params;
+
+	if (param_count > 4)
+		param_count = 4;
+
+	need_comma = 0;
+
+	for (n=0;n<param_count;n++)
+	{
+		if (need_comma)
+			RebuildEmit(", ");
+
+		RebuildEmit("%s", Cpp_reg[REG_i0 + n]);
+		need_comma = 1;
+	}
+
+	RebuildEmit(");	// tail call");
+	return 1;
+}
+
 //****************************************
 //
 //****************************************
@@ -676,6 +749,8 @@ void CppDecodeCallReg(OpcodeInfo *theOp)
 	int i2 = funcprop.reg_used & REGBIT(REG_i2);
 	int i3 = funcprop.reg_used & REGBIT(REG_i3);
 
+	CppEmitStoreSP();
+
 	RebuildEmit("	r14 = CallReg(%s", Cpp_reg[theOp->rd]);
 
 	if (i0)
@@ -1010,7 +1085,8 @@ void RebuildCppProlog(SYMBOL *sym, int isproto)
 		RebuildEmit("//tfr        = %s\n", Bin32(ThisFunctionRegs));
 		RebuildEmit("\n");
 	}
-	else RebuildEmit("static ");
+	else if (!ArgCppShards)
+		RebuildEmit("static ");
 
 	// Output function decl
 	switch(ThisFunctionRetType)
@@ -1104,6 +1180,26 @@ void RebuildCppProlog(SYMBOL *sym, int isproto)
 		RebuildEmit(";\n\n");
 	}
 
+	// sp and mem_ds are globals, and any store through mem_ds might change
+	// them as far as the C++ compiler knows, so they would be reloaded after
+	// each one. Keep them in locals. mem_ds is set once at startup, and sp
+	// goes back to the global before anything that reads it.
+
+	ThisFunctionLocalSP = 0;
+
+#ifdef CPP_LOCAL_GLOBALS
+	if (REGUSED(funcprop.reg_used, REG_sp))
+	{
+		RebuildEmit("\tint sp = ::sp;\n");
+		ThisFunctionLocalSP = 1;
+	}
+
+	if (funcprop.mem_access)
+		RebuildEmit("\tunsigned char *mem_ds = ::mem_ds;\n");
+
+	if (ThisFunctionLocalSP || funcprop.mem_access)
+		RebuildEmit("\n");
+#endif
 }
 
 //****************************************
@@ -1117,6 +1213,11 @@ void RebuildCppEpilog(SYMBOL *sym)
 	if (ReturnCount > 0)
 		RebuildEmit("label_0:;\n");
 
+	// Callers that don't use sp expect ::sp to be as it was
+
+	if (ThisFunctionLocalSP && funcprop.calls)
+		RebuildEmit("	::sp = sp;\n");
+
 	CppDecodeReturn(1);
 	RebuildEmit("\n");
 
@@ -1200,6 +1301,20 @@ void RebuildCppFunc(SYMBOL *sym, int isproto)
 		if (ip > ip_end)
 			ThisFunctionExit = 1;
 
+		ThisCallIsTail = 0;
+
+#ifdef CPP_TAIL_CALLS
+		if (thisOp.op == _CALLI && ip <= ip_end)
+		{
+			OpcodeInfo nextOp;
+
+			DecodeOpcode(&nextOp, ip);
+
+			if (nextOp.op == _RET)
+				ThisCallIsTail = 1;
+		}
+#endif
+
 		RebuildCppInst(&thisOp);
 
 //		DecodeAsmString(&thisOp, str);
@@ -1242,13 +1357,13 @@ void RebuildCppFunc(SYMBOL *sym, int isproto)
 //
 //****************************************
 
-void RebuildCpp_Code()
+void RebuildCpp_Code(int lo, int hi)
 {
 	SYMBOL *sym;
 	int n;
 	int c = 0;
 
-	for (n=0;n<CodeIP+1;n++)
+	for (n=lo;n<hi;n++)
 	{
 		sym = (SYMBOL *) ArrayGet(&CodeLabelArray, n);
 
@@ -1275,7 +1390,10 @@ void RebuildCpp_EmitProtos()
 
 	RebuildEmit("\n// Prototypes\n\n");
 
-	RebuildEmit("static int CallReg(int s, int i0, int i1, int i2, int i3);\n");
+	if (ArgCppShards)
+		RebuildEmit("int CallReg(int s, int i0, int i1, int i2, int i3);\n");
+	else
+		RebuildEmit("static int CallReg(int s, int i0, int i1, int i2, int i3);\n");
 
 	for (n=0;n<CodeIP+1;n++)
 	{
@@ -1562,6 +1680,242 @@ void RebuildCpp_EmitExtensionsProto()
 	}
 }
 
+//****************************************
+//	 Is there an emitted function at ip
+//****************************************
+
+SYMBOL * RebuildCpp_FuncAt(int ip)
+{
+	SYMBOL *sym = (SYMBOL *) ArrayGet(&CodeLabelArray, ip);
+
+	if (sym)
+	if (sym->Flags & SymFlag_Ref)
+	if (sym->LabelType >= label_Function)
+		return sym;
+
+	return 0;
+}
+
+//****************************************
+//	Split the code into shards that have
+//	  about the same amount of code each
+//****************************************
+
+void RebuildCpp_ShardBounds(int *bounds, int shards)
+{
+	SYMBOL *sym;
+	double total = 0;
+	double done = 0;
+	int shard = 1;
+	int n;
+
+	for (n=0;n<CodeIP+1;n++)
+	{
+		sym = RebuildCpp_FuncAt(n);
+
+		if (sym)
+			total += sym->EndIP - sym->Value + 1;
+	}
+
+	// Shard k starts at the first function past k shares
+
+	bounds[0] = 0;
+
+	for (n=0;n<CodeIP+1 && shard < shards;n++)
+	{
+		sym = RebuildCpp_FuncAt(n);
+
+		if (!sym)
+			continue;
+
+		if (done >= total * shard / shards)
+			bounds[shard++] = n;
+
+		done += sym->EndIP - sym->Value + 1;
+	}
+
+	// Too few functions leaves the last shards empty
+
+	while (shard <= shards)
+		bounds[shard++] = CodeIP+1;
+}
+
+//****************************************
+//	 Write the functions of one shard
+//****************************************
+
+void RebuildCpp_WriteShard(int shard, int lo, int hi)
+{
+	char name[64];
+
+	ArrayDispose(&RebuildArray);
+	ArrayInit(&RebuildArray, sizeof(char), 0);
+
+	RebuildEmit("//****************************************\n");
+	RebuildEmit("//      Generated Cpp code, shard %d\n", shard);
+	RebuildEmit("//****************************************\n");
+
+	RebuildEmit("\n");
+	RebuildEmit("#define REBUILD_SHARD\n");
+	RebuildEmit("#include \"mstypeinfo.h\"\n");
+	RebuildEmit("#include \"rebuild.build.h\"\n");
+
+	RebuildCpp_Code(lo, hi);
+
+	sprintf(name, "rebuild.build.%d.cpp", shard);
+
+	if (!ArrayWrite(&RebuildArray, name))
+		Error(Error_Fatal, "Problem writing '%s'", name);
+}
+
+//****************************************
+//	  Write the sharded C++ rebuild
+//****************************************
+
+// rebuild.build.h has the prototypes, rebuild.build.cpp the startup and the
+// CallReg sink, and rebuild.build.1.cpp to rebuild.build.<n>.cpp the functions.
+// The functions are no longer static, so they can call each other across
+// shards. Where fork() is available, each shard is written by its own process,
+// with at most one process per CPU running at a time.
+
+#ifndef _WIN32
+
+// Wait for the shard process with the given pid, or any of them if it's -1,
+// and check that it wrote its shard. pid[] has the first count shards;
+// the entry of the finished one is cleared.
+
+void RebuildCpp_WaitShard(int *pid, int count, int which)
+{
+	int status;
+	int done;
+	int n;
+
+	done = waitpid(which, &status, 0);
+
+	for (n=0;n<count;n++)
+	{
+		if (pid[n] == done)
+			break;
+	}
+
+	if (done <= 0 || n == count)
+		Error(Error_Fatal, "(RebuildCpp_WaitShard) lost a shard process");
+
+	pid[n] = 0;
+
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+		Error(Error_Fatal, "Problem writing 'rebuild.build.%d.cpp'", n + 1);
+}
+
+#endif
+
+void RebuildCpp_Sharded()
+{
+	int bounds[MAX_CPP_SHARDS + 1];
+	int shards = ArgCppShards;
+	int n;
+#ifndef _WIN32
+	int pid[MAX_CPP_SHARDS];
+	int maxLive, live;
+#endif
+
+	RebuildCpp_ShardBounds(bounds, shards);
+
+#ifndef _WIN32
+	fflush(stdout);
+
+	// No more shards at a time than there are CPUs
+
+	maxLive = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (maxLive < 1)
+		maxLive = 1;
+
+	live = 0;
+
+	for (n=0;n<shards;n++)
+	{
+		if (live >= maxLive)
+		{
+			RebuildCpp_WaitShard(pid, n, -1);
+			live--;
+		}
+
+		pid[n] = fork();
+
+		if (pid[n] > 0)
+			live++;
+
+		if (pid[n] == 0)
+		{
+			RebuildCpp_WriteShard(n + 1, bounds[n], bounds[n + 1]);
+			fflush(stdout);
+			_exit(0);
+		}
+
+		// No process, do it here
+
+		if (pid[n] < 0)
+			RebuildCpp_WriteShard(n + 1, bounds[n], bounds[n + 1]);
+	}
+#else
+	for (n=0;n<shards;n++)
+		RebuildCpp_WriteShard(n + 1, bounds[n], bounds[n + 1]);
+#endif
+
+	// Header
+
+	ArrayDispose(&RebuildArray);
+	ArrayInit(&RebuildArray, sizeof(char), 0);
+
+	RebuildEmit("//****************************************\n");
+	RebuildEmit("//       Generated Cpp code header\n");
+	RebuildEmit("//****************************************\n");
+
+	RebuildEmit("\n");
+	RebuildEmit("#ifndef REBUILD_BUILD_H\n");
+	RebuildEmit("#define REBUILD_BUILD_H\n");
+
+	RebuildCpp_EmitProtos();
+
+	RebuildEmit("\n#endif\n");
+
+	if (!ArrayWrite(&RebuildArray, "rebuild.build.h"))
+		Error(Error_Fatal, "Problem writing 'rebuild.build.h'");
+
+	// Startup and CallReg
+
+	ArrayDispose(&RebuildArray);
+	ArrayInit(&RebuildArray, sizeof(char), 0);
+
+	RebuildEmit("//****************************************\n");
+	RebuildEmit("//          Generated Cpp code\n");
+	RebuildEmit("//****************************************\n");
+
+	RebuildEmit("\n");
+	RebuildEmit("#include \"mstypeinfo.h\"\n");
+	RebuildEmit("#include \"rebuild.build.h\"\n");
+	RebuildEmit("\n");
+
+	RebuildCpp_StartUp();
+
+	// The shards are written elsewhere, so we can't tell if they use it
+
+	CppUsedCallReg = 1;
+	RebuildCpp_CallReg();
+
+	if (!ArrayWrite(&RebuildArray, "rebuild.build.cpp"))
+		Error(Error_Fatal, "Problem writing 'rebuild.build.cpp'");
+
+#ifndef _WIN32
+	for (n=0;n<shards;n++)
+	{
+		if (pid[n] > 0)
+			RebuildCpp_WaitShard(pid, shards, pid[n]);
+	}
+#endif
+}
+
 //****************************************
 //
 //****************************************
@@ -1586,6 +1940,16 @@ void RebuildCpp_Main()
 	Rebuild_Mode = 1;
 	CppUsedCallReg = 0;
 
+	if (ArgCppShards)
+	{
+		RebuildCpp_Sharded();
+
+		#ifdef CPP_SHOW_LINES
+		FreeFiles();
+		#endif
+		return;
+	}
+
 	RebuildEmit("//****************************************\n");
 	RebuildEmit("//          Generated Cpp code\n");
 	RebuildEmit("//****************************************\n");
@@ -1616,7 +1980,7 @@ void RebuildCpp_Main()
 
 	MaxEnumLabel = 0;
 
-	RebuildCpp_Code();
+	RebuildCpp_Code(0, CodeIP+1);
 	//RebuildCpp_EmitExtensions(1);
 	RebuildCpp_CallReg();
 
@@ -55,8 +55,7 @@ short Directives()
 	}
 
 
-	GetToken();	
-	t = ScanAsmToken();
+	t = GetAsmToken();
 
 	switch(t)
 	{
@@ -49,6 +49,8 @@ int FunctionRegAnalyse(SYMBOL *sym, FuncProp *fp)
 	fp->dst_reg = 0;
 	fp->assign_reg = 0;
 	fp->uninit_reg = 0;
+	fp->mem_access = 0;
+	fp->calls = 0;
 
 	// Make sure we have a valid symbol
 
@@ -104,6 +106,24 @@ int FunctionRegAnalyse(SYMBOL *sym, FuncProp *fp)
 		if (thisOp.op == _POP)
 			continue;
 
+		switch (thisOp.op)
+		{
+			case _LDW:
+			case _LDH:
+			case _LDB:
+			case _STW:
+			case _STH:
+			case _STB:
+				fp->mem_access++;
+			break;
+
+			case _CALLI:
+			case _CALL:
+			case _SYSCALL:
+				fp->calls++;
+			break;
+		}
+
 		//-----------------------------------------
 		// Deal with syscalls
 		// for some strange reason rd is the syscallId which will
@@ -289,6 +289,10 @@ int AddSourceFile(char *FileName, int local_scope)
 		// Wind source pointer forward
 	
 		SourceIdx += file_length;
+
+		if (ArgLinkCache)
+			LinkCacheAddObject(SourceIdx - file_length, SourceIdx);
+
 		return 1;
 	}
 
@@ -378,6 +382,9 @@ int AddSourceFile(char *FileName, int local_scope)
 			
 			SourceIdx += len;
 			memptr += thisObj.csize;
+
+			if (ArgLinkCache)
+				LinkCacheAddObject(SourceIdx - len, SourceIdx);
 		}
 
 		gDisposePtr(memtop);
@@ -527,6 +534,15 @@ char *GetLibaryFilePtr()
 // 
 //****************************************
 
+int GetLibaryFileLen()
+{
+	return SourceIdx;
+}
+
+//****************************************
+// 
+//****************************************
+
 //typedef unsigned char uchar;
 
 void DisposeLibrarian()
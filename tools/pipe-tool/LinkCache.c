@@ -0,0 +1,679 @@
+/* Copyright (C) 2009 Mobile Sorcery AB
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License, version 2, as published by
+the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING.  If not, write to the Free
+Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.
+*/
+
+//*********************************************************************************************
+//				  			  	Link Cache (-cache=dir)
+//*********************************************************************************************
+
+// The last link of each output is kept in <dir>/<output name>.link, together
+// with a key made from everything that went into it: the pipe-tool executable,
+// the switches, the loaded source (every input file and asm_config.lst) and the
+// profile header.
+// If the key of the next link is the same, its files are written from the
+// cache and nothing is assembled.
+//
+// The assembled code of an object can't be cached on its own. Instructions
+// refer to constants by their index in the constant pool, which is sorted by
+// use over the whole program, and to labels whose addresses move when anything
+// before them changes size.
+//
+// What is cached for each object is its tokenized form: where each statement
+// starts and which directive or instruction it is. That only depends on the
+// object's text, so it is kept in <dir>/<key>.tok, keyed by a hash of the text
+// and the pipe-tool executable, and used by every link that loads the same
+// object. Old .tok files are never removed; empty the directory to reclaim
+// the space.
+
+#ifdef WIN32
+#include <windows.h>
+#elif defined(__APPLE__)
+#include <mach-o/dyld.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "compile.h"
+
+#define LINKCACHE_MAGIC		0x434c414d		// 'MALC'
+#define LINKCACHE_VERSION	3
+
+#define LINKCACHE_MAXFILES	5
+
+#define TOKENCACHE_MAGIC	0x4b54414d		// 'MATK'
+#define TOKENCACHE_VERSION	1
+
+typedef struct
+{
+	int		magic;
+	int		version;
+	LinkKey	key;
+	int		count;				// Number of files that follow
+} LinkCacheHead;
+
+// Each file is its name length, name, data length and data
+
+typedef struct
+{
+	int		magic;
+	int		version;
+	LinkKey	key;
+	LinkKey	sum;				// Key of the tokens
+	int		count;				// Number of tokens that follow
+} TokenCacheHead;
+
+// Each token is its offset in the object and its AsmTokenArray value
+
+typedef struct
+{
+	int		start;				// Where the object's text is in the source
+	int		end;
+	LinkKey	key;
+	int		cached;				// Its tokens came from the cache
+} LinkObject;
+
+LinkKey	LinkCacheKey;
+LinkKey	LinkExeKey;
+char	LinkCacheFile[1024];
+
+LinkObject *LinkObjects = 0;
+int LinkObjectCount = 0;
+int LinkObjectMax = 0;
+
+//****************************************
+//			 Start a key
+//****************************************
+
+void LinkKeyInit(LinkKey *key)
+{
+	key->a = 2166136261u;
+	key->b = 0;
+	key->len = 0;
+}
+
+//****************************************
+//		   Add data to a key
+//****************************************
+
+void LinkKeyAdd(LinkKey *key, char *data, int len)
+{
+	uint a = key->a;
+	uint b = key->b;
+	int n;
+
+	for (n=0;n<len;n++)
+	{
+		uint c = (unsigned char) data[n];
+
+		a = (a ^ c) * 16777619u;
+		b = c + (b << 6) + (b << 16) - b;
+	}
+
+	key->a = a;
+	key->b = b;
+	key->len += len;
+}
+
+//****************************************
+//	  Key the running pipe-tool itself
+// A rebuilt pipe-tool may assemble the
+// same input differently. argv[0] is used
+// if the executable can't be found.
+//****************************************
+
+void LinkKeyAddExe(char *argv0)
+{
+	char path[1024];
+	char *filemem;
+	int len;
+
+#if defined(WIN32)
+	len = GetModuleFileName(NULL, path, sizeof(path));
+
+	if (len <= 0 || len >= (int) sizeof(path))
+		len = 0;
+#elif defined(__APPLE__)
+	uint size = sizeof(path);
+
+	len = 0;
+
+	if (_NSGetExecutablePath(path, &size) == 0)
+		len = strlen(path);
+#else
+	len = readlink("/proc/self/exe", path, sizeof(path) - 1);
+
+	if (len < 0)
+		len = 0;
+#endif
+
+	path[len] = 0;
+
+	if (!len)
+		strncpy(path, argv0, sizeof(path) - 1);
+
+	path[sizeof(path) - 1] = 0;
+
+	filemem = Open_FileAlloc(path);
+
+	if (!filemem)
+	{
+		// Without the executable the cache can't tell pipe-tools apart
+
+		printf("Link cache: can't read '%s', cache disabled\n", path);
+		ArgLinkCache = 0;
+		return;
+	}
+
+	LinkKeyAdd(&LinkCacheKey, filemem, FileAlloc_Len());
+	Free_File(filemem);
+}
+
+//****************************************
+//		Key the switches of this link
+// Ones that don't change the output are
+// left out.
+//****************************************
+
+void LinkCacheInit(char *argv0, char **args, int count)
+{
+	int n;
+
+	LinkKeyInit(&LinkCacheKey);
+
+	LinkKeyAddExe(argv0);
+
+	LinkExeKey = LinkCacheKey;
+
+	for (n=0;n<count;n++)
+	{
+		if (strncmp(args[n], "-cache=", 7) == 0)
+			continue;
+
+		if (strcmp(args[n], "-stats") == 0 || strcmp(args[n], "-quiet") == 0)
+			continue;
+
+		LinkKeyAdd(&LinkCacheKey, args[n], strlen(args[n]) + 1);
+	}
+}
+
+//****************************************
+//	 Can this link use the cache at all
+//****************************************
+
+int LinkCacheUsable()
+{
+	// These write other files, or print the symbols
+
+	if (ArgJavaNative || ArgCppGen || ArgCsGen || Do_Elimination)
+		return 0;
+
+	if (Do_Dump_Symbols || Do_Dump_Unref_Symbols || DisasFunc[0])
+		return 0;
+
+	return 1;
+}
+
+//****************************************
+//	  List the files this link writes
+//****************************************
+
+int LinkCacheFiles(char *output, char **files)
+{
+	int count = 0;
+
+	files[count++] = output;
+
+	if (ArgSLD)
+	{
+		files[count++] = SldName;
+		files[count++] = SldBinName;
+	}
+
+	if (ArgUseStabs)
+		files[count++] = StabsName;
+
+	if (ArgWriteMeta)
+		files[count++] = MetaFileName;
+
+	return count;
+}
+
+//****************************************
+//	  Finish the key and find the cache
+//****************************************
+
+void LinkCacheSetup(char *output)
+{
+	char *profile;
+	char *name;
+	int len;
+
+	LinkKeyAdd(&LinkCacheKey, GetLibaryFilePtr(), GetLibaryFileLen());
+
+	profile = GetProfileFileName();
+
+	if (profile)
+	{
+		char *filemem = Open_FileAlloc(profile);
+
+		if (filemem)
+		{
+			LinkKeyAdd(&LinkCacheKey, filemem, FileAlloc_Len());
+			Free_File(filemem);
+		}
+	}
+
+	// Name the cache after the output, without its path
+
+	name = output + strlen(output);
+
+	while (name > output && name[-1] != '/' && name[-1] != '\\')
+		name--;
+
+	strcpy(LinkCacheFile, LinkCacheDir);
+	len = strlen(LinkCacheFile);
+
+	if (len && LinkCacheFile[len-1] != '/' && LinkCacheFile[len-1] != '\\')
+		strcat(LinkCacheFile, "/");
+
+	strcat(LinkCacheFile, name);
+	strcat(LinkCacheFile, ".link");
+}
+
+//****************************************
+//	 Copy len bytes from one file to another
+//****************************************
+
+int LinkCacheCopy(FILE *dst, FILE *src, int len)
+{
+	char buf[16384];
+	int n;
+
+	while (len > 0)
+	{
+		n = len < (int) sizeof(buf) ? len : (int) sizeof(buf);
+
+		if (fread(buf, 1, n, src) != (size_t) n)
+			return 0;
+
+		if (fwrite(buf, 1, n, dst) != (size_t) n)
+			return 0;
+
+		len -= n;
+	}
+
+	return 1;
+}
+
+//****************************************
+//	Write the files of a cached link
+//	  Returns 1 if the link is done
+//****************************************
+
+int LinkCacheRestore(char *output)
+{
+	LinkCacheHead head;
+	FILE *cache, *out;
+	char name[1024];
+	int n, len;
+
+	if (!LinkCacheUsable())
+	{
+		printf("-cache is ignored with -elim, -java, -cpp, -cs, -disas and the symbol dumps\n");
+		return 0;
+	}
+
+	LinkCacheSetup(output);
+
+	cache = fopen(LinkCacheFile, "rb");
+
+	if (!cache)
+		return 0;
+
+	if (fread(&head, 1, sizeof(head), cache) != sizeof(head) ||
+		head.magic != LINKCACHE_MAGIC || head.version != LINKCACHE_VERSION ||
+		memcmp(&head.key, &LinkCacheKey, sizeof(LinkKey)) != 0)
+	{
+		fclose(cache);
+		return 0;
+	}
+
+	for (n=0;n<head.count;n++)
+	{
+		if (fread(&len, 1, sizeof(len), cache) != sizeof(len) || len <= 0 || len >= (int) sizeof(name))
+			break;
+
+		if (fread(name, 1, len, cache) != (size_t) len)
+			break;
+
+		name[len] = 0;
+
+		if (fread(&len, 1, sizeof(len), cache) != sizeof(len))
+			break;
+
+		out = fopen(name, "wb");
+
+		if (!out)
+			Error(Error_Fatal, "Problem creating '%s'", name);
+
+		if (!LinkCacheCopy(out, cache, len))
+		{
+			fclose(out);
+			break;
+		}
+
+		fclose(out);
+	}
+
+	fclose(cache);
+
+	// A broken cache only costs a link
+
+	if (n != head.count)
+	{
+		printf("Link cache '%s' is damaged, linking\n", LinkCacheFile);
+		remove(LinkCacheFile);
+		return 0;
+	}
+
+	printf("Link is unchanged, using '%s'\n", LinkCacheFile);
+	return 1;
+}
+
+//****************************************
+//	  Save the files of a finished link
+//****************************************
+
+void LinkCacheStore(char *output)
+{
+	LinkCacheHead head;
+	FILE *cache, *in;
+	char *files[LINKCACHE_MAXFILES];
+	int n, len, namelen, ok;
+
+	if (!LinkCacheUsable())
+		return;
+
+	head.magic = LINKCACHE_MAGIC;
+	head.version = LINKCACHE_VERSION;
+	head.key = LinkCacheKey;
+	head.count = LinkCacheFiles(output, files);
+
+	cache = fopen(LinkCacheFile, "wb");
+
+	if (!cache)
+	{
+		printf("Warning: could not write link cache '%s'\n", LinkCacheFile);
+		return;
+	}
+
+	ok = fwrite(&head, 1, sizeof(head), cache) == sizeof(head);
+
+	for (n=0;n<head.count && ok;n++)
+	{
+		in = fopen(files[n], "rb");
+
+		if (!in)
+		{
+			ok = 0;
+			break;
+		}
+
+		fseek(in, 0, SEEK_END);
+		len = ftell(in);
+		fseek(in, 0, SEEK_SET);
+
+		namelen = strlen(files[n]);
+
+		ok = fwrite(&namelen, 1, sizeof(namelen), cache) == sizeof(namelen);
+		ok = ok && fwrite(files[n], 1, namelen, cache) == (size_t) namelen;
+		ok = ok && fwrite(&len, 1, sizeof(len), cache) == sizeof(len);
+		ok = ok && LinkCacheCopy(cache, in, len);
+
+		fclose(in);
+	}
+
+	fclose(cache);
+
+	// Never leave half a cache behind
+
+	if (!ok)
+	{
+		printf("Warning: could not write link cache '%s'\n", LinkCacheFile);
+		remove(LinkCacheFile);
+	}
+}
+
+//****************************************
+//	  Note an object loaded by the
+//	  librarian, from start to end in
+//			  the source
+//****************************************
+
+void LinkCacheAddObject(int start, int end)
+{
+	if (end <= start)
+		return;
+
+	if (LinkObjectCount == LinkObjectMax)
+	{
+		LinkObjectMax += 256;
+
+		if (!LinkObjects)
+			LinkObjects = (LinkObject *) NewPtr(LinkObjectMax * sizeof(LinkObject));
+		else
+			LinkObjects = (LinkObject *) ReallocPtr((char *) LinkObjects, LinkObjectMax * sizeof(LinkObject));
+
+		if (!LinkObjects)
+			Error(Error_Fatal, "Link cache failed to allocate");
+	}
+
+	LinkObjects[LinkObjectCount].start = start;
+	LinkObjects[LinkObjectCount].end = end;
+	LinkObjects[LinkObjectCount].cached = 0;
+	LinkObjectCount++;
+}
+
+//****************************************
+//	   Name the token cache of an object
+//****************************************
+
+void TokenCacheName(char *name, int index)
+{
+	LinkKey *key = &LinkObjects[index].key;
+	int len;
+
+	strcpy(name, LinkCacheDir);
+	len = strlen(name);
+
+	if (len && name[len-1] != '/' && name[len-1] != '\\')
+		strcat(name, "/");
+
+	sprintf(name + strlen(name), "%08x%08x%08x.tok", key->a, key->b, key->len);
+}
+
+//****************************************
+//	  Read the cached tokens of an object
+//	 Returns 1 if they are all in place
+//****************************************
+
+int TokenCacheRead(int index)
+{
+	LinkObject *obj = &LinkObjects[index];
+	TokenCacheHead head;
+	LinkKey sum;
+	char name[1024];
+	FILE *cache;
+	int *tok;
+	int n, len, tlen;
+
+	TokenCacheName(name, index);
+
+	cache = fopen(name, "rb");
+
+	if (!cache)
+		return 0;
+
+	if (fread(&head, 1, sizeof(head), cache) != sizeof(head) ||
+		head.magic != TOKENCACHE_MAGIC || head.version != TOKENCACHE_VERSION ||
+		memcmp(&head.key, &obj->key, sizeof(LinkKey)) != 0 || head.count < 0)
+	{
+		fclose(cache);
+		return 0;
+	}
+
+	tok = (int *) NewPtr(head.count * 2 * sizeof(int) + 8);
+
+	if (!tok)
+		Error(Error_Fatal, "Link cache failed to allocate");
+
+	n = fread(tok, 2 * sizeof(int), head.count, cache);
+	fclose(cache);
+
+	LinkKeyInit(&sum);
+	LinkKeyAdd(&sum, (char *) tok, n * 2 * sizeof(int));
+
+	// Check them all before using any. A token ends at white space inside
+	// the object.
+
+	if (n == head.count && memcmp(&sum, &head.sum, sizeof(LinkKey)) != 0)
+		n = -1;
+
+	if (n == head.count)
+	{
+		len = obj->end - obj->start;
+
+		for (n=0;n<head.count;n++)
+		{
+			tlen = (uint) tok[n*2+1] >> 16;
+
+			if (tok[n*2] < 0 || tlen <= 0 || tok[n*2] + tlen >= len || !(tok[n*2+1] & 0xffff))
+				break;
+
+			if (!isspace((unsigned char) FileTop[obj->start + tok[n*2] + tlen]))
+				break;
+		}
+	}
+
+	if (n != head.count)
+	{
+		DisposePtr((char *) tok);
+		printf("Token cache '%s' is damaged, tokenizing\n", name);
+		remove(name);
+		return 0;
+	}
+
+	for (n=0;n<head.count;n++)
+		ArraySet(&AsmTokenArray, obj->start + tok[n*2], tok[n*2+1]);
+
+	DisposePtr((char *) tok);
+	return 1;
+}
+
+//****************************************
+//	 Load the cached tokens of the objects
+//****************************************
+
+void LinkCacheLoadTokens()
+{
+	LinkObject *obj;
+	int n, hits = 0;
+
+	for (n=0;n<LinkObjectCount;n++)
+	{
+		obj = &LinkObjects[n];
+
+		obj->key = LinkExeKey;
+		LinkKeyAdd(&obj->key, FileTop + obj->start, obj->end - obj->start);
+
+		obj->cached = TokenCacheRead(n);
+		hits += obj->cached;
+	}
+
+	if (ArgStats)
+		printf("stats: %d of %d objects tokenized from the cache\n", hits, LinkObjectCount);
+}
+
+//****************************************
+//	 Save the tokens of the objects that
+//		  weren't in the cache
+//****************************************
+
+void LinkCacheStoreTokens()
+{
+	TokenCacheHead head;
+	LinkObject *obj;
+	char name[1024];
+	FILE *cache;
+	int tok[2];
+	int n, i, ok;
+	uint v;
+
+	for (n=0;n<LinkObjectCount;n++)
+	{
+		obj = &LinkObjects[n];
+
+		if (obj->cached)
+			continue;
+
+		TokenCacheName(name, n);
+
+		cache = fopen(name, "wb");
+
+		if (!cache)
+		{
+			printf("Warning: could not write token cache '%s'\n", name);
+			return;
+		}
+
+		head.magic = TOKENCACHE_MAGIC;
+		head.version = TOKENCACHE_VERSION;
+		head.key = obj->key;
+		head.count = 0;
+
+		LinkKeyInit(&head.sum);
+
+		ok = fwrite(&head, 1, sizeof(head), cache) == sizeof(head);
+
+		// Only tokens that end inside the object depend on it alone
+
+		for (i=obj->start;i<obj->end && ok;i++)
+		{
+			v = ArrayGet(&AsmTokenArray, i);
+
+			if (!v || i + (int) (v >> 16) >= obj->end)
+				continue;
+
+			tok[0] = i - obj->start;
+			tok[1] = v;
+
+			ok = fwrite(tok, 1, sizeof(tok), cache) == sizeof(tok);
+			LinkKeyAdd(&head.sum, (char *) tok, sizeof(tok));
+			head.count++;
+		}
+
+		ok = ok && fseek(cache, 0, SEEK_SET) == 0;
+		ok = ok && fwrite(&head, 1, sizeof(head), cache) == sizeof(head);
+
+		fclose(cache);
+
+		if (!ok)
+		{
+			printf("Warning: could not write token cache '%s'\n", name);
+			remove(name);
+		}
+	}
+}
@@ -25,6 +25,11 @@ Software Foundation, 59 Temple Place - Suite 330, Boston, MA
 #include <windows.h>
 #endif
 
+// Older MSVC only has _snprintf, which returns -1 when the text doesn't fit.
+#if defined(_MSC_VER) && _MSC_VER < 1900
+#define snprintf _snprintf
+#endif
+
 #define __DEFGLOBALS__
 #include "compile.h"
 
@@ -120,6 +125,7 @@ int main(int argc,char *argv[])
 	ArrayInit(&AsmCharDataArray,4, 0);
 
 	ArrayInit(&AsmCharIPArray,	4, 0);
+	ArrayInit(&AsmTokenArray,	4, 0);
 	ArrayInit(&CodeTouchArray,	1, 0);
 
 	ArrayInit(&SLD_Line_Array,	4, 0);
@@ -251,9 +257,20 @@ int main(int argc,char *argv[])
 
 		if (Token("sld="))
 		{
+			int n;
+
 			ArgSLD = 1;
 			GetCmdString();
 			strcpy(SldName, Name);
+
+			n = snprintf(SldBinName, sizeof(SldBinName), "%s.bin", Name);
+
+			if (n < 0 || n >= (int) sizeof(SldBinName))
+			{
+				printf("Error: sld name '%s' is too long\n", Name);
+				ExitApp(1);
+			}
+
 			continue;
 		}
 
@@ -390,6 +407,20 @@ int main(int argc,char *argv[])
 			continue;
 		}
 
+		if (Token("stats"))
+		{
+			ArgStats = 1;
+			continue;
+		}
+
+		if (Token("cache="))
+		{
+			ArgLinkCache = 1;
+			GetCmdString();
+			strcpy(LinkCacheDir, Name);
+			continue;
+		}
+
 		if (Token("-credits"))
 		{
 			printf("\nMoSync Team Credits\n");
@@ -458,6 +489,24 @@ int main(int argc,char *argv[])
 		}
 */
 
+		if (Token("cpp-shards="))
+		{
+			ArgCppShards = GetNum();
+
+			if (ArgCppShards < 1 || ArgCppShards > MAX_CPP_SHARDS)
+			{
+				printf("invalid shard count %d\n", ArgCppShards);
+				ExitApp(1);
+			}
+
+			ArgCppGen = 1;
+			ArgConstOpt = 0;
+			Do_Elimination = 1;
+
+			dbprintf("Native cpp build in %d shards\n", ArgCppShards);
+			continue;
+		}
+
 		if (Token("cpp"))
 		{
 			ArgCppGen = 1;
@@ -531,6 +580,9 @@ int main(int argc,char *argv[])
 		ExitApp(1);
 	}
 
+	if (ArgLinkCache)
+		LinkCacheInit(argv[0], &argv[1], argno - 1);
+
 //--------------------------------
 //		Get ENV settings
 //--------------------------------
@@ -739,14 +791,18 @@ Build application (-B) options:\n\
   -p=vendor/model      link with device profile\n\
   -dump-syms           dump symbol tables\n\
   -dump-unref          dump unreferenced symbols\n\
-  -sld=file            output source/line translation\n\
+  -sld=file            output source/line translation, in file and file.bin\n\
   -stabs=file          output debug information\n\
   -elim                eliminate unreferenced code/data\n\
   -no-verify           prevent code verification\n\
   -java                build a Java class file\n\
   -gcj=flags           for -java option: set flags for GCJ\n\
   -cpp                 build C++ source code\n\
+  -cpp-shards=n        build C++ source code in n files, written in parallel\n\
   -cs                  build C# source code\n\
+  -stats               show the time and symbol/constant lookups of each pass\n\
+  -cache=dir           keep the link and the tokenized inputs in the existing\n\
+                       <dir>, and reuse what didn't change\n\
 \n\
 Resource compiler (-R) options:\n\
   -depend=file         output dependencies in makefile syntax\n\
@@ -935,15 +991,14 @@ char * GetMosyncPath(char *fpath, char *fname)
 //			Main entry point
 //****************************************
 
-void LoadProfileData()
+char * GetProfileFileName()
 {
-	char *filemem;
 	int len;
 
 	tempName[0] = 0;
 
 	if (ProfilePath[0] == 0)
-		return;
+		return 0;
 
 	// add the MOSYNC dir env
 
@@ -977,7 +1032,21 @@ void LoadProfileData()
 	strcat(tempName, "\\profile.h");
 	
 	//printf("profile = '%s'\n", tempName);
-	
+
+	return tempName;
+}
+
+//****************************************
+//			Main entry point
+//****************************************
+
+void LoadProfileData()
+{
+	char *filemem;
+
+	if (!GetProfileFileName())
+		return;
+
 	filemem = Open_FileAlloc(tempName);
 	
 	if (!filemem)
@@ -1004,6 +1073,12 @@ void MainAsm(char *input, char *output)
 	
 	FileTop = FilePtr = input;
 
+	if (ArgLinkCache && LinkCacheRestore(output))
+		return;
+
+	if (ArgLinkCache)
+		LinkCacheLoadTokens();
+
 	// Setup output file
 
 	CodeFile = fopen(output,"wb");
@@ -1057,6 +1132,12 @@ void MainAsm(char *input, char *output)
 	if (CodeFile)
 		fclose(CodeFile);
 
+	if (ArgLinkCache)
+	{
+		LinkCacheStoreTokens();
+		LinkCacheStore(output);
+	}
+
 	CloseSymbolTable();
 	Stabs_Dispose();
 }
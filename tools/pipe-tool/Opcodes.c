@@ -66,8 +66,7 @@ void Instructions()
 
 	ArraySet(&AsmCharIPArray, (int) (AsmCharPtr - FileTop) , CodeIP + 1);
 
-	GetToken();
-	t = ScanAsmToken();
+	t = GetAsmToken();
 
 	strcpy(ThisOpName, Name);
 
@@ -505,7 +505,7 @@ int FileInfo_From_IP(LineInfo *info, int ip)
 	file = ArrayGet(&SLD_File_Array, ip);
 
 	Sym = SymTab;
-	n = SYMMAX;
+	n = SymbolSlots();
 
 	do
 	{
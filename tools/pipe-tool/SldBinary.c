@@ -0,0 +1,238 @@
+/* Copyright (C) 2009 Mobile Sorcery AB
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License, version 2, as published by
+the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING.  If not, write to the Free
+Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.
+*/
+
+//*********************************************************************************************
+//				  			  	Binary SLD (-sld=file)
+//*********************************************************************************************
+
+// Next to the text SLD, -sld writes <file>.bin with the same files, lines,
+// functions and variables as flat arrays of 32 bit ints, already sorted the
+// way the runtime and the debugger search them:
+//
+//	head		SldBinHead
+//	files		{ index, scope, name } by index
+//	lines		{ ip, line, file } by ip
+//	address		line numbers into lines, by file, line and ip
+//	functions	{ start, stop, name } by start
+//	variables	{ scope, address, name }
+//	strings		the names, each ending in a 0
+//
+// Names are offsets into the strings. The head holds the size of the text SLD
+// it was written with, so a reader can tell if the text has been rewritten
+// without it (by an older pipe-tool, for example).
+//
+// The reader is runtimes/cpp/core/sld.cpp.
+
+#include "compile.h"
+
+#define SLDBIN_MAGIC	0x444c534d		// 'MSLD'
+#define SLDBIN_VERSION	1
+
+typedef struct
+{
+	int		magic;
+	int		version;
+	int		textSize;			// Size of the text SLD
+	int		fileCount;
+	int		lineCount;
+	int		functionCount;
+	int		variableCount;
+	int		stringSize;
+} SldBinHead;
+
+ArrayStore SldBinFiles;
+ArrayStore SldBinLines;
+ArrayStore SldBinFunctions;
+ArrayStore SldBinVariables;
+ArrayStore SldBinStrings;
+
+static uint *SldBinSortLines;
+
+//****************************************
+//		   Start a binary SLD
+//****************************************
+
+void SldBinBegin()
+{
+	ArrayInit(&SldBinFiles, 4, 1024);
+	ArrayInit(&SldBinLines, 4, 64*1024);
+	ArrayInit(&SldBinFunctions, 4, 16*1024);
+	ArrayInit(&SldBinVariables, 4, 16*1024);
+	ArrayInit(&SldBinStrings, 1, 64*1024);
+}
+
+//****************************************
+//	  Add a name, returns its offset
+//****************************************
+
+int SldBinString(char *name)
+{
+	int offset = ArrayGetPosition(&SldBinStrings);
+
+	do
+	{
+		ArrayAppend(&SldBinStrings, (uchar) *name);
+	}
+	while(*name++);
+
+	return offset;
+}
+
+//****************************************
+//		Add to the tables
+//****************************************
+
+void SldBinFile(int index, int scope, char *name)
+{
+	ArrayAppend(&SldBinFiles, index);
+	ArrayAppend(&SldBinFiles, scope);
+	ArrayAppend(&SldBinFiles, SldBinString(name));
+}
+
+void SldBinLine(int ip, int line, int file)
+{
+	ArrayAppend(&SldBinLines, ip);
+	ArrayAppend(&SldBinLines, line);
+	ArrayAppend(&SldBinLines, file);
+}
+
+void SldBinFunction(char *name, int start, int stop)
+{
+	ArrayAppend(&SldBinFunctions, start);
+	ArrayAppend(&SldBinFunctions, stop);
+	ArrayAppend(&SldBinFunctions, SldBinString(name));
+}
+
+void SldBinVariable(char *name, int scope, int address)
+{
+	ArrayAppend(&SldBinVariables, scope);
+	ArrayAppend(&SldBinVariables, address);
+	ArrayAppend(&SldBinVariables, SldBinString(name));
+}
+
+//****************************************
+//	 Order of the address table
+//****************************************
+
+int SldBinAddressCompare(const void *a, const void *b)
+{
+	uint *l = &SldBinSortLines[*(uint *) a * 3];
+	uint *r = &SldBinSortLines[*(uint *) b * 3];
+
+	if (l[2] != r[2])
+		return l[2] < r[2] ? -1 : 1;
+
+	if (l[1] != r[1])
+		return (int) l[1] < (int) r[1] ? -1 : 1;
+
+	return l[0] < r[0] ? -1 : (l[0] > r[0]);
+}
+
+//****************************************
+//		Write the binary SLD
+//****************************************
+
+void SldBinWrite(char *textName, char *binName)
+{
+	SldBinHead head;
+	FILE *text, *out;
+	uint *address = 0;
+	int n, ok;
+
+	head.magic = SLDBIN_MAGIC;
+	head.version = SLDBIN_VERSION;
+	head.textSize = 0;
+	head.fileCount = ArrayGetPosition(&SldBinFiles) / 3;
+	head.lineCount = ArrayGetPosition(&SldBinLines) / 3;
+	head.functionCount = ArrayGetPosition(&SldBinFunctions) / 3;
+	head.variableCount = ArrayGetPosition(&SldBinVariables) / 3;
+	head.stringSize = ArrayGetPosition(&SldBinStrings);
+
+	text = fopen(textName, "rb");
+
+	if (text)
+	{
+		fseek(text, 0, SEEK_END);
+		head.textSize = ftell(text);
+		fclose(text);
+	}
+
+	// Lines by file and line, for breakpoints
+
+	if (head.lineCount)
+	{
+		address = (uint *) NewPtrClear(head.lineCount * sizeof(uint));
+
+		if (!address)
+			Error(Error_Fatal, "Out of memory writing '%s'", binName);
+
+		for (n=0;n<head.lineCount;n++)
+			address[n] = n;
+
+		SldBinSortLines = (uint *) SldBinLines.array;
+		qsort(address, head.lineCount, sizeof(uint), SldBinAddressCompare);
+	}
+
+	out = fopen(binName, "wb");
+
+	if (!out)
+	{
+		printf("Failed to create binary source line file '%s'\n", binName);
+		ok = 0;
+	}
+	else
+	{
+		ok = fwrite(&head, 1, sizeof(head), out) == sizeof(head);
+
+		if (head.fileCount)
+			ok = ok && ArrayWriteFP(&SldBinFiles, out, head.fileCount * 3 * sizeof(uint));
+
+		if (head.lineCount)
+		{
+			ok = ok && ArrayWriteFP(&SldBinLines, out, head.lineCount * 3 * sizeof(uint));
+			ok = ok && fwrite(address, sizeof(uint), head.lineCount, out) == (size_t) head.lineCount;
+		}
+
+		if (head.functionCount)
+			ok = ok && ArrayWriteFP(&SldBinFunctions, out, head.functionCount * 3 * sizeof(uint));
+
+		if (head.variableCount)
+			ok = ok && ArrayWriteFP(&SldBinVariables, out, head.variableCount * 3 * sizeof(uint));
+
+		if (head.stringSize)
+			ok = ok && ArrayWriteFP(&SldBinStrings, out, head.stringSize);
+
+		fclose(out);
+
+		// The text SLD is still there, so a bad binary one is just left out
+
+		if (!ok)
+		{
+			printf("Failed to write binary source line file '%s'\n", binName);
+			remove(binName);
+		}
+	}
+
+	if (address)
+		DisposePtr((char *) address);
+
+	ArrayDispose(&SldBinFiles);
+	ArrayDispose(&SldBinLines);
+	ArrayDispose(&SldBinFunctions);
+	ArrayDispose(&SldBinVariables);
+	ArrayDispose(&SldBinStrings);
+}
@@ -50,7 +50,7 @@ char *Sect_Strings[] =
 //	Initialises Symbol table to null.
 //****************************************
 
-#define SYMBOL_HASH_SIZE 32749			// Prime
+#define SYMBOL_HASH_SIZE 262139			// Prime
 
 #ifdef USE_HASHING
 BucketArray SymbolHash;
@@ -130,7 +130,7 @@ void DisposeSymbols()
 	int	n;
 	SYMBOL *Sym = SymTab;
 
-	n = SYMMAX;
+	n = SymbolSlots();
 
 	do
 	{
@@ -180,6 +180,18 @@ SYMBOL * FreeSymbol(void)
 */
 }
 
+//****************************************
+//	  Number of Symbol slots to walk
+// FreeSymbol hands them out in order, so
+// the rest of the table is still empty.
+//  Never 0, so do/while loops are safe.
+//****************************************
+
+int SymbolSlots(void)
+{
+	return NextSymbolCount + 1;
+}
+
 //****************************************
 //		 Find a free Symbol slot
 //****************************************
@@ -190,7 +202,7 @@ void ClearSymbolFlags(int bits)
 	int	n;
 	int mask = ~bits;
 
-	n = SYMMAX;
+	n = SymbolSlots();
 
 	do
 	{
@@ -226,22 +238,22 @@ SYMBOL * GetSymbol(int num)
 // Returns the entry point into hash table
 //****************************************
 
-//#define HASHFUNC(vv) ((vv * 1103515245) + 12345)
+// FNV-1a. Summing HASHFUNC of each char only depended
+// on the sum of the chars, so names like _f12 and _f21
+// ended up in the same few buckets.
+
+#define SYMHASH(vv, cc) (((vv) ^ (uint) (cc)) * 16777619u)
 
 int HashSymbol(char *string, int scope, int section)
 {
-	uint v, n;
-	uint len;
+	uint v;
 
-	len = strlen(string);
+	v = 2166136261u;
+	v = SYMHASH(v, scope);
+	v = SYMHASH(v, section);
 
-	v = 41;
-	v += HASHFUNC(scope);
-	v += HASHFUNC(section);
-	v += HASHFUNC(len);
-
-	for (n=0;n<len;n++)
-		v += HASHFUNC(string[n]);
+	while (*string)
+		v = SYMHASH(v, (unsigned char) *string++);
 
 	return v % SYMBOL_HASH_SIZE;
 }
@@ -266,6 +278,8 @@ SYMBOL * FindSymbolsOld(char *string,int sectionStart,int sectionEnd)
 
 	len = strlen(string);
 
+	Stat_SymFinds++;
+
 	entry = HashSymbol(string, 0, sectionStart);
 	elem = -1;
 
@@ -273,6 +287,8 @@ SYMBOL * FindSymbolsOld(char *string,int sectionStart,int sectionEnd)
 	{
 		elem = BucketArraySearch(&SymbolHash, entry, elem, (uint*) &Sym);
 
+		Stat_SymProbes++;
+
 		if (Sym == 0)
 			return NULL;
 
@@ -309,9 +325,13 @@ SYMBOL * FindSymbolsOld(char *string,int sectionStart,int sectionEnd)
 
 	len = strlen(string);
 
-	n=SYMMAX;
+	Stat_SymFinds++;
+
+	n=SymbolSlots();
 	do
 	{
+		Stat_SymProbes++;
+
 		if ( (Sym->Len == len) &&
 			 (Sym->Section != 0)  &&
 			 (Sym->Section >= sectionStart) &&
@@ -354,6 +374,8 @@ SYMBOL * FindSymbols(char *string,int sectionStart,int sectionEnd, int scope)
 
 	len = strlen(string);
 
+	Stat_SymFinds++;
+
 	entry = HashSymbol(string, scope, sectionStart);
 	elem = -1;
 
@@ -361,6 +383,8 @@ SYMBOL * FindSymbols(char *string,int sectionStart,int sectionEnd, int scope)
 	{
 		elem = BucketArraySearch(&SymbolHash, entry, elem, (uint*) &Sym);
 
+		Stat_SymProbes++;
+
 		if (Sym == 0)
 			return NULL;
 
@@ -399,9 +423,13 @@ SYMBOL * FindSymbols(char *string,int sectionStart,int sectionEnd, int scope)
 
 	len = strlen(string);
 
-	n=SYMMAX;
+	Stat_SymFinds++;
+
+	n=SymbolSlots();
 	do
 	{
+		Stat_SymProbes++;
+
 		if ( (Sym->LocalScope == scope) &&
 			 (Sym->Len == len) &&
 			 (Sym->Section != 0)  &&
@@ -431,7 +459,7 @@ SYMBOL * ReverseFindSymbols(int v,int sectionStart,int sectionEnd)
 	int	n;
 	SYMBOL *Sym = SymTab;
 
-	n=SYMMAX;
+	n=SymbolSlots();
 	do
 	{
 		if ( (Sym->Section != 0)  &&
@@ -1245,7 +1273,7 @@ void DumpSymbols(int unref_only)
 	printf("Globals/Locals\n\n");
 
 	Sym = SymTab;
-	n = SYMMAX;
+	n = SymbolSlots();
 
 	do
 	{
@@ -1270,7 +1298,7 @@ void DumpSymbols(int unref_only)
 	printf("\nFiles\n\n");
 
 	Sym = SymTab;
-	n = SYMMAX;
+	n = SymbolSlots();
 	do
 	{
 		if (Sym->Section == section_File)
@@ -1312,7 +1340,7 @@ void SortVirtuals()
 		return;
 
 	Sym = SymTab;
-	n = SYMMAX;
+	n = SymbolSlots();
 
 	do
 	{
@@ -1366,7 +1394,7 @@ int CountUsedSymbols()
 	int		n;
 
 	Sym = SymTab;
-	n = SYMMAX;
+	n = SymbolSlots();
 
 	do
 	{
@@ -1391,7 +1419,7 @@ char * GetFileNumString(int file)
 	int		n;
 
 	Sym = SymTab;
-	n = SYMMAX;
+	n = SymbolSlots();
 
 	do
 	{
@@ -1414,7 +1442,7 @@ char * GetFileIdString(int id)
 	int		n;
 
 	Sym = SymTab;
-	n = SYMMAX;
+	n = SymbolSlots();
 
 	do
 	{
@@ -1445,7 +1473,7 @@ void DumpIPTrans()
 	int MustConvertPaths = 0;
 
 	Sym = SymTab;
-	n = SYMMAX;
+	n = SymbolSlots();
 
 	SldFile = fopen(SldName, "w");
 
@@ -1457,6 +1485,7 @@ void DumpIPTrans()
 
 	fprintf(SldFile, "Files\n");
 
+	SldBinBegin();
 
 	do
 	{
@@ -1500,6 +1529,7 @@ void DumpIPTrans()
 			temp[j] = 0;
 
 			fprintf(SldFile, "%d:%d:%s\n", Sym->Value, Sym->Type, temp);
+			SldBinFile(Sym->Value, Sym->Type, temp);
 		}
 
 		Sym++;
@@ -1508,18 +1538,19 @@ void DumpIPTrans()
 
 	fprintf(SldFile, "SLD\n");
 
-	if (!SLD_Line_Array.array)
-		return;
-
-	for (n=SLD_Line_Array.lo;n<SLD_Line_Array.hi+1;n++)
+	if (SLD_Line_Array.array)
 	{
+		for (n=SLD_Line_Array.lo;n<SLD_Line_Array.hi+1;n++)
+		{
 
-		line = ArrayGet(&SLD_Line_Array, n);
-		file= ArrayGet(&SLD_File_Array, n);
+			line = ArrayGet(&SLD_Line_Array, n);
+			file= ArrayGet(&SLD_File_Array, n);
 
-		if (line)
-		{
-			fprintf(SldFile, "%x:%d:%d\n", n, line, file);
+			if (line)
+			{
+				fprintf(SldFile, "%x:%d:%d\n", n, line, file);
+				SldBinLine(n, line, file);
+			}
 		}
 	}
 
@@ -1531,6 +1562,8 @@ void DumpIPTrans()
 	fprintf(SldFile, "END\n");
 
 	fclose(SldFile);
+
+	SldBinWrite(SldName, SldBinName);
 	return;
 }
 
@@ -1548,7 +1581,7 @@ void DumpFunctions(FILE *out)
 	fprintf(out, "FUNCTIONS\n");
 
 	Sym = SymTab;
-	n = SYMMAX;
+	n = SymbolSlots();
 
 	do
 	{
@@ -1560,6 +1593,7 @@ void DumpFunctions(FILE *out)
 			fprintf(out, "%s ",Sym->Name);
 			fprintf(out, "%s,",Hex32(Sym->Value));
 			fprintf(out, "%s",Hex32(Sym->EndIP));
+			SldBinFunction(Sym->Name, Sym->Value, Sym->EndIP);
 #if 0	// for debugging
 			fprintf(out, "(t%i, lt%i, s%i, vi%i, ls%i, le%i)",
 				Sym->Type, Sym->LabelType, Sym->Section, Sym->VirtualIndex,
@@ -1644,7 +1678,7 @@ void DumpMetaData ( FILE *out )
 	fprintf(out, "Meta\n");
 
 	Sym = SymTab;
-	n = SYMMAX;
+	n = SymbolSlots();
 
 	do
 	{
@@ -1709,7 +1743,7 @@ void DumpVariables(FILE *out)
 	fprintf(out, "VARIABLES\n");
 
 	Sym = SymTab;
-	n = SYMMAX;
+	n = SymbolSlots();
 
 	do
 	{
@@ -1728,6 +1762,7 @@ void DumpVariables(FILE *out)
 			fprintf(out, "%s %i ",Sym->Name, Sym->LocalScope);
 			fprintf(out, "%s",Hex32(value));
 			fprintf(out, "\n");
+			SldBinVariable(Sym->Name, Sym->LocalScope, value);
 		}
 
 		Sym++;
@@ -1746,7 +1781,7 @@ void DumpAllSyms(FILE *out)
 	fprintf(out, "ALL_SYMS\n");
 
 	Sym = SymTab;
-	n = SYMMAX;
+	n = SymbolSlots();
 
 	do
 	{
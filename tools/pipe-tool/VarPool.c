@@ -25,6 +25,16 @@ Software Foundation, 59 Temple Place - Suite 330, Boston, MA
 
 #define VARMAX 32768			//16384
 
+#define POOL_HASHING
+
+#ifdef POOL_HASHING
+#define VARHASH_BITS 16			// Twice VARMAX, so chains stay short
+#define VARHASH_SIZE (1 << VARHASH_BITS)
+#define VARHASH(v) (((uint) (v) * 2654435761u) >> (32 - VARHASH_BITS))
+
+int *VarHash;					// VarPool index + 1 for each slot, 0 if empty
+#endif
+
 //****************************************
 //		Initialise the constant pool
 //****************************************
@@ -44,6 +54,17 @@ int InitVarPool()
 		return 0;
 	}
 
+#ifdef POOL_HASHING
+	VarHash = (int *) NewPtrClear( (int) (sizeof(int) * VARHASH_SIZE));
+
+	if (!VarHash)
+	{
+		DisposePtr((char *) VarPool);
+		DisposePtr((char *) VarFreq);
+		return 0;
+	}
+#endif
+
 	ThisVar = VarPool;
 	VarCount = 0;
 
@@ -63,6 +84,13 @@ void CloseVarPool()
 	if (VarFreq)
 		DisposePtr((char *) VarFreq);
 
+#ifdef POOL_HASHING
+	if (VarHash)
+		DisposePtr((char *) VarHash);
+
+	VarHash = 0;
+#endif
+
 	VarCount = 0;
 	ThisVar = 0;
 }
@@ -76,9 +104,75 @@ void ClearVarPool()
 	ThisVar = VarPool;
 	VarCount = 0;
 
+#ifdef POOL_HASHING
+	memset(VarHash, 0, sizeof(int) * VARHASH_SIZE);
+#endif
+
 	StoreVarPool(0);			// Store defualt 0
 }
 
+#ifdef POOL_HASHING
+
+//****************************************
+//	  Add an entry to the pool index
+//****************************************
+
+void HashVarPoolEntry(int idx)
+{
+	int v = VarPool[idx];
+	uint h = VARHASH(v);
+
+	while (VarHash[h])
+	{
+		// Keep the first index, as the linear search did
+
+		if (VarPool[VarHash[h] - 1] == v)
+			return;
+
+		h = (h + 1) & (VARHASH_SIZE - 1);
+	}
+
+	VarHash[h] = idx + 1;
+}
+
+//****************************************
+//	 Rebuild the index after a sort
+//****************************************
+
+void IndexVarPool()
+{
+	int n;
+
+	memset(VarHash, 0, sizeof(int) * VARHASH_SIZE);
+
+	for (n=0;n<VarCount;n++)
+		HashVarPoolEntry(n);
+}
+
+//****************************************
+//		  Search var pool entry
+//****************************************
+
+int SearchVarPool(int v)
+{
+	uint h = VARHASH(v);
+	int idx;
+
+	while ((idx = VarHash[h]) != 0)
+	{
+		Stat_VarProbes++;
+
+		if (VarPool[idx - 1] == v)
+			return idx - 1;
+
+		h = (h + 1) & (VARHASH_SIZE - 1);
+	}
+
+	return -1;
+}
+
+#else
+
 //****************************************
 //		  Search var pool entry (Slow)
 //****************************************
@@ -94,6 +188,8 @@ int SearchVarPool(int v)
 
 	for (n=0;n<VarCount;n++)
 	{
+		Stat_VarProbes++;
+
 		if (v == *vptr++)
 			return n;
 
@@ -102,6 +198,8 @@ int SearchVarPool(int v)
 	return -1;
 }
 
+#endif
+
 //****************************************
 //		  Search var pool entry
 //****************************************
@@ -117,6 +215,10 @@ int StoreVarPool(int v)
 
 	idx = VarCount;
 	VarCount++;
+
+#ifdef POOL_HASHING
+	HashVarPoolEntry(idx);
+#endif
 	return idx;
 }
 
@@ -128,6 +230,8 @@ int FindVar(int v)
 {
 	int idx;
 
+	Stat_VarFinds++;
+
 	idx = SearchVarPool(v);
 
 	if (idx == -1)
@@ -155,7 +259,24 @@ int FindVar(int v)
 
 void SortVarPool()
 {
-  varpool_q_sort(0, VarCount - 1);
+	int n;
+
+	// From pass 2 on, the pool is sorted apart from new entries, which have
+	// no frequency and so already sort last. The quick sort leaves a sorted
+	// pool as it is, but takes quadratic time to do it.
+
+	for (n=1;n<VarCount;n++)
+	{
+		if (VarFreq[n] > VarFreq[n-1])
+			break;
+	}
+
+	if (n < VarCount)
+		varpool_q_sort(0, VarCount - 1);
+
+#ifdef POOL_HASHING
+	IndexVarPool();
+#endif
 }
 
 void varpool_q_sort(int left, int right)
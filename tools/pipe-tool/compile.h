@@ -341,6 +341,17 @@ typedef struct
 	uint	lo,hi,ps;
 } ArrayStore;
 
+//****************************************
+//			Link Cache Key
+//****************************************
+
+typedef struct
+{
+	uint	a;					// FNV-1a
+	uint	b;					// sdbm
+	uint	len;
+} LinkKey;
+
 
 //****************************************
 //			Opcode Info
@@ -570,6 +581,8 @@ typedef struct
 	int assign_reg;
 	int uninit_reg;
 	int reg_used;
+	int mem_access;		// Loads and stores
+	int calls;			// Calls and syscalls
 } FuncProp;
 
 //***************************************
@@ -698,6 +711,8 @@ enum
 #define MAX_CODE_MEM		(16 * 2048 * 1024)
 #define MAX_DATA_MEM		(16 * 2048 * 1024)
 
+#define MAX_CPP_SHARDS		256
+
 /**
  * Marks the place to return from a longjmp. Updates
  * the global variable ErrRetSet to mark that a setjmp
@@ -738,6 +753,7 @@ decset(int ArgRes, 0)
 decset(int ArgJavaNative, 0)
 decset(int ArgBrewGen, 0)
 decset(int ArgCppGen, 0)
+decset(int ArgCppShards, 0)
 decset(int ArgCsGen, 0)
 
 decset(int ArgFilePaths, 0)
@@ -750,10 +766,14 @@ decset(int ArgUseStabs, 0)
 decset(int ArgWriteMeta, 0)
 
 decset(int ArgQuiet, 0)
+decset(int ArgStats, 0)
+decset(int ArgLinkCache, 0)
 
 dec(char SldName[256])
+dec(char SldBinName[256])
 dec(char StabsName[256])
 dec(char MetaFileName[256])
+dec(char LinkCacheDir[256])
 
 decset(int ArgUseMasterDump, 0)
 
@@ -848,6 +868,13 @@ dec(int Function_Return_Type)
 
 dec(SYMBOL *CaseRef)
 
+// Lookup counts, reported by -stats
+
+decset(int Stat_VarFinds, 0)
+decset(int Stat_VarProbes, 0)
+decset(int Stat_SymFinds, 0)
+decset(int Stat_SymProbes, 0)
+
 // VarTables
 
 dec(int	VarCount)
@@ -927,6 +954,7 @@ dec(int register_initialized)			// if a register has been initialized
 dec(ArrayStore AsmCharArray)
 dec(ArrayStore AsmCharDataArray)
 dec(ArrayStore AsmCharIPArray)
+dec(ArrayStore AsmTokenArray)
 
 
 dec(ArrayStore CallArray)
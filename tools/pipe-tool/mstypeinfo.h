@@ -32,8 +32,14 @@ Software Foundation, 59 Temple Place - Suite 330, Boston, MA
 
 void MoSyncDiv0();
 
+//rebuild.build.cpp has these for the -cpp-shards files.
+#ifdef REBUILD_SHARD
+extern int sp;
+extern int __dbl_high;
+#else
 int sp;
 int __dbl_high;
+#endif
 
 extern unsigned char* mem_ds;
 #include "syscall_static_cpp.h"